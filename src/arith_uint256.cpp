@@ -84,6 +84,17 @@ base_uint<BITS> &base_uint<BITS>::operator/=(const base_uint &b) {
     int num_bits = num.bits();
     int div_bits = div.bits();
     if (div_bits == 0) throw uint_error("Division by zero");
+    if (div_bits <= 32) {
+        // short division by a single word, such as when averaging targets.
+        const uint64_t d = div.pn[0];
+        uint64_t rem = 0;
+        for (int i = WIDTH - 1; i >= 0; i--) {
+            const uint64_t cur = (rem << 32) | num.pn[i];
+            pn[i] = cur / d;
+            rem = cur % d;
+        }
+        return *this;
+    }
     // the result is certainly 0.
     if (div_bits > num_bits) return *this;
     int shift = num_bits - div_bits;
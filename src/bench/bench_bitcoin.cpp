@@ -4,11 +4,15 @@
 
 #include "bench.h"
 
+#include "crypto/blake2b.h"
+#include "crypto/sha256.h"
 #include "key.h"
 #include "util.h"
 #include "validation.h"
 
 int main(int argc, char **argv) {
+    SHA256AutoDetect();
+    Blake2bAutoDetect();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
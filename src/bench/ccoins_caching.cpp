@@ -5,6 +5,7 @@
 #include "bench.h"
 #include "coins.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "wallet/crypter.h"
 
 #include <vector>
@@ -89,4 +90,45 @@ static void CCoinsCaching(benchmark::State &state) {
     }
 }
 
+/**
+ * Fill a CCoinsMap with fresh outpoints, look them all up and spend half of
+ * them, as a cache does between two flushes. Without a resource, nodes are
+ * allocated one by one.
+ */
+static void CoinsMapChurn(benchmark::State &state, bool fPool) {
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 10000; i++) {
+        outpoints.emplace_back(GetRandHash(), i % 4);
+    }
+    const Coin coin(CTxOut(50 * CENT, CScript() << OP_1), 1, false);
+
+    while (state.KeepRunning()) {
+        std::unique_ptr<CCoinsMapMemoryResource> resource;
+        if (fPool) {
+            resource.reset(new CCoinsMapMemoryResource());
+        }
+        CCoinsMap map(0, SaltedOutpointHasher(), std::equal_to<COutPoint>(),
+                      CCoinsMapAllocator(resource.get()));
+        for (const COutPoint &outpoint : outpoints) {
+            map.emplace(outpoint, CCoinsCacheEntry(coin));
+        }
+        for (const COutPoint &outpoint : outpoints) {
+            assert(map.find(outpoint) != map.end());
+        }
+        for (size_t i = 0; i < outpoints.size(); i += 2) {
+            map.erase(outpoints[i]);
+        }
+    }
+}
+
+static void CCoinsMapPool(benchmark::State &state) {
+    CoinsMapChurn(state, true);
+}
+
+static void CCoinsMapMalloc(benchmark::State &state) {
+    CoinsMapChurn(state, false);
+}
+
 BENCHMARK(CCoinsCaching);
+BENCHMARK(CCoinsMapPool);
+BENCHMARK(CCoinsMapMalloc);
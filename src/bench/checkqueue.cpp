@@ -90,5 +90,55 @@ static void CCheckQueueSpeedPrevectorJob(benchmark::State &state) {
     tg.interrupt_all();
     tg.join_all();
 }
+
+// This Benchmark runs the CheckQueue with a fixed number of worker threads and
+// checks doing a little work each, so that the results for 1 to 64 threads
+// chart how the throughput scales.
+static void CCheckQueueSpeedThreads(benchmark::State &state, int nThreads) {
+    struct FakeJobLightWork {
+        uint64_t n;
+        FakeJobLightWork() : n(0) {}
+        bool operator()() {
+            for (int i = 0; i < 100; i++) {
+                n = n * 6364136223846793005ULL + 1442695040888963407ULL;
+            }
+            return n != 1;
+        }
+        void swap(FakeJobLightWork &x) { std::swap(n, x.n); };
+    };
+    CCheckQueue<FakeJobLightWork> queue{QUEUE_BATCH_SIZE};
+    boost::thread_group tg;
+    // The master thread is the last of them.
+    for (auto x = 0; x < nThreads - 1; ++x) {
+        tg.create_thread([&] { queue.Thread(); });
+    }
+    while (state.KeepRunning()) {
+        CCheckQueueControl<FakeJobLightWork> control(&queue);
+        std::vector<std::vector<FakeJobLightWork>> vBatches(BATCHES);
+        for (auto &vChecks : vBatches) {
+            vChecks.resize(BATCH_SIZE);
+        }
+        for (auto &vChecks : vBatches) {
+            control.Add(vChecks);
+        }
+        control.Wait();
+    }
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+#define BENCHMARK_CHECKQUEUE_THREADS(n)                                        \
+    static void CCheckQueueSpeed##n##Threads(benchmark::State &state) {       \
+        CCheckQueueSpeedThreads(state, n);                                     \
+    }                                                                          \
+    BENCHMARK(CCheckQueueSpeed##n##Threads)
+
 BENCHMARK(CCheckQueueSpeed);
 BENCHMARK(CCheckQueueSpeedPrevectorJob);
+BENCHMARK_CHECKQUEUE_THREADS(1);
+BENCHMARK_CHECKQUEUE_THREADS(2);
+BENCHMARK_CHECKQUEUE_THREADS(4);
+BENCHMARK_CHECKQUEUE_THREADS(8);
+BENCHMARK_CHECKQUEUE_THREADS(16);
+BENCHMARK_CHECKQUEUE_THREADS(32);
+BENCHMARK_CHECKQUEUE_THREADS(64);
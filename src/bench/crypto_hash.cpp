@@ -32,22 +32,58 @@ static void SHA1(benchmark::State &state) {
         CSHA1().Write(in.data(), in.size()).Finalize(hash);
 }
 
-static void SHA256(benchmark::State &state) {
+static void SHA256(benchmark::State &state,
+                   sha256_implementation::UseImplementation impl) {
+    SHA256AutoDetect(impl);
     uint8_t hash[CSHA256::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE, 0);
     while (state.KeepRunning())
         CSHA256().Write(in.data(), in.size()).Finalize(hash);
+    SHA256AutoDetect();
 }
 
-static void SHA256_32b(benchmark::State &state) {
+static void SHA256_32b(benchmark::State &state,
+                       sha256_implementation::UseImplementation impl) {
+    SHA256AutoDetect(impl);
     std::vector<uint8_t> in(32, 0);
     while (state.KeepRunning()) {
         for (int i = 0; i < 1000000; i++) {
             CSHA256().Write(in.data(), in.size()).Finalize(&in[0]);
         }
     }
+    SHA256AutoDetect();
 }
 
+static void SHA256D64_1024(benchmark::State &state,
+                           sha256_implementation::UseImplementation impl) {
+    SHA256AutoDetect(impl);
+    std::vector<uint8_t> in(64 * 1024, 0);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), 1024);
+    }
+    SHA256AutoDetect();
+}
+
+// Each SHA256 benchmark is run with every implementation. The ones the CPU
+// does not support fall back to the standard implementation.
+#define BENCHMARK_SHA256(name)                                                 \
+    static void name##_STANDARD(benchmark::State &state) {                     \
+        name(state, sha256_implementation::STANDARD);                          \
+    }                                                                          \
+    static void name##_SSE4(benchmark::State &state) {                         \
+        name(state, sha256_implementation::USE_SSE4);                          \
+    }                                                                          \
+    static void name##_AVX2(benchmark::State &state) {                         \
+        name(state, sha256_implementation::USE_AVX2);                          \
+    }                                                                          \
+    static void name##_SHANI(benchmark::State &state) {                        \
+        name(state, sha256_implementation::USE_SHANI);                         \
+    }                                                                          \
+    BENCHMARK(name##_STANDARD);                                                \
+    BENCHMARK(name##_SSE4);                                                    \
+    BENCHMARK(name##_AVX2);                                                    \
+    BENCHMARK(name##_SHANI);
+
 static void SHA512(benchmark::State &state) {
     uint8_t hash[CSHA512::OUTPUT_SIZE];
     std::vector<uint8_t> in(BUFFER_SIZE, 0);
@@ -86,10 +122,11 @@ static void FastRandom_1bit(benchmark::State &state) {
 
 BENCHMARK(RIPEMD160);
 BENCHMARK(SHA1);
-BENCHMARK(SHA256);
+BENCHMARK_SHA256(SHA256);
 BENCHMARK(SHA512);
 
-BENCHMARK(SHA256_32b);
+BENCHMARK_SHA256(SHA256_32b);
+BENCHMARK_SHA256(SHA256D64_1024);
 BENCHMARK(SipHash_32b);
 BENCHMARK(FastRandom_32bit);
 BENCHMARK(FastRandom_1bit);
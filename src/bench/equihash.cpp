@@ -0,0 +1,106 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "crypto/equihash.h"
+#include "random.h"
+#include "uint256.h"
+
+#include <cassert>
+#include <string>
+#include <vector>
+
+// Solution for Equihash<96,5> taken from the equihash unit tests.
+static const std::string INPUT_96_5 =
+    "Equihash is an asymmetric PoW based on the Generalised Birthday problem.";
+static const std::vector<eh_index> SOLUTION_96_5 = {
+    2261,   15185,  36112, 104243, 23779,  118390, 118332, 130041,
+    32642,  69878,  76925, 80080,  45858,  116805, 92842,  111026,
+    15972,  115059, 85191, 90330,  68190,  122819, 81830,  91132,
+    23460,  49807,  52426, 80391,  69567,  114474, 104973, 122568};
+
+/**
+ * Build a solution of 2^k distinct indices in increasing order. It is not
+ * valid, but both validators hash every index before they reject it, which
+ * dominates the cost of checking a real solution.
+ */
+static std::vector<unsigned char> RandomSolution(unsigned int n,
+                                                 unsigned int k) {
+    size_t cBitLen = n / (k + 1);
+    FastRandomContext rng(true);
+    std::vector<eh_index> indices;
+    eh_index index = 0;
+    for (size_t i = 0; i < (size_t(1) << k); i++) {
+        index += 1 + rng.randrange(1 << (cBitLen - k));
+        indices.push_back(index);
+    }
+    return GetMinimalFromIndices(indices, cBitLen);
+}
+
+static void EquihashSodium(benchmark::State &state, unsigned int n,
+                           unsigned int k, const std::string &input,
+                           const std::vector<unsigned char> &soln,
+                           bool expected) {
+    uint256 V = ArithToUint256(1);
+    while (state.KeepRunning()) {
+        crypto_generichash_blake2b_state hashState;
+        EhInitialiseState(n, k, hashState, false);
+        crypto_generichash_blake2b_update(
+            &hashState, (const unsigned char *)input.data(), input.size());
+        crypto_generichash_blake2b_update(&hashState, V.begin(), V.size());
+        bool isValid;
+        EhIsValidSolution(n, k, hashState, soln, isValid);
+        assert(isValid == expected);
+    }
+}
+
+static void EquihashBlake2b(benchmark::State &state, unsigned int n,
+                            unsigned int k, const std::string &input,
+                            const std::vector<unsigned char> &soln,
+                            bool expected) {
+    uint256 V = ArithToUint256(1);
+    while (state.KeepRunning()) {
+        CBlake2b hasher;
+        EhInitialiseState(n, k, hasher, false);
+        hasher.Write((const unsigned char *)input.data(), input.size());
+        hasher.Write(V.begin(), V.size());
+        bool isValid;
+        EhIsValidSolution(n, k, hasher, soln, isValid);
+        assert(isValid == expected);
+    }
+}
+
+static void EquihashValidate_96_5_Sodium(benchmark::State &state) {
+    EquihashSodium(state, 96, 5, INPUT_96_5,
+                   GetMinimalFromIndices(SOLUTION_96_5, 16), true);
+}
+
+static void EquihashValidate_96_5_Blake2b(benchmark::State &state) {
+    EquihashBlake2b(state, 96, 5, INPUT_96_5,
+                    GetMinimalFromIndices(SOLUTION_96_5, 16), true);
+}
+
+static void EquihashValidate_144_5_Sodium(benchmark::State &state) {
+    EquihashSodium(state, 144, 5, INPUT_96_5, RandomSolution(144, 5), false);
+}
+
+static void EquihashValidate_144_5_Blake2b(benchmark::State &state) {
+    EquihashBlake2b(state, 144, 5, INPUT_96_5, RandomSolution(144, 5), false);
+}
+
+static void EquihashValidate_200_9_Sodium(benchmark::State &state) {
+    EquihashSodium(state, 200, 9, INPUT_96_5, RandomSolution(200, 9), false);
+}
+
+static void EquihashValidate_200_9_Blake2b(benchmark::State &state) {
+    EquihashBlake2b(state, 200, 9, INPUT_96_5, RandomSolution(200, 9), false);
+}
+
+BENCHMARK(EquihashValidate_96_5_Sodium);
+BENCHMARK(EquihashValidate_96_5_Blake2b);
+BENCHMARK(EquihashValidate_144_5_Sodium);
+BENCHMARK(EquihashValidate_144_5_Blake2b);
+BENCHMARK(EquihashValidate_200_9_Sodium);
+BENCHMARK(EquihashValidate_200_9_Blake2b);
@@ -0,0 +1,149 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "config.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "random.h"
+#include "script/scriptcache.h"
+#include "script/sigcache.h"
+#include "script/standard.h"
+#include "txmempool.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <boost/thread.hpp>
+
+#include <vector>
+
+// Number of transactions fed to the mempool in each iteration: the admission
+// rate in tx/s is this divided by the time per iteration.
+static const int MEMPOOL_ACCEPT_TXS = 500;
+
+// Height of the fake tip, past the regtest forks so that the current block's
+// script flags match the standard ones.
+static const int MEMPOOL_ACCEPT_TIP_HEIGHT = 3000;
+
+// Microbenchmark for a stream of synthetic P2PKH transactions entering the
+// mempool, either one by one under cs_main, or as a batch whose scripts are
+// checked in parallel on nThreads script check threads. The signature and
+// script caches are cleared in each iteration, so that every signature is
+// verified.
+static void MempoolAccept(benchmark::State &state, bool fBatch,
+                          int nThreads) {
+    SelectParams(CBaseChainParams::REGTEST);
+    const Config &config = GetConfig();
+    ForceSetArg("-maxsigcachesize", "1");
+    ForceSetArg("-maxscriptcachesize", "1");
+
+    CKey key;
+    key.MakeNewKey(true);
+    const CScript scriptPubKey =
+        GetScriptForDestination(key.GetPubKey().GetID());
+
+    uint256 hashTip = GetRandHash();
+    CBlockIndex tip;
+    tip.phashBlock = &hashTip;
+    tip.nHeight = MEMPOOL_ACCEPT_TIP_HEIGHT;
+    tip.nTime = GetTime();
+
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    coins.SetBestBlock(hashTip);
+
+    std::vector<CTransactionRef> txs;
+    for (int i = 0; i < MEMPOOL_ACCEPT_TXS; i++) {
+        const COutPoint outpoint(GetRandHash(), 0);
+        coins.AddCoin(outpoint, Coin(CTxOut(COIN, scriptPubKey), 1, false),
+                      false);
+
+        CMutableTransaction mtx;
+        mtx.nVersion = 1;
+        mtx.vin.resize(1);
+        mtx.vin[0].prevout = outpoint;
+        mtx.vout.resize(1);
+        mtx.vout[0].nValue = COIN - Amount(10000);
+        mtx.vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<uint8_t> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, mtx, 0,
+                                     SIGHASH_ALL | SIGHASH_FORKID, COIN);
+        bool fSigned = key.Sign(hash, vchSig);
+        assert(fSigned);
+        vchSig.push_back(uint8_t(SIGHASH_ALL | SIGHASH_FORKID));
+        mtx.vin[0].scriptSig << vchSig << ToByteVector(key.GetPubKey());
+        txs.push_back(MakeTransactionRef(std::move(mtx)));
+    }
+
+    CCoinsViewCache *pcoinsTipOld;
+    CBlockIndex *pindexTipOld;
+    const int nScriptCheckThreadsOld = nScriptCheckThreads;
+    {
+        LOCK(cs_main);
+        pcoinsTipOld = pcoinsTip;
+        pcoinsTip = &coins;
+        pindexTipOld = chainActive.Tip();
+        mapBlockIndex[hashTip] = &tip;
+        chainActive.SetTip(&tip);
+        nScriptCheckThreads = nThreads ? nThreads + 1 : 0;
+    }
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads; i++) {
+        tg.create_thread(&ThreadMempoolScriptCheck);
+    }
+
+    while (state.KeepRunning()) {
+        InitSignatureCache();
+        InitScriptExecutionCache();
+        if (fBatch) {
+            std::vector<MempoolAcceptRequest> vRequests;
+            for (const CTransactionRef &tx : txs) {
+                vRequests.emplace_back(tx, false);
+            }
+            AcceptToMemoryPoolBatch(config, mempool, vRequests);
+            for (const MempoolAcceptRequest &request : vRequests) {
+                assert(request.fAccepted);
+            }
+        } else {
+            LOCK(cs_main);
+            for (const CTransactionRef &tx : txs) {
+                CValidationState stateTx;
+                bool fAccepted = AcceptToMemoryPool(config, mempool, stateTx,
+                                                    tx, false, nullptr);
+                assert(fAccepted);
+            }
+        }
+        mempool.clear();
+    }
+
+    tg.interrupt_all();
+    tg.join_all();
+    {
+        LOCK(cs_main);
+        nScriptCheckThreads = nScriptCheckThreadsOld;
+        chainActive.SetTip(pindexTipOld);
+        mapBlockIndex.erase(hashTip);
+        pcoinsTip = pcoinsTipOld;
+    }
+}
+
+static void MempoolAcceptSerial(benchmark::State &state) {
+    MempoolAccept(state, false, 0);
+}
+static void MempoolAcceptBatch(benchmark::State &state) {
+    MempoolAccept(state, true, 0);
+}
+static void MempoolAcceptBatchThreads(benchmark::State &state) {
+    MempoolAccept(state, true, 3);
+}
+
+BENCHMARK(MempoolAcceptSerial);
+BENCHMARK(MempoolAcceptBatch);
+BENCHMARK(MempoolAcceptBatchThreads);
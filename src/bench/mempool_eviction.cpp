@@ -4,8 +4,10 @@
 
 #include "bench.h"
 #include "policy/policy.h"
+#include "random.h"
 #include "txmempool.h"
 
+#include <iostream>
 #include <list>
 #include <vector>
 
@@ -112,4 +114,48 @@ static void MempoolEviction(benchmark::State &state) {
     }
 }
 
+// Number of transactions, in chains of MEMPOOL_USAGE_CHAIN_LENGTH, used to
+// measure the memory the mempool takes per transaction.
+static const int MEMPOOL_USAGE_TXS = 10000;
+static const int MEMPOOL_USAGE_CHAIN_LENGTH = 5;
+
+// Times filling and clearing a mempool, and reports the bytes it accounts for
+// per transaction (including the transaction itself), which determines how
+// many transactions fit in -maxmempool.
+static void MempoolBytesPerTx(benchmark::State &state) {
+    std::vector<CTransaction> txs;
+    txs.reserve(MEMPOOL_USAGE_TXS);
+    for (int i = 0; i < MEMPOOL_USAGE_TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        if (i % MEMPOOL_USAGE_CHAIN_LENGTH) {
+            tx.vin[0].prevout = COutPoint(txs.back().GetId(), 0);
+        } else {
+            tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        }
+        tx.vin[0].scriptSig = CScript() << OP_1;
+        tx.vout.resize(2);
+        tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+        tx.vout[0].nValue = 10 * COIN;
+        tx.vout[1].scriptPubKey = CScript() << OP_2 << OP_EQUAL;
+        tx.vout[1].nValue = 10 * COIN;
+        txs.emplace_back(tx);
+    }
+
+    CTxMemPool pool(CFeeRate(Amount(1000)));
+    bool fReported = false;
+    while (state.KeepRunning()) {
+        for (const CTransaction &tx : txs) {
+            AddTx(tx, Amount(1000LL), pool);
+        }
+        if (!fReported) {
+            std::cout << "MempoolBytesPerTx-usage," << pool.size() << ","
+                      << pool.DynamicMemoryUsage() / pool.size() << "\n";
+            fReported = true;
+        }
+        pool.clear();
+    }
+}
+
 BENCHMARK(MempoolEviction);
+BENCHMARK(MempoolBytesPerTx);
@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chainparams.h"
+#include "config.h"
+#include "hash.h"
+#include "net.h"
+#include "protocol.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// Payload size of the received message: the receive rate in bytes/s is this
+// divided by the time per iteration.
+static const size_t NET_RECEIVE_MESSAGE_SIZE = 2 * 1024 * 1024;
+
+// Microbenchmark for a block message going through CNode::ReceiveMsgBytes in
+// socket sized chunks, as in CConnman::SocketHandler, where the data is
+// either read into a buffer on the stack or in place into the message.
+static void NetReceive(benchmark::State &state, bool fInPlace) {
+    SelectParams(CBaseChainParams::MAIN);
+    const Config &config = GetConfig();
+
+    std::vector<uint8_t> payload(NET_RECEIVE_MESSAGE_SIZE);
+    GetRandBytes(payload.data(), payload.size());
+    CMessageHeader hdr(Params().NetMagic(), NetMsgType::BLOCK,
+                       payload.size());
+    uint256 hash = Hash(payload.begin(), payload.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    CDataStream ss(SER_NETWORK, INIT_PROTO_VERSION);
+    ss << hdr;
+    ss.insert(ss.end(), (const char *)payload.data(),
+              (const char *)payload.data() + payload.size());
+    const std::vector<char> vMsg(ss.begin(), ss.end());
+
+    CAddress addr(CService(), NODE_NONE);
+
+    while (state.KeepRunning()) {
+        // A new node each time, which drops the message received.
+        CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0);
+        size_t nPos = 0;
+        bool complete = false;
+        while (nPos < vMsg.size()) {
+            // typical socket buffer is 8K-64K
+            char pchBuf[0x10000];
+            unsigned int nBufSize = sizeof(pchBuf);
+            char *pchRecv =
+                fInPlace ? node.GetReceiveBuffer(pchBuf, nBufSize) : pchBuf;
+            // The copy recv() makes out of the socket.
+            size_t nBytes = std::min<size_t>(nBufSize, vMsg.size() - nPos);
+            memcpy(pchRecv, vMsg.data() + nPos, nBytes);
+            nPos += nBytes;
+            bool fOk = node.ReceiveMsgBytes(config, pchRecv, nBytes, complete);
+            assert(fOk);
+        }
+        assert(complete);
+    }
+}
+
+static void NetReceiveCopy(benchmark::State &state) {
+    NetReceive(state, false);
+}
+static void NetReceiveInPlace(benchmark::State &state) {
+    NetReceive(state, true);
+}
+
+BENCHMARK(NetReceiveCopy);
+BENCHMARK(NetReceiveInPlace);
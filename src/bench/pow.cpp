@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "arith_uint256.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "pow.h"
+#include "random.h"
+
+#include <vector>
+
+/**
+ * Build a chain going through every LWMA rule, using mainnet parameters with
+ * the rule changes moved close to genesis.
+ */
+static void BuildLwmaChain(std::vector<CBlockIndex> &blocks,
+                           Consensus::Params &params) {
+    SelectParams(CBaseChainParams::MAIN);
+    params = Params().GetConsensus();
+    params.nNewRuleHeight = 100;
+    params.CDYEquihashForkHeight = 200;
+
+    const arith_uint256 powLimit = UintToArith256(params.PowLimit(true));
+    FastRandomContext rng(true);
+    blocks[0].nTime = 1500000000;
+    blocks[0].nBits = arith_uint256(powLimit >> 8).GetCompact();
+    for (size_t i = 1; i < blocks.size(); i++) {
+        blocks[i].pprev = &blocks[i - 1];
+        blocks[i].nHeight = i;
+        blocks[i].nTime = blocks[i - 1].nTime +
+                          rng.randrange(3 * params.nPowTargetSpacingCDY);
+        blocks[i].BuildSkip();
+        blocks[i].nBits =
+            int64_t(i) <= params.nZawyLwmaAveragingWindow
+                ? blocks[0].nBits
+                : LwmaCalculateNextWorkRequired(&blocks[i - 1], params);
+    }
+}
+
+/**
+ * Work required after each block of the chain, as for a stream of new
+ * headers: the parent's sums are known, the block's own are not.
+ */
+static void LwmaNextWorkRolling(benchmark::State &state) {
+    std::vector<CBlockIndex> blocks(1000);
+    Consensus::Params params;
+    BuildLwmaChain(blocks, params);
+
+    while (state.KeepRunning()) {
+        // The cache only keeps the most recent heights, so that the sums of
+        // each block are rolled forward from its parent's.
+        for (size_t i = 300; i < blocks.size(); i++) {
+            LwmaCalculateNextWorkRequired(&blocks[i], params);
+        }
+    }
+}
+
+/** Same, walking the whole window for every block. */
+static void LwmaNextWorkFromScratch(benchmark::State &state) {
+    std::vector<CBlockIndex> blocks(1000);
+    Consensus::Params params;
+    BuildLwmaChain(blocks, params);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 300; i < blocks.size(); i++) {
+            ClearLwmaStateCache();
+            LwmaCalculateNextWorkRequired(&blocks[i], params);
+        }
+    }
+}
+
+BENCHMARK(LwmaNextWorkRolling);
+BENCHMARK(LwmaNextWorkFromScratch);
@@ -0,0 +1,145 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+
+#include "blockencodings.h"
+#include "chain.h"
+#include "net.h"
+#include "netmessagemaker.h"
+#include "primitives/block.h"
+#include "sync.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+#include <list>
+#include <map>
+#include <tuple>
+
+namespace {
+
+/**
+ * LRU of blocks and compact blocks in their wire form, so that a block many
+ * peers (or RPC and REST clients) ask for is read from disk and serialized
+ * only once. Blocks never change once stored, so entries are only ever
+ * evicted for room.
+ */
+class CSerializedBlockCache {
+private:
+    struct Key {
+        uint256 hash;
+        bool fCompact;
+        int nFlags;
+
+        bool operator<(const Key &other) const {
+            return std::tie(hash, fCompact, nFlags) <
+                   std::tie(other.hash, other.fCompact, other.nFlags);
+        }
+    };
+
+    typedef std::pair<Key, std::shared_ptr<const CSharedNetMsg>> entry_type;
+
+    //! Most recently used first.
+    std::list<entry_type> lru;
+    std::map<Key, std::list<entry_type>::iterator> index;
+    //! Total size of the cached payloads.
+    size_t nUsage;
+    size_t nMaxUsage;
+    CCriticalSection cs_blockcache;
+
+    void Trim() {
+        while (nUsage > nMaxUsage) {
+            nUsage -= lru.back().second->data->size();
+            index.erase(lru.back().first);
+            lru.pop_back();
+        }
+    }
+
+public:
+    // Usable before InitSerializedBlockCache is called, eg. in the tests.
+    CSerializedBlockCache()
+        : nUsage(0), nMaxUsage(DEFAULT_BLOCK_CACHE_SIZE * (size_t(1) << 20)) {}
+
+    std::shared_ptr<const CSharedNetMsg> Get(const Key &key) {
+        LOCK(cs_blockcache);
+        auto it = index.find(key);
+        if (it == index.end()) {
+            return nullptr;
+        }
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->second;
+    }
+
+    void Insert(const Key &key, std::shared_ptr<const CSharedNetMsg> msg) {
+        LOCK(cs_blockcache);
+        if (msg->data->size() > nMaxUsage || index.count(key)) {
+            return;
+        }
+        nUsage += msg->data->size();
+        lru.emplace_front(key, std::move(msg));
+        index.emplace(key, lru.begin());
+        Trim();
+    }
+
+    void SetMaxSize(size_t nMaxUsageIn) {
+        LOCK(cs_blockcache);
+        nMaxUsage = nMaxUsageIn;
+        Trim();
+    }
+
+    std::shared_ptr<const CSharedNetMsg>
+    GetOrSerialize(const Config &config, const CBlockIndex *pindex,
+                   bool fCompact, int nFlags) {
+        const Key key{pindex->GetBlockHash(), fCompact, nFlags};
+        std::shared_ptr<const CSharedNetMsg> msg = Get(key);
+        if (msg) {
+            return msg;
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, config)) {
+            return nullptr;
+        }
+        // Serializing blocks only depends on the flags, not on the version
+        // the peer speaks, so one entry serves every peer.
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        if (fCompact) {
+            msg = std::make_shared<const CSharedNetMsg>(
+                msgMaker.Make(nFlags, NetMsgType::CMPCTBLOCK,
+                              CBlockHeaderAndShortTxIDs(block)));
+        } else {
+            msg = std::make_shared<const CSharedNetMsg>(
+                msgMaker.Make(nFlags, NetMsgType::BLOCK, block));
+        }
+        Insert(key, msg);
+        return msg;
+    }
+};
+
+static CSerializedBlockCache serializedBlockCache;
+}
+
+void InitSerializedBlockCache() {
+    size_t nMaxCacheSize =
+        std::min(std::max(int64_t(0),
+                          GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)),
+                 MAX_BLOCK_CACHE_SIZE) *
+        (size_t(1) << 20);
+    serializedBlockCache.SetMaxSize(nMaxCacheSize);
+    LogPrintf("Using %zu MiB for serialized block cache\n",
+              nMaxCacheSize >> 20);
+}
+
+std::shared_ptr<const CSharedNetMsg>
+GetSerializedBlock(const Config &config, const CBlockIndex *pindex,
+                   int nFlags) {
+    return serializedBlockCache.GetOrSerialize(config, pindex, false, nFlags);
+}
+
+std::shared_ptr<const CSharedNetMsg>
+GetSerializedCompactBlock(const Config &config, const CBlockIndex *pindex,
+                          int nFlags) {
+    return serializedBlockCache.GetOrSerialize(config, pindex, true, nFlags);
+}
@@ -0,0 +1,39 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKCACHE_H
+#define BITCOIN_BLOCKCACHE_H
+
+#include <cstdint>
+#include <memory>
+
+class CBlockIndex;
+class Config;
+struct CSharedNetMsg;
+
+// After a new block, every peer asks for the same one or two blocks, so a
+// few full size blocks are enough to serve the burst from memory.
+static const unsigned int DEFAULT_BLOCK_CACHE_SIZE = 64;
+// Maximum serialized block cache size allowed
+static const int64_t MAX_BLOCK_CACHE_SIZE = 16384;
+
+/** Initializes the cache of serialized blocks */
+void InitSerializedBlockCache();
+
+/**
+ * Return the BLOCK message for a block we have the data of, serialized with
+ * the given flags (eg. SERIALIZE_BLOCK_LEGACY). It is served from the cache
+ * if possible, otherwise read from disk and cached. Returns nullptr if the
+ * block can't be read.
+ */
+std::shared_ptr<const CSharedNetMsg>
+GetSerializedBlock(const Config &config, const CBlockIndex *pindex,
+                   int nFlags);
+
+/** Same as GetSerializedBlock, for the CMPCTBLOCK message of the block. */
+std::shared_ptr<const CSharedNetMsg>
+GetSerializedCompactBlock(const Config &config, const CBlockIndex *pindex,
+                          int nFlags);
+
+#endif // BITCOIN_BLOCKCACHE_H
@@ -5,6 +5,9 @@
 
 #include "chain.h"
 
+#include "txdb.h"
+#include "validation.h"
+
 /**
  * CChain implementation
  */
@@ -194,3 +197,25 @@ bool AreOnTheSameFork(const CBlockIndex *pa, const CBlockIndex *pb) {
     const CBlockIndex *pindexCommon = LastCommonAncestor(pa, pb);
     return pindexCommon == pa || pindexCommon == pb;
 }
+
+bool CBlockIndex::GetSolution(std::vector<unsigned char> &solution) const {
+    if (!fSolutionEvicted) {
+        solution = nSolution;
+        return true;
+    }
+
+    if (!pblocktree || !pblocktree->ReadSolution(GetBlockHash(), solution)) {
+        return error("%s: failed to read the solution of block %s", __func__,
+                     GetBlockHash().ToString());
+    }
+    return true;
+}
+
+void CBlockIndex::EvictSolution() {
+    // Headers from before the fork have no solution, and nothing to save.
+    if (nSolution.empty()) {
+        return;
+    }
+    std::vector<unsigned char>().swap(nSolution);
+    fSolutionEvicted = true;
+}
@@ -188,8 +188,14 @@ public:
     uint32_t nTime;
     uint32_t nBits;
     uint256 nNonce;
+    //! Equihash solution. It is dropped from memory once the entry is in the
+    //! block tree DB, use GetSolution() to read it.
     std::vector<unsigned char> nSolution;
 
+    //! (memory only) Whether nSolution was dropped and has to be read from
+    //! the block tree DB.
+    bool fSolutionEvicted;
+
     //! (memory only) Sequential id assigned to distinguish order in which
     //! blocks are received.
     int32_t nSequenceId;
@@ -219,6 +225,7 @@ public:
         nBits = 0;
         nNonce         = uint256();
         nSolution.clear();
+        fSolutionEvicted = false;
     }
 
     CBlockIndex() { SetNull(); }
@@ -255,20 +262,39 @@ public:
         return ret;
     }
 
-    CBlockHeader GetBlockHeader() const {
-        CBlockHeader block;
+    /**
+     * Get the Equihash solution, reading it from the block tree DB if it was
+     * evicted from memory. Returns false if it cannot be read.
+     */
+    bool GetSolution(std::vector<unsigned char> &solution) const;
+
+    /**
+     * Drop the Equihash solution from memory. Only call this once the entry
+     * has been written to the block tree DB.
+     */
+    void EvictSolution();
+
+    /**
+     * Get the block header. An Equihash solution evicted from memory is read
+     * back from the block tree DB, or left empty if fReadSolution is false so
+     * that the caller can read it with CBlockTreeDB::ReadSolution without
+     * holding cs_main. Returns false if the solution cannot be read.
+     */
+    bool GetBlockHeader(CBlockHeader &block,
+                        bool fReadSolution = true) const {
         block.nVersion = nVersion;
-        if (pprev) {
-            block.hashPrevBlock = pprev->GetBlockHash();
-        }
+        block.hashPrevBlock = pprev ? pprev->GetBlockHash() : uint256();
         block.hashMerkleRoot = hashMerkleRoot;
         block.nHeight        = nHeight;
         memcpy(block.nReserved, nReserved, sizeof(block.nReserved));
         block.nTime = nTime;
         block.nBits = nBits;
         block.nNonce = nNonce;
-        block.nSolution      = nSolution;
-        return block;
+        if (fSolutionEvicted && !fReadSolution) {
+            block.nSolution.clear();
+            return true;
+        }
+        return GetSolution(block.nSolution);
     }
 
     uint256 GetBlockHash() const { return *phashBlock; }
@@ -369,10 +395,23 @@ public:
 
     CDiskBlockIndex() { hashPrev = uint256(); }
 
+    //! The Equihash solution is not copied if it was evicted from memory, see
+    //! ReadSolution.
     explicit CDiskBlockIndex(const CBlockIndex *pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
     }
 
+    //! Read back the Equihash solution if it was evicted from memory.
+    bool ReadSolution() {
+        if (fSolutionEvicted) {
+            if (!GetSolution(nSolution)) {
+                return false;
+            }
+            fSolutionEvicted = false;
+        }
+        return true;
+    }
+
     ADD_SERIALIZE_METHODS;
 
     template <typename Stream, typename Operation>
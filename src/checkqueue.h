@@ -6,6 +6,11 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
@@ -23,144 +28,293 @@ template <typename T> class CCheckQueueControl;
  * queue, where they are processed by N-1 worker threads. When the master is
  * done adding work, it temporarily joins the worker pool as an N'th worker,
  * until all jobs are done.
+ *
+ * The master spreads the verifications over one deque per worker. A worker
+ * takes them from its own deque first, and steals from the others once it is
+ * empty. Taking and adding verifications is lock-free: the mutex is only used
+ * to put idle threads to sleep and wake them up.
  */
 template <typename T> class CCheckQueue {
 private:
-    //! Mutex to protect the inner state
-    boost::mutex mutex;
+    //! Number of deques, beyond which workers share them.
+    static const size_t MAX_DEQUES = 64;
+    //! Number of verifications a deque holds (a power of two).
+    static const uint64_t DEQUE_CAPACITY = 4096;
+    //! Number of verifications in each block of storage.
+    static const size_t STORAGE_BLOCK_SIZE = 1024;
+    //! Number of storage blocks kept from one batch to the next.
+    static const size_t STORAGE_BLOCKS_KEPT = 16;
+    //! Number of times an idle worker looks for work before sleeping.
+    static const int IDLE_SPINS = 64;
 
-    //! Worker threads block on this when out of work
-    boost::condition_variable condWorker;
+    /**
+     * Ring of pointers to verifications, filled by the master at the bottom
+     * and emptied by any thread at the top. top and bottom only ever grow.
+     */
+    struct Deque {
+        std::atomic<uint64_t> top;
+        char padding1[64];
+        std::atomic<uint64_t> bottom;
+        char padding2[64];
+        //! Allocated by the master before the first verification is added.
+        std::unique_ptr<std::atomic<T *>[]> slots;
 
-    //! Master thread blocks on this when out of work
-    boost::condition_variable condMaster;
+        Deque() : top(0), bottom(0) {}
+    };
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    std::unique_ptr<Deque[]> deques;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The number of worker threads that started, which use one deque each.
+    std::atomic<size_t> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The deque the master adds the next verification to.
+    size_t nNextDeque;
+
+    /**
+     * The verifications added since the last Wait(), only touched by the
+     * master. They are kept in fixed blocks so that the deques can point to
+     * them while more are added.
+     */
+    std::vector<std::unique_ptr<std::vector<T>>> storage;
+    size_t nStorageBlocks;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
      * This includes elements that are no longer queued, but still in the
      * worker's own batches.
      */
-    unsigned int nTodo;
+    std::atomic<uint64_t> nTodo;
+
+    //! The number of workers sleeping on condWorker.
+    std::atomic<int> nSleeping;
+
+    //! Protects sleeping on the condition variables.
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
 
     //! The maximum number of elements to be processed in one batch
     unsigned int nBatchSize;
 
-    /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false) {
-        boost::condition_variable &cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
-        do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us
-                // to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it
-                        // can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+    size_t DequesInUse() const {
+        return std::max<size_t>(
+            1, std::min<size_t>(nWorkers.load(), size_t(MAX_DEQUES)));
+    }
+
+    bool HasWork() {
+        const size_t nDeques = DequesInUse();
+        for (size_t i = 0; i < nDeques; i++) {
+            if (deques[i].top.load() < deques[i].bottom.load()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** Store a pointer to the verification in a deque, if one has room. */
+    bool Push(T *pcheck) {
+        const size_t nDeques = DequesInUse();
+        for (size_t i = 0; i < nDeques; i++) {
+            Deque &deque = deques[nNextDeque++ % nDeques];
+            const uint64_t nBottom =
+                deque.bottom.load(std::memory_order_relaxed);
+            if (nBottom - deque.top.load(std::memory_order_acquire) >=
+                DEQUE_CAPACITY) {
+                continue;
+            }
+            if (!deque.slots) {
+                deque.slots.reset(new std::atomic<T *>[DEQUE_CAPACITY]);
+            }
+            deque.slots[nBottom & (DEQUE_CAPACITY - 1)].store(
+                pcheck, std::memory_order_relaxed);
+            deque.bottom.store(nBottom + 1, std::memory_order_release);
+            return true;
+        }
+        return false;
+    }
+
+    /** Move a verification into storage, and return where it now lives. */
+    T *Store(T &check) {
+        if (nStorageBlocks == storage.size()) {
+            storage.emplace_back(new std::vector<T>());
+            storage.back()->reserve(STORAGE_BLOCK_SIZE);
+        }
+        std::vector<T> &block = *storage[nStorageBlocks];
+        // The block never grows past its capacity, so the verifications in
+        // it do not move.
+        block.emplace_back();
+        block.back().swap(check);
+        if (block.size() == STORAGE_BLOCK_SIZE) {
+            nStorageBlocks++;
+        }
+        return &block.back();
+    }
+
+    /** Run a verification, and destroy it on this thread. */
+    void Run(T &check, bool fOk) {
+        if (fOk && !check()) {
+            fAllOk.store(false, std::memory_order_relaxed);
+        }
+        T().swap(check);
+    }
+
+    /**
+     * Take a batch of verifications from the deques, starting with
+     * nFirstDeque, and run them. Returns false if there was nothing to take.
+     */
+    bool RunBatch(size_t nFirstDeque, std::vector<T *> &vBatch) {
+        const size_t nDeques = DequesInUse();
+        for (size_t i = 0; i < nDeques; i++) {
+            Deque &deque = deques[(nFirstDeque + i) % nDeques];
+            uint64_t nTop = deque.top.load(std::memory_order_acquire);
+            while (true) {
+                const uint64_t nBottom =
+                    deque.bottom.load(std::memory_order_acquire);
+                if (nTop >= nBottom) {
+                    break;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster) fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
-                    nIdle++;
-                    cond.wait(lock); // wait
-                    nIdle--;
+                // Take half of what is left, so that other threads can steal
+                // the rest.
+                const uint64_t nNow = std::max<uint64_t>(
+                    1, std::min<uint64_t>(nBatchSize, (nBottom - nTop) / 2));
+                vBatch.resize(nNow);
+                for (uint64_t j = 0; j < nNow; j++) {
+                    vBatch[j] = deque.slots[(nTop + j) & (DEQUE_CAPACITY - 1)]
+                                    .load(std::memory_order_relaxed);
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for
-                // increasingly smaller batches so all workers finish
-                // approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start
-                // helping.
-                // * Don't do batches smaller than 1 (duh), or larger than
-                // nBatchSize.
-                nNow = std::max(
-                    1U, std::min(nBatchSize, (unsigned int)queue.size() /
-                                                 (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible,
-                    // so swap jobs from the global queue to the local batch
-                    // vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
+                // If the master reused one of the slots read above, the top
+                // moved and this fails.
+                if (!deque.top.compare_exchange_weak(
+                        nTop, nTop + nNow, std::memory_order_acq_rel,
+                        std::memory_order_acquire)) {
+                    continue;
                 }
                 // Check whether we need to do work at all
-                fOk = fAllOk;
-            }
-            // execute work
-            for (T &check : vChecks) {
-                if (fOk) fOk = check();
+                const bool fOk = fAllOk.load(std::memory_order_relaxed);
+                for (T *pcheck : vBatch) {
+                    Run(*pcheck, fOk);
+                }
+                if (nTodo.fetch_sub(nNow, std::memory_order_acq_rel) == nNow) {
+                    // We processed the last element; inform the master it
+                    // can exit and return the result
+                    boost::unique_lock<boost::mutex> lock(mutex);
+                    condMaster.notify_one();
+                }
+                return true;
             }
-            vChecks.clear();
-        } while (true);
+        }
+        return false;
     }
 
 public:
     //! Create a new check queue
     CCheckQueue(unsigned int nBatchSizeIn)
-        : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false),
+        : deques(new Deque[MAX_DEQUES]), nWorkers(0), nNextDeque(0),
+          nStorageBlocks(0), fAllOk(true), nTodo(0), nSleeping(0),
           nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
-    void Thread() { Loop(); }
+    void Thread() {
+        const size_t nDeque = nWorkers++ % MAX_DEQUES;
+        std::vector<T *> vBatch;
+        vBatch.reserve(nBatchSize);
+        int nSpins = 0;
+        while (true) {
+            if (RunBatch(nDeque, vBatch)) {
+                nSpins = 0;
+                continue;
+            }
+            if (++nSpins < IDLE_SPINS) {
+                std::this_thread::yield();
+                continue;
+            }
+            nSpins = 0;
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSleeping++;
+            // Pairs with the fence in Add: either the master sees this worker
+            // sleeping, or this worker sees the work added.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (!HasWork()) {
+                // Interruption point, which ends the thread.
+                try {
+                    condWorker.wait(lock);
+                } catch (...) {
+                    nSleeping--;
+                    throw;
+                }
+            }
+            nSleeping--;
+        }
+    }
 
     //! Wait until execution finishes, and return whether all evaluations were
     //! successful.
-    bool Wait() { return Loop(true); }
+    bool Wait() {
+        std::vector<T *> vBatch;
+        vBatch.reserve(nBatchSize);
+        while (RunBatch(0, vBatch)) {
+        }
+        {
+            // Nothing is left to take, wait for the batches being run.
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (nTodo.load(std::memory_order_acquire) != 0) {
+                condMaster.wait(lock);
+            }
+        }
+
+        // The verifications were all destroyed by the threads running them.
+        if (storage.size() > STORAGE_BLOCKS_KEPT) {
+            storage.resize(STORAGE_BLOCKS_KEPT);
+        }
+        for (size_t i = 0; i < storage.size() && i <= nStorageBlocks; i++) {
+            storage[i]->clear();
+        }
+        nStorageBlocks = 0;
+
+        bool fRet = fAllOk.load(std::memory_order_relaxed);
+        // reset the status for new work later
+        fAllOk.store(true, std::memory_order_relaxed);
+        return fRet;
+    }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T> &vChecks) {
-        boost::unique_lock<boost::mutex> lock(mutex);
+        if (vChecks.empty()) {
+            return;
+        }
+        nTodo.fetch_add(vChecks.size(), std::memory_order_relaxed);
+        size_t nAdded = 0;
         for (T &check : vChecks) {
-            queue.push_back(std::move(check));
+            T *pcheck = Store(check);
+            if (Push(pcheck)) {
+                nAdded++;
+                continue;
+            }
+            // Every deque is full: the master does this one itself.
+            Run(*pcheck, fAllOk.load(std::memory_order_relaxed));
+            nTodo.fetch_sub(1, std::memory_order_relaxed);
         }
-        nTodo += vChecks.size();
-        if (vChecks.size() == 1) {
-            condWorker.notify_one();
-        } else if (vChecks.size() > 1) {
-            condWorker.notify_all();
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (nAdded && nSleeping.load(std::memory_order_relaxed)) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nAdded == 1) {
+                condWorker.notify_one();
+            } else {
+                condWorker.notify_all();
+            }
         }
     }
 
     ~CCheckQueue() {}
 
-    bool IsIdle() {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
-    }
+    bool IsIdle() { return nTodo.load() == 0 && fAllOk.load(); }
 };
 
 /**
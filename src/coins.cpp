@@ -2,6 +2,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#if defined(HAVE_CONFIG_H)
+#include "config/bitcoin-config.h"
+#endif
+
 #include "coins.h"
 
 #include "consensus/consensus.h"
@@ -55,7 +59,22 @@ SaltedOutpointHasher::SaltedOutpointHasher()
       k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
 
 CCoinsViewCache::CCoinsViewCache(CCoinsView *baseIn)
-    : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {}
+    : CCoinsViewBacked(baseIn), cachedCoinsUsage(0) {
+    ReallocateCache();
+}
+
+void CCoinsViewCache::ReallocateCache() {
+    // Destroy the nodes before the resource holding them. The map is rebuilt
+    // in place because its hasher, holding a const salt, is not assignable.
+    cacheCoins.~CCoinsMap();
+    m_cache_coins_memory_resource.reset();
+#ifdef ENABLE_COINS_POOL
+    m_cache_coins_memory_resource.reset(new CCoinsMapMemoryResource());
+#endif
+    ::new (&cacheCoins)
+        CCoinsMap(0, SaltedOutpointHasher(), std::equal_to<COutPoint>(),
+                  CCoinsMapAllocator(m_cache_coins_memory_resource.get()));
+}
 
 size_t CCoinsViewCache::DynamicMemoryUsage() const {
     return memusage::DynamicUsage(cacheCoins) + cachedCoinsUsage;
@@ -152,6 +171,19 @@ bool CCoinsViewCache::SpendCoin(const COutPoint &outpoint, Coin *moveout) {
     return true;
 }
 
+void CCoinsViewCache::AddFetchedCoin(const COutPoint &outpoint, Coin &&coin) {
+    assert(!coin.IsSpent());
+    CCoinsMap::iterator it;
+    bool inserted;
+    std::tie(it, inserted) =
+        cacheCoins.emplace(std::piecewise_construct,
+                           std::forward_as_tuple(outpoint),
+                           std::forward_as_tuple(std::move(coin)));
+    if (inserted) {
+        cachedCoinsUsage += it->second.coin.DynamicMemoryUsage();
+    }
+}
+
 static const Coin coinEmpty;
 
 const Coin &CCoinsViewCache::AccessCoin(const COutPoint &outpoint) const {
@@ -248,11 +280,21 @@ bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins,
 
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, hashBlock);
-    cacheCoins.clear();
+    ReallocateCache();
     cachedCoinsUsage = 0;
     return fOk;
 }
 
+std::unique_ptr<CCoinsCacheSnapshot> CCoinsViewCache::DetachCache() {
+    const size_t nUsage = DynamicMemoryUsage();
+    std::unique_ptr<CCoinsCacheSnapshot> snapshot(new CCoinsCacheSnapshot(
+        std::move(m_cache_coins_memory_resource), std::move(cacheCoins),
+        hashBlock, nUsage));
+    ReallocateCache();
+    cachedCoinsUsage = 0;
+    return snapshot;
+}
+
 void CCoinsViewCache::Uncache(const COutPoint &outpoint) {
     CCoinsMap::iterator it = cacheCoins.find(outpoint);
     if (it != cacheCoins.end() && it->second.flags == 0) {
@@ -11,10 +11,13 @@
 #include "hash.h"
 #include "memusage.h"
 #include "serialize.h"
+#include "support/allocators/pool.h"
 #include "uint256.h"
 
 #include <cassert>
 #include <cstdint>
+#include <functional>
+#include <memory>
 #include <unordered_map>
 
 /**
@@ -112,9 +115,36 @@ struct CCoinsCacheEntry {
         : coin(std::move(coinIn)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher>
+/**
+ * CCoinsMap nodes are allocated from a PoolResource owned by the cache, unless
+ * built with --disable-coins-pool. Blocks leave room for the node's next
+ * pointer and cached hash.
+ */
+typedef PoolAllocator<std::pair<const COutPoint, CCoinsCacheEntry>,
+                      sizeof(std::pair<const COutPoint, CCoinsCacheEntry>) +
+                          sizeof(void *) * 4>
+    CCoinsMapAllocator;
+typedef CCoinsMapAllocator::ResourceType CCoinsMapMemoryResource;
+
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher,
+                           std::equal_to<COutPoint>, CCoinsMapAllocator>
     CCoinsMap;
 
+/** Entries taken out of a CCoinsViewCache, with the memory they live in. */
+struct CCoinsCacheSnapshot {
+    CCoinsCacheSnapshot(std::unique_ptr<CCoinsMapMemoryResource> resourceIn,
+                        CCoinsMap &&mapIn, const uint256 &hashBlockIn,
+                        size_t nUsageIn)
+        : resource(std::move(resourceIn)), map(std::move(mapIn)),
+          hashBlock(hashBlockIn), nUsage(nUsageIn) {}
+
+    std::unique_ptr<CCoinsMapMemoryResource> resource;
+    CCoinsMap map;
+    uint256 hashBlock;
+    //! DynamicMemoryUsage() of the cache they were taken from.
+    size_t nUsage;
+};
+
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor {
 public:
@@ -188,6 +218,8 @@ protected:
      * declared as "const".
      */
     mutable uint256 hashBlock;
+    /** Memory of cacheCoins' nodes, declared first to outlive it. */
+    std::unique_ptr<CCoinsMapMemoryResource> m_cache_coins_memory_resource;
     mutable CCoinsMap cacheCoins;
 
     /* Cached dynamic memory usage for the inner Coin objects. */
@@ -231,6 +263,12 @@ public:
      */
     bool SpendCoin(const COutPoint &outpoint, Coin *moveto = nullptr);
 
+    /**
+     * Add a coin read from the base, unless this cache already has an entry
+     * for it. The coin must still be the version held by the base.
+     */
+    void AddFetchedCoin(const COutPoint &outpoint, Coin &&coin);
+
     /**
      * Push the modifications applied to this cache to its base.
      * Failure to call this method before destruction will cause the changes to
@@ -239,6 +277,13 @@ public:
      */
     bool Flush();
 
+    /**
+     * Take all entries out of this cache, without writing them to its base.
+     * The caller must write them before the base is read again for any of
+     * them, for instance with CCoinsViewBackgroundWriter.
+     */
+    std::unique_ptr<CCoinsCacheSnapshot> DetachCache();
+
     /**
      * Removes the UTXO with the given outpoint from the cache, if it is not
      * modified.
@@ -278,6 +323,12 @@ public:
 private:
     CCoinsMap::iterator FetchCoin(const COutPoint &outpoint) const;
 
+    /**
+     * Empty cacheCoins and give its memory back: clearing the map only
+     * returns the nodes to the pool.
+     */
+    void ReallocateCache();
+
     /**
      * By making the copy constructor private, we prevent accidentally using it
      * when one intends to create a cache on top of a base cache.
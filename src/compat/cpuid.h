@@ -0,0 +1,36 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_COMPAT_CPUID_H
+#define BITCOIN_COMPAT_CPUID_H
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#define HAVE_GETCPUID
+
+/** Query CPUID leaf/subleaf (GCC and Clang inline assembly). */
+inline void GetCPUID(uint32_t leaf, uint32_t subleaf, uint32_t &a, uint32_t &b,
+                     uint32_t &c, uint32_t &d) {
+    __asm__("cpuid"
+            : "=a"(a), "=b"(b), "=c"(c), "=d"(d)
+            : "0"(leaf), "2"(subleaf));
+}
+
+/** Return whether the OS saves the AVX (YMM) register state. */
+inline bool AVXEnabledByOS() {
+    uint32_t a, b, c, d;
+    GetCPUID(1, 0, a, b, c, d);
+    // OSXSAVE must be set before XGETBV may be used.
+    if (!((c >> 27) & 1)) {
+        return false;
+    }
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    // Both the XMM and YMM state must be enabled.
+    return (xcr0_lo & 6) == 6;
+}
+
+#endif // defined(__x86_64__) || defined(__amd64__) || defined(__i386__)
+#endif // BITCOIN_COMPAT_CPUID_H
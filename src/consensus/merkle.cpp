@@ -3,6 +3,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "merkle.h"
+#include "crypto/sha256.h"
 #include "hash.h"
 #include "utilstrencodings.h"
 
@@ -143,10 +144,31 @@ static void MerkleComputation(const std::vector<uint256> &leaves,
     if (proot) *proot = h;
 }
 
-uint256 ComputeMerkleRoot(const std::vector<uint256> &leaves, bool *mutated) {
-    uint256 hash;
-    MerkleComputation(leaves, &hash, mutated, -1, nullptr);
-    return hash;
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated) {
+    // Reduce the tree one level at a time, hashing all the pairs of a level
+    // at once so that SHA256D64 can use the multi-way implementations.
+    bool mutation = false;
+    while (hashes.size() > 1) {
+        if (mutated) {
+            for (size_t pos = 0; pos + 1 < hashes.size(); pos += 2) {
+                if (hashes[pos] == hashes[pos + 1]) {
+                    mutation = true;
+                }
+            }
+        }
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+    }
+    if (mutated) {
+        *mutated = mutation;
+    }
+    if (hashes.size() == 0) {
+        return uint256();
+    }
+    return hashes[0];
 }
 
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256> &leaves,
@@ -178,7 +200,7 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated) {
     for (size_t s = 0; s < block.vtx.size(); s++) {
         leaves[s] = block.vtx[s]->GetId();
     }
-    return ComputeMerkleRoot(leaves, mutated);
+    return ComputeMerkleRoot(std::move(leaves), mutated);
 }
 
 std::vector<uint256> BlockMerkleBranch(const CBlock &block, uint32_t position) {
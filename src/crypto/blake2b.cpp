@@ -0,0 +1,240 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "crypto/blake2b.h"
+
+#include "compat/cpuid.h"
+#include "crypto/common.h"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(ENABLE_SSE41)
+namespace blake2b_sse41 {
+void FinalizeTwoWay(const uint64_t *h, uint64_t t, const uint8_t *blocks,
+                    uint64_t *out);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace blake2b_avx2 {
+void FinalizeFourWay(const uint64_t *h, uint64_t t, const uint8_t *blocks,
+                     uint64_t *out);
+}
+#endif
+
+// Internal implementation code.
+namespace {
+/// Internal BLAKE2b implementation.
+namespace blake2b {
+    const uint64_t IV[8] = {
+        0x6a09e667f3bcc908ull, 0xbb67ae8584caa73bull, 0x3c6ef372fe94f82bull,
+        0xa54ff53a5f1d36f1ull, 0x510e527fade682d1ull, 0x9b05688c2b3e6c1full,
+        0x1f83d9abfb41bd6bull, 0x5be0cd19137e2179ull};
+
+    const uint8_t SIGMA[12][16] = {
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3},
+        {11, 8, 12, 0, 5, 2, 15, 13, 10, 14, 3, 6, 7, 1, 9, 4},
+        {7, 9, 3, 1, 13, 12, 11, 14, 2, 6, 5, 10, 4, 0, 15, 8},
+        {9, 0, 5, 7, 2, 4, 10, 15, 14, 1, 11, 12, 6, 8, 3, 13},
+        {2, 12, 6, 10, 0, 11, 8, 3, 4, 13, 7, 5, 15, 14, 1, 9},
+        {12, 5, 1, 15, 14, 13, 4, 10, 0, 7, 6, 3, 9, 2, 8, 11},
+        {13, 11, 7, 14, 12, 1, 3, 9, 5, 0, 15, 4, 8, 6, 2, 10},
+        {6, 15, 14, 9, 11, 3, 0, 8, 12, 2, 13, 7, 1, 4, 10, 5},
+        {10, 2, 8, 4, 7, 6, 1, 5, 15, 11, 9, 14, 3, 12, 13, 0},
+        {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15},
+        {14, 10, 4, 8, 9, 15, 13, 6, 1, 12, 0, 2, 11, 7, 5, 3}};
+
+    inline uint64_t Rotr(uint64_t x, int n) { return (x >> n) | (x << (64 - n)); }
+
+    inline void G(uint64_t &a, uint64_t &b, uint64_t &c, uint64_t &d,
+                  uint64_t x, uint64_t y) {
+        a = a + b + x;
+        d = Rotr(d ^ a, 32);
+        c = c + d;
+        b = Rotr(b ^ c, 24);
+        a = a + b + y;
+        d = Rotr(d ^ a, 16);
+        c = c + d;
+        b = Rotr(b ^ c, 63);
+    }
+
+    /**
+     * Compress one 128-byte block into the state h. t is the number of bytes
+     * hashed so far including this block.
+     */
+    void Compress(uint64_t *h, const uint8_t *block, uint64_t t, bool final) {
+        uint64_t m[16], v[16];
+        for (int i = 0; i < 16; i++) {
+            m[i] = ReadLE64(block + 8 * i);
+        }
+        for (int i = 0; i < 8; i++) {
+            v[i] = h[i];
+            v[i + 8] = IV[i];
+        }
+        v[12] ^= t;
+        if (final) {
+            v[14] = ~v[14];
+        }
+        for (int r = 0; r < 12; r++) {
+            const uint8_t *s = SIGMA[r];
+            G(v[0], v[4], v[8], v[12], m[s[0]], m[s[1]]);
+            G(v[1], v[5], v[9], v[13], m[s[2]], m[s[3]]);
+            G(v[2], v[6], v[10], v[14], m[s[4]], m[s[5]]);
+            G(v[3], v[7], v[11], v[15], m[s[6]], m[s[7]]);
+            G(v[0], v[5], v[10], v[15], m[s[8]], m[s[9]]);
+            G(v[1], v[6], v[11], v[12], m[s[10]], m[s[11]]);
+            G(v[2], v[7], v[8], v[13], m[s[12]], m[s[13]]);
+            G(v[3], v[4], v[9], v[14], m[s[14]], m[s[15]]);
+        }
+        for (int i = 0; i < 8; i++) {
+            h[i] ^= v[i] ^ v[i + 8];
+        }
+    }
+
+    /** Write the first outlen bytes of the state h to out. */
+    void Output(const uint64_t *h, size_t outlen, uint8_t *out) {
+        uint8_t full[CBlake2b::MAX_OUTPUT_SIZE];
+        for (int i = 0; i < 8; i++) {
+            WriteLE64(full + 8 * i, h[i]);
+        }
+        memcpy(out, full, outlen);
+    }
+
+    /**
+     * Finalize several messages sharing the state h and length t, whose last
+     * blocks are laid out contiguously in blocks. Each output is 8 words.
+     */
+    typedef void (*FinalizeMultiFn)(const uint64_t *h, uint64_t t,
+                                    const uint8_t *blocks, uint64_t *out);
+
+    void FinalizeOneWay(const uint64_t *h, uint64_t t, const uint8_t *blocks,
+                        uint64_t *out) {
+        std::copy(h, h + 8, out);
+        Compress(out, blocks, t, true);
+    }
+
+    FinalizeMultiFn FinalizeMulti = FinalizeOneWay;
+    size_t nFinalizeLanes = 1;
+} // namespace blake2b
+} // namespace
+
+CBlake2b::CBlake2b(size_t outlenIn, const uint8_t *personal)
+    : bufsize(0), bytes(0), outlen(outlenIn) {
+    assert(outlen > 0 && outlen <= MAX_OUTPUT_SIZE);
+    // Parameter block: digest length, no key, fanout 1, depth 1, no salt.
+    uint8_t param[64] = {};
+    param[0] = outlen;
+    param[2] = 1;
+    param[3] = 1;
+    if (personal) {
+        memcpy(param + 48, personal, PERSONAL_SIZE);
+    }
+    for (int i = 0; i < 8; i++) {
+        h[i] = blake2b::IV[i] ^ ReadLE64(param + 8 * i);
+    }
+}
+
+CBlake2b &CBlake2b::Write(const uint8_t *data, size_t len) {
+    while (len > 0) {
+        if (bufsize == BLOCK_SIZE) {
+            // More data follows, so this is not the last block.
+            bytes += BLOCK_SIZE;
+            blake2b::Compress(h, buf, bytes, false);
+            bufsize = 0;
+        }
+        size_t n = std::min(len, BLOCK_SIZE - bufsize);
+        memcpy(buf + bufsize, data, n);
+        bufsize += n;
+        data += n;
+        len -= n;
+    }
+    return *this;
+}
+
+void CBlake2b::Finalize(uint8_t *hash) {
+    memset(buf + bufsize, 0, BLOCK_SIZE - bufsize);
+    bytes += bufsize;
+    blake2b::Compress(h, buf, bytes, true);
+    blake2b::Output(h, outlen, hash);
+}
+
+void CBlake2b::FinalizeIndices(const uint32_t *indices, size_t count,
+                               uint8_t *out) const {
+    if (bufsize + sizeof(uint32_t) > BLOCK_SIZE) {
+        // The index spills into another block, do it the slow way.
+        for (size_t i = 0; i < count; i++) {
+            uint8_t le[sizeof(uint32_t)];
+            WriteLE32(le, indices[i]);
+            CBlake2b(*this).Write(le, sizeof(le)).Finalize(out + i * outlen);
+        }
+        return;
+    }
+
+    // Every message ends with the same (single) block, except for the index.
+    const uint64_t t = bytes + bufsize + sizeof(uint32_t);
+    const size_t nLanes = blake2b::nFinalizeLanes;
+    uint8_t blocks[4 * BLOCK_SIZE];
+    uint64_t words[4 * 8];
+    for (size_t lane = 0; lane < nLanes; lane++) {
+        uint8_t *block = blocks + lane * BLOCK_SIZE;
+        memcpy(block, buf, bufsize);
+        memset(block + bufsize, 0, BLOCK_SIZE - bufsize);
+    }
+
+    size_t i = 0;
+    for (; i + nLanes <= count; i += nLanes) {
+        for (size_t lane = 0; lane < nLanes; lane++) {
+            WriteLE32(blocks + lane * BLOCK_SIZE + bufsize, indices[i + lane]);
+        }
+        blake2b::FinalizeMulti(h, t, blocks, words);
+        for (size_t lane = 0; lane < nLanes; lane++) {
+            blake2b::Output(words + lane * 8, outlen, out + (i + lane) * outlen);
+        }
+    }
+    for (; i < count; i++) {
+        WriteLE32(blocks + bufsize, indices[i]);
+        blake2b::FinalizeOneWay(h, t, blocks, words);
+        blake2b::Output(words, outlen, out + i * outlen);
+    }
+}
+
+std::string Blake2bAutoDetect(
+    blake2b_implementation::UseImplementation use_implementation) {
+#if defined(HAVE_GETCPUID)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    // SSSE3 is needed for the byte shuffles on top of SSE4.1.
+    bool have_sse41 = ((ecx >> 19) & 1) && ((ecx >> 9) & 1) &&
+                      (use_implementation & blake2b_implementation::USE_SSE41);
+    bool have_avx2 = false;
+    if (AVXEnabledByOS()) {
+        GetCPUID(7, 0, eax, ebx, ecx, edx);
+        have_avx2 = ((ebx >> 5) & 1) &&
+                    (use_implementation & blake2b_implementation::USE_AVX2);
+    }
+
+#if defined(ENABLE_AVX2)
+    if (have_avx2) {
+        blake2b::FinalizeMulti = blake2b_avx2::FinalizeFourWay;
+        blake2b::nFinalizeLanes = 4;
+        return "avx2(4way)";
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (have_sse41) {
+        blake2b::FinalizeMulti = blake2b_sse41::FinalizeTwoWay;
+        blake2b::nFinalizeLanes = 2;
+        return "sse4.1(2way)";
+    }
+#endif
+    (void)have_sse41;
+    (void)have_avx2;
+#endif
+
+    blake2b::FinalizeMulti = blake2b::FinalizeOneWay;
+    blake2b::nFinalizeLanes = 1;
+    return "standard";
+}
@@ -0,0 +1,71 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_CRYPTO_BLAKE2B_H
+#define BITCOIN_CRYPTO_BLAKE2B_H
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+/**
+ * A hasher class for unkeyed BLAKE2b (RFC 7693) with an optional
+ * personalization string, producing the same digests as libsodium's
+ * crypto_generichash_blake2b_init_salt_personal without a salt.
+ *
+ * Besides the usual Write/Finalize interface it can hash many messages that
+ * only differ by a trailing 32-bit index at once, which is what Equihash
+ * needs. When the index fits in the last block those only cost a single
+ * compression each, and several of them are computed in parallel using SIMD
+ * when the CPU supports it (see Blake2bAutoDetect).
+ */
+class CBlake2b {
+private:
+    uint64_t h[8];
+    uint8_t buf[128];
+    //! Number of bytes in buf. The last block is always kept here, as
+    //! BLAKE2b has to know which compression is the final one.
+    size_t bufsize;
+    //! Number of bytes compressed so far.
+    uint64_t bytes;
+    size_t outlen;
+
+public:
+    static const size_t BLOCK_SIZE = 128;
+    static const size_t MAX_OUTPUT_SIZE = 64;
+    static const size_t PERSONAL_SIZE = 16;
+
+    explicit CBlake2b(size_t outlenIn = MAX_OUTPUT_SIZE,
+                      const uint8_t *personal = nullptr);
+    CBlake2b &Write(const uint8_t *data, size_t len);
+    void Finalize(uint8_t *hash);
+    size_t OutputSize() const { return outlen; }
+
+    /**
+     * For each i < count, write H(data || LE32(indices[i])) to
+     * out + i * OutputSize(), where data is what has been written so far.
+     * This hasher is left unchanged.
+     */
+    void FinalizeIndices(const uint32_t *indices, size_t count,
+                         uint8_t *out) const;
+};
+
+namespace blake2b_implementation {
+enum UseImplementation : uint8_t {
+    STANDARD = 0,
+    USE_SSE41 = 1 << 0,
+    USE_AVX2 = 1 << 1,
+    USE_ALL = USE_SSE41 | USE_AVX2,
+};
+}
+
+/**
+ * Select the fastest multi-lane BLAKE2b implementation supported by the CPU,
+ * restricted to the ones allowed by use_implementation, and return a
+ * description of it.
+ */
+std::string Blake2bAutoDetect(blake2b_implementation::UseImplementation
+                                  use_implementation = blake2b_implementation::USE_ALL);
+
+#endif // BITCOIN_CRYPTO_BLAKE2B_H
@@ -52,6 +52,23 @@ int Equihash<N,K>::InitialiseState(eh_HashState& base_state, bool cdy_salt)
                                                          personalization);
 }
 
+template<unsigned int N, unsigned int K>
+int Equihash<N,K>::InitialiseState(CBlake2b& base_state, bool cdy_salt)
+{
+    uint32_t le_N = htole32(N);
+    uint32_t le_K = htole32(K);
+    unsigned char personalization[CBlake2b::PERSONAL_SIZE] = {};
+    if (cdy_salt) {
+        memcpy(personalization, "CandyPoW", 8);
+    } else {
+        memcpy(personalization, "ZcashPoW", 8);
+    }
+    memcpy(personalization+8,  &le_N, 4);
+    memcpy(personalization+12, &le_K, 4);
+    base_state = CBlake2b((512/N)*N/8, personalization);
+    return 0;
+}
+
 void GenerateHash(const eh_HashState& base_state, eh_index g,
                   unsigned char* hash, size_t hLen)
 {
@@ -773,6 +790,87 @@ bool Equihash<N,K>::IsValidSolution(const eh_HashState& base_state, std::vector<
     return X[0].IsZero(hashLen);
 }
 
+template<unsigned int N, unsigned int K>
+bool Equihash<N,K>::IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln)
+{
+    if (soln.size() != SolutionWidth) {
+        LogPrint(BCLog::POW, "Invalid solution length: %d (expected %d)\n",
+                 soln.size(), SolutionWidth);
+        return false;
+    }
+    assert(base_state.OutputSize() == HashOutput);
+
+    // Everything lives on the stack: for (200,9) this is about 50KB.
+    const size_t nIndices = 1 << K;
+    unsigned char indicesArray[nIndices * sizeof(eh_index)];
+    eh_index indices[nIndices];
+    ExpandArray(soln.data(), soln.size(), indicesArray, sizeof(indicesArray),
+                CollisionBitLength+1, sizeof(eh_index) - ((CollisionBitLength+1)+7)/8);
+    for (size_t i = 0; i < nIndices; i++) {
+        indices[i] = ArrayToEhIndex(indicesArray + i*sizeof(eh_index));
+    }
+
+    // No index may appear twice. The reference validator checks this between
+    // every pair of sibling subtrees, which is the same as checking it once
+    // for all of them.
+    eh_index sorted[nIndices];
+    std::copy(indices, indices + nIndices, sorted);
+    std::sort(sorted, sorted + nIndices);
+    if (std::adjacent_find(sorted, sorted + nIndices) != sorted + nIndices) {
+        LogPrint(BCLog::POW, "Invalid solution: duplicate indices\n");
+        return false;
+    }
+
+    // Hash all the indices in one go, and expand them into rows.
+    eh_index hashIndices[nIndices];
+    for (size_t i = 0; i < nIndices; i++) {
+        hashIndices[i] = indices[i]/IndicesPerHashOutput;
+    }
+    unsigned char hashes[nIndices * HashOutput];
+    base_state.FinalizeIndices(hashIndices, nIndices, hashes);
+    unsigned char rows[nIndices][HashLength];
+    for (size_t i = 0; i < nIndices; i++) {
+        ExpandArray(hashes + i*HashOutput + (indices[i] % IndicesPerHashOutput) * N/8,
+                    N/8, rows[i], HashLength, CollisionBitLength);
+    }
+
+    // Walk up the tree, merging sibling rows in place. At each level, rows[j]
+    // is the subtree built from indices[j*width, (j+1)*width). For a valid
+    // solution each merge keeps the left subtree first, so the index lists
+    // of the reference validator are always slices of indices.
+    size_t hashLen = HashLength;
+    size_t width = 1;
+    for (size_t nRows = nIndices; nRows > 1; nRows /= 2) {
+        for (size_t j = 0; j < nRows/2; j++) {
+            const unsigned char* a = rows[2*j];
+            const unsigned char* b = rows[2*j+1];
+            if (memcmp(a, b, CollisionByteLength) != 0) {
+                LogPrint(BCLog::POW, "Invalid solution: invalid collision length between StepRows\n");
+                return false;
+            }
+            const eh_index* left = indices + 2*j*width;
+            const eh_index* right = left + width;
+            if (std::lexicographical_compare(right, right + width, left, right)) {
+                LogPrint(BCLog::POW, "Invalid solution: Index tree incorrectly ordered\n");
+                return false;
+            }
+            // rows[j] is never ahead of the rows being read.
+            for (size_t i = CollisionByteLength; i < hashLen; i++) {
+                rows[j][i-CollisionByteLength] = a[i] ^ b[i];
+            }
+        }
+        hashLen -= CollisionByteLength;
+        width *= 2;
+    }
+
+    for (size_t i = 0; i < hashLen; i++) {
+        if (rows[0][i] != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // Explicit instantiations for Equihash<96,3>
 template int Equihash<96,3>::InitialiseState(eh_HashState& base_state, bool cdy_salt);
 template bool Equihash<96,3>::BasicSolve(const eh_HashState& base_state,
@@ -782,6 +880,8 @@ template bool Equihash<96,3>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<96,3>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<96,3>::InitialiseState(CBlake2b& base_state, bool cdy_salt);
+template bool Equihash<96,3>::IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<200,9>
 template int Equihash<200,9>::InitialiseState(eh_HashState& base_state, bool cdy_salt);
@@ -792,6 +892,8 @@ template bool Equihash<200,9>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<200,9>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<200,9>::InitialiseState(CBlake2b& base_state, bool cdy_salt);
+template bool Equihash<200,9>::IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<144,5>
 template int Equihash<144,5>::InitialiseState(eh_HashState& base_state, bool cdy_salt);
@@ -802,6 +904,8 @@ template bool Equihash<144,5>::OptimisedSolve(const eh_HashState& base_state,
                                               const std::function<bool(std::vector<unsigned char>)> validBlock,
                                               const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<144,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<144,5>::InitialiseState(CBlake2b& base_state, bool cdy_salt);
+template bool Equihash<144,5>::IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln);
 
 
 // Explicit instantiations for Equihash<96,5>
@@ -813,6 +917,8 @@ template bool Equihash<96,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<96,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<96,5>::InitialiseState(CBlake2b& base_state, bool cdy_salt);
+template bool Equihash<96,5>::IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln);
 
 // Explicit instantiations for Equihash<48,5>
 template int Equihash<48,5>::InitialiseState(eh_HashState& base_state, bool cdy_salt);
@@ -823,3 +929,5 @@ template bool Equihash<48,5>::OptimisedSolve(const eh_HashState& base_state,
                                              const std::function<bool(std::vector<unsigned char>)> validBlock,
                                              const std::function<bool(EhSolverCancelCheck)> cancelled);
 template bool Equihash<48,5>::IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+template int Equihash<48,5>::InitialiseState(CBlake2b& base_state, bool cdy_salt);
+template bool Equihash<48,5>::IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln);
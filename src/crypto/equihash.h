@@ -7,6 +7,7 @@
 #define BITCOIN_EQUIHASH_H
 
 #include "compat/endian.h"
+#include "crypto/blake2b.h"
 #include "crypto/sha256.h"
 #include "utilstrencodings.h"
 
@@ -185,6 +186,7 @@ public:
     Equihash() { }
 
     int InitialiseState(eh_HashState& base_state, bool cdy_salt);
+    int InitialiseState(CBlake2b& base_state, bool cdy_salt);
     bool BasicSolve(const eh_HashState& base_state,
                     const std::function<bool(std::vector<unsigned char>)> validBlock,
                     const std::function<bool(EhSolverCancelCheck)> cancelled);
@@ -192,6 +194,11 @@ public:
                         const std::function<bool(std::vector<unsigned char>)> validBlock,
                         const std::function<bool(EhSolverCancelCheck)> cancelled);
     bool IsValidSolution(const eh_HashState& base_state, std::vector<unsigned char> soln);
+    /**
+     * Same as above, using the built-in BLAKE2b to hash all the indices at
+     * once and checking the collision tree in place in a fixed size buffer.
+     */
+    bool IsValidSolution(const CBlake2b& base_state, const std::vector<unsigned char>& soln);
 };
 
 #include "equihash.tcc"
@@ -4,10 +4,32 @@
 
 #include "crypto/sha256.h"
 
+#include "compat/cpuid.h"
 #include "crypto/common.h"
 
 #include <cstring>
 
+#if defined(ENABLE_SSE41)
+namespace sha256d64_sse41 {
+void Transform_4way(uint8_t *out, const uint8_t *in);
+}
+#endif
+
+#if defined(ENABLE_AVX2)
+namespace sha256d64_avx2 {
+void Transform_8way(uint8_t *out, const uint8_t *in);
+}
+#endif
+
+#if defined(ENABLE_SHANI)
+namespace sha256_shani {
+void Transform(uint32_t *s, const uint8_t *chunk, size_t blocks);
+}
+namespace sha256d64_shani {
+void Transform_2way(uint8_t *out, const uint8_t *in);
+}
+#endif
+
 // Internal implementation code.
 namespace {
 /// Internal SHA-256 implementation.
@@ -186,9 +208,114 @@ namespace sha256 {
         s[7] += h;
     }
 
+    /** Perform SHA-256 transformations on a number of 64-byte chunks. */
+    void TransformBlocks(uint32_t *s, const uint8_t *chunk, size_t blocks) {
+        while (blocks--) {
+            Transform(s, chunk);
+            chunk += 64;
+        }
+    }
+
 } // namespace sha256
+
+typedef void (*TransformType)(uint32_t *, const uint8_t *, size_t);
+typedef void (*TransformD64Type)(uint8_t *, const uint8_t *);
+
+/** Double-SHA256 a single 64-byte input using the transform tr. */
+template <TransformType tr>
+void TransformD64Wrapper(uint8_t *out, const uint8_t *in) {
+    // Padding of a 64-byte message: 0x80, zeroes and a length of 512 bits.
+    static const uint8_t padding1[64] = {0x80, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         0,    0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+                                         0,    0, 0, 0, 0, 0, 0, 2, 0};
+    // The second message is the 32-byte hash of the first one, padded with
+    // 0x80, zeroes and a length of 256 bits.
+    uint8_t buffer2[64] = {0};
+    buffer2[32] = 0x80;
+    buffer2[62] = 1;
+
+    uint32_t s[8];
+    sha256::Initialize(s);
+    tr(s, in, 1);
+    tr(s, padding1, 1);
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(buffer2 + 4 * i, s[i]);
+    }
+    sha256::Initialize(s);
+    tr(s, buffer2, 1);
+    for (int i = 0; i < 8; i++) {
+        WriteBE32(out + 4 * i, s[i]);
+    }
+}
+
+TransformType Transform = sha256::TransformBlocks;
+TransformD64Type TransformD64 = TransformD64Wrapper<sha256::TransformBlocks>;
+TransformD64Type TransformD64_2way = nullptr;
+TransformD64Type TransformD64_4way = nullptr;
+TransformD64Type TransformD64_8way = nullptr;
+
 } // namespace
 
+std::string SHA256AutoDetect(
+    sha256_implementation::UseImplementation use_implementation) {
+    std::string ret = "standard";
+    Transform = sha256::TransformBlocks;
+    TransformD64 = TransformD64Wrapper<sha256::TransformBlocks>;
+    TransformD64_2way = nullptr;
+    TransformD64_4way = nullptr;
+    TransformD64_8way = nullptr;
+
+#if defined(HAVE_GETCPUID)
+    uint32_t eax, ebx, ecx, edx;
+    GetCPUID(1, 0, eax, ebx, ecx, edx);
+    // SSSE3 is needed for the byte shuffles on top of SSE4.1.
+    const bool cpu_sse4 = ((ecx >> 19) & 1) && ((ecx >> 9) & 1);
+    bool have_sse4 =
+        cpu_sse4 && (use_implementation & sha256_implementation::USE_SSE4);
+    bool have_avx2 = false;
+    GetCPUID(7, 0, eax, ebx, ecx, edx);
+    if (AVXEnabledByOS()) {
+        have_avx2 = ((ebx >> 5) & 1) &&
+                    (use_implementation & sha256_implementation::USE_AVX2);
+    }
+    bool have_shani = cpu_sse4 && ((ebx >> 29) & 1) &&
+                      (use_implementation & sha256_implementation::USE_SHANI);
+
+#if defined(ENABLE_SHANI)
+    if (have_shani) {
+        Transform = sha256_shani::Transform;
+        TransformD64 = TransformD64Wrapper<sha256_shani::Transform>;
+        TransformD64_2way = sha256d64_shani::Transform_2way;
+        ret = "shani(1way,2way)";
+        // The SHA extensions beat the multi-way implementations, and mixing
+        // them would only split batches.
+        have_sse4 = false;
+        have_avx2 = false;
+    }
+#endif
+#if defined(ENABLE_SSE41)
+    if (have_sse4) {
+        TransformD64_4way = sha256d64_sse41::Transform_4way;
+        ret = "standard(1way),sse41(4way)";
+    }
+#endif
+#if defined(ENABLE_AVX2)
+    if (have_avx2) {
+        TransformD64_8way = sha256d64_avx2::Transform_8way;
+        ret += ",avx2(8way)";
+    }
+#endif
+    (void)have_sse4;
+    (void)have_avx2;
+    (void)have_shani;
+#endif
+
+    return ret;
+}
+
 ////// SHA-256
 
 CSHA256::CSHA256() : bytes(0) {
@@ -203,14 +330,15 @@ CSHA256 &CSHA256::Write(const uint8_t *data, size_t len) {
         memcpy(buf + bufsize, data, 64 - bufsize);
         bytes += 64 - bufsize;
         data += 64 - bufsize;
-        sha256::Transform(s, buf);
+        Transform(s, buf, 1);
         bufsize = 0;
     }
-    while (end >= data + 64) {
+    if (end - data >= 64) {
         // Process full chunks directly from the source.
-        sha256::Transform(s, data);
-        bytes += 64;
-        data += 64;
+        size_t blocks = (end - data) / 64;
+        Transform(s, data, blocks);
+        data += 64 * blocks;
+        bytes += 64 * blocks;
     }
     if (end > data) {
         // Fill the buffer with what remains.
@@ -241,3 +369,36 @@ CSHA256 &CSHA256::Reset() {
     sha256::Initialize(s);
     return *this;
 }
+
+void SHA256D64(uint8_t *out, const uint8_t *in, size_t blocks) {
+    if (TransformD64_8way) {
+        while (blocks >= 8) {
+            TransformD64_8way(out, in);
+            out += 256;
+            in += 512;
+            blocks -= 8;
+        }
+    }
+    if (TransformD64_4way) {
+        while (blocks >= 4) {
+            TransformD64_4way(out, in);
+            out += 128;
+            in += 256;
+            blocks -= 4;
+        }
+    }
+    if (TransformD64_2way) {
+        while (blocks >= 2) {
+            TransformD64_2way(out, in);
+            out += 64;
+            in += 128;
+            blocks -= 2;
+        }
+    }
+    while (blocks) {
+        TransformD64(out, in);
+        out += 32;
+        in += 64;
+        --blocks;
+    }
+}
@@ -7,6 +7,7 @@
 
 #include <cstdint>
 #include <cstdlib>
+#include <string>
 
 /** A hasher class for SHA-256. */
 class CSHA256 {
@@ -24,4 +25,31 @@ public:
     CSHA256 &Reset();
 };
 
+namespace sha256_implementation {
+enum UseImplementation : uint8_t {
+    STANDARD = 0,
+    USE_SSE4 = 1 << 0,
+    USE_AVX2 = 1 << 1,
+    USE_SHANI = 1 << 2,
+    USE_ALL = USE_SSE4 | USE_AVX2 | USE_SHANI,
+};
+}
+
+/**
+ * Autodetect the best available SHA256 implementation, restricted to the ones
+ * allowed by use_implementation, and return a description of it.
+ */
+std::string SHA256AutoDetect(sha256_implementation::UseImplementation
+                                 use_implementation = sha256_implementation::USE_ALL);
+
+/**
+ * Compute multiple double-SHA256's of 64-byte blobs.
+ * output:  pointer to a blocks*32 byte output buffer
+ * input:   pointer to a blocks*64 byte input buffer
+ * blocks:  the number of hashes to compute.
+ * The output may overlap the start of the input, as in a Merkle tree level
+ * computed in place.
+ */
+void SHA256D64(uint8_t *output, const uint8_t *input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
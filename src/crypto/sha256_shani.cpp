@@ -0,0 +1,171 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// SHA-256 using the Intel SHA extensions. The state is kept in the ABEF/CDGH
+// layout expected by the sha256rnds2 instruction.
+
+#if defined(ENABLE_SHANI)
+
+#include <cstddef>
+#include <cstdint>
+#include <immintrin.h>
+
+namespace {
+
+/** Byte shuffle converting between big endian words and native ones. */
+alignas(16) const uint8_t MASK[16] = {0x03, 0x02, 0x01, 0x00, 0x07, 0x06,
+                                      0x05, 0x04, 0x0b, 0x0a, 0x09, 0x08,
+                                      0x0f, 0x0e, 0x0d, 0x0c};
+
+inline __m128i Load(const uint8_t *in) {
+    return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)in),
+                            _mm_load_si128((const __m128i *)MASK));
+}
+
+inline void Save(uint8_t *out, __m128i s) {
+    const __m128i mask = _mm_load_si128((const __m128i *)MASK);
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(s, mask));
+}
+
+/** Convert s[0..3], s[4..7] into the ABEF/CDGH layout. */
+inline void Shuffle(__m128i &s0, __m128i &s1) {
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0xB1);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0x1B);
+    s0 = _mm_alignr_epi8(t1, t2, 0x08);
+    s1 = _mm_blend_epi16(t2, t1, 0xF0);
+}
+
+/** Convert the ABEF/CDGH layout back into s[0..3], s[4..7]. */
+inline void Unshuffle(__m128i &s0, __m128i &s1) {
+    const __m128i t1 = _mm_shuffle_epi32(s0, 0x1B);
+    const __m128i t2 = _mm_shuffle_epi32(s1, 0xB1);
+    s0 = _mm_blend_epi16(t1, t2, 0xF0);
+    s1 = _mm_alignr_epi8(t2, t1, 0x08);
+}
+
+/** Four rounds, using message words m and round constants k1:k0. */
+inline void QuadRound(__m128i &s0, __m128i &s1, __m128i m, uint64_t k1,
+                      uint64_t k0) {
+    const __m128i msg = _mm_add_epi32(m, _mm_set_epi64x(k1, k0));
+    s1 = _mm_sha256rnds2_epu32(s1, s0, msg);
+    s0 = _mm_sha256rnds2_epu32(s0, s1, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/** First half of the message schedule: m0 += sigma0(m0..m1). */
+inline void ShiftMessageA(__m128i &m0, __m128i m1) {
+    m0 = _mm_sha256msg1_epu32(m0, m1);
+}
+
+/** Second half: compute the next four message words into m2. */
+inline void ShiftMessageC(__m128i m0, __m128i m1, __m128i &m2) {
+    m2 = _mm_sha256msg2_epu32(_mm_add_epi32(m2, _mm_alignr_epi8(m1, m0, 4)),
+                              m1);
+}
+
+inline void ShiftMessageB(__m128i &m0, __m128i m1, __m128i &m2) {
+    ShiftMessageC(m0, m1, m2);
+    ShiftMessageA(m0, m1);
+}
+
+/**
+ * Run one SHA-256 compression of the message words m0..m3 on the shuffled
+ * state s0/s1.
+ */
+inline void Compress(__m128i &s0, __m128i &s1, __m128i m0, __m128i m1,
+                     __m128i m2, __m128i m3) {
+    const __m128i so0 = s0, so1 = s1;
+
+    QuadRound(s0, s1, m0, 0xe9b5dba5b5c0fbcfull, 0x71374491428a2f98ull);
+    QuadRound(s0, s1, m1, 0xab1c5ed5923f82a4ull, 0x59f111f13956c25bull);
+    ShiftMessageA(m0, m1);
+    QuadRound(s0, s1, m2, 0x550c7dc3243185beull, 0x12835b01d807aa98ull);
+    ShiftMessageA(m1, m2);
+    QuadRound(s0, s1, m3, 0xc19bf1749bdc06a7ull, 0x80deb1fe72be5d74ull);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 0x240ca1cc0fc19dc6ull, 0xefbe4786e49b69c1ull);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 0x76f988da5cb0a9dcull, 0x4a7484aa2de92c6full);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 0xbf597fc7b00327c8ull, 0xa831c66d983e5152ull);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 0x1429296706ca6351ull, 0xd5a79147c6e00bf3ull);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 0x53380d134d2c6dfcull, 0x2e1b213827b70a85ull);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 0x92722c8581c2c92eull, 0x766a0abb650a7354ull);
+    ShiftMessageB(m0, m1, m2);
+    QuadRound(s0, s1, m2, 0xc76c51a3c24b8b70ull, 0xa81a664ba2bfe8a1ull);
+    ShiftMessageB(m1, m2, m3);
+    QuadRound(s0, s1, m3, 0x106aa070f40e3585ull, 0xd6990624d192e819ull);
+    ShiftMessageB(m2, m3, m0);
+    QuadRound(s0, s1, m0, 0x34b0bcb52748774cull, 0x1e376c0819a4c116ull);
+    ShiftMessageB(m3, m0, m1);
+    QuadRound(s0, s1, m1, 0x682e6ff35b9cca4full, 0x4ed8aa4a391c0cb3ull);
+    ShiftMessageC(m0, m1, m2);
+    QuadRound(s0, s1, m2, 0x8cc7020884c87814ull, 0x78a5636f748f82eeull);
+    ShiftMessageC(m1, m2, m3);
+    QuadRound(s0, s1, m3, 0xc67178f2bef9a3f7ull, 0xa4506ceb90befffaull);
+
+    s0 = _mm_add_epi32(s0, so0);
+    s1 = _mm_add_epi32(s1, so1);
+}
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t *s, const uint8_t *chunk, size_t blocks) {
+    __m128i s0 = _mm_loadu_si128((const __m128i *)s);
+    __m128i s1 = _mm_loadu_si128((const __m128i *)(s + 4));
+    Shuffle(s0, s1);
+
+    while (blocks--) {
+        Compress(s0, s1, Load(chunk), Load(chunk + 16), Load(chunk + 32),
+                 Load(chunk + 48));
+        chunk += 64;
+    }
+
+    Unshuffle(s0, s1);
+    _mm_storeu_si128((__m128i *)s, s0);
+    _mm_storeu_si128((__m128i *)(s + 4), s1);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani {
+void Transform_2way(uint8_t *out, const uint8_t *in) {
+    // Initial state, already in the ABEF/CDGH layout.
+    const __m128i init0 =
+        _mm_set_epi64x(0x6a09e667bb67ae85ull, 0x510e527f9b05688cull);
+    const __m128i init1 =
+        _mm_set_epi64x(0x3c6ef372a54ff53aull, 0x1f83d9ab5be0cd19ull);
+    // Padding of a 64-byte and of a 32-byte message.
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i pad64_0 = _mm_set_epi64x(0, 0x80000000ull);
+    const __m128i pad64_3 = _mm_set_epi64x(0x20000000000ull, 0);
+    const __m128i pad32_3 = _mm_set_epi64x(0x10000000000ull, 0);
+
+    // The two inputs are independent, so the CPU can overlap their rounds.
+    __m128i as0 = init0, as1 = init1, bs0 = init0, bs1 = init1;
+    Compress(as0, as1, Load(in), Load(in + 16), Load(in + 32), Load(in + 48));
+    Compress(bs0, bs1, Load(in + 64), Load(in + 80), Load(in + 96),
+             Load(in + 112));
+    Compress(as0, as1, pad64_0, zero, zero, pad64_3);
+    Compress(bs0, bs1, pad64_0, zero, zero, pad64_3);
+
+    // The first hashes, as message words, are the unshuffled states.
+    Unshuffle(as0, as1);
+    Unshuffle(bs0, bs1);
+    __m128i at0 = init0, at1 = init1, bt0 = init0, bt1 = init1;
+    Compress(at0, at1, as0, as1, pad64_0, pad32_3);
+    Compress(bt0, bt1, bs0, bs1, pad64_0, pad32_3);
+
+    Unshuffle(at0, at1);
+    Unshuffle(bt0, bt1);
+    Save(out, at0);
+    Save(out + 16, at1);
+    Save(out + 32, bt0);
+    Save(out + 48, bt1);
+}
+} // namespace sha256d64_shani
+
+#endif
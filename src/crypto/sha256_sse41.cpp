@@ -0,0 +1,160 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+// This is a 4-way SHA-256 implementation using SSE4.1, computing the double
+// SHA-256 of 4 independent 64-byte inputs at once. Each 128-bit register
+// holds the same state or message word for the 4 inputs.
+
+#if defined(ENABLE_SSE41)
+
+#include <cstdint>
+#include <immintrin.h>
+
+#include "crypto/common.h"
+
+namespace sha256d64_sse41 {
+namespace {
+
+const uint32_t K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1,
+    0x923f82a4, 0xab1c5ed5, 0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+    0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174, 0xe49b69c1, 0xefbe4786,
+    0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147,
+    0x06ca6351, 0x14292967, 0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+    0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85, 0xa2bfe8a1, 0xa81a664b,
+    0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a,
+    0x5b9cca4f, 0x682e6ff3, 0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+    0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2};
+
+inline __m128i Const(uint32_t x) { return _mm_set1_epi32(x); }
+inline __m128i Add(__m128i x, __m128i y) { return _mm_add_epi32(x, y); }
+inline __m128i Xor(__m128i x, __m128i y) { return _mm_xor_si128(x, y); }
+inline __m128i Or(__m128i x, __m128i y) { return _mm_or_si128(x, y); }
+inline __m128i And(__m128i x, __m128i y) { return _mm_and_si128(x, y); }
+inline __m128i ShR(__m128i x, int n) { return _mm_srli_epi32(x, n); }
+inline __m128i Rotr(__m128i x, int n) {
+    return Or(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
+
+inline __m128i Ch(__m128i x, __m128i y, __m128i z) {
+    return Xor(z, And(x, Xor(y, z)));
+}
+inline __m128i Maj(__m128i x, __m128i y, __m128i z) {
+    return Or(And(x, y), And(z, Or(x, y)));
+}
+inline __m128i Sigma0(__m128i x) {
+    return Xor(Xor(Rotr(x, 2), Rotr(x, 13)), Rotr(x, 22));
+}
+inline __m128i Sigma1(__m128i x) {
+    return Xor(Xor(Rotr(x, 6), Rotr(x, 11)), Rotr(x, 25));
+}
+inline __m128i sigma0(__m128i x) {
+    return Xor(Xor(Rotr(x, 7), Rotr(x, 18)), ShR(x, 3));
+}
+inline __m128i sigma1(__m128i x) {
+    return Xor(Xor(Rotr(x, 17), Rotr(x, 19)), ShR(x, 10));
+}
+
+inline void Initialize(__m128i *s) {
+    s[0] = Const(0x6a09e667ul);
+    s[1] = Const(0xbb67ae85ul);
+    s[2] = Const(0x3c6ef372ul);
+    s[3] = Const(0xa54ff53aul);
+    s[4] = Const(0x510e527ful);
+    s[5] = Const(0x9b05688cul);
+    s[6] = Const(0x1f83d9abul);
+    s[7] = Const(0x5be0cd19ul);
+}
+
+/**
+ * Run one SHA-256 compression on each lane of s. w holds the 16 message words
+ * and is overwritten by the message schedule.
+ */
+void Compress(__m128i *s, __m128i *w) {
+    __m128i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5],
+            g = s[6], h = s[7];
+    for (int i = 0; i < 64; i++) {
+        if (i >= 16) {
+            w[i & 15] = Add(Add(w[i & 15], sigma1(w[(i - 2) & 15])),
+                            Add(w[(i - 7) & 15], sigma0(w[(i - 15) & 15])));
+        }
+        __m128i t1 = Add(Add(Add(h, Sigma1(e)), Add(Ch(e, f, g), Const(K[i]))),
+                         w[i & 15]);
+        __m128i t2 = Add(Sigma0(a), Maj(a, b, c));
+        h = g;
+        g = f;
+        f = e;
+        e = Add(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = Add(t1, t2);
+    }
+    s[0] = Add(s[0], a);
+    s[1] = Add(s[1], b);
+    s[2] = Add(s[2], c);
+    s[3] = Add(s[3], d);
+    s[4] = Add(s[4], e);
+    s[5] = Add(s[5], f);
+    s[6] = Add(s[6], g);
+    s[7] = Add(s[7], h);
+}
+
+/** Read the big endian word at offset of each of the 4 64-byte inputs. */
+inline __m128i Read4(const uint8_t *in, int offset) {
+    return _mm_set_epi32(
+        ReadBE32(in + 192 + offset),
+        ReadBE32(in + 128 + offset),
+        ReadBE32(in + 64 + offset),
+        ReadBE32(in + offset));
+}
+
+/** Write lane i of v as a big endian word at offset of the i-th output. */
+inline void Write4(uint8_t *out, int offset, __m128i v) {
+    WriteBE32(out + offset, _mm_extract_epi32(v, 0));
+    WriteBE32(out + 32 + offset, _mm_extract_epi32(v, 1));
+    WriteBE32(out + 64 + offset, _mm_extract_epi32(v, 2));
+    WriteBE32(out + 96 + offset, _mm_extract_epi32(v, 3));
+}
+
+} // namespace
+
+void Transform_4way(uint8_t *out, const uint8_t *in) {
+    __m128i s[8], t[8], w[16];
+
+    // First hash: the input block, followed by the padding of a 64-byte
+    // message.
+    Initialize(s);
+    for (int i = 0; i < 16; i++) {
+        w[i] = Read4(in, 4 * i);
+    }
+    Compress(s, w);
+    w[0] = Const(0x80000000ul);
+    for (int i = 1; i < 15; i++) {
+        w[i] = Const(0);
+    }
+    w[15] = Const(512);
+    Compress(s, w);
+
+    // Second hash: the 32-byte result of the first one, and its padding.
+    Initialize(t);
+    for (int i = 0; i < 8; i++) {
+        w[i] = s[i];
+    }
+    w[8] = Const(0x80000000ul);
+    for (int i = 9; i < 15; i++) {
+        w[i] = Const(0);
+    }
+    w[15] = Const(256);
+    Compress(t, w);
+
+    for (int i = 0; i < 8; i++) {
+        Write4(out, 4 * i, t[i]);
+    }
+}
+} // namespace sha256d64_sse41
+
+#endif
@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "equihashcache.h"
+
+#include "crypto/sha256.h"
+#include "cuckoocache.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "script/sigcache.h"
+#include "util.h"
+
+#include <atomic>
+
+#include <boost/thread.hpp>
+
+namespace {
+
+/**
+ * Cache of headers whose Equihash solution is known to be valid, so that a
+ * solution is verified only once even though the same header reaches us in
+ * HEADERS, CMPCTBLOCK and BLOCK messages and gets read back from disk.
+ *
+ * Unlike the script execution cache, lookups happen without cs_main held
+ * (see BatchCheckEquihashSolutions), so the cache has its own lock.
+ */
+class CEquihashCache {
+private:
+    //! Entries are SHA256(nonce || header hash)
+    uint256 nonce;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
+    map_type setValid;
+    boost::shared_mutex cs_equihashcache;
+    std::atomic<uint64_t> nHits;
+    std::atomic<uint64_t> nMisses;
+    std::atomic<size_t> nMaxElements;
+
+public:
+    CEquihashCache() : nHits(0), nMisses(0) {
+        GetRandBytes(nonce.begin(), 32);
+        // Usable before InitEquihashCache is called, eg. in the benchmarks.
+        nMaxElements = setValid.setup_bytes(0);
+    }
+
+    void ComputeEntry(uint256 &entry, const uint256 &hash) {
+        CSHA256()
+            .Write(nonce.begin(), 32)
+            .Write(hash.begin(), 32)
+            .Finalize(entry.begin());
+    }
+
+    bool Get(const uint256 &entry) {
+        bool fFound;
+        {
+            boost::shared_lock<boost::shared_mutex> lock(cs_equihashcache);
+            fFound = setValid.contains(entry, false);
+        }
+        if (fFound) {
+            nHits++;
+        } else {
+            nMisses++;
+        }
+        return fFound;
+    }
+
+    void Set(uint256 entry) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_equihashcache);
+        setValid.insert(entry);
+    }
+
+    size_t setup_bytes(size_t n) {
+        boost::unique_lock<boost::shared_mutex> lock(cs_equihashcache);
+        nMaxElements = setValid.setup_bytes(n);
+        return nMaxElements;
+    }
+
+    EquihashCacheStats GetStats() const {
+        return {nHits, nMisses, nMaxElements};
+    }
+};
+
+static CEquihashCache equihashCache;
+}
+
+void InitEquihashCache() {
+    // nMaxCacheSize is unsigned. If -equihashcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    size_t nMaxCacheSize =
+        std::min(std::max(int64_t(0), GetArg("-equihashcachesize",
+                                             DEFAULT_EQUIHASH_CACHE_SIZE)),
+                 MAX_EQUIHASH_CACHE_SIZE) *
+        (size_t(1) << 20);
+    size_t nElems = equihashCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for equihash cache, able to "
+              "store %zu elements\n",
+              (nElems * sizeof(uint256)) >> 20, nMaxCacheSize >> 20, nElems);
+}
+
+uint256 GetEquihashCacheKey(const CBlockHeader &header) {
+    uint256 key;
+    equihashCache.ComputeEntry(key, header.GetHash());
+    return key;
+}
+
+bool IsKeyInEquihashCache(const uint256 &key) {
+    return equihashCache.Get(key);
+}
+
+void AddKeyInEquihashCache(const uint256 &key) {
+    equihashCache.Set(key);
+}
+
+EquihashCacheStats GetEquihashCacheStats() {
+    return equihashCache.GetStats();
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_EQUIHASHCACHE_H
+#define BITCOIN_EQUIHASHCACHE_H
+
+#include "uint256.h"
+
+#include <cstdint>
+
+class CBlockHeader;
+
+// Each entry is a 32 bytes hash, so 4MB fits over 130000 headers, which is
+// plenty to cover everything we see more than once while syncing.
+static const unsigned int DEFAULT_EQUIHASH_CACHE_SIZE = 4;
+// Maximum equihash cache size allowed
+static const int64_t MAX_EQUIHASH_CACHE_SIZE = 16384;
+
+/** Cache statistics, as reported by getequihashcacheinfo */
+struct EquihashCacheStats {
+    uint64_t nHits;
+    uint64_t nMisses;
+    size_t nMaxElements;
+};
+
+/** Initializes the cache of verified Equihash solutions */
+void InitEquihashCache();
+
+/**
+ * Compute the cache key for a given header. The header hash commits to the
+ * Equihash solution, so a hit means this exact solution was already verified.
+ */
+uint256 GetEquihashCacheKey(const CBlockHeader &header);
+
+/** Check if a given key is in the cache, and account for a hit or a miss. */
+bool IsKeyInEquihashCache(const uint256 &key);
+
+/** Add an entry in the cache. */
+void AddKeyInEquihashCache(const uint256 &key);
+
+EquihashCacheStats GetEquihashCacheStats();
+
+#endif // BITCOIN_EQUIHASHCACHE_H
@@ -11,12 +11,16 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "config.h"
 #include "consensus/validation.h"
+#include "crypto/blake2b.h"
+#include "crypto/sha256.h"
+#include "equihashcache.h"
 #include "httprpc.h"
 #include "httpserver.h"
 #include "key.h"
@@ -24,6 +28,7 @@
 #include "net.h"
 #include "net_processing.h"
 #include "netbase.h"
+#include "netmsgstats.h"
 #include "policy/policy.h"
 #include "rpc/register.h"
 #include "rpc/server.h"
@@ -65,6 +70,7 @@
 
 #if ENABLE_ZMQ
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqpublishnotifier.h"
 #endif
 
 bool fFeeEstimatesInitialized = false;
@@ -197,6 +203,7 @@ void Shutdown() {
     StopREST();
     StopRPC();
     StopHTTPServer();
+    StopEquihashSolverThreads();
 #ifdef ENABLE_WALLET
     if (pwalletMain) pwalletMain->Flush(false);
 #endif
@@ -228,8 +235,19 @@ void Shutdown() {
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+    }
+
+    // The scheduler thread is gone: deliver what is left in the validation
+    // notification queue, including the SetBestChain generated by
+    // FlushStateToDisk, before the subscribers go away.
+    GetMainSignals().FlushBackgroundCallbacks();
+
+    {
+        LOCK(cs_main);
         delete pcoinsTip;
         pcoinsTip = nullptr;
+        delete pcoinsWriter;
+        pcoinsWriter = nullptr;
         delete pcoinscatcher;
         pcoinscatcher = nullptr;
         delete pcoinsdbview;
@@ -257,6 +275,7 @@ void Shutdown() {
     }
 #endif
     UnregisterAllValidationInterfaces();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
 #ifdef ENABLE_WALLET
     delete pwalletMain;
     pwalletMain = nullptr;
@@ -358,6 +377,12 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(
             _("Set database cache size in megabytes (%d to %d, default: %d)"),
             nMinDbCache, nMaxDbCache, nDefaultDbCache));
+    strUsage += HelpMessageOpt(
+        "-backgroundflush",
+        strprintf(_("Write the UTXO cache to disk on a separate thread once "
+                    "it takes half of -dbcache, instead of stalling block "
+                    "processing when it is full (default: %u)"),
+                  DEFAULT_BACKGROUND_FLUSH));
     if (showDebug) {
         strUsage += HelpMessageOpt(
             "-feefilter", strprintf("Tell other nodes to filter invs to us by "
@@ -488,6 +513,17 @@ std::string HelpMessage(HelpMessageMode mode) {
         "-maxsendbuffer=<n>", strprintf(_("Maximum per-connection send buffer, "
                                           "<n>*1000 bytes (default: %u)"),
                                         DEFAULT_MAXSENDBUFFER));
+    strUsage += HelpMessageOpt(
+        "-msgworkerthreads=<n>",
+        strprintf(_("Number of threads processing the peer messages that "
+                    "don't wait on block validation, such as pings and "
+                    "addresses (0-%d, default: %d)"),
+                  MAX_MSG_WORKER_THREADS, DEFAULT_MSG_WORKER_THREADS));
+    strUsage += HelpMessageOpt(
+        "-msgstatsinterval=<n>",
+        strprintf(_("Log statistics on the processing of peer messages every "
+                    "<n> seconds, 0 = never (default: %d)"),
+                  DEFAULT_MSG_STATS_INTERVAL));
     strUsage += HelpMessageOpt(
         "-maxtimeadjustment",
         strprintf(_("Maximum allowed median peer time offset adjustment. Local "
@@ -575,6 +611,11 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(_("Tries to keep outbound traffic under the given target (in "
                     "MiB per 24h), 0 = no limit (default: %d)"),
                   DEFAULT_MAX_UPLOAD_TARGET));
+    strUsage += HelpMessageOpt(
+        "-blockcachesize=<n>",
+        strprintf(_("Keep up to <n> MiB of recently served blocks and compact "
+                    "blocks in their serialized form (default: %u)"),
+                  DEFAULT_BLOCK_CACHE_SIZE));
 
     strUsage += HelpMessageOpt("-bootstrap", _("Enables Bitcoin Candy bootstrap mode. Allows CDY client to connect to Bitcoin p2p network to download blockahin history."));
     strUsage += HelpMessageOpt("-skiphardforkibd", _("Skip Initial Block Download when reaching hardfork block."));
@@ -591,6 +632,15 @@ std::string HelpMessage(HelpMessageMode mode) {
                        _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>",
                                _("Enable publish raw block in <address>"));
+    strUsage += HelpMessageOpt(
+        "-zmqpubrawblocktemplate=<address>",
+        _("Enable publish raw block template in <address>"));
+    strUsage += HelpMessageOpt(
+        "-zmqrawblocktemplatefeedelta=<amt>",
+        strprintf(_("Publish a new block template when its fees rose by at "
+                    "least <amt> (in %s) (default: %s)"),
+                  CURRENCY_UNIT,
+                  FormatMoney(DEFAULT_ZMQ_BLOCK_TEMPLATE_FEE_DELTA)));
     strUsage +=
         HelpMessageOpt("-zmqpubrawtx=<address>",
                        _("Enable publish raw transaction in <address>"));
@@ -617,6 +667,12 @@ std::string HelpMessage(HelpMessageMode mode) {
                 "setBlockIndexCandidates, chainActive and mapBlocksUnlinked "
                 "occasionally. Also sets -checkmempool (default: %d)",
                 Params(CBaseChainParams::MAIN).DefaultConsistencyChecks()));
+        strUsage += HelpMessageOpt(
+            "-checkblockreads",
+            strprintf("Re-verify the Equihash solution and proof of work of "
+                      "already validated blocks when reading them from disk "
+                      "(default: %d)",
+                      DEFAULT_CHECK_BLOCK_READS));
         strUsage += HelpMessageOpt(
             "-checkmempool=<n>",
             strprintf(
@@ -728,6 +784,11 @@ std::string HelpMessage(HelpMessageMode mode) {
             "-maxscriptcachesize=<n>",
             strprintf("Limit size of script cache to <n> MiB (default: %u)",
                       DEFAULT_MAX_SCRIPT_CACHE_SIZE));
+        strUsage += HelpMessageOpt(
+            "-equihashcachesize=<n>",
+            strprintf("Limit size of the cache of verified Equihash solutions "
+                      "to <n> MiB (default: %u)",
+                      DEFAULT_EQUIHASH_CACHE_SIZE));
         strUsage += HelpMessageOpt(
             "-maxtipage=<n>",
             strprintf("Maximum tip age in seconds to consider node in initial "
@@ -822,6 +883,16 @@ std::string HelpMessage(HelpMessageMode mode) {
         strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be "
                     "included in block creation. (default: %s)"),
                   CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
+    strUsage += HelpMessageOpt(
+        "-genproclimit=<n>",
+        strprintf(_("Set the number of threads used to solve Equihash in the "
+                    "generate RPCs (-1 = all cores, default: %d)"),
+                  DEFAULT_GENERATE_THREADS));
+    strUsage += HelpMessageOpt(
+        "-generatetimeout=<n>",
+        strprintf(_("Give up solving a block in the generate RPCs after <n> "
+                    "seconds (0 = no timeout, default: %d)"),
+                  DEFAULT_GENERATE_TIMEOUT));
     if (showDebug) {
         strUsage +=
             HelpMessageOpt("-blockversion=<n>",
@@ -1335,20 +1406,28 @@ bool AppInitParameterInteraction(Config &config) {
         GetArg("-maxconnections", DEFAULT_MAX_PEER_CONNECTIONS);
     nMaxConnections = std::max(nUserMaxConnections, 0);
 
-    // Trim requested connection counts, to fit into system limitations
+    // Trim requested connection counts, to fit into system limitations. With
+    // epoll, only the file descriptor limit applies, less the listening
+    // sockets and the epoll instance itself.
+#ifdef USE_EPOLL
+    int nReservedFD = nBind + 1;
+#else
+    int nReservedFD = 0;
     nMaxConnections =
         std::max(std::min(nMaxConnections,
                           (int)(FD_SETSIZE - nBind - MIN_CORE_FILEDESCRIPTORS -
                                 MAX_ADDNODE_CONNECTIONS)),
                  0);
-    nFD = RaiseFileDescriptorLimit(nMaxConnections + MIN_CORE_FILEDESCRIPTORS +
+#endif
+    nFD = RaiseFileDescriptorLimit(nMaxConnections + nReservedFD +
+                                   MIN_CORE_FILEDESCRIPTORS +
                                    MAX_ADDNODE_CONNECTIONS);
     if (nFD < MIN_CORE_FILEDESCRIPTORS) {
         return InitError(_("Not enough file descriptors available."));
     }
-    nMaxConnections =
-        std::min(nFD - MIN_CORE_FILEDESCRIPTORS - MAX_ADDNODE_CONNECTIONS,
-                 nMaxConnections);
+    nMaxConnections = std::min(nFD - nReservedFD - MIN_CORE_FILEDESCRIPTORS -
+                                   MAX_ADDNODE_CONNECTIONS,
+                               nMaxConnections);
 
     if (nMaxConnections < nUserMaxConnections) {
         InitWarning(strprintf(_("Reducing -maxconnections from %d to %d, "
@@ -1405,6 +1484,8 @@ bool AppInitParameterInteraction(Config &config) {
         GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled =
         GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    fCheckBlockReads =
+        GetBoolArg("-checkblockreads", DEFAULT_CHECK_BLOCK_READS);
 
     hashAssumeValid = uint256S(
         GetArg("-assumevalid",
@@ -1659,6 +1740,11 @@ static bool LockDataDirectory(bool probeOnly) {
 bool AppInitSanityChecks() {
     // Step 4: sanity checks
 
+    std::string sha256_algo = SHA256AutoDetect();
+    LogPrintf("Using the '%s' SHA256 implementation\n", sha256_algo);
+    std::string blake2b_algo = Blake2bAutoDetect();
+    LogPrintf("Using the '%s' BLAKE2b implementation\n", blake2b_algo);
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1714,12 +1800,17 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitEquihashCache();
+    InitSerializedBlockCache();
 
     LogPrintf("Using %u threads for script verification\n",
               nScriptCheckThreads);
     if (nScriptCheckThreads) {
         for (int i = 0; i < nScriptCheckThreads - 1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadEquihashCheck);
+            threadGroup.create_thread(&ThreadCoinPrefetch);
+            threadGroup.create_thread(&ThreadMempoolScriptCheck);
         }
     }
 
@@ -1732,6 +1823,9 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
     threadGroup.create_thread(boost::bind(&TraceThread<CScheduler::Function>,
                                           "scheduler", serviceLoop));
 
+    // Deliver validation notifications on it, outside of cs_main
+    GetMainSignals().RegisterBackgroundSignalScheduler(scheduler);
+
     /* Start the RPC server already.  It will be started in "warmup" mode
      * and not really process calls already (but it will signify connections
      * that the server is there and will be ready later).  Warmup mode will
@@ -2007,6 +2101,7 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsWriter;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
@@ -2016,7 +2111,8 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false,
                                                 fReindex || fReindexChainState);
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinsWriter = new CCoinsViewBackgroundWriter(pcoinscatcher);
+                pcoinsTip = new CCoinsViewCache(pcoinsWriter);
 
                 if (fReindex) {
                     pblocktree->WriteReindexing(true);
@@ -2106,7 +2202,7 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
                 }
 
                 if (!CVerifyDB().VerifyDB(
-                        config, pcoinsdbview,
+                        config, pcoinsWriter,
                         GetArg("-checklevel", DEFAULT_CHECKLEVEL),
                         GetArg("-checkblocks", DEFAULT_CHECKBLOCKS))) {
                     strLoadError = _("Corrupted block database detected");
@@ -2252,6 +2348,10 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
         1000 * GetArg("-maxsendbuffer", DEFAULT_MAXSENDBUFFER);
     connOptions.nReceiveFloodSize =
         1000 * GetArg("-maxreceivebuffer", DEFAULT_MAXRECEIVEBUFFER);
+    connOptions.nMsgWorkerThreads =
+        std::min(std::max(0, int(GetArg("-msgworkerthreads",
+                                         DEFAULT_MSG_WORKER_THREADS))),
+                 MAX_MSG_WORKER_THREADS);
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
@@ -2260,6 +2360,12 @@ bool AppInitMain(Config &config, boost::thread_group &threadGroup,
         return InitError(strNodeError);
     }
 
+    int64_t nMsgStatsInterval =
+        GetArg("-msgstatsinterval", DEFAULT_MSG_STATS_INTERVAL);
+    if (nMsgStatsInterval > 0) {
+        scheduler.scheduleEvery(&LogNetMsgStats, nMsgStatsInterval);
+    }
+
     // Step 12: finished
 
     SetRPCWarmupFinished();
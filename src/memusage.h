@@ -6,6 +6,7 @@
 #define BITCOIN_MEMUSAGE_H
 
 #include "indirectmap.h"
+#include "support/allocators/pool.h"
 
 #include <cstdlib>
 
@@ -16,6 +17,9 @@
 #include <unordered_map>
 #include <unordered_set>
 
+template <unsigned int N, typename T, typename Size, typename Diff>
+class prevector;
+
 namespace memusage {
 
 /** Compute the total memory used by allocating alloc bytes. */
@@ -178,6 +182,30 @@ static inline size_t DynamicUsage(const std::unordered_map<X, Y, Z> &m) {
                m.size() +
            MallocUsage(sizeof(void *) * m.bucket_count());
 }
+
+/**
+ * With a PoolResource, the nodes use exactly the chunks it allocated, each
+ * also tracked in a std::list node of three pointers. Only bucket arrays too
+ * large for the pool are allocated separately.
+ */
+template <typename X, typename Y, typename Z, typename E, size_t MAX_BLOCK,
+          size_t ALIGN>
+static inline size_t DynamicUsage(
+    const std::unordered_map<
+        X, Y, Z, E, PoolAllocator<std::pair<const X, Y>, MAX_BLOCK, ALIGN>>
+        &m) {
+    const auto *resource = m.get_allocator().resource();
+    if (resource == nullptr) {
+        return MallocUsage(sizeof(unordered_node<std::pair<const X, Y>>)) *
+                   m.size() +
+               MallocUsage(sizeof(void *) * m.bucket_count());
+    }
+    const size_t bucket_bytes = sizeof(void *) * m.bucket_count();
+    return (MallocUsage(resource->ChunkSizeBytes()) +
+            MallocUsage(sizeof(void *) * 3)) *
+               resource->NumAllocatedChunks() +
+           (bucket_bytes > MAX_BLOCK ? MallocUsage(bucket_bytes) : 0);
+}
 }
 
 #endif // BITCOIN_MEMUSAGE_H
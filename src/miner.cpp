@@ -6,19 +6,25 @@
 #include "miner.h"
 
 #include "amount.h"
+#include "arith_uint256.h"
 #include "chain.h"
 #include "chainparams.h"
+#include "checkqueue.h"
 #include "coins.h"
 #include "config.h"
 #include "consensus/consensus.h"
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
+#include "crypto/equihash.h"
 #include "hash.h"
+#include "init.h"
 #include "net.h"
 #include "policy/policy.h"
 #include "pow.h"
 #include "primitives/transaction.h"
 #include "script/standard.h"
+#include "streams.h"
+#include "sync.h"
 #include "timedata.h"
 #include "txmempool.h"
 #include "util.h"
@@ -27,9 +33,12 @@
 #include "validationinterface.h"
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <queue>
 #include <utility>
 
+#include <boost/bind/bind.hpp>
 #include <boost/thread.hpp>
 #include <boost/tuple/tuple.hpp>
 
@@ -109,7 +118,7 @@ static uint64_t ComputeMaxGeneratedBlockSize(const Config &config,
 
 BlockAssembler::BlockAssembler(const Config &_config,
                                const CChainParams &_chainparams)
-    : chainparams(_chainparams), config(&_config) {
+    : pindexPrev(nullptr), chainparams(_chainparams), config(&_config) {
     if (IsArgSet("-blockmintxfee")) {
         Amount n(0);
         ParseMoney(GetArg("-blockmintxfee", ""), n);
@@ -136,6 +145,7 @@ void BlockAssembler::resetBlock() {
 
     lastFewTxs = 0;
     blockFinished = false;
+    lowestPackageFeeRate = CFeeRate(MAX_MONEY);
 }
 
 static const std::vector<uint8_t>
@@ -168,9 +178,9 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     pblocktemplate->vTxSigOpsCount.push_back(-1);
 
     LOCK2(cs_main, mempool.cs);
-    CBlockIndex *pindexPrev = chainActive.Tip();
+    pindexPrev = chainActive.Tip();
     nHeight = pindexPrev->nHeight + 1;
-    
+
     pblock->nVersion =
         ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
     // -regtest only: allow overriding block.nVersion with
@@ -194,6 +204,34 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
 
     int64_t nTime1 = GetTimeMicros();
 
+    FinishBlock(scriptPubKeyIn);
+
+    const Consensus::Params &params = chainparams.GetConsensus();
+    int ser_flags = (nHeight < params.cdyHeight) ? SERIALIZE_BLOCK_LEGACY : 0;
+    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION | ser_flags);
+
+    LogPrintf("CreateNewBlock(): total size: %u txs: %u fees: %ld sigops %d\n",
+              nSerializeSize, nBlockTx, nFees, nBlockSigOps);
+
+    CValidationState state;
+    if (!TestBlockValidity(*config, state, *pblock, pindexPrev, false, false)) {
+        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s",
+                                           __func__,
+                                           FormatStateMessage(state)));
+    }
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint("bench", "CreateNewBlock() packages: %.2fms (%d packages, %d "
+                      "updated descendants), validity: %.2fms (total %.2fms)\n",
+             0.001 * (nTime1 - nTimeStart), nPackagesSelected,
+             nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
+             0.001 * (nTime2 - nTimeStart));
+
+    // The block is kept, for UpdateNewBlock to add to.
+    return std::unique_ptr<CBlockTemplate>(new CBlockTemplate(*pblocktemplate));
+}
+
+void BlockAssembler::FinishBlock(const CScript &scriptPubKeyIn) {
     nLastBlockTx = nBlockTx;
     nLastBlockSize = nBlockSize;
 
@@ -209,13 +247,7 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     pblock->vtx[0] = MakeTransactionRef(coinbaseTx);
     pblocktemplate->vTxFees[0] = -1 * nFees;
 
-    const Consensus::Params& params = chainparams.GetConsensus();
-    int ser_flags = (nHeight < params.cdyHeight) ? SERIALIZE_BLOCK_LEGACY : 0;
-    uint64_t nSerializeSize = GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION | ser_flags);
-
-    LogPrintf("CreateNewBlock(): total size: %u txs: %u fees: %ld sigops %d\n",
-              nSerializeSize, nBlockTx, nFees, nBlockSigOps);
-
+    const Consensus::Params &params = chainparams.GetConsensus();
     arith_uint256 nonce;
     if (nHeight >= params.cdyHeight) {
         // Randomise nonce for new block foramt.
@@ -234,22 +266,79 @@ BlockAssembler::CreateNewBlock(const CScript &scriptPubKeyIn) {
     pblock->nSolution.clear();
     pblocktemplate->vTxSigOpsCount[0] =
         GetSigOpCountWithoutP2SH(*pblock->vtx[0]);
+}
 
-    CValidationState state;
-    if (!TestBlockValidity(*config, state, *pblock, pindexPrev, false, false)) {
-        throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s",
-                                           __func__,
-                                           FormatStateMessage(state)));
+std::unique_ptr<CBlockTemplate>
+BlockAssembler::UpdateNewBlock(const CScript &scriptPubKeyIn,
+                               const std::vector<uint256> &vAdded) {
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    if (!pblocktemplate || pindexPrev != chainActive.Tip()) {
+        return nullptr;
     }
-    int64_t nTime2 = GetTimeMicros();
 
-    LogPrint("bench", "CreateNewBlock() packages: %.2fms (%d packages, %d "
-                      "updated descendants), validity: %.2fms (total %.2fms)\n",
-             0.001 * (nTime1 - nTimeStart), nPackagesSelected,
-             nDescendantsUpdated, 0.001 * (nTime2 - nTime1),
-             0.001 * (nTime2 - nTimeStart));
+    // Each new transaction is considered with its ancestors not in the block
+    // yet, as addPackageTxs would once it reached its ancestor score.
+    int nPackagesSelected = 0;
+    for (const uint256 &txid : vAdded) {
+        CTxMemPool::txiter iter = mempool.mapTx.find(txid);
+        if (iter == mempool.mapTx.end() || inBlock.count(iter)) {
+            continue;
+        }
 
-    return std::move(pblocktemplate);
+        CTxMemPool::setEntries ancestors;
+        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+        std::string dummy;
+        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit,
+                                          nNoLimit, nNoLimit, dummy, false);
+        onlyUnconfirmed(ancestors);
+        ancestors.insert(iter);
+
+        uint64_t packageSize = 0;
+        Amount packageFees(0);
+        int64_t packageSigOps = 0;
+        for (const CTxMemPool::txiter it : ancestors) {
+            packageSize += it->GetTxSize();
+            packageFees += it->GetModifiedFee();
+            packageSigOps += it->GetSigOpCount();
+        }
+
+        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+            continue;
+        }
+
+        if (!TestPackage(packageSize, packageSigOps)) {
+            if (CFeeRate(packageFees, packageSize) > lowestPackageFeeRate) {
+                // addPackageTxs would have picked this package before some
+                // which are in the block.
+                return nullptr;
+            }
+            continue;
+        }
+
+        if (!TestPackageTransactions(ancestors)) {
+            continue;
+        }
+
+        std::vector<CTxMemPool::txiter> sortedEntries;
+        SortForBlock(ancestors, iter, sortedEntries);
+        for (const CTxMemPool::txiter it : sortedEntries) {
+            AddToBlock(it);
+        }
+        lowestPackageFeeRate = std::min(lowestPackageFeeRate,
+                                        CFeeRate(packageFees, packageSize));
+        ++nPackagesSelected;
+    }
+
+    FinishBlock(scriptPubKeyIn);
+    int64_t nTime1 = GetTimeMicros();
+
+    LogPrint("bench", "UpdateNewBlock() packages: %.2fms (%d new packages, "
+                      "%u txs)\n",
+             0.001 * (nTime1 - nTimeStart), nPackagesSelected, nBlockTx);
+
+    return std::unique_ptr<CBlockTemplate>(new CBlockTemplate(*pblocktemplate));
 }
 
 bool BlockAssembler::isStillDependent(CTxMemPool::txiter iter) {
@@ -566,6 +655,8 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected,
             mapModifiedTx.erase(sortedEntries[i]);
         }
 
+        lowestPackageFeeRate = std::min(lowestPackageFeeRate,
+                                        CFeeRate(packageFees, packageSize));
         ++nPackagesSelected;
 
         // Update transactions that depend on each of these
@@ -655,6 +746,81 @@ void BlockAssembler::addPriorityTxs() {
     }
 }
 
+BlockTemplateEngine::BlockTemplateEngine(const Config &_config,
+                                         CTxMemPool &_pool)
+    : config(&_config), pool(_pool), fRebuild(true), nLastRebuild(0) {
+    pool.NotifyEntryAdded.connect(
+        boost::bind(&BlockTemplateEngine::TransactionAdded, this,
+                    boost::placeholders::_1));
+    pool.NotifyEntryRemoved.connect(
+        boost::bind(&BlockTemplateEngine::TransactionRemoved, this,
+                    boost::placeholders::_1, boost::placeholders::_2));
+}
+
+BlockTemplateEngine::~BlockTemplateEngine() {
+    pool.NotifyEntryAdded.disconnect(
+        boost::bind(&BlockTemplateEngine::TransactionAdded, this,
+                    boost::placeholders::_1));
+    pool.NotifyEntryRemoved.disconnect(
+        boost::bind(&BlockTemplateEngine::TransactionRemoved, this,
+                    boost::placeholders::_1, boost::placeholders::_2));
+}
+
+void BlockTemplateEngine::TransactionAdded(CTransactionRef tx) {
+    LOCK(cs);
+    if (fRebuild) {
+        return;
+    }
+    vAdded.push_back(tx->GetId());
+    // Nobody asked for a template in a while: start over instead.
+    if (vAdded.size() > pool.size()) {
+        fRebuild = true;
+        vAdded.clear();
+    }
+}
+
+void BlockTemplateEngine::TransactionRemoved(CTransactionRef tx,
+                                             MemPoolRemovalReason reason) {
+    LOCK(cs);
+    if (setInTemplate.count(tx->GetId())) {
+        fRebuild = true;
+        vAdded.clear();
+    }
+}
+
+std::unique_ptr<CBlockTemplate>
+BlockTemplateEngine::CreateNewBlock(const CScript &scriptPubKeyIn) {
+    LOCK2(cs_main, pool.cs);
+    LOCK(cs);
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate;
+    if (!fRebuild && passembler &&
+        GetTime() - nLastRebuild < BLOCK_TEMPLATE_REBUILD_INTERVAL) {
+        pblocktemplate = passembler->UpdateNewBlock(scriptPubKeyIn, vAdded);
+    }
+
+    if (!pblocktemplate) {
+        passembler.reset(new BlockAssembler(*config, config->GetChainParams()));
+        pblocktemplate = passembler->CreateNewBlock(scriptPubKeyIn);
+        nLastRebuild = GetTime();
+        setInTemplate.clear();
+        fRebuild = false;
+    }
+    vAdded.clear();
+
+    // Skip the coinbase, which is not in the mempool.
+    for (size_t i = 1; i < pblocktemplate->block.vtx.size(); i++) {
+        setInTemplate.insert(pblocktemplate->block.vtx[i]->GetId());
+    }
+
+    return pblocktemplate;
+}
+
+BlockTemplateEngine &GetBlockTemplateEngine(const Config &config) {
+    static BlockTemplateEngine engine(config, mempool);
+    return engine;
+}
+
 void IncrementExtraNonce(const Config &config, CBlock *pblock,
                          const CBlockIndex *pindexPrev,
                          unsigned int &nExtraNonce) {
@@ -677,3 +843,152 @@ void IncrementExtraNonce(const Config &config, CBlock *pblock,
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+namespace {
+/** The share of the nonces of one SolveEquihash call tried by one thread. */
+class CEquihashSolveJob {
+private:
+    const std::function<void(int)> *psolver;
+    int nThread;
+
+public:
+    CEquihashSolveJob() : psolver(nullptr), nThread(0) {}
+    CEquihashSolveJob(const std::function<void(int)> &solverIn, int nThreadIn)
+        : psolver(&solverIn), nThread(nThreadIn) {}
+
+    bool operator()() {
+        (*psolver)(nThread);
+        return true;
+    }
+
+    void swap(CEquihashSolveJob &job) {
+        std::swap(psolver, job.psolver);
+        std::swap(nThread, job.nThread);
+    }
+};
+
+// Each thread takes a single job at a time.
+CCheckQueue<CEquihashSolveJob> equihashsolvequeue(1);
+// Serializes SolveEquihash calls, as the queue only supports one master, and
+// protects the pool of solver threads, which are started on first use.
+CCriticalSection cs_equihashsolve;
+boost::thread_group equihashSolverThreads;
+int nEquihashSolverThreads = 0;
+
+void ThreadEquihashSolve() {
+    RenameThread("bitcoin-eqsolve");
+    equihashsolvequeue.Thread();
+}
+} // namespace
+
+void StopEquihashSolverThreads() {
+    LOCK(cs_equihashsolve);
+    equihashSolverThreads.interrupt_all();
+    equihashSolverThreads.join_all();
+    nEquihashSolverThreads = 0;
+}
+
+bool SolveEquihash(const Config &config, CBlock *pblock, int nThreads,
+                   uint64_t &nMaxTries, int64_t nDeadline,
+                   EquihashSolverStats &stats) {
+    const CChainParams &params = config.GetChainParams();
+    const unsigned int n = params.EquihashN(pblock->nHeight);
+    const unsigned int k = params.EquihashK(pblock->nHeight);
+
+    // H(I||... where I = the block header minus nonce and solution.
+    crypto_generichash_blake2b_state eh_state;
+    EhInitialiseState(n, k, eh_state,
+                      params.EquihashUseCDYSalt(pblock->nHeight));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CEquihashInput{*pblock};
+    crypto_generichash_blake2b_update(&eh_state, (unsigned char *)&ss[0],
+                                      ss.size());
+
+    std::atomic<bool> fStop(false);
+    std::atomic<uint64_t> nTriesLeft(nMaxTries);
+    std::atomic<uint64_t> nNonces(0);
+    std::atomic<uint64_t> nSolutions(0);
+    CCriticalSection cs_found;
+    bool fFound = false;
+
+    auto fnShouldStop = [&]() {
+        return fStop || ShutdownRequested() ||
+               (nDeadline && GetTimeMicros() > nDeadline);
+    };
+    std::function<bool(EhSolverCancelCheck)> cancelled =
+        [&](EhSolverCancelCheck pos) { return fnShouldStop(); };
+
+    // Job i tries the nonces start + i, start + i + nThreads, ...
+    const arith_uint256 nStartNonce = UintToArith256(pblock->nNonce);
+    const std::function<void(int)> solver = [&](int nThread) {
+        CBlockHeader header = pblock->GetBlockHeader();
+        arith_uint256 nonce = nStartNonce + nThread;
+        std::function<bool(std::vector<unsigned char>)> validBlock =
+            [&](std::vector<unsigned char> soln) {
+                ++nSolutions;
+                header.nSolution = soln;
+                return CheckProofOfWork(header.GetHash(), header.nBits, true,
+                                        config);
+            };
+
+        while (!fnShouldStop()) {
+            uint64_t nLeft = nTriesLeft;
+            do {
+                if (nLeft == 0) {
+                    return;
+                }
+            } while (!nTriesLeft.compare_exchange_weak(nLeft, nLeft - 1));
+
+            header.nNonce = ArithToUint256(nonce);
+            nonce += nThreads;
+            ++nNonces;
+
+            // H(I||V||...
+            crypto_generichash_blake2b_state curr_state = eh_state;
+            crypto_generichash_blake2b_update(&curr_state,
+                                              header.nNonce.begin(),
+                                              header.nNonce.size());
+            try {
+                if (!EhOptimisedSolve(n, k, curr_state, validBlock,
+                                      cancelled)) {
+                    continue;
+                }
+            } catch (const EhSolverCancelledException &) {
+                return;
+            }
+
+            LOCK(cs_found);
+            if (!fFound) {
+                fFound = true;
+                pblock->nNonce = header.nNonce;
+                pblock->nSolution = header.nSolution;
+            }
+            fStop = true;
+            return;
+        }
+    };
+
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK(cs_equihashsolve);
+        // The calling thread does its share of the work as well.
+        while (nEquihashSolverThreads < nThreads - 1) {
+            equihashSolverThreads.create_thread(&ThreadEquihashSolve);
+            nEquihashSolverThreads++;
+        }
+        std::vector<CEquihashSolveJob> vJobs;
+        vJobs.reserve(nThreads);
+        for (int i = 0; i < nThreads; i++) {
+            vJobs.emplace_back(solver, i);
+        }
+        CCheckQueueControl<CEquihashSolveJob> control(&equihashsolvequeue);
+        control.Add(vJobs);
+        control.Wait();
+    }
+
+    nMaxTries = nTriesLeft;
+    stats.nNonces += nNonces;
+    stats.nSolutions += nSolutions;
+    stats.nTimeMicros += GetTimeMicros() - nTimeStart;
+    return fFound;
+}
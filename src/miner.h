@@ -14,6 +14,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <unordered_set>
 
 class CBlockIndex;
 class CChainParams;
@@ -23,6 +24,12 @@ class CScript;
 class CWallet;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Default number of threads generate uses to solve Equihash (-1 = all cores) */
+static const int DEFAULT_GENERATE_THREADS = -1;
+/** Default limit in seconds on the time spent solving one block (0 = none) */
+static const int64_t DEFAULT_GENERATE_TIMEOUT = 0;
+/** Interval in seconds between full rebuilds of updated block templates */
+static const int64_t BLOCK_TEMPLATE_REBUILD_INTERVAL = 60;
 
 struct CBlockTemplate {
     CBlock block;
@@ -142,8 +149,11 @@ private:
     uint64_t nBlockSigOps;
     Amount nFees;
     CTxMemPool::setEntries inBlock;
+    // The lowest fee rate of the packages added by feerate
+    CFeeRate lowestPackageFeeRate;
 
     // Chain context for the block
+    CBlockIndex *pindexPrev;
     int nHeight;
     int64_t nLockTimeCutoff;
     const CChainParams &chainparams;
@@ -159,6 +169,17 @@ public:
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate>
     CreateNewBlock(const CScript &scriptPubKeyIn);
+    /**
+     * Add the packages of transactions which entered the mempool since the
+     * last block was created to it, and return it with coinbase to
+     * scriptPubKeyIn. The transactions in the block must all still be in the
+     * mempool. Returns nullptr if the block has to be created again instead:
+     * the tip changed, or a new package doesn't fit but has a higher feerate
+     * than one in the block.
+     */
+    std::unique_ptr<CBlockTemplate>
+    UpdateNewBlock(const CScript &scriptPubKeyIn,
+                   const std::vector<uint256> &vAdded);
 
     uint64_t GetMaxGeneratedBlockSize() const { return nMaxGeneratedBlockSize; }
 
@@ -168,6 +189,8 @@ private:
     void resetBlock();
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Fill in the coinbase and header of the block */
+    void FinishBlock(const CScript &scriptPubKeyIn);
 
     // Methods for how to add transactions to a block.
     /** Add transactions based on tx "priority" */
@@ -209,10 +232,79 @@ private:
                                indexed_modified_transaction_set &mapModifiedTx);
 };
 
+/**
+ * Block templates kept up to date as transactions enter and leave the mempool.
+ * New transactions are added to the last template with
+ * BlockAssembler::UpdateNewBlock, which takes milliseconds, and the template is
+ * only created again from the whole mempool when the tip changes, a
+ * transaction in it leaves the mempool, a better package doesn't fit, or every
+ * BLOCK_TEMPLATE_REBUILD_INTERVAL seconds, which also checks the
+ * template with TestBlockValidity.
+ */
+class BlockTemplateEngine {
+private:
+    const Config *config;
+    CTxMemPool &pool;
+
+    CCriticalSection cs;
+    //! The transactions which entered the mempool since the last template.
+    std::vector<uint256> vAdded;
+    //! The transactions in the last template.
+    std::unordered_set<uint256, SaltedTxidHasher> setInTemplate;
+    //! Whether the next template has to be created from the whole mempool.
+    bool fRebuild;
+
+    std::unique_ptr<BlockAssembler> passembler;
+    int64_t nLastRebuild;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+
+public:
+    BlockTemplateEngine(const Config &_config, CTxMemPool &_pool);
+    ~BlockTemplateEngine();
+
+    /** Return a block template with coinbase to scriptPubKeyIn. */
+    std::unique_ptr<CBlockTemplate>
+    CreateNewBlock(const CScript &scriptPubKeyIn);
+};
+
+/**
+ * The engine following the global mempool, shared by getblocktemplate and the
+ * block template notifications. It is created with the config of the first
+ * caller.
+ */
+BlockTemplateEngine &GetBlockTemplateEngine(const Config &config);
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(const Config &config, CBlock *pblock,
                          const CBlockIndex *pindexPrev,
                          unsigned int &nExtraNonce);
 int64_t UpdateTime(CBlockHeader *pblock, const Config &config,
                    const CBlockIndex *pindexPrev);
+
+/** Counters of Equihash solver runs. */
+struct EquihashSolverStats {
+    //! Number of nonces the solver was run on.
+    uint64_t nNonces = 0;
+    //! Number of solutions found, whether they met the target or not.
+    uint64_t nSolutions = 0;
+    //! Wall clock time spent solving, in microseconds.
+    int64_t nTimeMicros = 0;
+};
+
+/**
+ * Search for a nonce and Equihash solution meeting the target of pblock, using
+ * nThreads threads which each try their own nonces with the optimised solver.
+ * The calling thread is one of them, the others are kept in a pool from one
+ * call to the next. The search gives up after nMaxTries nonces (decreased by
+ * the number tried), once GetTimeMicros() passes nDeadline (0 for no
+ * deadline), or on shutdown. On success, the nonce and solution of pblock are
+ * set. The counters of the run are added to stats.
+ */
+bool SolveEquihash(const Config &config, CBlock *pblock, int nThreads,
+                   uint64_t &nMaxTries, int64_t nDeadline,
+                   EquihashSolverStats &stats);
+/** Stop the threads SolveEquihash started. */
+void StopEquihashSolverThreads();
 #endif // BITCOIN_MINER_H
@@ -18,6 +18,7 @@
 #include "crypto/sha256.h"
 #include "hash.h"
 #include "netbase.h"
+#include "netmsgstats.h"
 #include "primitives/transaction.h"
 #include "scheduler.h"
 #include "ui_interface.h"
@@ -29,6 +30,10 @@
 #include <fcntl.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -61,8 +66,6 @@
 #endif
 #endif
 
-static const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
-
 // SHA256("netgroup")[0:8]
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL;
 // SHA256("localhostnonce")[0:8]
@@ -355,7 +358,7 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
                                       nConnectTimeout, &proxyConnectionFailed)
                 : ConnectSocket(addrConnect, hSocket, nConnectTimeout,
                                 &proxyConnectionFailed)) {
-        if (!IsSelectableSocket(hSocket)) {
+        if (!CanWatchSocket(hSocket)) {
             LogPrintf("Cannot create connection: non-selectable socket created "
                       "(fd >= FD_SETSIZE ?)\n");
             CloseSocket(hSocket);
@@ -434,7 +437,10 @@ void CNode::CloseSocketDisconnect() {
     LOCK(cs_hSocket);
     if (hSocket != INVALID_SOCKET) {
         LogPrint("net", "disconnecting peer=%d\n", id);
+        // Closing the socket also removes it from the epoll instance.
         CloseSocket(hSocket);
+        fSocketRegistered = false;
+        nSocketEvents = 0;
     }
 }
 
@@ -673,6 +679,11 @@ void CNode::copyStats(CNodeStats &stats) {
         X(mapRecvBytesPerMsgCmd);
         X(nRecvBytes);
     }
+    {
+        LOCK(cs_vProcessMsg);
+        X(mapQueueTimePerMsgCmd);
+        X(mapProcessUsecPerMsgCmd);
+    }
     X(fWhitelisted);
     X(fUsesCDYMagic);
 
@@ -701,6 +712,34 @@ void CNode::copyStats(CNodeStats &stats) {
 }
 #undef X
 
+void CNode::RecordQueueTime(const CNetMessage &msg) {
+    const int64_t nQueueUsec = std::max(int64_t(0), GetTimeMicros() - msg.nTime);
+    GetNetMsgCmdStats(msg.hdr.pchCommand).queueTime.Add(nQueueUsec);
+    LOCK(cs_vProcessMsg);
+    mapMsgCmdQueueTime::iterator i =
+        mapQueueTimePerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapQueueTimePerMsgCmd.end()) {
+        i = mapQueueTimePerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    }
+    assert(i != mapQueueTimePerMsgCmd.end());
+    i->second.nCount++;
+    i->second.nTotalUsec += nQueueUsec;
+    i->second.nMaxUsec = std::max(i->second.nMaxUsec, nQueueUsec);
+}
+
+void CNode::RecordProcessTime(const CNetMessage &msg, int64_t nProcessUsec) {
+    nProcessUsec = std::max(int64_t(0), nProcessUsec);
+    GetNetMsgCmdStats(msg.hdr.pchCommand).processTime.Add(nProcessUsec);
+    LOCK(cs_vProcessMsg);
+    mapMsgCmdSize::iterator i =
+        mapProcessUsecPerMsgCmd.find(msg.hdr.pchCommand);
+    if (i == mapProcessUsecPerMsgCmd.end()) {
+        i = mapProcessUsecPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
+    }
+    assert(i != mapProcessUsecPerMsgCmd.end());
+    i->second += nProcessUsec;
+}
+
 static bool IsOversizedMessage(const Config &config, const CNetMessage &msg) {
     if (!msg.in_data) {
         // Header only, cannot be oversized.
@@ -780,6 +819,21 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
     return true;
 }
 
+char *CNode::GetReceiveBuffer(char *pchDefault, unsigned int &nBytes) {
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data ||
+        vRecvMsg.back().complete()) {
+        return pchDefault;
+    }
+    unsigned int nInPlace;
+    char *pch = vRecvMsg.back().GetDataBuffer(nBytes, nInPlace);
+    if (!pch) {
+        return pchDefault;
+    }
+    nBytes = nInPlace;
+    return pch;
+}
+
 void CNode::SetSendVersion(int nVersionIn) {
     // Send version may only be changed in the version message, and only one
     // version message is allowed per session. We can therefore treat this value
@@ -842,19 +896,111 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes) {
     unsigned int nRemaining = hdr.nMessageSize - nDataPos;
     unsigned int nCopy = std::min(nRemaining, nBytes);
 
-    if (vRecv.size() < nDataPos + nCopy) {
-        // Allocate up to 256 KiB ahead, but never more than the total message
-        // size.
-        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nCopy + 256 * 1024));
-    }
-
+    vRecv.Reserve(nCopy, hdr.nMessageSize);
     hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    vRecv.Append(pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+char *CNetMessage::GetDataBuffer(unsigned int nMinBytes,
+                                 unsigned int &nBytes) {
+    assert(in_data);
+    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
+    if (nRemaining < nMinBytes) {
+        return nullptr;
+    }
+    char *pch = vRecv.Reserve(nMinBytes, hdr.nMessageSize);
+    nBytes = std::min<size_t>(nRemaining, vRecv.Available());
+    return pch;
+}
+
+/** Released receive buffers, kept for reuse. */
+struct CNetRecvBufferPool {
+    CCriticalSection cs;
+    std::vector<std::unique_ptr<CNetRecvBuffer>> vBuffers;
+    size_t nBytes = 0;
+};
+
+// Maximum number of bytes kept in released receive buffers.
+static const size_t MAX_RECV_BUFFER_POOL_BYTES = 32 * 1024 * 1024;
+// Smallest receive buffer allocated, to make them easier to reuse.
+static const size_t MIN_RECV_BUFFER_SIZE = 4 * 1024;
+
+static CNetRecvBufferPool &GetRecvBufferPool() {
+    static CNetRecvBufferPool pool;
+    return pool;
+}
+
+static void ReleaseRecvBuffer(CNetRecvBuffer *pbuffer) {
+    std::unique_ptr<CNetRecvBuffer> buffer(pbuffer);
+    CNetRecvBufferPool &pool = GetRecvBufferPool();
+    LOCK(pool.cs);
+    if (pool.nBytes + buffer->capacity() <= MAX_RECV_BUFFER_POOL_BYTES) {
+        pool.nBytes += buffer->capacity();
+        pool.vBuffers.push_back(std::move(buffer));
+    }
+}
+
+CNetRecvBufferRef AllocateRecvBuffer(size_t nSize) {
+    std::unique_ptr<CNetRecvBuffer> buffer;
+    {
+        CNetRecvBufferPool &pool = GetRecvBufferPool();
+        LOCK(pool.cs);
+        // Take the smallest buffer which is large enough.
+        auto best = pool.vBuffers.end();
+        for (auto it = pool.vBuffers.begin(); it != pool.vBuffers.end();
+             ++it) {
+            if ((*it)->capacity() >= nSize &&
+                (best == pool.vBuffers.end() ||
+                 (*it)->capacity() < (*best)->capacity())) {
+                best = it;
+            }
+        }
+        if (best != pool.vBuffers.end()) {
+            buffer = std::move(*best);
+            *best = std::move(pool.vBuffers.back());
+            pool.vBuffers.pop_back();
+            pool.nBytes -= buffer->capacity();
+        }
+    }
+    if (!buffer) {
+        buffer.reset(
+            new CNetRecvBuffer(std::max(nSize, MIN_RECV_BUFFER_SIZE)));
+    }
+    return CNetRecvBufferRef(buffer.release(), ReleaseRecvBuffer);
+}
+
+char *CNetRecvStream::Reserve(size_t nBytes, size_t nMaxSize) {
+    if (nBytes > Available()) {
+        // Allocate up to 256 KiB ahead, or double the buffer, but never more
+        // than the total message size.
+        size_t nCapacity = std::max<size_t>(nSize + nBytes + 256 * 1024,
+                                            buffer ? 2 * buffer->capacity()
+                                                   : 0);
+        nCapacity = std::max(std::min(nCapacity, nMaxSize), nSize + nBytes);
+        CNetRecvBufferRef newBuffer = AllocateRecvBuffer(nCapacity);
+        if (nSize) {
+            memcpy(newBuffer->data(), buffer->data(), nSize);
+        }
+        buffer = std::move(newBuffer);
+    }
+    return buffer ? buffer->data() + nSize : nullptr;
+}
+
+void CNetRecvStream::Append(const char *pch, size_t nBytes) {
+    if (nBytes == 0) {
+        return;
+    }
+    assert(nBytes <= Available());
+    char *pchDest = buffer->data() + nSize;
+    if (pch != pchDest) {
+        memcpy(pchDest, pch, nBytes);
+    }
+    nSize += nBytes;
+}
+
 const uint256 &CNetMessage::GetMessageHash() const {
     assert(complete());
     if (data_hash.IsNull()) {
@@ -869,20 +1015,55 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
     size_t nSentSize = 0;
     size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+    while (nMsgCount < pnode->vSendMsg.size()) {
+        // Gather as many queued buffers as one call can take, starting with
+        // what is left of the first one.
+        size_t nBuffers = 0;
+        size_t nAttempted = 0;
+#ifdef WIN32
+        std::pair<const char *, size_t> buffers[1];
+#else
+        struct iovec buffers[MAX_SEND_BUFFERS];
+#endif
+        for (size_t i = nMsgCount;
+             i < pnode->vSendMsg.size() && nBuffers < MAX_SEND_BUFFERS; i++) {
+            const std::vector<uint8_t> &data = *pnode->vSendMsg[i];
+            const size_t nOffset = i == nMsgCount ? pnode->nSendOffset : 0;
+            assert(data.size() > nOffset);
+#ifdef WIN32
+            buffers[nBuffers].first =
+                reinterpret_cast<const char *>(data.data()) + nOffset;
+            buffers[nBuffers].second = data.size() - nOffset;
+#else
+            buffers[nBuffers].iov_base =
+                const_cast<uint8_t *>(data.data()) + nOffset;
+            buffers[nBuffers].iov_len = data.size() - nOffset;
+#endif
+            nAttempted += data.size() - nOffset;
+            nBuffers++;
+#ifdef WIN32
+            // No gathering send here, one buffer at a time.
+            break;
+#endif
+        }
 
+        int nBytes = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET) {
                 break;
             }
 
-            nBytes = send(
-                pnode->hSocket, reinterpret_cast<const char *>(data.data()) +
-                                    pnode->nSendOffset,
-                data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            nBytes = send(pnode->hSocket, buffers[0].first, buffers[0].second,
+                          MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            struct msghdr msg;
+            memset(&msg, 0, sizeof(msg));
+            msg.msg_iov = buffers;
+            msg.msg_iovlen = nBuffers;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
 
         if (nBytes == 0) {
@@ -905,17 +1086,28 @@ size_t CConnman::SocketSendData(CNode *pnode) const {
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
-        }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
+        // Drop the buffers that went out in full.
+        size_t nLeft = nBytes;
+        while (nLeft > 0) {
+            const size_t nSize = pnode->vSendMsg[nMsgCount]->size();
+            const size_t nRemaining = nSize - pnode->nSendOffset;
+            if (nLeft < nRemaining) {
+                pnode->nSendOffset += nLeft;
+                break;
+            }
+            nLeft -= nRemaining;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= nSize;
+            nMsgCount++;
+        }
         pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
+
+        if (size_t(nBytes) != nAttempted) {
+            // could not send everything; stop sending more
+            break;
+        }
     }
 
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
@@ -1174,7 +1366,7 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
         return;
     }
 
-    if (!IsSelectableSocket(hSocket)) {
+    if (!CanWatchSocket(hSocket)) {
         LogPrintf("connection from %s dropped: non-selectable socket\n",
                   addr.ToString());
         CloseSocket(hSocket);
@@ -1225,8 +1417,220 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    UpdateSocketEvents(pnode);
+}
+
+bool CConnman::CanWatchSocket(SOCKET hSocket) const {
+    // epoll has no limit on the value of the descriptors it watches.
+    return epollfd != -1 || IsSelectableSocket(hSocket);
+}
+
+/** Frequency to poll pnode->vSend, in milliseconds. */
+static const int SOCKET_EVENTS_TIMEOUT = 50;
+
+void CConnman::SocketEvents() {
+    vSocketEvents.clear();
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        SocketEventsEpoll();
+    } else
+#endif
+    {
+        SocketEventsSelect();
+    }
+    std::sort(vSocketEvents.begin(), vSocketEvents.end());
+}
+
+uint32_t CConnman::GetSocketEvents(NodeId id) const {
+    auto it = std::lower_bound(vSocketEvents.begin(), vSocketEvents.end(),
+                               std::make_pair(id, uint32_t(0)));
+    return it != vSocketEvents.end() && it->first == id ? it->second : 0;
+}
+
+void CConnman::SocketEventsSelect() {
+    struct timeval timeout = MillisToTimeval(SOCKET_EVENTS_TIMEOUT);
+
+    fd_set fdsetRecv;
+    fd_set fdsetSend;
+    fd_set fdsetError;
+    FD_ZERO(&fdsetRecv);
+    FD_ZERO(&fdsetSend);
+    FD_ZERO(&fdsetError);
+    SOCKET hSocketMax = 0;
+    bool have_fds = false;
+    std::vector<std::pair<NodeId, SOCKET>> vSockets;
+
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+        const SOCKET hSocket = vhListenSocket[i].socket;
+        FD_SET(hSocket, &fdsetRecv);
+        hSocketMax = std::max(hSocketMax, hSocket);
+        vSockets.emplace_back(ListenSocketEventId(i), hSocket);
+        have_fds = true;
+    }
+
+    {
+        LOCK(cs_vNodes);
+        for (CNode *pnode : vNodes) {
+            // Implement the following logic:
+            // * If there is data to send, select() for sending data. As this
+            // only happens when optimistic write failed, we choose to first
+            // drain the write buffer in this case before receiving more. This
+            // avoids needlessly queueing received data, if the remote peer is
+            // not themselves receiving data. This means properly utilizing TCP
+            // flow control signalling.
+            // * Otherwise, if there is space left in the receive buffer,
+            // select() for receiving data.
+            // * Hand off all complete messages to the processor, to be handled
+            // without blocking here.
+
+            bool select_recv = !pnode->fPauseRecv;
+            bool select_send;
+            {
+                LOCK(pnode->cs_vSend);
+                select_send = !pnode->vSendMsg.empty();
+            }
+
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET) {
+                continue;
+            }
+
+            FD_SET(pnode->hSocket, &fdsetError);
+            hSocketMax = std::max(hSocketMax, pnode->hSocket);
+            vSockets.emplace_back(pnode->GetId(), pnode->hSocket);
+            have_fds = true;
+
+            if (select_send) {
+                FD_SET(pnode->hSocket, &fdsetSend);
+                continue;
+            }
+            if (select_recv) {
+                FD_SET(pnode->hSocket, &fdsetRecv);
+            }
+        }
+    }
+
+    int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv,
+                         &fdsetSend, &fdsetError, &timeout);
+    if (interruptNet) {
+        return;
+    }
+
+    if (nSelect == SOCKET_ERROR) {
+        if (have_fds) {
+            int nErr = WSAGetLastError();
+            LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
+            for (const auto &socket : vSockets) {
+                vSocketEvents.emplace_back(socket.first, SOCKET_EVENT_RECV);
+            }
+        }
+        interruptNet.sleep_for(
+            std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT));
+        return;
+    }
+
+    for (const auto &socket : vSockets) {
+        uint32_t nEvents = 0;
+        if (FD_ISSET(socket.second, &fdsetRecv)) {
+            nEvents |= SOCKET_EVENT_RECV;
+        }
+        if (FD_ISSET(socket.second, &fdsetSend)) {
+            nEvents |= SOCKET_EVENT_SEND;
+        }
+        if (FD_ISSET(socket.second, &fdsetError)) {
+            nEvents |= SOCKET_EVENT_ERROR;
+        }
+        if (nEvents) {
+            vSocketEvents.emplace_back(socket.first, nEvents);
+        }
+    }
 }
 
+void CConnman::UpdateSocketEvents(CNode *pnode) {
+#ifdef USE_EPOLL
+    if (epollfd == -1) {
+        return;
+    }
+
+    // Same logic as select(): send if vSendMsg is not empty, otherwise
+    // receive unless receiving is paused. Errors and hang-ups are always
+    // reported. cs_vSend is held until the socket is updated, so that
+    // concurrent updates are applied in order.
+    LOCK(pnode->cs_vSend);
+    uint32_t nEvents = 0;
+    if (!pnode->vSendMsg.empty()) {
+        nEvents = EPOLLOUT;
+    } else if (!pnode->fPauseRecv) {
+        nEvents = EPOLLIN;
+    }
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET ||
+        (pnode->fSocketRegistered && pnode->nSocketEvents == nEvents)) {
+        return;
+    }
+
+    struct epoll_event event = {};
+    event.events = nEvents;
+    // The events are reported by node id, as the descriptor may be closed
+    // and reused by another peer before they are handled.
+    event.data.u64 = uint64_t(pnode->GetId());
+    int op = pnode->fSocketRegistered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    int ret = epoll_ctl(epollfd, op, pnode->hSocket, &event);
+    if (ret != 0 && op == EPOLL_CTL_ADD && errno == EEXIST) {
+        // The descriptor was reused before the registration of the socket it
+        // used to be went away.
+        ret = epoll_ctl(epollfd, EPOLL_CTL_MOD, pnode->hSocket, &event);
+    }
+    if (ret != 0) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->id,
+                  NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+        return;
+    }
+    pnode->fSocketRegistered = true;
+    pnode->nSocketEvents = nEvents;
+#endif
+}
+
+#ifdef USE_EPOLL
+void CConnman::SocketEventsEpoll() {
+    // The listening sockets were registered once in Start(), and the peer
+    // sockets are kept up to date by UpdateSocketEvents.
+    // Level-triggered, so whatever does not fit is reported by the next call.
+    struct epoll_event events[1024];
+    int nEvents = epoll_wait(epollfd, events, ARRAYLEN(events),
+                             SOCKET_EVENTS_TIMEOUT);
+    if (interruptNet) {
+        return;
+    }
+
+    if (nEvents == -1) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n",
+                      NetworkErrorString(errno));
+            interruptNet.sleep_for(
+                std::chrono::milliseconds(SOCKET_EVENTS_TIMEOUT));
+        }
+        return;
+    }
+
+    for (int i = 0; i < nEvents; i++) {
+        uint32_t nReady = 0;
+        if (events[i].events & EPOLLIN) {
+            nReady |= SOCKET_EVENT_RECV;
+        }
+        if (events[i].events & EPOLLOUT) {
+            nReady |= SOCKET_EVENT_SEND;
+        }
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+            nReady |= SOCKET_EVENT_ERROR;
+        }
+        vSocketEvents.emplace_back(NodeId(events[i].data.u64), nReady);
+    }
+}
+#endif
+
 void CConnman::ThreadSocketHandler() {
     unsigned int nPrevNodeCount = 0;
     while (!interruptNet) {
@@ -1293,96 +1697,18 @@ void CConnman::ThreadSocketHandler() {
         //
         // Find which sockets have data to receive
         //
-        struct timeval timeout;
-        timeout.tv_sec = 0;
-        // Frequency to poll pnode->vSend
-        timeout.tv_usec = 50000;
-
-        fd_set fdsetRecv;
-        fd_set fdsetSend;
-        fd_set fdsetError;
-        FD_ZERO(&fdsetRecv);
-        FD_ZERO(&fdsetSend);
-        FD_ZERO(&fdsetError);
-        SOCKET hSocketMax = 0;
-        bool have_fds = false;
-
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            FD_SET(hListenSocket.socket, &fdsetRecv);
-            hSocketMax = std::max(hSocketMax, hListenSocket.socket);
-            have_fds = true;
-        }
-
-        {
-            LOCK(cs_vNodes);
-            for (CNode *pnode : vNodes) {
-                // Implement the following logic:
-                // * If there is data to send, select() for sending data. As
-                // this only happens when optimistic write failed, we choose to
-                // first drain the write buffer in this case before receiving
-                // more. This avoids needlessly queueing received data, if the
-                // remote peer is not themselves receiving data. This means
-                // properly utilizing TCP flow control signalling.
-                // * Otherwise, if there is space left in the receive buffer,
-                // select() for receiving data.
-                // * Hand off all complete messages to the processor, to be
-                // handled without blocking here.
-
-                bool select_recv = !pnode->fPauseRecv;
-                bool select_send;
-                {
-                    LOCK(pnode->cs_vSend);
-                    select_send = !pnode->vSendMsg.empty();
-                }
-
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET) {
-                    continue;
-                }
-
-                FD_SET(pnode->hSocket, &fdsetError);
-                hSocketMax = std::max(hSocketMax, pnode->hSocket);
-                have_fds = true;
-
-                if (select_send) {
-                    FD_SET(pnode->hSocket, &fdsetSend);
-                    continue;
-                }
-                if (select_recv) {
-                    FD_SET(pnode->hSocket, &fdsetRecv);
-                }
-            }
-        }
-
-        int nSelect = select(have_fds ? hSocketMax + 1 : 0, &fdsetRecv,
-                             &fdsetSend, &fdsetError, &timeout);
+        SocketEvents();
         if (interruptNet) {
             return;
         }
 
-        if (nSelect == SOCKET_ERROR) {
-            if (have_fds) {
-                int nErr = WSAGetLastError();
-                LogPrintf("socket select error %s\n", NetworkErrorString(nErr));
-                for (unsigned int i = 0; i <= hSocketMax; i++) {
-                    FD_SET(i, &fdsetRecv);
-                }
-            }
-            FD_ZERO(&fdsetSend);
-            FD_ZERO(&fdsetError);
-            if (!interruptNet.sleep_for(
-                    std::chrono::milliseconds(timeout.tv_usec / 1000))) {
-                return;
-            }
-        }
-
         //
         // Accept new connections
         //
-        for (const ListenSocket &hListenSocket : vhListenSocket) {
-            if (hListenSocket.socket != INVALID_SOCKET &&
-                FD_ISSET(hListenSocket.socket, &fdsetRecv)) {
-                AcceptConnection(hListenSocket);
+        for (size_t i = 0; i < vhListenSocket.size(); i++) {
+            if (vhListenSocket[i].socket != INVALID_SOCKET &&
+                (GetSocketEvents(ListenSocketEventId(i)) & SOCKET_EVENT_RECV)) {
+                AcceptConnection(vhListenSocket[i]);
             }
         }
 
@@ -1405,33 +1731,34 @@ void CConnman::ThreadSocketHandler() {
             //
             // Receive
             //
-            bool recvSet = false;
-            bool sendSet = false;
-            bool errorSet = false;
+            const uint32_t nReady = GetSocketEvents(pnode->GetId());
+            const bool recvSet = nReady & SOCKET_EVENT_RECV;
+            const bool sendSet = nReady & SOCKET_EVENT_SEND;
+            const bool errorSet = nReady & SOCKET_EVENT_ERROR;
             {
                 LOCK(pnode->cs_hSocket);
                 if (pnode->hSocket == INVALID_SOCKET) {
                     continue;
                 }
-                recvSet = FD_ISSET(pnode->hSocket, &fdsetRecv);
-                sendSet = FD_ISSET(pnode->hSocket, &fdsetSend);
-                errorSet = FD_ISSET(pnode->hSocket, &fdsetError);
             }
             if (recvSet || errorSet) {
                 // typical socket buffer is 8K-64K
                 char pchBuf[0x10000];
+                // The data of large messages is read in place instead.
+                unsigned int nBufSize = sizeof(pchBuf);
+                char *pchRecv = pnode->GetReceiveBuffer(pchBuf, nBufSize);
                 int nBytes = 0;
                 {
                     LOCK(pnode->cs_hSocket);
                     if (pnode->hSocket == INVALID_SOCKET) {
                         continue;
                     }
-                    nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf),
+                    nBytes = recv(pnode->hSocket, pchRecv, nBufSize,
                                   MSG_DONTWAIT);
                 }
                 if (nBytes > 0) {
                     bool notify = false;
-                    if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes,
+                    if (!pnode->ReceiveMsgBytes(*config, pchRecv, nBytes,
                                                 notify)) {
                         pnode->CloseSocketDisconnect();
                     }
@@ -1455,7 +1782,9 @@ void CConnman::ThreadSocketHandler() {
                             pnode->fPauseRecv =
                                 pnode->nProcessQueueSize > nReceiveFloodSize;
                         }
+                        UpdateSocketEvents(pnode);
                         WakeMessageHandler();
+                        ScheduleConcurrentMessages(pnode);
                     }
                 } else if (nBytes == 0) {
                     // socket closed gracefully
@@ -1486,6 +1815,7 @@ void CConnman::ThreadSocketHandler() {
                 if (nBytes) {
                     RecordBytesSent(nBytes);
                 }
+                UpdateSocketEvents(pnode);
             }
 
             //
@@ -1539,6 +1869,33 @@ void CConnman::WakeMessageHandler() {
     condMsgProc.notify_one();
 }
 
+void CConnman::ScheduleConcurrentMessages(CNode *pnode) {
+    if (nMsgWorkerThreads == 0 || pnode->fDisconnect ||
+        !pnode->fSuccessfullyConnected) {
+        return;
+    }
+
+    {
+        LOCK(pnode->cs_vProcessMsg);
+        if (pnode->vProcessMsg.empty() ||
+            !NetMsgType::IsConcurrent(
+                pnode->vProcessMsg.front().hdr.GetCommand())) {
+            return;
+        }
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutexMsgProc);
+        if (pnode->fMsgWorkerQueued) {
+            return;
+        }
+        pnode->fMsgWorkerQueued = true;
+        pnode->AddRef();
+        vMsgWorkerQueue.push_back(pnode);
+    }
+    condMsgWorker.notify_one();
+}
+
 #ifdef USE_UPNP
 void ThreadMapPort() {
     std::string port = strprintf("%u", GetListenPort());
@@ -2101,6 +2458,7 @@ bool CConnman::OpenNetworkConnection(const CAddress &addrConnect,
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
+    UpdateSocketEvents(pnode);
 
     return true;
 }
@@ -2123,23 +2481,31 @@ void CConnman::ThreadMessageHandler() {
                 continue;
             }
 
-            // Receive messages
-            bool fMoreNodeWork = GetNodeSignals().ProcessMessages(
-                *config, pnode, *this, flagInterruptMsgProc);
-            fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
-            if (flagInterruptMsgProc) {
-                return;
-            }
-
-            // Send messages
             {
-                LOCK(pnode->cs_sendProcessing);
-                GetNodeSignals().SendMessages(*config, pnode, *this,
-                                              flagInterruptMsgProc);
-            }
-            if (flagInterruptMsgProc) {
-                return;
+                // Waits for a message worker thread done with this peer.
+                LOCK(pnode->cs_msgProcessing);
+
+                // Receive messages
+                bool fMoreNodeWork = GetNodeSignals().ProcessMessages(
+                    *config, pnode, *this, flagInterruptMsgProc);
+                fMoreWork |= (fMoreNodeWork && !pnode->fPauseSend);
+                if (flagInterruptMsgProc) {
+                    return;
+                }
+
+                // Send messages
+                {
+                    LOCK(pnode->cs_sendProcessing);
+                    GetNodeSignals().SendMessages(*config, pnode, *this,
+                                                  flagInterruptMsgProc);
+                }
+                if (flagInterruptMsgProc) {
+                    return;
+                }
             }
+
+            // A worker may have skipped the peer while it was locked here.
+            ScheduleConcurrentMessages(pnode);
         }
 
         {
@@ -2159,6 +2525,49 @@ void CConnman::ThreadMessageHandler() {
     }
 }
 
+/**
+ * Processes the messages that don't need cs_main (see
+ * ProcessConcurrentMessages), so that pings, addresses and filters from
+ * peers are handled while the message handler thread waits for cs_main or
+ * validates a block. A peer is worked on by one thread at a time, which
+ * keeps its messages in order. Peers are handed over in vMsgWorkerQueue by
+ * ScheduleConcurrentMessages, so that idle workers sleep instead of polling.
+ */
+void CConnman::ThreadMessageWorker() {
+    while (!flagInterruptMsgProc) {
+        CNode *pnode;
+        {
+            std::unique_lock<std::mutex> lock(mutexMsgProc);
+            condMsgWorker.wait(lock, [this] {
+                return !vMsgWorkerQueue.empty() || flagInterruptMsgProc;
+            });
+            if (flagInterruptMsgProc) {
+                return;
+            }
+            pnode = vMsgWorkerQueue.front();
+            vMsgWorkerQueue.pop_front();
+            pnode->fMsgWorkerQueued = false;
+        }
+
+        bool fMoreWork = false;
+        if (!pnode->fDisconnect) {
+            // The message handler thread schedules the peer again once done
+            // with it.
+            TRY_LOCK(pnode->cs_msgProcessing, lockProcessing);
+            if (lockProcessing) {
+                fMoreWork = GetNodeSignals().ProcessConcurrentMessages(
+                    *config, pnode, *this, flagInterruptMsgProc);
+            }
+        }
+
+        // Back to the end of the queue, to take turns with the other peers.
+        if (fMoreWork) {
+            ScheduleConcurrentMessages(pnode);
+        }
+        pnode->Release();
+    }
+}
+
 bool CConnman::BindListenPort(const CService &addrBind, std::string &strError,
                               bool fWhitelisted) {
     strError = "";
@@ -2356,6 +2765,7 @@ CConnman::CConnman(const Config &configIn, uint64_t nSeed0In, uint64_t nSeed1In)
     nLastNodeId = 0;
     nSendBufferMaxSize = 0;
     nReceiveFloodSize = 0;
+    nMsgWorkerThreads = 0;
     semOutbound = nullptr;
     semAddnode = nullptr;
     nMaxConnections = 0;
@@ -2364,6 +2774,7 @@ CConnman::CConnman(const Config &configIn, uint64_t nSeed0In, uint64_t nSeed1In)
     nBestHeight = 0;
     clientInterface = nullptr;
     flagInterruptMsgProc = false;
+    epollfd = -1;
 }
 
 NodeId CConnman::GetNewNodeId() {
@@ -2386,6 +2797,7 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
 
     nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
     nReceiveFloodSize = connOptions.nReceiveFloodSize;
+    nMsgWorkerThreads = connOptions.nMsgWorkerThreads;
 
     nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
     nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -2461,6 +2873,32 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
         fMsgProcWake = false;
     }
 
+#ifdef USE_EPOLL
+    epollfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epollfd == -1) {
+        LogPrintf("epoll_create1 failed (%s), falling back to select()\n",
+                  NetworkErrorString(errno));
+    }
+    for (size_t i = 0; i < vhListenSocket.size(); i++) {
+        if (epollfd == -1) {
+            break;
+        }
+        struct epoll_event event = {};
+        event.events = EPOLLIN;
+        event.data.u64 = uint64_t(ListenSocketEventId(i));
+        if (epoll_ctl(epollfd, EPOLL_CTL_ADD, vhListenSocket[i].socket,
+                      &event)) {
+            LogPrintf("epoll_ctl failed for a listening socket (%s), falling "
+                      "back to select()\n",
+                      NetworkErrorString(errno));
+            close(epollfd);
+            epollfd = -1;
+        }
+    }
+#endif
+    LogPrintf("Using %s to wait on network sockets\n",
+              epollfd != -1 ? "epoll" : "select()");
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(
         &TraceThread<std::function<void()>>, "net",
@@ -2496,6 +2934,12 @@ bool CConnman::Start(CScheduler &scheduler, std::string &strNodeError,
         std::thread(&TraceThread<std::function<void()>>, "msghand",
                     std::function<void()>(
                         std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMsgWorkerThreads; i++) {
+        threadMessageWorkers.emplace_back(
+            &TraceThread<std::function<void()>>, "msgwork",
+            std::function<void()>(
+                std::bind(&CConnman::ThreadMessageWorker, this)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(boost::bind(&CConnman::DumpData, this),
@@ -2522,6 +2966,7 @@ void CConnman::Interrupt() {
         flagInterruptMsgProc = true;
     }
     condMsgProc.notify_all();
+    condMsgWorker.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2543,6 +2988,12 @@ void CConnman::Stop() {
     if (threadMessageHandler.joinable()) {
         threadMessageHandler.join();
     }
+    for (std::thread &thread : threadMessageWorkers) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    threadMessageWorkers.clear();
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
     }
@@ -2555,6 +3006,17 @@ void CConnman::Stop() {
     if (threadSocketHandler.joinable()) {
         threadSocketHandler.join();
     }
+    for (CNode *pnode : vMsgWorkerQueue) {
+        pnode->fMsgWorkerQueued = false;
+        pnode->Release();
+    }
+    vMsgWorkerQueue.clear();
+#ifdef USE_EPOLL
+    if (epollfd != -1) {
+        close(epollfd);
+        epollfd = -1;
+    }
+#endif
 
     if (fAddressesInitialized) {
         DumpData();
@@ -2835,6 +3297,8 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
     nServices = NODE_NONE;
     nServicesExpected = NODE_NONE;
     hSocket = hSocketIn;
+    fSocketRegistered = false;
+    nSocketEvents = 0;
     nRecvVersion = INIT_PROTO_VERSION;
     nLastSend = 0;
     nLastRecv = 0;
@@ -2881,11 +3345,16 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn,
     fPauseRecv = false;
     fPauseSend = false;
     nProcessQueueSize = 0;
+    fMsgWorkerQueued = false;
 
     for (const std::string &msg : getAllNetMessageTypes()) {
         mapRecvBytesPerMsgCmd[msg] = 0;
+        mapQueueTimePerMsgCmd[msg] = CMsgQueueTime();
+        mapProcessUsecPerMsgCmd[msg] = 0;
     }
     mapRecvBytesPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
+    mapQueueTimePerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = CMsgQueueTime();
+    mapProcessUsecPerMsgCmd[NET_MESSAGE_COMMAND_OTHER] = 0;
 
     if (fLogIPs) {
         LogPrint("net", "Added connection to %s peer=%d\n", addrName, id);
@@ -2949,19 +3418,28 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
+CSharedNetMsg::CSharedNetMsg(CSerializedNetMsg &&msg)
+    : data(std::make_shared<const std::vector<uint8_t>>(std::move(msg.data))),
+      command(std::move(msg.command)),
+      hash(Hash(data->data(), data->data() + data->size())) {}
+
 void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
-    size_t nMessageSize = msg.data.size();
+    PushMessage(pnode, CSharedNetMsg(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode *pnode, const CSharedNetMsg &msg) {
+    size_t nMessageSize = msg.data->size();
     size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
     LogPrint("net", "sending %s (%d bytes) peer=%d\n",
              SanitizeString(msg.command.c_str()), nMessageSize, pnode->id);
 
-    std::vector<uint8_t> serializedHeader;
-    serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
+    // The header carries the peer's magic, so only the payload is shared.
+    auto serializedHeader = std::make_shared<std::vector<uint8_t>>();
+    serializedHeader->reserve(CMessageHeader::HEADER_SIZE);
     CMessageHeader hdr(pnode->GetMagic(Params()), msg.command.c_str(), nMessageSize);
-    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    memcpy(hdr.pchChecksum, msg.hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
-    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, *serializedHeader, 0, hdr};
 
     size_t nBytesSent = 0;
     {
@@ -2971,19 +3449,21 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         // log total amount of bytes per command
         pnode->mapSendBytesPerMsgCmd[msg.command] += nTotalSize;
         pnode->nSendSize += nTotalSize;
+        GetSendBufferStats().Add(pnode->nSendSize);
 
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
         pnode->vSendMsg.push_back(std::move(serializedHeader));
         if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.data);
         }
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true) {
             nBytesSent = SocketSendData(pnode);
         }
+        UpdateSocketEvents(pnode);
     }
     if (nBytesSent) {
         RecordBytesSent(nBytesSent);
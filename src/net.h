@@ -28,6 +28,7 @@
 #include <cstdint>
 #include <deque>
 #include <memory>
+#include <set>
 #include <thread>
 
 #ifndef WIN32
@@ -37,6 +38,12 @@
 #include <boost/filesystem/path.hpp>
 #include <boost/signals2/signal.hpp>
 
+#if defined(HAVE_SYS_EPOLL_H)
+// Wait on the sockets with epoll rather than select(), see
+// CConnman::SocketEvents.
+#define USE_EPOLL
+#endif
+
 class CAddrMan;
 class Config;
 class CNode;
@@ -82,6 +89,8 @@ static const unsigned int DEFAULT_MAX_PEER_CONNECTIONS = 125;
 static const uint64_t DEFAULT_MAX_UPLOAD_TARGET = 0;
 /** The default timeframe for -maxuploadtarget. 1 day. */
 static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
+/** Maximum number of queued buffers handed to the socket in one call. */
+static const size_t MAX_SEND_BUFFERS = 64;
 /** Default for blocks only*/
 static const bool DEFAULT_BLOCKSONLY = false;
 
@@ -91,6 +100,13 @@ static const bool DEFAULT_BLOCKSONLY = false;
 static const bool DEFAULT_FORCEDNSSEED = true;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
+/**
+ * The default number of threads processing the messages that don't need
+ * cs_main, next to the message handler thread.
+ */
+static const int DEFAULT_MSG_WORKER_THREADS = 2;
+/** Maximum number of message worker threads */
+static const int MAX_MSG_WORKER_THREADS = 16;
 
 static const ServiceFlags REQUIRED_SERVICES = ServiceFlags(NODE_NETWORK);
 
@@ -123,6 +139,18 @@ struct CSerializedNetMsg {
     std::string command;
 };
 
+/**
+ * A serialized message to queue to many peers. Their send queues share the
+ * payload instead of copies of it, and its checksum is computed only once.
+ */
+struct CSharedNetMsg {
+    explicit CSharedNetMsg(CSerializedNetMsg &&msg);
+
+    std::shared_ptr<const std::vector<uint8_t>> data;
+    std::string command;
+    uint256 hash;
+};
+
 class CConnman {
 public:
     enum NumConnections {
@@ -145,6 +173,7 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        int nMsgWorkerThreads = 0;
     };
     CConnman(const Config &configIn, uint64_t seed0, uint64_t seed1);
     ~CConnman();
@@ -166,6 +195,7 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode *pnode)> func);
 
     void PushMessage(CNode *pnode, CSerializedNetMsg &&msg);
+    void PushMessage(CNode *pnode, const CSharedNetMsg &msg);
 
     template <typename Callable> void ForEachNode(Callable &&func) {
         LOCK(cs_vNodes);
@@ -284,6 +314,13 @@ public:
 
     void WakeMessageHandler();
 
+    /**
+     * Update the events the socket of pnode is watched for with epoll, after
+     * its send queue became empty or not, or receiving was paused or resumed.
+     * This does nothing with select(), which looks at every peer on each call.
+     */
+    void UpdateSocketEvents(CNode *pnode);
+
 private:
     struct ListenSocket {
         SOCKET socket;
@@ -297,7 +334,36 @@ private:
     void ProcessOneShot();
     void ThreadOpenConnections();
     void ThreadMessageHandler();
+    void ThreadMessageWorker();
+    /**
+     * Hand pnode to the message worker threads if the next message in its
+     * queue is one they process (see NetMsgType::IsConcurrent) and it isn't
+     * queued for them yet.
+     */
+    void ScheduleConcurrentMessages(CNode *pnode);
     void AcceptConnection(const ListenSocket &hListenSocket);
+    bool CanWatchSocket(SOCKET hSocket) const;
+    //! Socket events reported by SocketEvents.
+    enum : uint32_t {
+        SOCKET_EVENT_RECV = (1U << 0),
+        SOCKET_EVENT_SEND = (1U << 1),
+        SOCKET_EVENT_ERROR = (1U << 2),
+    };
+    //! Id the events of the i-th listening socket are reported under, which
+    //! does not collide with the id of a node.
+    static NodeId ListenSocketEventId(size_t i) { return -1 - NodeId(i); }
+    /**
+     * Wait for sockets to be ready, and add the events of each one that is to
+     * vSocketEvents, by node id.
+     */
+    void SocketEvents();
+    void SocketEventsSelect();
+#ifdef USE_EPOLL
+    void SocketEventsEpoll();
+#endif
+    //! Events found by the last SocketEvents call for a node or a listening
+    //! socket.
+    uint32_t GetSocketEvents(NodeId id) const;
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -358,6 +424,14 @@ private:
     unsigned int nReceiveFloodSize;
 
     std::vector<ListenSocket> vhListenSocket;
+    /**
+     * epoll instance the listening and peer sockets are registered with, or
+     * -1 to fall back to select().
+     */
+    int epollfd;
+    //! Sockets found ready by SocketEvents, sorted by node id. Only used by
+    //! the socket handler thread, and kept to reuse its memory.
+    std::vector<std::pair<NodeId, uint32_t>> vSocketEvents;
     std::atomic<bool> fNetworkActive;
     banmap_t setBanned;
     CCriticalSection cs_setBanned;
@@ -393,8 +467,15 @@ private:
 
     /** flag for waking the message processor. */
     bool fMsgProcWake;
+    int nMsgWorkerThreads;
+    /**
+     * Peers for the message worker threads, each holding a reference. Guarded
+     * by mutexMsgProc.
+     */
+    std::deque<CNode *> vMsgWorkerQueue;
 
     std::condition_variable condMsgProc;
+    std::condition_variable condMsgWorker;
     std::mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc;
 
@@ -405,6 +486,7 @@ private:
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
     std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageWorkers;
 };
 extern std::unique_ptr<CConnman> g_connman;
 void Discover(boost::thread_group &threadGroup);
@@ -433,6 +515,10 @@ struct CNodeSignals {
                                  std::atomic<bool> &),
                             CombinerAll>
         ProcessMessages;
+    boost::signals2::signal<bool(const Config &, CNode *, CConnman &,
+                                 std::atomic<bool> &),
+                            CombinerAll>
+        ProcessConcurrentMessages;
     boost::signals2::signal<bool(const Config &, CNode *, CConnman &,
                                  std::atomic<bool> &),
                             CombinerAll>
@@ -492,6 +578,16 @@ extern std::map<CNetAddr, LocalServiceInfo> mapLocalHost;
 // Command, total bytes
 typedef std::map<std::string, uint64_t> mapMsgCmdSize;
 
+/** Time messages of one command spent queued before being processed. */
+struct CMsgQueueTime {
+    uint64_t nCount;
+    int64_t nTotalUsec;
+    int64_t nMaxUsec;
+};
+
+// Command, queue time
+typedef std::map<std::string, CMsgQueueTime> mapMsgCmdQueueTime;
+
 class CNodeStats {
 public:
     NodeId nodeid;
@@ -511,6 +607,8 @@ public:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     uint64_t nRecvBytes;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    mapMsgCmdQueueTime mapQueueTimePerMsgCmd;
+    mapMsgCmdSize mapProcessUsecPerMsgCmd;
     bool fWhitelisted;
     double dPingTime;
     double dPingWait;
@@ -520,6 +618,122 @@ public:
     bool fUsesCDYMagic;
 };
 
+/**
+ * Storage for the payload of a received message. Network data is not secret,
+ * so unlike CDataStream it is neither zeroed when allocated nor wiped when
+ * freed, and the buffers of processed messages are kept for reuse.
+ */
+class CNetRecvBuffer {
+private:
+    std::unique_ptr<char[]> pdata;
+    size_t nCapacity;
+
+public:
+    explicit CNetRecvBuffer(size_t nCapacityIn)
+        : pdata(new char[nCapacityIn]), nCapacity(nCapacityIn) {}
+
+    char *data() { return pdata.get(); }
+    const char *data() const { return pdata.get(); }
+    size_t capacity() const { return nCapacity; }
+};
+
+typedef std::shared_ptr<CNetRecvBuffer> CNetRecvBufferRef;
+
+/**
+ * Get a buffer of at least nSize bytes, reusing one released by an earlier
+ * message if possible. It goes back to the pool when the last reference to it
+ * is dropped.
+ */
+CNetRecvBufferRef AllocateRecvBuffer(size_t nSize);
+
+/**
+ * The payload of a received message, which the socket reads into and which
+ * messages are deserialized from in place. It has the interface of CDataStream
+ * used by message processing, including writes for the messages it makes up
+ * itself.
+ */
+class CNetRecvStream {
+private:
+    CNetRecvBufferRef buffer;
+    //! Bytes of the message in the buffer.
+    size_t nSize;
+    size_t nReadPos;
+
+    int nType;
+    int nVersion;
+
+public:
+    CNetRecvStream(int nTypeIn, int nVersionIn)
+        : nSize(0), nReadPos(0), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    size_t size() const { return nSize - nReadPos; }
+    bool empty() const { return nSize == nReadPos; }
+    bool eof() const { return empty(); }
+    int in_avail() const { return size(); }
+    const char *data() const {
+        return buffer ? buffer->data() + nReadPos : nullptr;
+    }
+
+    void SetType(int n) { nType = n; }
+    int GetType() const { return nType; }
+    void SetVersion(int n) { nVersion = n; }
+    int GetVersion() const { return nVersion; }
+
+    void read(char *pch, size_t nBytes) {
+        if (nBytes > size()) {
+            throw std::ios_base::failure(
+                "CNetRecvStream::read(): end of data");
+        }
+        if (nBytes) {
+            memcpy(pch, buffer->data() + nReadPos, nBytes);
+            nReadPos += nBytes;
+        }
+    }
+
+    void ignore(int nBytes) {
+        if (nBytes < 0) {
+            throw std::ios_base::failure(
+                "CNetRecvStream::ignore(): nSize negative");
+        }
+        if (size_t(nBytes) > size()) {
+            throw std::ios_base::failure(
+                "CNetRecvStream::ignore(): end of data");
+        }
+        nReadPos += nBytes;
+    }
+
+    template <typename T> CNetRecvStream &operator>>(T &obj) {
+        // Unserialize from this stream
+        ::Unserialize(*this, obj);
+        return (*this);
+    }
+
+    void write(const char *pch, size_t nBytes) {
+        // Grow geometrically, as the final size is not known.
+        Reserve(nBytes, 2 * (nSize + nBytes));
+        Append(pch, nBytes);
+    }
+
+    template <typename T> CNetRecvStream &operator<<(const T &obj) {
+        // Serialize to this stream
+        ::Serialize(*this, obj);
+        return (*this);
+    }
+
+    /**
+     * Make room for nBytes more bytes of a message of nMaxSize bytes, and
+     * return where they go. The buffer grows up to 256 KiB ahead, but never
+     * past nMaxSize.
+     */
+    char *Reserve(size_t nBytes, size_t nMaxSize);
+    //! Bytes that can be appended without growing the buffer.
+    size_t Available() const {
+        return buffer ? buffer->capacity() - nSize : 0;
+    }
+    //! Append nBytes bytes, unless they were read in place already.
+    void Append(const char *pch, size_t nBytes);
+};
+
 class CNetMessage {
 private:
     mutable CHash256 hasher;
@@ -536,7 +750,7 @@ public:
     unsigned int nHdrPos;
 
     // Received message data.
-    CDataStream vRecv;
+    CNetRecvStream vRecv;
     unsigned int nDataPos;
 
     // Time (in microseconds) of message receipt.
@@ -570,6 +784,13 @@ public:
 
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+
+    /**
+     * If at least nMinBytes of the data are still to come, return where they
+     * can be read to in place (and set nBytes to the room there), to be passed
+     * to readData. Return nullptr otherwise.
+     */
+    char *GetDataBuffer(unsigned int nMinBytes, unsigned int &nBytes);
 };
 
 /** Information about a peer */
@@ -587,16 +808,27 @@ public:
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset;
     uint64_t nSendBytes;
-    std::deque<std::vector<uint8_t>> vSendMsg;
+    // Message headers and payloads, which may be shared with other peers.
+    std::deque<std::shared_ptr<const std::vector<uint8_t>>> vSendMsg;
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
+    // Whether hSocket was added to CConnman::epollfd, and the events it is
+    // watched for there. Guarded by cs_hSocket.
+    bool fSocketRegistered;
+    uint32_t nSocketEvents;
     CCriticalSection cs_vRecv;
 
     CCriticalSection cs_vProcessMsg;
     std::list<CNetMessage> vProcessMsg;
     size_t nProcessQueueSize;
 
+    // Held while the peer's messages are processed or sent, so that only one
+    // message handling thread at a time works on the peer, in order.
+    CCriticalSection cs_msgProcessing;
     CCriticalSection cs_sendProcessing;
+    // Whether the peer is in CConnman::vMsgWorkerQueue, guarded by
+    // CConnman::mutexMsgProc.
+    bool fMsgWorkerQueued;
 
     std::deque<CInv> vRecvGetData;
     uint64_t nRecvBytes;
@@ -648,12 +880,18 @@ public:
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
     mapMsgCmdSize mapRecvBytesPerMsgCmd;
+    // Guarded by cs_vProcessMsg.
+    mapMsgCmdQueueTime mapQueueTimePerMsgCmd;
+    // Microseconds spent processing the messages, guarded by cs_vProcessMsg.
+    mapMsgCmdSize mapProcessUsecPerMsgCmd;
 
 public:
     uint256 hashContinue;
     std::atomic<int> nStartingHeight;
 
-    // flood relay
+    // flood relay, guarded by cs_addrSend as other peers relay addresses to
+    // this one from the message worker threads.
+    CCriticalSection cs_addrSend;
     std::vector<CAddress> vAddrToSend;
     CRollingBloomFilter addrKnown;
     bool fGetAddr;
@@ -744,6 +982,12 @@ public:
 
     bool ReceiveMsgBytes(const Config &config, const char *pch, uint32_t nBytes,
                          bool &complete);
+    /**
+     * Where the next nBytes received bytes can be read to, in the buffer of
+     * the message being received if enough of it is still to come, so that
+     * ReceiveMsgBytes does not copy them. pchDefault otherwise.
+     */
+    char *GetReceiveBuffer(char *pchDefault, unsigned int &nBytes);
 
     void SetRecvVersion(int nVersionIn) { nRecvVersion = nVersionIn; }
     int GetRecvVersion() { return nRecvVersion; }
@@ -766,10 +1010,12 @@ public:
     void Release() { nRefCount--; }
 
     void AddAddressKnown(const CAddress &_addr) {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress &_addr, FastRandomContext &insecure_rand) {
+        LOCK(cs_addrSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
@@ -810,6 +1056,14 @@ public:
 
     void copyStats(CNodeStats &stats);
 
+    /**
+     * Account for the time a message spent queued, from its receipt until
+     * processing starts now.
+     */
+    void RecordQueueTime(const CNetMessage &msg);
+    /** Account for the time spent processing a message. */
+    void RecordProcessTime(const CNetMessage &msg, int64_t nProcessUsec);
+
     ServiceFlags GetLocalServices() const { return nLocalServices; }
 
     std::string GetAddrName() const;
@@ -7,6 +7,7 @@
 
 #include "addrman.h"
 #include "arith_uint256.h"
+#include "blockcache.h"
 #include "blockencodings.h"
 #include "blockstatus.h"
 #include "chainparams.h"
@@ -24,6 +25,7 @@
 #include "primitives/transaction.h"
 #include "random.h"
 #include "tinyformat.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -687,6 +689,7 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
 
 void RegisterNodeSignals(CNodeSignals &nodeSignals) {
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
+    nodeSignals.ProcessConcurrentMessages.connect(&ProcessConcurrentMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
     nodeSignals.InitializeNode.connect(&InitializeNode);
     nodeSignals.FinalizeNode.connect(&FinalizeNode);
@@ -694,6 +697,8 @@ void RegisterNodeSignals(CNodeSignals &nodeSignals) {
 
 void UnregisterNodeSignals(CNodeSignals &nodeSignals) {
     nodeSignals.ProcessMessages.disconnect(&ProcessMessages);
+    nodeSignals.ProcessConcurrentMessages.disconnect(
+        &ProcessConcurrentMessages);
     nodeSignals.SendMessages.disconnect(&SendMessages);
     nodeSignals.InitializeNode.disconnect(&InitializeNode);
     nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
@@ -942,9 +947,11 @@ void PeerLogicValidation::NewPoWValidBlock(
         most_recent_compact_block = pcmpctblock;
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker,
-                          &hashBlock](CNode *pnode) {
-        // TODO: Avoid the repeated-serialization here
+    // Serialized once, on the first peer we announce to, and then shared by
+    // the send queues of all of them.
+    std::unique_ptr<CSharedNetMsg> cmpctblockMsg;
+    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, &hashBlock,
+                          &cmpctblockMsg](CNode *pnode) {
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
             return;
         }
@@ -958,8 +965,11 @@ void PeerLogicValidation::NewPoWValidBlock(
             LogPrint("net", "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->id);
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            if (!cmpctblockMsg) {
+                cmpctblockMsg.reset(new CSharedNetMsg(
+                    msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock)));
+            }
+            connman->PushMessage(pnode, *cmpctblockMsg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1222,18 +1232,22 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
                 // Pruned nodes may have deleted the block, so check whether
                 // it's available before trying to send.
                 if (send && (mi->second->nStatus.hasData())) {
-                    // Send block from disk
-                    CBlock block;
-                    if (!ReadBlockFromDisk(block, (*mi).second, config)) {
-                        assert(!"cannot load block from disk");
-                    }
-
+                    // Blocks and compact blocks are sent from the cache of
+                    // serialized blocks, filtered blocks from disk.
                     int legacy_block_flag = (pfrom->IsLegacyBlockHeader(pfrom->GetSendVersion())
                                                  ? SERIALIZE_BLOCK_LEGACY : 0);
                     if (inv.type == MSG_BLOCK) {
-                        connman.PushMessage(
-                            pfrom, msgMaker.Make(NetMsgType::BLOCK, block));
+                        std::shared_ptr<const CSharedNetMsg> blockMsg =
+                            GetSerializedBlock(config, mi->second, 0);
+                        if (!blockMsg) {
+                            assert(!"cannot load block from disk");
+                        }
+                        connman.PushMessage(pfrom, *blockMsg);
                     } else if (inv.type == MSG_FILTERED_BLOCK) {
+                        CBlock block;
+                        if (!ReadBlockFromDisk(block, (*mi).second, config)) {
+                            assert(!"cannot load block from disk");
+                        }
                         bool sendMerkleBlock = false;
                         CMerkleBlock merkleBlock;
                         {
@@ -1276,19 +1290,20 @@ static void ProcessGetData(const Config &config, CNode *pfrom,
                         // constructing the object for them, so instead we
                         // respond with the full, non-compact block.
                         int nSendFlags = legacy_block_flag;
+                        std::shared_ptr<const CSharedNetMsg> blockMsg;
                         if (CanDirectFetch(consensusParams) &&
                             mi->second->nHeight >=
                                 chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
-                            CBlockHeaderAndShortTxIDs cmpctblock(block);
-                            connman.PushMessage(
-                                pfrom, msgMaker.Make(nSendFlags,
-                                                     NetMsgType::CMPCTBLOCK,
-                                                     cmpctblock));
+                            blockMsg = GetSerializedCompactBlock(
+                                config, mi->second, nSendFlags);
                         } else {
-                            connman.PushMessage(
-                                pfrom, msgMaker.Make(nSendFlags,
-                                                     NetMsgType::BLOCK, block));
+                            blockMsg = GetSerializedBlock(config, mi->second,
+                                                          nSendFlags);
+                        }
+                        if (!blockMsg) {
+                            assert(!"cannot load block from disk");
                         }
+                        connman.PushMessage(pfrom, *blockMsg);
                     }
 
                     // Trigger the peer node to send a getblocks request for the
@@ -1388,7 +1403,8 @@ inline static void SendBlockTransactions(const CBlock &block,
 }
 
 static bool ProcessMessage(const Config &config, CNode *pfrom,
-                           const std::string &strCommand, CDataStream &vRecv,
+                           const std::string &strCommand,
+                           CNetRecvStream &vRecv,
                            int64_t nTimeReceived,
                            const CChainParams &chainparams, CConnman &connman,
                            const std::atomic<bool> &interruptMsgProc) {
@@ -1991,58 +2007,78 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         uint256 hashStop;
         vRecv >> locator >> hashStop;
 
-        LOCK(cs_main);
-        if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
-            LogPrint("net", "Ignoring getheaders from peer=%d because node is "
-                            "in initial block download\n",
-                     pfrom->id);
-            return true;
-        }
-
-        CNodeState *nodestate = State(pfrom->GetId());
-        const CBlockIndex *pindex = nullptr;
-        if (locator.IsNull()) {
-            // If locator is null, return the hashStop block
-            BlockMap::iterator mi = mapBlockIndex.find(hashStop);
-            if (mi == mapBlockIndex.end()) {
+        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx
+        // count at the end
+        std::vector<CBlock> vHeaders;
+        // Headers whose Equihash solution was evicted from memory, with their
+        // hash. The solutions are read from disk once cs_main is released.
+        std::vector<std::pair<size_t, uint256>> vEvicted;
+        {
+            LOCK(cs_main);
+            if (IsInitialBlockDownload() && !pfrom->fWhitelisted) {
+                LogPrint("net", "Ignoring getheaders from peer=%d because "
+                                "node is in initial block download\n",
+                         pfrom->id);
                 return true;
             }
-            pindex = (*mi).second;
-        } else {
-            // Find the last block the caller has in the main chain
-            pindex = FindForkInGlobalIndex(chainActive, locator);
-            if (pindex) {
-                pindex = chainActive.Next(pindex);
+
+            CNodeState *nodestate = State(pfrom->GetId());
+            const CBlockIndex *pindex = nullptr;
+            if (locator.IsNull()) {
+                // If locator is null, return the hashStop block
+                BlockMap::iterator mi = mapBlockIndex.find(hashStop);
+                if (mi == mapBlockIndex.end()) {
+                    return true;
+                }
+                pindex = (*mi).second;
+            } else {
+                // Find the last block the caller has in the main chain
+                pindex = FindForkInGlobalIndex(chainActive, locator);
+                if (pindex) {
+                    pindex = chainActive.Next(pindex);
+                }
             }
+
+            int nLimit = MAX_HEADERS_RESULTS;
+            LogPrint("net", "getheaders %d to %s from peer=%d\n",
+                     (pindex ? pindex->nHeight : -1),
+                     hashStop.IsNull() ? "end" : hashStop.ToString(),
+                     pfrom->id);
+            for (; pindex; pindex = chainActive.Next(pindex)) {
+                vHeaders.emplace_back();
+                pindex->GetBlockHeader(vHeaders.back(), false);
+                if (pindex->fSolutionEvicted) {
+                    vEvicted.emplace_back(vHeaders.size() - 1,
+                                          pindex->GetBlockHash());
+                }
+                if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop) {
+                    break;
+                }
+            }
+            // pindex can be nullptr either if we sent chainActive.Tip() OR
+            // if our peer has chainActive.Tip() (and thus we are sending an
+            // empty headers message). In both cases it's safe to update
+            // pindexBestHeaderSent to be our tip.
+            //
+            // It is important that we simply reset the BestHeaderSent value
+            // here, and not max(BestHeaderSent, newHeaderSent). We might have
+            // announced the currently-being-connected tip using a compact
+            // block, which resulted in the peer sending a headers request,
+            // which we respond to without the new block. By resetting the
+            // BestHeaderSent, we ensure we will re-announce the new block via
+            // headers (or compact blocks again) in the SendMessages logic.
+            nodestate->pindexBestHeaderSent =
+                pindex ? pindex : chainActive.Tip();
         }
 
-        // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx
-        // count at the end
-        std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
-        LogPrint("net", "getheaders %d to %s from peer=%d\n",
-                 (pindex ? pindex->nHeight : -1),
-                 hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->id);
-        for (; pindex; pindex = chainActive.Next(pindex)) {
-            vHeaders.push_back(pindex->GetBlockHeader());
-            if (--nLimit <= 0 || pindex->GetBlockHash() == hashStop) {
-                break;
+        for (const auto &evicted : vEvicted) {
+            if (!pblocktree->ReadSolution(evicted.second,
+                                          vHeaders[evicted.first].nSolution)) {
+                return error("failed to read the solution of block %s",
+                             evicted.second.ToString());
             }
         }
-        // pindex can be nullptr either if we sent chainActive.Tip() OR
-        // if our peer has chainActive.Tip() (and thus we are sending an empty
-        // headers message). In both cases it's safe to update
-        // pindexBestHeaderSent to be our tip.
-        //
-        // It is important that we simply reset the BestHeaderSent value here,
-        // and not max(BestHeaderSent, newHeaderSent). We might have announced
-        // the currently-being-connected tip using a compact block, which
-        // resulted in the peer sending a headers request, which we respond to
-        // without the new block. By resetting the BestHeaderSent, we ensure we
-        // will re-announce the new block via headers (or compact blocks again)
-        // in the SendMessages logic.
-        nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        
+
         int legacy_block_flag = pfrom->IsLegacyBlockHeader(pfrom->GetSendVersion()) ? SERIALIZE_BLOCK_LEGACY : 0;
         connman.PushMessage(pfrom, msgMaker.Make(legacy_block_flag, NetMsgType::HEADERS, vHeaders));
     }
@@ -2069,16 +2105,34 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         CInv inv(MSG_TX, tx.GetId());
         pfrom->AddInventoryKnown(inv);
 
+        bool fAlreadyHave;
+        {
+            LOCK(cs_main);
+            pfrom->setAskFor.erase(inv.hash);
+            mapAlreadyAskedFor.erase(inv.hash);
+            fAlreadyHave = AlreadyHave(inv);
+        }
+
+        // The scripts are checked without cs_main, so that blocks can be
+        // processed meanwhile.
+        std::vector<MempoolAcceptRequest> vRequests;
+        if (!fAlreadyHave) {
+            vRequests.emplace_back(ptx, true);
+            AcceptToMemoryPoolBatch(config, mempool, vRequests);
+        }
+
         LOCK(cs_main);
 
         bool fMissingInputs = false;
         CValidationState state;
+        bool fAccepted = false;
+        if (!vRequests.empty()) {
+            fMissingInputs = vRequests[0].fMissingInputs;
+            state = vRequests[0].state;
+            fAccepted = vRequests[0].fAccepted;
+        }
 
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
-
-        if (!AlreadyHave(inv) && AcceptToMemoryPool(config, mempool, state, ptx,
-                                                    true, &fMissingInputs)) {
+        if (fAccepted) {
             mempool.check(pcoinsTip);
             RelayTransaction(tx, connman);
             for (size_t i = 0; i < tx.vout.size(); i++) {
@@ -2300,13 +2354,13 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         // dummy (empty) BLOCKTXN message, to re-use the logic there in
         // completing processing of the putative block (without cs_main).
         bool fProcessBLOCKTXN = false;
-        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+        CNetRecvStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
 
         // If we end up treating this as a plain headers message, call that as
         // well
         // without cs_main.
         bool fRevertToHeaderProcessing = false;
-        CDataStream vHeadersMsg(SER_NETWORK, PROTOCOL_VERSION);
+        CNetRecvStream vHeadersMsg(SER_NETWORK, PROTOCOL_VERSION);
 
         // Keep a CBlock for "optimistic" compactblock reconstructions (see
         // below)
@@ -2881,7 +2935,10 @@ static bool ProcessMessage(const Config &config, CNode *pfrom,
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman.GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -3103,42 +3160,22 @@ static bool SendRejectsAndCheckIfBanned(CNode *pnode, CConnman &connman) {
     return false;
 }
 
-bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
-                     const std::atomic<bool> &interruptMsgProc) {
-    const CChainParams &chainparams = Params();
-    //
-    // Message format
-    //  (4) message start
-    //  (12) command
-    //  (4) size
-    //  (4) checksum
-    //  (x) data
-    //
-    bool fMoreWork = false;
-
-    if (!pfrom->vRecvGetData.empty()) {
-        ProcessGetData(config, pfrom, chainparams.GetConsensus(), connman,
-                       interruptMsgProc);
-    }
-
-    if (pfrom->fDisconnect) {
-        return false;
-    }
-
-    // this maintains the order of responses
-    if (!pfrom->vRecvGetData.empty()) {
-        return true;
-    }
-
-    // Don't bother if send buffer is too full to respond anyway
-    if (pfrom->fPauseSend) {
-        return false;
-    }
-
-    std::list<CNetMessage> msgs;
+/**
+ * Take the next message to process from the peer's queue, into msgs, unless
+ * fConcurrentOnly is set and it needs cs_main. Returns whether there are
+ * more such messages queued.
+ */
+static bool TakeNextMessage(CNode *pfrom, CConnman &connman,
+                            std::list<CNetMessage> &msgs,
+                            bool fConcurrentOnly) {
+    bool fResumeRecv;
+    bool fMore;
     {
         LOCK(pfrom->cs_vProcessMsg);
-        if (pfrom->vProcessMsg.empty()) {
+        if (pfrom->vProcessMsg.empty() ||
+            (fConcurrentOnly &&
+             !NetMsgType::IsConcurrent(
+                 pfrom->vProcessMsg.front().hdr.GetCommand()))) {
             return false;
         }
         // Just take one message
@@ -3146,11 +3183,30 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
                     pfrom->vProcessMsg.begin());
         pfrom->nProcessQueueSize -=
             msgs.front().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        fResumeRecv = pfrom->fPauseRecv &&
+                      pfrom->nProcessQueueSize <= connman.GetReceiveFloodSize();
         pfrom->fPauseRecv =
             pfrom->nProcessQueueSize > connman.GetReceiveFloodSize();
-        fMoreWork = !pfrom->vProcessMsg.empty();
+        pfrom->RecordQueueTime(msgs.front());
+        fMore = !pfrom->vProcessMsg.empty() &&
+                (!fConcurrentOnly ||
+                 NetMsgType::IsConcurrent(
+                     pfrom->vProcessMsg.front().hdr.GetCommand()));
     }
-    CNetMessage &msg(msgs.front());
+    if (fResumeRecv) {
+        connman.UpdateSocketEvents(pfrom);
+    }
+    return fMore;
+}
+
+/**
+ * Check a message taken from the peer's queue and process it. Returns false
+ * if the message was dropped before processing.
+ */
+static bool ProcessNetMessage(const Config &config, CNode *pfrom,
+                              CNetMessage &msg, CConnman &connman,
+                              const std::atomic<bool> &interruptMsgProc) {
+    const CChainParams &chainparams = Params();
 
     msg.SetVersion(pfrom->GetRecvVersion());
 
@@ -3178,7 +3234,7 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
     if (!hdr.IsValid(pfrom->GetMagic(chainparams))) {
         LogPrintf("PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d\n",
                   SanitizeString(hdr.GetCommand()), pfrom->id);
-        return fMoreWork;
+        return false;
     }
     std::string strCommand = hdr.GetCommand();
 
@@ -3186,7 +3242,7 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
     unsigned int nMessageSize = hdr.nMessageSize;
 
     // Checksum
-    CDataStream &vRecv = msg.vRecv;
+    CNetRecvStream &vRecv = msg.vRecv;
     const uint256 &hash = msg.GetMessageHash();
     if (memcmp(hash.begin(), hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) !=
         0) {
@@ -3196,19 +3252,17 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
             HexStr(hash.begin(), hash.begin() + CMessageHeader::CHECKSUM_SIZE),
             HexStr(hdr.pchChecksum,
                    hdr.pchChecksum + CMessageHeader::CHECKSUM_SIZE));
-        return fMoreWork;
+        return false;
     }
 
     // Process message
     bool fRet = false;
+    const int64_t nProcessStart = GetTimeMicros();
     try {
         fRet = ProcessMessage(config, pfrom, strCommand, vRecv, msg.nTime,
                               chainparams, connman, interruptMsgProc);
         if (interruptMsgProc) {
-            return false;
-        }
-        if (!pfrom->vRecvGetData.empty()) {
-            fMoreWork = true;
+            return true;
         }
     } catch (const std::ios_base::failure &e) {
         connman.PushMessage(
@@ -3238,17 +3292,90 @@ bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
         PrintExceptionContinue(nullptr, "ProcessMessages()");
     }
 
+    pfrom->RecordProcessTime(msg, GetTimeMicros() - nProcessStart);
+
     if (!fRet) {
         LogPrintf("%s(%s, %u bytes) FAILED peer=%d\n", __func__,
                   SanitizeString(strCommand), nMessageSize, pfrom->id);
     }
 
+    return true;
+}
+
+bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
+                     const std::atomic<bool> &interruptMsgProc) {
+    const CChainParams &chainparams = Params();
+    //
+    // Message format
+    //  (4) message start
+    //  (12) command
+    //  (4) size
+    //  (4) checksum
+    //  (x) data
+    //
+
+    if (!pfrom->vRecvGetData.empty()) {
+        ProcessGetData(config, pfrom, chainparams.GetConsensus(), connman,
+                       interruptMsgProc);
+    }
+
+    if (pfrom->fDisconnect) {
+        return false;
+    }
+
+    // this maintains the order of responses
+    if (!pfrom->vRecvGetData.empty()) {
+        return true;
+    }
+
+    // Don't bother if send buffer is too full to respond anyway
+    if (pfrom->fPauseSend) {
+        return false;
+    }
+
+    std::list<CNetMessage> msgs;
+    bool fMoreWork = TakeNextMessage(pfrom, connman, msgs, false);
+    if (msgs.empty()) {
+        return false;
+    }
+
+    if (!ProcessNetMessage(config, pfrom, msgs.front(), connman,
+                           interruptMsgProc)) {
+        return fMoreWork;
+    }
+    if (interruptMsgProc) {
+        return false;
+    }
+    if (!pfrom->vRecvGetData.empty()) {
+        fMoreWork = true;
+    }
+
     LOCK(cs_main);
     SendRejectsAndCheckIfBanned(pfrom, connman);
 
     return fMoreWork;
 }
 
+bool ProcessConcurrentMessages(const Config &config, CNode *pfrom,
+                               CConnman &connman,
+                               const std::atomic<bool> &interruptMsgProc) {
+    // Pending getdata responses go first, and need cs_main.
+    if (!pfrom->vRecvGetData.empty() || pfrom->fPauseSend) {
+        return false;
+    }
+
+    std::list<CNetMessage> msgs;
+    bool fMoreWork = TakeNextMessage(pfrom, connman, msgs, true);
+    if (msgs.empty()) {
+        return false;
+    }
+
+    ProcessNetMessage(config, pfrom, msgs.front(), connman, interruptMsgProc);
+
+    // Rejects and bans need cs_main, they are handled in SendMessages.
+    return fMoreWork && !interruptMsgProc && !pfrom->fPauseSend;
+}
+
 class CompareInvMempoolOrder {
     CTxMemPool *mp;
 
@@ -3332,6 +3459,7 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
     if (pto->nNextAddrSend < nNow) {
         pto->nNextAddrSend =
             PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+        LOCK(pto->cs_addrSend);
         std::vector<CAddress> vAddr;
         vAddr.reserve(pto->vAddrToSend.size());
         for (const CAddress &addr : pto->vAddrToSend) {
@@ -3455,7 +3583,7 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                 pBestIndex = pindex;
                 if (fFoundStartingHeader) {
                     // add this to the headers message
-                    vHeaders.push_back(pindex->GetBlockHeader());
+                    vHeaders.emplace_back();
                 } else if (PeerHasHeader(&state, pindex)) {
                     // Keep looking for the first new block.
                     continue;
@@ -3465,13 +3593,19 @@ bool SendMessages(const Config &config, CNode *pto, CConnman &connman,
                     // one.
                     // Start sending headers.
                     fFoundStartingHeader = true;
-                    vHeaders.push_back(pindex->GetBlockHeader());
+                    vHeaders.emplace_back();
                 } else {
                     // Peer doesn't have this header or the prior one --
                     // nothing will connect, so bail out.
                     fRevertToInv = true;
                     break;
                 }
+                // These are recent blocks, whose solution is still in memory
+                // or in the solution cache of the block tree DB.
+                if (!pindex->GetBlockHeader(vHeaders.back())) {
+                    fRevertToInv = true;
+                    break;
+                }
             }
         }
         if (!fRevertToInv && !vHeaders.empty()) {
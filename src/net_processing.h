@@ -62,6 +62,13 @@ void Misbehaving(NodeId nodeid, int howmuch, const std::string &reason);
 /** Process protocol messages received from a given node */
 bool ProcessMessages(const Config &config, CNode *pfrom, CConnman &connman,
                      const std::atomic<bool> &interrupt);
+/**
+ * Process the next messages received from a given node if they don't need
+ * cs_main, from the message worker threads.
+ */
+bool ProcessConcurrentMessages(const Config &config, CNode *pfrom,
+                               CConnman &connman,
+                               const std::atomic<bool> &interrupt);
 /**
  * Send queued protocol messages to be sent to a give node.
  *
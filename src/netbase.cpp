@@ -20,6 +20,7 @@
 
 #ifndef WIN32
 #include <fcntl.h>
+#include <poll.h>
 #endif
 
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
@@ -199,6 +200,29 @@ struct timeval MillisToTimeval(int64_t nTimeout) {
     return timeout;
 }
 
+/**
+ * Wait until a socket is readable, or writable if fWrite, for at most
+ * nTimeout milliseconds. Returns the number of ready sockets (0 on timeout)
+ * or SOCKET_ERROR. Unlike select(), poll() places no limit on the value of
+ * the descriptor, which can exceed FD_SETSIZE when many peers are connected.
+ */
+static int WaitForSocket(SOCKET hSocket, bool fWrite, int64_t nTimeout) {
+#ifdef WIN32
+    struct timeval timeout = MillisToTimeval(nTimeout);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    return select(hSocket + 1, fWrite ? nullptr : &fdset,
+                  fWrite ? &fdset : nullptr, nullptr, &timeout);
+#else
+    struct pollfd pfd;
+    pfd.fd = hSocket;
+    pfd.events = fWrite ? POLLOUT : POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, nTimeout);
+#endif
+}
+
 /**
  * Read bytes from socket. This will either read the full number of bytes
  * requested or return False on error or timeout.
@@ -231,15 +255,8 @@ static bool InterruptibleRecv(char *data, size_t len, int timeout,
             int nErr = WSAGetLastError();
             if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
                 nErr == WSAEINVAL) {
-                if (!IsSelectableSocket(hSocket)) {
-                    return false;
-                }
-                struct timeval tval =
-                    MillisToTimeval(std::min(endTime - curTime, maxWait));
-                fd_set fdset;
-                FD_ZERO(&fdset);
-                FD_SET(hSocket, &fdset);
-                int nRet = select(hSocket + 1, &fdset, nullptr, nullptr, &tval);
+                int nRet = WaitForSocket(hSocket, false,
+                                         std::min(endTime - curTime, maxWait));
                 if (nRet == SOCKET_ERROR) {
                     return false;
                 }
@@ -473,11 +490,7 @@ static bool ConnectSocketDirectly(const CService &addrConnect,
         // WSAEINVAL is here because some legacy version of winsock uses it
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
             nErr == WSAEINVAL) {
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+            int nRet = WaitForSocket(hSocket, true, nTimeout);
             if (nRet == 0) {
                 LogPrint("net", "connection to %s timeout\n",
                          addrConnect.ToString());
@@ -485,7 +498,7 @@ static bool ConnectSocketDirectly(const CService &addrConnect,
                 return false;
             }
             if (nRet == SOCKET_ERROR) {
-                LogPrintf("select() for %s failed: %s\n",
+                LogPrintf("waiting on connection to %s failed: %s\n",
                           addrConnect.ToString(),
                           NetworkErrorString(WSAGetLastError()));
                 CloseSocket(hSocket);
@@ -507,7 +520,7 @@ static bool ConnectSocketDirectly(const CService &addrConnect,
                 return false;
             }
             if (nRet != 0) {
-                LogPrintf("connect() to %s failed after select(): %s\n",
+                LogPrintf("connect() to %s failed after waiting: %s\n",
                           addrConnect.ToString(), NetworkErrorString(nRet));
                 CloseSocket(hSocket);
                 return false;
@@ -0,0 +1,135 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netmsgstats.h"
+
+#include "protocol.h"
+#include "util.h"
+
+#include <algorithm>
+
+namespace {
+
+struct CNetMsgCmdStatsMap {
+    std::map<std::string, CNetMsgCmdStats> mapStats;
+
+    CNetMsgCmdStatsMap() {
+        for (const std::string &strCommand : getAllNetMessageTypes()) {
+            mapStats[strCommand];
+        }
+        mapStats[NET_MESSAGE_COMMAND_OTHER];
+    }
+};
+
+// Built on first use, as the list of commands is itself a static, and never
+// changed after, so lookups need no lock.
+std::map<std::string, CNetMsgCmdStats> &GetNetMsgCmdStatsMap() {
+    static CNetMsgCmdStatsMap stats;
+    return stats.mapStats;
+}
+
+CHistogram sendBufferStats;
+}
+
+CHistogram::CHistogram() : nCount(0), nTotal(0), nMax(0) {
+    for (int i = 0; i < BUCKETS; i++) {
+        vBuckets[i] = 0;
+    }
+}
+
+int CHistogram::GetBucket(uint64_t nValue) {
+    int nBucket = 0;
+    while (nValue && nBucket < BUCKETS - 1) {
+        nValue >>= 1;
+        nBucket++;
+    }
+    return nBucket;
+}
+
+uint64_t CHistogram::GetBucketMax(int nBucket) {
+    return (uint64_t(1) << nBucket) - 1;
+}
+
+void CHistogram::Add(uint64_t nValue) {
+    vBuckets[GetBucket(nValue)].fetch_add(1, std::memory_order_relaxed);
+    nCount.fetch_add(1, std::memory_order_relaxed);
+    nTotal.fetch_add(nValue, std::memory_order_relaxed);
+    uint64_t nPrevMax = nMax.load(std::memory_order_relaxed);
+    while (nValue > nPrevMax &&
+           !nMax.compare_exchange_weak(nPrevMax, nValue,
+                                       std::memory_order_relaxed)) {
+    }
+}
+
+CHistogram::Snapshot CHistogram::GetSnapshot() const {
+    Snapshot snapshot;
+    snapshot.nCount = nCount.load(std::memory_order_relaxed);
+    snapshot.nTotal = nTotal.load(std::memory_order_relaxed);
+    snapshot.nMax = nMax.load(std::memory_order_relaxed);
+    snapshot.vBuckets.resize(BUCKETS);
+    for (int i = 0; i < BUCKETS; i++) {
+        snapshot.vBuckets[i] = vBuckets[i].load(std::memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+uint64_t CHistogram::Snapshot::GetPercentile(double fraction) const {
+    // The buckets are read one by one while values are being added, so they
+    // may not sum up to nCount exactly.
+    uint64_t nTotalCount = 0;
+    for (uint64_t nBucketCount : vBuckets) {
+        nTotalCount += nBucketCount;
+    }
+    uint64_t nSeen = 0;
+    for (size_t i = 0; i < vBuckets.size(); i++) {
+        nSeen += vBuckets[i];
+        if (nSeen > 0 && nSeen >= fraction * nTotalCount) {
+            return i + 1 == vBuckets.size() ? nMax
+                                            : std::min(GetBucketMax(i), nMax);
+        }
+    }
+    return nMax;
+}
+
+CNetMsgCmdStats &GetNetMsgCmdStats(const std::string &strCommand) {
+    std::map<std::string, CNetMsgCmdStats> &mapStats = GetNetMsgCmdStatsMap();
+    auto it = mapStats.find(strCommand);
+    if (it == mapStats.end()) {
+        it = mapStats.find(NET_MESSAGE_COMMAND_OTHER);
+    }
+    return it->second;
+}
+
+const std::map<std::string, CNetMsgCmdStats> &GetAllNetMsgCmdStats() {
+    return GetNetMsgCmdStatsMap();
+}
+
+CHistogram &GetSendBufferStats() {
+    return sendBufferStats;
+}
+
+void LogNetMsgStats() {
+    LogPrintf("Message statistics (count, total, median, 99th percentile and "
+              "max, in ms):\n");
+    for (const auto &entry : GetNetMsgCmdStatsMap()) {
+        const CHistogram::Snapshot process =
+            entry.second.processTime.GetSnapshot();
+        if (process.nCount == 0) {
+            continue;
+        }
+        const CHistogram::Snapshot queue =
+            entry.second.queueTime.GetSnapshot();
+        LogPrintf("  %-12s processing %u, %.2f, %.2f, %.2f, %.2f - queued "
+                  "%.2f, %.2f, %.2f, %.2f\n",
+                  entry.first, process.nCount, process.nTotal * 0.001,
+                  process.GetPercentile(0.5) * 0.001,
+                  process.GetPercentile(0.99) * 0.001, process.nMax * 0.001,
+                  queue.nTotal * 0.001, queue.GetPercentile(0.5) * 0.001,
+                  queue.GetPercentile(0.99) * 0.001, queue.nMax * 0.001);
+    }
+    const CHistogram::Snapshot sendBuffer = sendBufferStats.GetSnapshot();
+    LogPrintf("Send buffers (bytes): median %u, 99th percentile %u, max %u\n",
+              sendBuffer.GetPercentile(0.5), sendBuffer.GetPercentile(0.99),
+              sendBuffer.nMax);
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETMSGSTATS_H
+#define BITCOIN_NETMSGSTATS_H
+
+#include <atomic>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// By default the message statistics are not written to the log.
+static const int64_t DEFAULT_MSG_STATS_INTERVAL = 0;
+
+/**
+ * Histogram of values (times in microseconds, sizes in bytes) over power of
+ * two buckets: bucket 0 counts zeros, and bucket i > 0 the values from
+ * 2^(i-1) to 2^i - 1, the last one also counting anything larger. Values are
+ * added with relaxed atomic operations only, so threads never wait on each
+ * other to record them.
+ */
+class CHistogram {
+public:
+    static const int BUCKETS = 32;
+
+    struct Snapshot {
+        uint64_t nCount;
+        uint64_t nTotal;
+        uint64_t nMax;
+        std::vector<uint64_t> vBuckets;
+
+        /**
+         * Upper bound of the bucket where the given fraction of the values
+         * is reached, eg. 0.5 for the median.
+         */
+        uint64_t GetPercentile(double fraction) const;
+    };
+
+    CHistogram();
+
+    void Add(uint64_t nValue);
+    Snapshot GetSnapshot() const;
+
+    static int GetBucket(uint64_t nValue);
+    //! Largest value counted in the bucket (but the last one).
+    static uint64_t GetBucketMax(int nBucket);
+
+private:
+    std::atomic<uint64_t> vBuckets[BUCKETS];
+    std::atomic<uint64_t> nCount;
+    std::atomic<uint64_t> nTotal;
+    std::atomic<uint64_t> nMax;
+};
+
+/** Statistics on the messages of one command, from all peers. */
+struct CNetMsgCmdStats {
+    //! Time spent processing the messages.
+    CHistogram processTime;
+    //! Time the messages waited from their receipt until processing.
+    CHistogram queueTime;
+};
+
+/**
+ * Statistics per command: the set of commands is fixed, unknown ones are
+ * accounted as NET_MESSAGE_COMMAND_OTHER.
+ */
+CNetMsgCmdStats &GetNetMsgCmdStats(const std::string &strCommand);
+
+/** The commands, with their statistics. */
+const std::map<std::string, CNetMsgCmdStats> &GetAllNetMsgCmdStats();
+
+/** Bytes queued to a peer's send buffer, sampled when a message is queued. */
+CHistogram &GetSendBufferStats();
+
+/** Write a summary of the message statistics to the log. */
+void LogNetMsgStats();
+
+#endif // BITCOIN_NETMSGSTATS_H
@@ -13,12 +13,15 @@
 #include "consensus/params.h"
 //#include "chainparams.h"
 #include "crypto/equihash.h"
+#include "equihashcache.h"
 #include "primitives/block.h"
 #include "streams.h"
+#include "sync.h"
 #include "uint256.h"
 #include "util.h"
 #include "validation.h"
 
+
 unsigned int BitcoinGetNextWorkRequired(const CBlockIndex* pindexPrev, const CBlockHeader *pblock, const Consensus::Params& params);
 
 /**
@@ -110,60 +113,151 @@ unsigned int LwmaGetNextWorkRequired(const CBlockIndex* pindexPrev, const CBlock
     return LwmaCalculateNextWorkRequired(pindexPrev, params);
 }
 
+/** Solvetime of pindex, capped to 8 target spacings if fCapped. */
+static int64_t LwmaSolvetime(const CBlockIndex *pindex, bool fCapped,
+                             const Consensus::Params &params) {
+    int64_t solvetime = pindex->GetBlockTime() - pindex->pprev->GetBlockTime();
+    //in case difficulty drops too fast
+    if (fCapped && solvetime >= 8 * params.nPowTargetSpacingCDY) {
+        solvetime = 8 * params.nPowTargetSpacingCDY;
+    }
+    return solvetime;
+}
+
+namespace {
+/**
+ * Number of heights the LWMA sums are kept for. It covers the largest window,
+ * so that the parent of a new header is found along the active chain.
+ */
+const int LWMA_STATE_CACHE_SIZE = 64;
+
+struct CLwmaCacheEntry {
+    const CBlockIndex *pindex;
+    CLwmaState state;
+};
+
+CCriticalSection cs_lwmacache;
+//! LWMA sums of the last block they were computed for at each height, modulo
+//! LWMA_STATE_CACHE_SIZE.
+CLwmaCacheEntry lwmaCache[LWMA_STATE_CACHE_SIZE];
+
+bool GetCachedLwmaState(const CBlockIndex *pindex, int nWindow, bool fCapped,
+                        CLwmaState &state) {
+    LOCK(cs_lwmacache);
+    const CLwmaCacheEntry &entry =
+        lwmaCache[pindex->nHeight % LWMA_STATE_CACHE_SIZE];
+    if (entry.pindex != pindex || entry.state.nWindow != nWindow ||
+        entry.state.fCapped != fCapped) {
+        return false;
+    }
+    state = entry.state;
+    return true;
+}
+
+void CacheLwmaState(const CBlockIndex *pindex, const CLwmaState &state) {
+    LOCK(cs_lwmacache);
+    CLwmaCacheEntry &entry = lwmaCache[pindex->nHeight % LWMA_STATE_CACHE_SIZE];
+    entry.pindex = pindex;
+    entry.state = state;
+}
+} // namespace
+
+void ClearLwmaStateCache() {
+    LOCK(cs_lwmacache);
+    for (CLwmaCacheEntry &entry : lwmaCache) {
+        entry.pindex = nullptr;
+    }
+}
+
+CLwmaState GetLwmaState(const CBlockIndex *pindexPrev,
+                        const Consensus::Params &params) {
+    // The window and the cap depend on the height of the next block.
+    const int height = pindexPrev->nHeight + 1;
+    assert(height > params.nZawyLwmaAveragingWindow);
+    CLwmaState state;
+    state.nWindow = params.nZawyLwmaAveragingWindow;
+    if (height > params.nNewRuleHeight) state.nWindow = 45;
+    state.fCapped = height > params.nNewRuleHeight;
+    const int N = state.nWindow;
+
+    if (GetCachedLwmaState(pindexPrev, N, state.fCapped, state)) {
+        return state;
+    }
+
+    arith_uint256 target;
+    CLwmaState parent;
+    if (GetCachedLwmaState(pindexPrev->pprev, N, state.fCapped, parent)) {
+        // Slide the parent's window by one block: every weight drops by one,
+        // which drops the oldest block, and pindexPrev comes in with weight N.
+        const CBlockIndex *pindexOut = pindexPrev->GetAncestor(height - N - 1);
+        const int64_t solvetimeOut =
+            LwmaSolvetime(pindexOut, state.fCapped, params);
+        const int64_t solvetimeIn =
+            LwmaSolvetime(pindexPrev, state.fCapped, params);
+        state.nWeightedTime =
+            parent.nWeightedTime - parent.nTime + N * solvetimeIn;
+        state.nTime = parent.nTime - solvetimeOut + solvetimeIn;
+        state.nTargetSum = parent.nTargetSum;
+        target.SetCompact(pindexOut->nBits);
+        state.nTargetSum -= target;
+        target.SetCompact(pindexPrev->nBits);
+        state.nTargetSum += target;
+    } else {
+        state.nWeightedTime = 0;
+        state.nTime = 0;
+        state.nTargetSum = 0;
+        const CBlockIndex *pindex = pindexPrev;
+        for (int nWeight = N; nWeight > 0; nWeight--) {
+            const int64_t solvetime =
+                LwmaSolvetime(pindex, state.fCapped, params);
+            state.nWeightedTime += solvetime * nWeight;
+            state.nTime += solvetime;
+            target.SetCompact(pindex->nBits);
+            state.nTargetSum += target;
+            pindex = pindex->pprev;
+        }
+    }
+
+    CacheLwmaState(pindexPrev, state);
+    return state;
+}
+
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexPrev, const Consensus::Params& params)
 {
     if (params.fPowNoRetargeting) {
         return pindexPrev->nBits;
     }
 
-    int N = params.nZawyLwmaAveragingWindow;  
     const int T = params.nPowTargetSpacingCDY; //2 minutes
     const int height = pindexPrev->nHeight + 1;
     const int nNewRuleHeight = params.nNewRuleHeight;
     const int CDYEquihashForkHeight= params.CDYEquihashForkHeight; 
     double adjust = 1;//0.998;
-    
-    assert(height > N);
-    if(height>nNewRuleHeight) N = 45;
-    arith_uint256 sum_target, sum_last10_target,sum_last5_target;
-    int sum_time = 0, nWeight = 0;
-    
+
+    // Sums over the N most recent blocks, rolled forward from the parent's.
+    const CLwmaState state = GetLwmaState(pindexPrev, params);
+    const int N = state.nWindow;
+    int sum_time = state.nWeightedTime;  // Weighted solvetime sum. The nearsest blocks get the most weight.
+    arith_uint256 sum_target = state.nTargetSum;
+    arith_uint256 sum_last10_target,sum_last5_target;
+
     int sum_last10_time=0;  //Solving time of the last ten block
     int sum_last5_time=0;
 
-    // Loop through N most recent blocks.
-    for (int i = height - N; i < height; i++) {
-        const CBlockIndex* block = pindexPrev->GetAncestor(i);
-        const CBlockIndex* block_Prev = block->GetAncestor(i - 1);
-        int64_t solvetime = block->GetBlockTime() - block_Prev->GetBlockTime();
-        
-        //in case difficulty drops too fast
-        if(height>nNewRuleHeight && solvetime>=8*T)  solvetime = 8 * T;
-        
-        nWeight++;
-        sum_time += solvetime * nWeight;  // Weighted solvetime sum. The nearsest blocks get the most weight. 
-        
-        // Target sum divided by a factor, (k N^2).
-        // The factor is a part of the final equation. However we divide sum_target here to avoid
-        // potential overflow.
+    const CBlockIndex* block = pindexPrev;
+    for (int i = height - 1; i >= height - 10; i--) {
+        int64_t solvetime = LwmaSolvetime(block, state.fCapped, params);
         arith_uint256 target;
         target.SetCompact(block->nBits);
-        sum_target += target ;   // (k * N * N);       
-        if(i >= height-10) 
-        {
-            sum_last10_time += solvetime;
-            sum_last10_target += target;
-	    if(i >= height-5) 
-            {
-              sum_last5_time += solvetime;
-              sum_last5_target += target;
-            }     
-
-        }       
-
+        sum_last10_time += solvetime;
+        sum_last10_target += target;
+        if (i >= height - 5) {
+            sum_last5_time += solvetime;
+            sum_last5_target += target;
+        }
+        block = block->pprev;
     }
-    
-    
+
     // Keep t reasonable in case strange solvetimes occurred.
     if (sum_time < N * N * T / 20) {
         sum_time = N * N * T / 20;
@@ -464,14 +558,19 @@ unsigned int CalculateBCCNextWorkRequired(const CBlockIndex* pindexPrev, int64_t
 }
 bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& params)
 {
+    // Skip the verification if we have already seen this exact solution.
+    uint256 cacheKey = GetEquihashCacheKey(*pblock);
+    if (IsKeyInEquihashCache(cacheKey)) {
+        return true;
+    }
+
     int height = pblock->nHeight;
     unsigned int n = params.EquihashN(height);
     unsigned int k = params.EquihashK(height);
 
     // Hash state
-    crypto_generichash_blake2b_state state;
-    EhInitialiseState(n, k, state, params.EquihashUseCDYSalt(height));
-
+    CBlake2b hasher;
+    EhInitialiseState(n, k, hasher, params.EquihashUseCDYSalt(height));
 
     // I = the block header minus nonce and solution.
     CEquihashInput I{*pblock};
@@ -481,13 +580,14 @@ bool CheckEquihashSolution(const CBlockHeader *pblock, const CChainParams& param
     ss << pblock->nNonce;
 
     // H(I||V||...
-    crypto_generichash_blake2b_update(&state, (unsigned char*)&ss[0], ss.size());
+    hasher.Write((unsigned char*)&ss[0], ss.size());
 
     bool isValid;
-    EhIsValidSolution(n, k, state, pblock->nSolution, isValid);
+    EhIsValidSolution(n, k, hasher, pblock->nSolution, isValid);
     if (!isValid)
         return error("CheckEquihashSolution(): invalid solution");
 
+    AddKeyInEquihashCache(cacheKey);
     return true;
 }
 
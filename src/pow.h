@@ -19,9 +19,36 @@ class CChainParams;
 uint32_t GetNextWorkRequired(const CBlockIndex *pindexPrev,
                              const CBlockHeader *pblock, const Config &config);
 
+/**
+ * Running sums over the LWMA window ending at a block, so that the work
+ * required after its child can be derived from its parent's sums instead of
+ * walking the whole window again.
+ */
+struct CLwmaState {
+    //! Number of blocks in the window.
+    int nWindow;
+    //! Whether solvetimes are capped to 8 target spacings.
+    bool fCapped;
+    //! Solvetimes weighted from 1 for the oldest block to nWindow for the
+    //! newest.
+    int64_t nWeightedTime;
+    //! Plain sum of the solvetimes.
+    int64_t nTime;
+    //! Sum of the targets.
+    arith_uint256 nTargetSum;
+};
+
 /** Zawy's LWMA - next generation algorithm for testnet currently */
 unsigned int LwmaGetNextWorkRequired(const CBlockIndex* pindexPrev, const CBlockHeader *pblock, const Consensus::Params&);
 unsigned int LwmaCalculateNextWorkRequired(const CBlockIndex* pindexPrev, const Consensus::Params& params);
+/**
+ * Get the LWMA sums over the window ending at pindexPrev, computing them if
+ * needed. The sums of the most recent blocks are kept in a small cache by
+ * height, so that those of a child are rolled forward from its parent's.
+ */
+CLwmaState GetLwmaState(const CBlockIndex *pindexPrev, const Consensus::Params &params);
+/** Forget the cached LWMA sums, which refer to block index entries. */
+void ClearLwmaStateCache();
 
 /** Digishield v3 - used in Bitcoin Gold mainnet currently */
 unsigned int DigishieldGetNextWorkRequired(const CBlockIndex* pindexPrev, const CBlockHeader *pblock, const Consensus::Params&);
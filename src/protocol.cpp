@@ -45,6 +45,16 @@ bool IsBlockLike(const std::string &strCommand) {
            strCommand == NetMsgType::CMPCTBLOCK ||
            strCommand == NetMsgType::BLOCKTXN;
 }
+
+bool IsConcurrent(const std::string &strCommand) {
+    return strCommand == NetMsgType::PING || strCommand == NetMsgType::PONG ||
+           strCommand == NetMsgType::ADDR ||
+           strCommand == NetMsgType::GETADDR ||
+           strCommand == NetMsgType::FEEFILTER ||
+           strCommand == NetMsgType::FILTERLOAD ||
+           strCommand == NetMsgType::FILTERADD ||
+           strCommand == NetMsgType::FILTERCLEAR;
+}
 }; // namespace NetMsgType
 
 /**
@@ -177,6 +187,8 @@ std::string CInv::ToString() const {
     }
 }
 
+const char *NET_MESSAGE_COMMAND_OTHER = "*other*";
+
 const std::vector<std::string> &getAllNetMessageTypes() {
     return allNetMessageTypesVec;
 }
@@ -257,11 +257,22 @@ extern const char *BLOCKTXN;
  * may need to be processed differently.
  */
 bool IsBlockLike(const std::string &strCommand);
+
+/**
+ * Indicate if the message is handled without cs_main, but to punish the peer:
+ * it only touches the peer itself, the address manager and the peers' address
+ * relay state, which have their own locks. The message worker threads process
+ * these messages.
+ */
+bool IsConcurrent(const std::string &strCommand);
 }; // namespace NetMsgType
 
 /* Get a vector of all valid message types (see above) */
 const std::vector<std::string> &getAllNetMessageTypes();
 
+/* Name under which the statistics of any other message type are kept */
+extern const char *NET_MESSAGE_COMMAND_OTHER;
+
 /**
  * nServices flags.
  */
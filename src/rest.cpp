@@ -3,10 +3,12 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "config.h"
 #include "httpserver.h"
+#include "net.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "rpc/blockchain.h"
@@ -14,6 +16,7 @@
 #include "rpc/tojson.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "validation.h"
@@ -157,6 +160,10 @@ static bool rest_headers(Config &config, HTTPRequest *req,
 
     std::vector<const CBlockIndex *> headers;
     headers.reserve(count);
+    std::vector<CBlockHeader> vHeaders;
+    vHeaders.reserve(count);
+    // Headers whose solution was evicted from memory, with their hash.
+    std::vector<std::pair<size_t, uint256>> vEvicted;
     {
         LOCK(cs_main);
         BlockMap::const_iterator it = mapBlockIndex.find(hash);
@@ -164,6 +171,12 @@ static bool rest_headers(Config &config, HTTPRequest *req,
             (it != mapBlockIndex.end()) ? it->second : nullptr;
         while (pindex != nullptr && chainActive.Contains(pindex)) {
             headers.push_back(pindex);
+            vHeaders.emplace_back();
+            pindex->GetBlockHeader(vHeaders.back(), false);
+            if (pindex->fSolutionEvicted) {
+                vEvicted.emplace_back(vHeaders.size() - 1,
+                                      pindex->GetBlockHash());
+            }
             if (headers.size() == size_t(count)) {
                 break;
             }
@@ -171,9 +184,18 @@ static bool rest_headers(Config &config, HTTPRequest *req,
         }
     }
 
+    // Read the evicted solutions without holding cs_main.
+    for (const auto &evicted : vEvicted) {
+        if (!pblocktree->ReadSolution(evicted.second,
+                                      vHeaders[evicted.first].nSolution)) {
+            return RESTERR(req, HTTP_INTERNAL_SERVER_ERROR,
+                           "Can't read block solution from disk");
+        }
+    }
+
     CDataStream ssHeader(SER_NETWORK, PROTOCOL_VERSION);
-    for (const CBlockIndex *pindex : headers) {
-        ssHeader << pindex->GetBlockHeader();
+    for (const CBlockHeader &header : vHeaders) {
+        ssHeader << header;
     }
 
     switch (rf) {
@@ -193,8 +215,12 @@ static bool rest_headers(Config &config, HTTPRequest *req,
         }
         case RF_JSON: {
             UniValue jsonHeaders(UniValue::VARR);
-            for (const CBlockIndex *pindex : headers) {
-                jsonHeaders.push_back(blockheaderToJSON(pindex));
+            {
+                LOCK(cs_main);
+                for (size_t i = 0; i < headers.size(); i++) {
+                    jsonHeaders.push_back(
+                        blockheaderToJSON(headers[i], vHeaders[i].nSolution));
+                }
             }
             std::string strJSON = jsonHeaders.write() + "\n";
             req->WriteHeader("Content-Type", "application/json");
@@ -227,6 +253,9 @@ static bool rest_block(const Config &config, HTTPRequest *req,
     }
 
     CBlock block;
+    // The binary and hex formats are served from the cache of serialized
+    // blocks.
+    std::shared_ptr<const CSharedNetMsg> blockMsg;
     CBlockIndex *pblockindex = nullptr;
     {
         LOCK(cs_main);
@@ -241,25 +270,29 @@ static bool rest_block(const Config &config, HTTPRequest *req,
                            hashStr + " not available (pruned data)");
         }
 
-        if (!ReadBlockFromDisk(block, pblockindex, config)) {
+        if (rf == RF_BINARY || rf == RF_HEX) {
+            blockMsg = GetSerializedBlock(config, pblockindex,
+                                          RPCSerializationFlags());
+            if (!blockMsg) {
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+            }
+        } else if (!ReadBlockFromDisk(block, pblockindex, config)) {
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
         }
     }
 
-    CDataStream ssBlock(SER_NETWORK,
-                        PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
-
     switch (rf) {
         case RF_BINARY: {
-            std::string binaryBlock = ssBlock.str();
+            std::string binaryBlock(blockMsg->data->begin(),
+                                    blockMsg->data->end());
             req->WriteHeader("Content-Type", "application/octet-stream");
             req->WriteReply(HTTP_OK, binaryBlock);
             return true;
         }
 
         case RF_HEX: {
-            std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+            std::string strHex =
+                HexStr(blockMsg->data->begin(), blockMsg->data->end()) + "\n";
             req->WriteHeader("Content-Type", "text/plain");
             req->WriteReply(HTTP_OK, strHex);
             return true;
@@ -6,6 +6,7 @@
 #include "rpc/blockchain.h"
 
 #include "amount.h"
+#include "blockcache.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -13,7 +14,9 @@
 #include "config.h"
 #include "consensus/validation.h"
 #include "consensus/params.h"
+#include "equihashcache.h"
 #include "hash.h"
+#include "net.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
 #include "rpc/server.h"
@@ -103,7 +106,8 @@ double GetDifficulty(const CBlockIndex *blockindex) {
     return GetDifficultyFromBits(blockindex->nBits);
 }
 
-UniValue blockheaderToJSON(const CBlockIndex *blockindex) {
+UniValue blockheaderToJSON(const CBlockIndex *blockindex,
+                           const std::vector<unsigned char> &solution) {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", blockindex->GetBlockHash().GetHex()));
     int confirmations = -1;
@@ -122,7 +126,7 @@ UniValue blockheaderToJSON(const CBlockIndex *blockindex) {
         Pair("mediantime", int64_t(blockindex->GetMedianTimePast())));
     result.push_back(Pair("nonceUint32", (uint64_t)((uint32_t)blockindex->nNonce.GetUint64(0))));
     result.push_back(Pair("nonce", blockindex->nNonce.GetHex()));
-    result.push_back(Pair("solution", HexStr(blockindex->nSolution)));
+    result.push_back(Pair("solution", HexStr(solution)));
     result.push_back(Pair("bits", strprintf("%08x", blockindex->nBits)));
     result.push_back(Pair("difficulty", GetDifficulty(blockindex)));
     result.push_back(Pair("chainwork", blockindex->nChainWork.GetHex()));
@@ -790,15 +794,21 @@ UniValue getblockheader(const Config &config, const JSONRPCRequest &request) {
 
     CBlockIndex *pblockindex = mapBlockIndex[hash];
 
+    CBlockHeader header;
+    if (!pblockindex->GetBlockHeader(header)) {
+        throw JSONRPCError(RPC_DATABASE_ERROR,
+                           "Can't read block solution from disk");
+    }
+
     if (!fVerbose) {
         int ser_flags = legacy_format ? SERIALIZE_BLOCK_LEGACY : 0;
         CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | ser_flags);
-        ssBlock << pblockindex->GetBlockHeader();
+        ssBlock << header;
         std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
         return strHex;
     }
 
-    return blockheaderToJSON(pblockindex);
+    return blockheaderToJSON(pblockindex, header.nSolution);
 }
 
 UniValue getblock(const Config &config, const JSONRPCRequest &request) {
@@ -890,21 +900,22 @@ UniValue getblock(const Config &config, const JSONRPCRequest &request) {
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
     }
 
-    if (!ReadBlockFromDisk(block, pblockindex, config)) {
-        // Block not found on disk. This could be because we have the block
-        // header in our index but don't have the block (for example if a
-        // non-whitelisted node sends us an unrequested long chain of valid
-        // blocks, we add the headers to our index, but don't accept the block).
-        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
-    }
-
+    // The block may not be on disk even though we have its header in our
+    // index (for example if a non-whitelisted node sends us an unrequested
+    // long chain of valid blocks, we add the headers to our index, but don't
+    // accept the block).
     if (verbosity <= 0) {
         int ser_flags = legacy_format ? SERIALIZE_BLOCK_LEGACY : 0;
-        CDataStream ssBlock(SER_NETWORK, 
-                            PROTOCOL_VERSION | ser_flags | RPCSerializationFlags());
-        ssBlock << block;
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end());
-        return strHex;
+        std::shared_ptr<const CSharedNetMsg> blockMsg = GetSerializedBlock(
+            config, pblockindex, ser_flags | RPCSerializationFlags());
+        if (!blockMsg) {
+            throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
+        }
+        return HexStr(blockMsg->data->begin(), blockMsg->data->end());
+    }
+
+    if (!ReadBlockFromDisk(block, pblockindex, config)) {
+        throw JSONRPCError(RPC_MISC_ERROR, "Block not found on disk");
     }
 
     return blockToJSON(config, block, pblockindex, verbosity >= 2);
@@ -1568,6 +1579,35 @@ UniValue getmempoolinfo(const Config &config, const JSONRPCRequest &request) {
     return mempoolInfoToJSON();
 }
 
+UniValue getequihashcacheinfo(const Config &config,
+                              const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0) {
+        throw std::runtime_error(
+            "getequihashcacheinfo\n"
+            "\nReturns details on the cache of verified Equihash "
+            "solutions.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"maxelements\": xxxxx,        (numeric) Number of solutions "
+            "the cache can hold\n"
+            "  \"hits\": xxxxx,               (numeric) Verifications "
+            "avoided thanks to the cache\n"
+            "  \"misses\": xxxxx              (numeric) Solutions that had to "
+            "be verified\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getequihashcacheinfo", "") +
+            HelpExampleRpc("getequihashcacheinfo", ""));
+    }
+
+    EquihashCacheStats stats = GetEquihashCacheStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("maxelements", (int64_t)stats.nMaxElements));
+    ret.push_back(Pair("hits", (int64_t)stats.nHits));
+    ret.push_back(Pair("misses", (int64_t)stats.nMisses));
+    return ret;
+}
+
 UniValue preciousblock(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() != 1) {
         throw std::runtime_error(
@@ -1922,6 +1962,7 @@ static const CRPCCommand commands[] = {
     { "blockchain",         "getmempooldescendants",  getmempooldescendants,  true,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        getmempoolentry,        true,  {"txid"} },
     { "blockchain",         "getmempoolinfo",         getmempoolinfo,         true,  {} },
+    { "blockchain",         "getequihashcacheinfo",   getequihashcacheinfo,   true,  {} },
     { "blockchain",         "getrawmempool",          getrawmempool,          true,  {"verbose"} },
     { "blockchain",         "gettxout",               gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        true,  {} },
@@ -30,8 +30,10 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"setmocktime", 0, "timestamp"},
     {"generate", 0, "nblocks"},
     {"generate", 1, "maxtries"},
+    {"generate", 2, "verbose"},
     {"generatetoaddress", 0, "nblocks"},
     {"generatetoaddress", 2, "maxtries"},
+    {"generatetoaddress", 3, "verbose"},
     {"getnetworkhashps", 0, "nblocks"},
     {"getnetworkhashps", 1, "height"},
     {"sendtoaddress", 1, "amount"},
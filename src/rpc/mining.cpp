@@ -113,10 +113,11 @@ static UniValue getnetworkhashps(const Config &config,
 static UniValue generateBlocks(const Config &config,
                                std::shared_ptr<CReserveScript> coinbaseScript,
                                int nGenerate, uint64_t nMaxTries,
-                               bool keepScript) {
+                               bool keepScript, bool fVerbose) {
     static const int nInnerLoopCount = 0x100000;
-    static const int nInnerLoopEquihashMask = 0xFFFF;
-    static const int nInnerLoopEquihashCount = 0xFFFF;
+    // Nonces tried on one template before it is refreshed with the new
+    // transactions of the mempool.
+    static const uint64_t nInnerLoopEquihashCount = 0xFFFF;
     int nHeightStart = 0;
     int nHeightEnd = 0;
     int nHeight = 0;
@@ -129,11 +130,20 @@ static UniValue generateBlocks(const Config &config,
         nHeightEnd = nHeightStart + nGenerate;
     }
 
+    int nThreads = GetArg("-genproclimit", DEFAULT_GENERATE_THREADS);
+    if (nThreads <= 0) {
+        nThreads = std::max(GetNumCores(), 1);
+    }
+    int64_t nTimeout = GetArg("-generatetimeout", DEFAULT_GENERATE_TIMEOUT);
+    // The timeout applies to each block, from the first template built for
+    // its height.
+    int64_t nDeadline = 0;
+    int nDeadlineHeight = -1;
+    EquihashSolverStats solverStats;
+
     unsigned int nExtraNonce = 0;
     UniValue blockHashes(UniValue::VARR);
     const CChainParams& params = config.GetChainParams();
-    unsigned int n;
-    unsigned int k;
     while (nHeight < nHeightEnd) {
         std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(config, Params()).CreateNewBlock(coinbaseScript->reserveScript));
         if (!pblocktemplate.get()) {
@@ -146,6 +156,10 @@ static UniValue generateBlocks(const Config &config,
             LOCK(cs_main);
             IncrementExtraNonce(config, pblock, chainActive.Tip(), nExtraNonce);
         }
+        if (nTimeout > 0 && nDeadlineHeight != nHeight) {
+            nDeadline = GetTimeMicros() + nTimeout * 1000000;
+            nDeadlineHeight = nHeight;
+        }
         if (pblock->nHeight < (uint32_t)params.GetConsensus().cdyHeight) {
             // Solve sha256d.
             while (nMaxTries > 0 && (int)pblock->nNonce.GetUint64(0) < nInnerLoopCount &&
@@ -153,57 +167,29 @@ static UniValue generateBlocks(const Config &config,
                 pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
                 --nMaxTries;
             }
+            if (nMaxTries == 0) {
+                break;
+            }
+            if ((int)pblock->nNonce.GetUint64(0) == nInnerLoopCount) {
+                continue;
+            }
         } else {
-            // Solve Equihash.
-            n = params.EquihashN(pblock->nHeight);
-            k = params.EquihashK(pblock->nHeight);
-            crypto_generichash_blake2b_state eh_state;
-            EhInitialiseState(n, k, eh_state, params.EquihashUseCDYSalt(pblock->nHeight));
-            // I = the block header minus nonce and solution.
-            CEquihashInput I{*pblock};
-            CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-            ss << I;
-
-            // H(I||...
-            crypto_generichash_blake2b_update(&eh_state, (unsigned char*)&ss[0], ss.size());
-
-            while (nMaxTries > 0 &&
-                   ((int)pblock->nNonce.GetUint64(0) & nInnerLoopEquihashMask) < nInnerLoopEquihashCount) {
-                // Yes, there is a chance every nonce could fail to satisfy the -regtest
-                // target -- 1 in 2^(2^256). That ain't gonna happen
-                pblock->nNonce = ArithToUint256(UintToArith256(pblock->nNonce) + 1);
-
-                // H(I||V||...
-                crypto_generichash_blake2b_state curr_state;
-                curr_state = eh_state;
-                crypto_generichash_blake2b_update(&curr_state,
-                                                  pblock->nNonce.begin(),
-                                                  pblock->nNonce.size());
-
-                // (x_1, x_2, ...) = A(I, V, n, k)
-                std::function<bool(std::vector<unsigned char>)> validBlock =
-                        [&config,&pblock](std::vector<unsigned char> soln) {
-                    pblock->nSolution = soln;
-                    // TODO(h4x3rotab): Add metrics counter like Zcash? `solutionTargetChecks.increment();`
-                    // TODO(h4x3rotab): Maybe switch to EhBasicSolve and better deal with `nMaxTries`?
-                    return CheckProofOfWork(pblock->GetHash(), pblock->nBits, true, config);
-                };
-                bool found = EhBasicSolveUncancellable(n, k, curr_state, validBlock);
-                --nMaxTries;
-                // TODO(h4x3rotab): Add metrics counter like Zcash? `ehSolverRuns.increment();`
-                if (found) {
+            uint64_t nTries = std::min(nMaxTries, nInnerLoopEquihashCount);
+            const uint64_t nTriesStart = nTries;
+            bool fSolved = SolveEquihash(config, pblock, nThreads, nTries,
+                                         nDeadline, solverStats);
+            nMaxTries -= nTriesStart - nTries;
+            if (!fSolved) {
+                if (nMaxTries == 0 || ShutdownRequested() ||
+                    (nDeadline && GetTimeMicros() > nDeadline)) {
+                    // Out of tries or time, or shutting down.
                     break;
                 }
+                // Try again on a fresh template.
+                continue;
             }
         }
 
-        if (nMaxTries == 0) {
-            break;
-        }
-        if ((int)pblock->nNonce.GetUint64(0) == nInnerLoopCount) {
-            continue;
-        }
-
         std::shared_ptr<const CBlock> shared_pblock =
             std::make_shared<const CBlock>(*pblock);
         if (!ProcessNewBlock(config, shared_pblock, true, nullptr)) {
@@ -220,14 +206,45 @@ static UniValue generateBlocks(const Config &config,
         }
     }
 
-    return blockHashes;
+    if (!fVerbose) {
+        return blockHashes;
+    }
+
+    double dElapsed = solverStats.nTimeMicros * 0.000001;
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("blocks", blockHashes));
+    result.push_back(Pair("threads", nThreads));
+    result.push_back(Pair("nonces", solverStats.nNonces));
+    result.push_back(Pair("solutions", solverStats.nSolutions));
+    result.push_back(Pair("elapsed", dElapsed));
+    result.push_back(Pair("solutionspersecond",
+                          dElapsed > 0 ? solverStats.nSolutions / dElapsed
+                                       : 0.0));
+    return result;
+}
+
+static std::string GenerateVerboseResultHelp() {
+    return "{\n"
+           "  \"blocks\": [ blockhashes ],  (array) hashes of blocks "
+           "generated\n"
+           "  \"threads\": n,              (numeric) number of Equihash "
+           "solver threads\n"
+           "  \"nonces\": n,               (numeric) number of nonces the "
+           "solver was run on\n"
+           "  \"solutions\": n,            (numeric) number of Equihash "
+           "solutions found, meeting the target or not\n"
+           "  \"elapsed\": x.xxx,          (numeric) seconds spent solving "
+           "Equihash\n"
+           "  \"solutionspersecond\": x.x, (numeric) Equihash solutions "
+           "found per second\n"
+           "}\n";
 }
 
 static UniValue generate(const Config &config, const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 1 ||
-        request.params.size() > 2) {
+        request.params.size() > 3) {
         throw std::runtime_error(
-            "generate nblocks ( maxtries )\n"
+            "generate nblocks ( maxtries verbose )\n"
             "\nMine up to nblocks blocks immediately (before the RPC call "
             "returns)\n"
             "\nArguments:\n"
@@ -235,8 +252,12 @@ static UniValue generate(const Config &config, const JSONRPCRequest &request) {
             "immediately.\n"
             "2. maxtries     (numeric, optional) How many iterations to try "
             "(default = 1000000).\n"
-            "\nResult:\n"
+            "3. verbose      (boolean, optional, default=false) Also report "
+            "Equihash solver statistics.\n"
+            "\nResult (for verbose = false):\n"
             "[ blockhashes ]     (array) hashes of blocks generated\n"
+            "\nResult (for verbose = true):\n" +
+            GenerateVerboseResultHelp() +
             "\nExamples:\n"
             "\nGenerate 11 blocks\n" +
             HelpExampleCli("generate", "11"));
@@ -247,6 +268,7 @@ static UniValue generate(const Config &config, const JSONRPCRequest &request) {
     if (request.params.size() > 1) {
         nMaxTries = request.params[1].get_int();
     }
+    bool fVerbose = request.params.size() > 2 && request.params[2].get_bool();
 
     std::shared_ptr<CReserveScript> coinbaseScript;
     GetMainSignals().ScriptForMining(coinbaseScript);
@@ -265,15 +287,16 @@ static UniValue generate(const Config &config, const JSONRPCRequest &request) {
             "No coinbase script available (mining requires a wallet)");
     }
 
-    return generateBlocks(config, coinbaseScript, nGenerate, nMaxTries, true);
+    return generateBlocks(config, coinbaseScript, nGenerate, nMaxTries, true,
+                          fVerbose);
 }
 
 static UniValue generatetoaddress(const Config &config,
                                   const JSONRPCRequest &request) {
     if (request.fHelp || request.params.size() < 2 ||
-        request.params.size() > 3) {
+        request.params.size() > 4) {
         throw std::runtime_error(
-            "generatetoaddress nblocks address (maxtries)\n"
+            "generatetoaddress nblocks address ( maxtries verbose )\n"
             "\nMine blocks immediately to a specified address (before the RPC "
             "call returns)\n"
             "\nArguments:\n"
@@ -283,8 +306,12 @@ static UniValue generatetoaddress(const Config &config,
             "generated bitcoin to.\n"
             "3. maxtries     (numeric, optional) How many iterations to try "
             "(default = 1000000).\n"
-            "\nResult:\n"
+            "4. verbose      (boolean, optional, default=false) Also report "
+            "Equihash solver statistics.\n"
+            "\nResult (for verbose = false):\n"
             "[ blockhashes ]     (array) hashes of blocks generated\n"
+            "\nResult (for verbose = true):\n" +
+            GenerateVerboseResultHelp() +
             "\nExamples:\n"
             "\nGenerate 11 blocks to myaddress\n" +
             HelpExampleCli("generatetoaddress", "11 \"myaddress\""));
@@ -295,6 +322,7 @@ static UniValue generatetoaddress(const Config &config,
     if (request.params.size() > 2) {
         nMaxTries = request.params[2].get_int();
     }
+    bool fVerbose = request.params.size() > 3 && request.params[3].get_bool();
 
     CTxDestination destination = 
             DecodeDestination(request.params[1].get_str());
@@ -306,7 +334,8 @@ static UniValue generatetoaddress(const Config &config,
     std::shared_ptr<CReserveScript> coinbaseScript(new CReserveScript());
     coinbaseScript->reserveScript = GetScriptForDestination(destination);
 
-    return generateBlocks(config, coinbaseScript, nGenerate, nMaxTries, false);
+    return generateBlocks(config, coinbaseScript, nGenerate, nMaxTries, false,
+                          fVerbose);
 }
 
 static UniValue getmininginfo(const Config &config,
@@ -699,13 +728,12 @@ static UniValue getblocktemplate(const Config &config,
         // expires-immediately template to stop miners?
     }
 
-    // Update block
+    // Update block. The engine follows the mempool, so that a template with
+    // the new transactions only takes their selection.
     static CBlockIndex *pindexPrev;
-    static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
     if (pindexPrev != chainActive.Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
-         GetTime() - nStart > 5)) {
+        mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast) {
         // Clear pindexPrev so future calls make a new block, despite any
         // failures from here on
         pindexPrev = nullptr;
@@ -713,12 +741,11 @@ static UniValue getblocktemplate(const Config &config,
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
         CBlockIndex *pindexPrevNew = chainActive.Tip();
-        nStart = GetTime();
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
         pblocktemplate =
-            BlockAssembler(config, Params()).CreateNewBlock(scriptDummy);
+            GetBlockTemplateEngine(config).CreateNewBlock(scriptDummy);
         if (!pblocktemplate) {
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
         }
@@ -1179,8 +1206,8 @@ static const CRPCCommand commands[] = {
     {"mining",     "submitblock",           submitblock,           true, {"hexdata", "parameters"}},
     {"mining",     "getblocksubsidy",       getblocksubsidy,       true, {"height"}},
 
-    {"generating", "generate",              generate,              true, {"nblocks", "maxtries"}},
-    {"generating", "generatetoaddress",     generatetoaddress,     true, {"nblocks", "address", "maxtries"}},
+    {"generating", "generate",              generate,              true, {"nblocks", "maxtries", "verbose"}},
+    {"generating", "generatetoaddress",     generatetoaddress,     true, {"nblocks", "address", "maxtries", "verbose"}},
 
     {"util",       "estimatefee",           estimatefee,           true, {"nblocks"}},
     {"util",       "estimatepriority",      estimatepriority,      true, {"nblocks"}},
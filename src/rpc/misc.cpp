@@ -5,18 +5,22 @@
 
 #include "rpc/misc.h"
 #include "base58.h"
+#include "chainparams.h"
 #include "clientversion.h"
 #include "config.h"
 #include "dstencode.h"
 #include "init.h"
+#include "memusage.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/blockchain.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "validation.h"
+#include "validationinterface.h"
 #ifdef ENABLE_WALLET
 #include "wallet/wallet.h"
 #include "wallet/walletdb.h"
@@ -535,6 +539,53 @@ static UniValue RPCLockedMemoryInfo() {
     return obj;
 }
 
+static UniValue RPCBlockIndexMemoryInfo(const Config &config) {
+    const CChainParams &params = config.GetChainParams();
+    size_t nEvicted = 0;
+    size_t nSolutionUsage = 0;
+    size_t nEvictedUsage = 0;
+    size_t nEntries = 0;
+    size_t nUsage = 0;
+
+    {
+        LOCK(cs_main);
+        nEntries = mapBlockIndex.size();
+        for (const std::pair<const uint256, CBlockIndex *> &entry :
+             mapBlockIndex) {
+            const CBlockIndex *pindex = entry.second;
+            if (pindex->fSolutionEvicted) {
+                nEvicted++;
+                nEvictedUsage += memusage::MallocUsage(
+                    params.EquihashSolutionWidth(pindex->nHeight));
+            } else {
+                nSolutionUsage += memusage::DynamicUsage(pindex->nSolution);
+            }
+        }
+        // Entries are allocated one by one and indexed by mapBlockIndex.
+        nUsage = memusage::DynamicUsage(mapBlockIndex) +
+                 nEntries * memusage::MallocUsage(sizeof(CBlockIndex)) +
+                 nSolutionUsage;
+    }
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", uint64_t(nEntries)));
+    obj.push_back(Pair("usage", uint64_t(nUsage)));
+    obj.push_back(
+        Pair("usage_without_eviction", uint64_t(nUsage + nEvictedUsage)));
+    obj.push_back(Pair("solutions_evicted", uint64_t(nEvicted)));
+
+    UniValue cache(UniValue::VOBJ);
+    if (pblocktree) {
+        SolutionCacheStats stats = pblocktree->GetSolutionCacheStats();
+        cache.push_back(Pair("entries", uint64_t(stats.nEntries)));
+        cache.push_back(Pair("usage", uint64_t(stats.nUsage)));
+        cache.push_back(Pair("hits", stats.nHits));
+        cache.push_back(Pair("misses", stats.nMisses));
+    }
+    obj.push_back(Pair("solution_cache", cache));
+    return obj;
+}
+
 static UniValue getmemoryinfo(const Config &config,
                               const JSONRPCRequest &request) {
     /* Please, avoid using the word "pool" here in the RPC interface or help,
@@ -559,6 +610,27 @@ static UniValue getmemoryinfo(const Config &config,
             "disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"blockindex\": {           (json object) Information about "
+            "the block index\n"
+            "    \"entries\": xxxxx,       (numeric) Number of block index "
+            "entries\n"
+            "    \"usage\": xxxxx,         (numeric) Estimated memory usage "
+            "in bytes\n"
+            "    \"usage_without_eviction\": xxxxx, (numeric) Estimated "
+            "memory usage if all Equihash solutions were kept in memory\n"
+            "    \"solutions_evicted\": xxxxx, (numeric) Number of entries "
+            "whose solution is only in the block index database\n"
+            "    \"solution_cache\": {     (json object) Solutions read back "
+            "from the block index database\n"
+            "      \"entries\": xxxxx,     (numeric) Number of cached "
+            "solutions\n"
+            "      \"usage\": xxxxx,       (numeric) Memory usage in bytes\n"
+            "      \"hits\": xxxxx,        (numeric) Reads served from the "
+            "cache\n"
+            "      \"misses\": xxxxx,      (numeric) Reads from the "
+            "database\n"
+            "    }\n"
             "  }\n"
             "}\n"
             "\nExamples:\n" +
@@ -566,6 +638,77 @@ static UniValue getmemoryinfo(const Config &config,
             HelpExampleRpc("getmemoryinfo", ""));
     UniValue obj(UniValue::VOBJ);
     obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+    obj.push_back(Pair("blockindex", RPCBlockIndexMemoryInfo(config)));
+    return obj;
+}
+
+static UniValue getvalidationqueueinfo(const Config &config,
+                                       const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationqueueinfo\n"
+            "Returns an object containing information about the delivery of "
+            "validation notifications (new transactions and blocks) to the "
+            "wallet, ZMQ and the network code.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"pending\": xxxxx,         (numeric) Notifications waiting to "
+            "be delivered\n"
+            "  \"max_pending\": xxxxx,     (numeric) Number of pending "
+            "notifications at which block validation waits for them\n"
+            "  \"delivered\": xxxxx,       (numeric) Notifications delivered "
+            "from the queue\n"
+            "  \"wait_avg_us\": xxxxx,     (numeric) Average time they "
+            "waited in the queue, in microseconds\n"
+            "  \"wait_max_us\": xxxxx,     (numeric) Longest time one waited "
+            "in the queue, in microseconds\n"
+            "  \"subscribers\": [          (json array) Registered "
+            "subscribers\n"
+            "    {\n"
+            "      \"name\": \"xxxx\",       (string) Subscriber type\n"
+            "      \"calls\": xxxxx,       (numeric) Notifications handled\n"
+            "      \"time_us\": xxxxx,     (numeric) Total time spent "
+            "handling them, in microseconds\n"
+            "      \"time_avg_us\": xxxxx, (numeric) Average time per "
+            "notification, in microseconds\n"
+            "      \"time_max_us\": xxxxx  (numeric) Longest time spent on "
+            "one notification, in microseconds\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getvalidationqueueinfo", "") +
+            HelpExampleRpc("getvalidationqueueinfo", ""));
+
+    uint64_t nDelivered;
+    int64_t nTotalWaitMicros, nMaxWaitMicros;
+    GetMainSignals().GetQueueStats(nDelivered, nTotalWaitMicros,
+                                   nMaxWaitMicros);
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("pending", uint64_t(GetMainSignals().CallbacksPending())));
+    obj.push_back(Pair("max_pending", uint64_t(MAX_VALIDATION_INTERFACE_QUEUE)));
+    obj.push_back(Pair("delivered", nDelivered));
+    obj.push_back(Pair("wait_avg_us",
+                       nDelivered ? nTotalWaitMicros / int64_t(nDelivered) : 0));
+    obj.push_back(Pair("wait_max_us", nMaxWaitMicros));
+
+    UniValue subscribers(UniValue::VARR);
+    for (const ValidationInterfaceStats &stats :
+         GetValidationInterfaceStats()) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("name", stats.name));
+        entry.push_back(Pair("calls", stats.nCalls));
+        entry.push_back(Pair("time_us", stats.nTotalMicros));
+        entry.push_back(Pair("time_avg_us",
+                             stats.nCalls ? stats.nTotalMicros /
+                                                int64_t(stats.nCalls)
+                                          : 0));
+        entry.push_back(Pair("time_max_us", stats.nMaxMicros));
+        subscribers.push_back(entry);
+    }
+    obj.push_back(Pair("subscribers", subscribers));
     return obj;
 }
 
@@ -588,6 +731,7 @@ static const CRPCCommand commands[] = {
     //  ------------------- ------------------------  ----------------------  ----------
     { "control",            "getinfo",                getinfo,                true,  {} }, /* uses wallet if enabled */
     { "control",            "getmemoryinfo",          getmemoryinfo,          true,  {} },
+    { "control",            "getvalidationqueueinfo", getvalidationqueueinfo, true,  {} },
     { "util",               "validateaddress",        validateaddress,        true,  {"address"} }, /* uses wallet if enabled */
     { "util",               "createmultisig",         createmultisig,         true,  {"nrequired","keys"} },
     { "util",               "verifymessage",          verifymessage,          true,  {"address","signature","message"} },
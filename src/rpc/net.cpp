@@ -10,6 +10,7 @@
 #include "net.h"
 #include "net_processing.h"
 #include "netbase.h"
+#include "netmsgstats.h"
 #include "policy/policy.h"
 #include "protocol.h"
 #include "sync.h"
@@ -131,6 +132,17 @@ static UniValue getpeerinfo(const Config &config,
             "       \"addr\": n,              (numeric) The total bytes "
             "received aggregated by message type\n"
             "       ...\n"
+            "    },\n"
+            "    \"queuetime_per_msg\": {\n"
+            "       \"addr\": {             (json object) Time received "
+            "messages waited before being processed, by message type\n"
+            "         \"count\": n,         (numeric) Number of messages\n"
+            "         \"avg\": n,           (numeric) Average time in "
+            "seconds\n"
+            "         \"max\": n            (numeric) Longest time in "
+            "seconds\n"
+            "       },\n"
+            "       ...\n"
             "    }\n"
             "  }\n"
             "  ,...\n"
@@ -213,6 +225,22 @@ static UniValue getpeerinfo(const Config &config,
         }
         obj.push_back(Pair("bytesrecv_per_msg", recvPerMsgCmd));
 
+        UniValue queueTimePerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdQueueTime::value_type &i :
+             stats.mapQueueTimePerMsgCmd) {
+            if (i.second.nCount > 0) {
+                UniValue queueTime(UniValue::VOBJ);
+                queueTime.push_back(Pair("count", i.second.nCount));
+                queueTime.push_back(
+                    Pair("avg", double(i.second.nTotalUsec) /
+                                    i.second.nCount / 1e6));
+                queueTime.push_back(
+                    Pair("max", double(i.second.nMaxUsec) / 1e6));
+                queueTimePerMsgCmd.push_back(Pair(i.first, queueTime));
+            }
+        }
+        obj.push_back(Pair("queuetime_per_msg", queueTimePerMsgCmd));
+
         ret.push_back(obj);
     }
 
@@ -458,6 +486,141 @@ static UniValue getnettotals(const Config &config,
     return obj;
 }
 
+/**
+ * A histogram as a json object, with its values divided by scale (eg. to
+ * show microseconds as seconds).
+ */
+static UniValue HistogramToJSON(const CHistogram &histogram, double scale) {
+    const CHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("count", snapshot.nCount));
+    obj.push_back(Pair("total", snapshot.nTotal / scale));
+    obj.push_back(Pair("median", snapshot.GetPercentile(0.5) / scale));
+    obj.push_back(Pair("p99", snapshot.GetPercentile(0.99) / scale));
+    obj.push_back(Pair("max", snapshot.nMax / scale));
+    UniValue buckets(UniValue::VARR);
+    for (size_t i = 0; i < snapshot.vBuckets.size(); i++) {
+        if (snapshot.vBuckets[i] == 0) {
+            continue;
+        }
+        UniValue bucket(UniValue::VOBJ);
+        if (i + 1 < snapshot.vBuckets.size()) {
+            bucket.push_back(Pair("upto", CHistogram::GetBucketMax(i) / scale));
+        }
+        bucket.push_back(Pair("count", snapshot.vBuckets[i]));
+        buckets.push_back(bucket);
+    }
+    obj.push_back(Pair("histogram", buckets));
+    return obj;
+}
+
+static UniValue getnetmsgstats(const Config &config,
+                               const JSONRPCRequest &request) {
+    if (request.fHelp || request.params.size() > 0) {
+        throw std::runtime_error(
+            "getnetmsgstats\n"
+            "\nReturns statistics on the processing of the messages received "
+            "from peers,\nby message type and by peer, to find what keeps the "
+            "message handler busy.\n"
+            "Histograms have power of two buckets, and their percentiles are "
+            "the upper\nbounds of buckets.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"messages\": {\n"
+            "    \"tx\": {               (json object) Statistics for one "
+            "message type\n"
+            "      \"processing\": {     (json object) Time spent processing "
+            "the messages, in seconds\n"
+            "        \"count\": n,       (numeric) Number of messages\n"
+            "        \"total\": n,       (numeric) Sum of the times\n"
+            "        \"median\": n,      (numeric) Median time\n"
+            "        \"p99\": n,         (numeric) 99th percentile\n"
+            "        \"max\": n,         (numeric) Longest time\n"
+            "        \"histogram\": [    (json array) Non-empty buckets\n"
+            "          {\n"
+            "            \"upto\": n,    (numeric) Largest time in the "
+            "bucket, absent for the last one\n"
+            "            \"count\": n    (numeric) Number of messages in "
+            "the bucket\n"
+            "          }\n"
+            "          ,...\n"
+            "        ]\n"
+            "      },\n"
+            "      \"queued\": {...}     (json object) Time the messages "
+            "waited to be processed, in seconds, as above\n"
+            "    }\n"
+            "    ,...\n"
+            "  },\n"
+            "  \"sendbuffer\": {...},    (json object) Bytes queued to a "
+            "peer, each time a message is queued, as above\n"
+            "  \"peers\": [\n"
+            "    {\n"
+            "      \"id\": n,            (numeric) Peer index\n"
+            "      \"addr\": \"host:port\", (string) The ip address and port "
+            "of the peer\n"
+            "      \"processing\": n,    (numeric) Time spent processing the "
+            "peer's messages, in seconds\n"
+            "      \"processing_per_msg\": {\n"
+            "        \"tx\": n           (numeric) The same by message "
+            "type\n"
+            "        ,...\n"
+            "      }\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n" +
+            HelpExampleCli("getnetmsgstats", "") +
+            HelpExampleRpc("getnetmsgstats", ""));
+    }
+
+    if (!g_connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    UniValue messages(UniValue::VOBJ);
+    for (const auto &entry : GetAllNetMsgCmdStats()) {
+        if (entry.second.queueTime.GetSnapshot().nCount == 0) {
+            continue;
+        }
+        UniValue cmdStats(UniValue::VOBJ);
+        cmdStats.push_back(
+            Pair("processing", HistogramToJSON(entry.second.processTime, 1e6)));
+        cmdStats.push_back(
+            Pair("queued", HistogramToJSON(entry.second.queueTime, 1e6)));
+        messages.push_back(Pair(entry.first, cmdStats));
+    }
+
+    std::vector<CNodeStats> vstats;
+    g_connman->GetNodeStats(vstats);
+    UniValue peers(UniValue::VARR);
+    for (const CNodeStats &stats : vstats) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("id", stats.nodeid));
+        obj.push_back(Pair("addr", stats.addrName));
+        uint64_t nProcessUsec = 0;
+        UniValue processPerMsgCmd(UniValue::VOBJ);
+        for (const mapMsgCmdSize::value_type &i :
+             stats.mapProcessUsecPerMsgCmd) {
+            if (i.second > 0) {
+                processPerMsgCmd.push_back(Pair(i.first, i.second / 1e6));
+                nProcessUsec += i.second;
+            }
+        }
+        obj.push_back(Pair("processing", nProcessUsec / 1e6));
+        obj.push_back(Pair("processing_per_msg", processPerMsgCmd));
+        peers.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("messages", messages));
+    ret.push_back(Pair("sendbuffer", HistogramToJSON(GetSendBufferStats(), 1)));
+    ret.push_back(Pair("peers", peers));
+    return ret;
+}
+
 static UniValue GetNetworksInfo() {
     UniValue networks(UniValue::VARR);
     for (int n = 0; n < NET_MAX; ++n) {
@@ -760,6 +923,7 @@ static const CRPCCommand commands[] = {
     { "network",            "disconnectnode",         disconnectnode,         true,  {"address", "nodeid"} },
     { "network",            "getaddednodeinfo",       getaddednodeinfo,       true,  {"node"} },
     { "network",            "getnettotals",           getnettotals,           true,  {} },
+    { "network",            "getnetmsgstats",         getnetmsgstats,         true,  {} },
     { "network",            "getnetworkinfo",         getnetworkinfo,         true,  {} },
     { "network",            "setban",                 setban,                 true,  {"subnet", "command", "bantime", "absolute"} },
     { "network",            "listbanned",             listbanned,             true,  {} },
@@ -9,6 +9,8 @@
 
 #include <univalue.h>
 
+#include <vector>
+
 class CScript;
 
 void ScriptPubKeyToJSON(const Config &config, const CScript &scriptPubKey,
@@ -17,6 +19,11 @@ void TxToJSON(const Config &config, const CTransaction &tx,
               const uint256 hashBlock, UniValue &entry);
 UniValue blockToJSON(const Config &config, const CBlock &block,
                      const CBlockIndex *blockindex, bool txDetails = false);
-UniValue blockheaderToJSON(const CBlockIndex *blockindex);
+/**
+ * The Equihash solution is passed separately, as it may have been evicted from
+ * blockindex and read back from the block tree DB.
+ */
+UniValue blockheaderToJSON(const CBlockIndex *blockindex,
+                           const std::vector<unsigned char> &solution);
 
 #endif // BITCOIN_RPCTOJSON_H
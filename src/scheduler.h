@@ -12,8 +12,11 @@
 //
 #include <boost/chrono/chrono.hpp>
 #include <boost/thread.hpp>
+#include <list>
 #include <map>
 
+#include "sync.h"
+
 //
 // Simple class for background tasks that should be run periodically or once
 // "after a while"
@@ -68,6 +71,9 @@ public:
     size_t getQueueInfo(boost::chrono::system_clock::time_point &first,
                         boost::chrono::system_clock::time_point &last) const;
 
+    // Returns true if there are threads actively running in serviceQueue()
+    bool AreThreadsServicingQueue() const;
+
 private:
     std::multimap<boost::chrono::system_clock::time_point, Function> taskQueue;
     boost::condition_variable newTaskScheduled;
@@ -80,4 +86,43 @@ private:
     }
 };
 
+/**
+ * Class used by CScheduler clients which may schedule multiple jobs which are
+ * required to be run serially. Jobs may not be run on the same thread, but no
+ * two jobs will be executed at the same time and they are run in the order
+ * they were added.
+ */
+class SingleThreadedSchedulerClient {
+private:
+    CScheduler *m_pscheduler;
+
+    CCriticalSection m_cs_callbacks_pending;
+    std::list<std::function<void(void)>> m_callbacks_pending;
+    bool m_are_callbacks_running = false;
+
+    void MaybeScheduleProcessQueue();
+    void ProcessQueue();
+
+public:
+    explicit SingleThreadedSchedulerClient(CScheduler *pschedulerIn)
+        : m_pscheduler(pschedulerIn) {}
+
+    /**
+     * Add a callback to be executed. Callbacks are executed serially and
+     * memory is release-acquire consistent between callback executions.
+     * Practically, this means that callbacks can behave as if they are
+     * executed in order by a single thread.
+     */
+    void AddToProcessQueue(std::function<void(void)> func);
+
+    /**
+     * Processes all remaining queue members on the calling thread, blocking
+     * until queue is empty. Must be called after the CScheduler has no
+     * remaining processing threads!
+     */
+    void EmptyQueue();
+
+    size_t CallbacksPending();
+};
+
 #endif
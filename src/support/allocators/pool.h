@@ -0,0 +1,215 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+#define BITCOIN_SUPPORT_ALLOCATORS_POOL_H
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <list>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * A memory resource handing out small blocks carved from large chunks, for
+ * node based containers such as std::unordered_map.
+ *
+ * Blocks of up to MAX_BLOCK_SIZE_BYTES are rounded up to a multiple of the
+ * alignment, and each size gets its own free list. Freed blocks go back to
+ * their free list and are reused, but the chunks are only released when the
+ * resource is destroyed. Larger blocks, such as the bucket array of a hash
+ * map, go to operator new directly.
+ *
+ * This saves the malloc overhead and bookkeeping of every node, keeps nodes
+ * allocated together close in memory, and makes the memory usage exact: it is
+ * the number of chunks times their size.
+ *
+ * Not thread safe, like the containers using it.
+ */
+template <std::size_t MAX_BLOCK_SIZE_BYTES, std::size_t ALIGN_BYTES>
+class PoolResource {
+    static_assert(ALIGN_BYTES > 0 && (ALIGN_BYTES & (ALIGN_BYTES - 1)) == 0,
+                  "ALIGN_BYTES must be a power of two");
+    static_assert(ALIGN_BYTES <= alignof(std::max_align_t),
+                  "chunks are only aligned to max_align_t");
+
+    /** A free block, linked to the next free block of the same size. */
+    struct ListNode {
+        ListNode *m_next;
+        explicit ListNode(ListNode *next) : m_next(next) {}
+    };
+
+    static constexpr std::size_t ELEM_ALIGN_BYTES =
+        ALIGN_BYTES > alignof(ListNode) ? ALIGN_BYTES : alignof(ListNode);
+    static_assert(sizeof(ListNode) <= ELEM_ALIGN_BYTES,
+                  "a free block must fit a ListNode");
+
+    /** Free list for every multiple of ELEM_ALIGN_BYTES. */
+    static constexpr std::size_t NUM_FREELISTS =
+        MAX_BLOCK_SIZE_BYTES / ELEM_ALIGN_BYTES + 1;
+
+    const std::size_t m_chunk_size_bytes;
+    std::list<void *> m_allocated_chunks;
+    std::array<ListNode *, NUM_FREELISTS> m_free_lists;
+
+    /** Unused part of the last chunk. */
+    char *m_available_memory_it = nullptr;
+    char *m_available_memory_end = nullptr;
+
+    static constexpr std::size_t NumElemAlignBytes(std::size_t bytes) {
+        return (bytes + ELEM_ALIGN_BYTES - 1) / ELEM_ALIGN_BYTES + (bytes == 0);
+    }
+
+    static constexpr bool IsFreeListUsable(std::size_t bytes,
+                                           std::size_t alignment) {
+        return alignment <= ELEM_ALIGN_BYTES && bytes <= MAX_BLOCK_SIZE_BYTES;
+    }
+
+    void PlacementAddToList(void *p, ListNode *&node) {
+        node = new (p) ListNode(node);
+    }
+
+    void AllocateChunk() {
+        // Whatever is left of the current chunk is a multiple of the
+        // alignment, and smaller than a block: give it to its free list.
+        const std::size_t remaining_available_bytes =
+            m_available_memory_end - m_available_memory_it;
+        if (remaining_available_bytes != 0) {
+            PlacementAddToList(
+                m_available_memory_it,
+                m_free_lists[remaining_available_bytes / ELEM_ALIGN_BYTES]);
+        }
+
+        void *storage = ::operator new(m_chunk_size_bytes);
+        m_available_memory_it = static_cast<char *>(storage);
+        m_available_memory_end = m_available_memory_it + m_chunk_size_bytes;
+        m_allocated_chunks.push_back(storage);
+    }
+
+public:
+    explicit PoolResource(std::size_t chunk_size_bytes)
+        : m_chunk_size_bytes(NumElemAlignBytes(chunk_size_bytes) *
+                             ELEM_ALIGN_BYTES) {
+        assert(m_chunk_size_bytes >= MAX_BLOCK_SIZE_BYTES);
+        m_free_lists.fill(nullptr);
+        AllocateChunk();
+    }
+
+    /** 256 KiB chunks. */
+    PoolResource() : PoolResource(1 << 18) {}
+
+    PoolResource(const PoolResource &) = delete;
+    PoolResource &operator=(const PoolResource &) = delete;
+
+    ~PoolResource() {
+        for (void *chunk : m_allocated_chunks) {
+            ::operator delete(chunk);
+        }
+    }
+
+    void *Allocate(std::size_t bytes, std::size_t alignment) {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            return ::operator new(bytes);
+        }
+
+        const std::size_t num_alignments = NumElemAlignBytes(bytes);
+        ListNode *&free_list = m_free_lists[num_alignments];
+        if (free_list != nullptr) {
+            return std::exchange(free_list, free_list->m_next);
+        }
+
+        const std::size_t round_bytes = num_alignments * ELEM_ALIGN_BYTES;
+        if (round_bytes >
+            std::size_t(m_available_memory_end - m_available_memory_it)) {
+            AllocateChunk();
+        }
+        return std::exchange(m_available_memory_it,
+                             m_available_memory_it + round_bytes);
+    }
+
+    void Deallocate(void *p, std::size_t bytes,
+                    std::size_t alignment) noexcept {
+        if (!IsFreeListUsable(bytes, alignment)) {
+            ::operator delete(p);
+            return;
+        }
+        PlacementAddToList(p, m_free_lists[NumElemAlignBytes(bytes)]);
+    }
+
+    std::size_t NumAllocatedChunks() const { return m_allocated_chunks.size(); }
+
+    std::size_t ChunkSizeBytes() const { return m_chunk_size_bytes; }
+};
+
+/**
+ * Allocator taking its memory from a PoolResource. Without a resource, it
+ * falls back to operator new and delete, like std::allocator.
+ *
+ * The resource is propagated when a container is moved or swapped, so that
+ * nodes are always returned to the resource they came from.
+ */
+template <class T, std::size_t MAX_BLOCK_SIZE_BYTES,
+          std::size_t ALIGN_BYTES = alignof(T)>
+class PoolAllocator {
+public:
+    typedef T value_type;
+    typedef PoolResource<MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> ResourceType;
+
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    template <typename U> struct rebind {
+        typedef PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> other;
+    };
+
+    PoolAllocator(ResourceType *resource = nullptr) noexcept
+        : m_resource(resource) {}
+
+    template <typename U>
+    PoolAllocator(const PoolAllocator<U, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES>
+                      &other) noexcept
+        : m_resource(other.resource()) {}
+
+    T *allocate(std::size_t n) {
+        if (m_resource == nullptr) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(
+            m_resource->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *p, std::size_t n) noexcept {
+        if (m_resource == nullptr) {
+            ::operator delete(p);
+            return;
+        }
+        m_resource->Deallocate(p, n * sizeof(T), alignof(T));
+    }
+
+    ResourceType *resource() const noexcept { return m_resource; }
+
+private:
+    ResourceType *m_resource;
+};
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES,
+          std::size_t ALIGN_BYTES>
+bool operator==(
+    const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept {
+    return a.resource() == b.resource();
+}
+
+template <class T1, class T2, std::size_t MAX_BLOCK_SIZE_BYTES,
+          std::size_t ALIGN_BYTES>
+bool operator!=(
+    const PoolAllocator<T1, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &a,
+    const PoolAllocator<T2, MAX_BLOCK_SIZE_BYTES, ALIGN_BYTES> &b) noexcept {
+    return !(a == b);
+}
+
+#endif // BITCOIN_SUPPORT_ALLOCATORS_POOL_H
@@ -4,11 +4,15 @@
 
 #include "util.h"
 
+#include "memusage.h"
+#include "support/allocators/pool.h"
 #include "support/allocators/secure.h"
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
 
+#include <unordered_map>
+
 BOOST_FIXTURE_TEST_SUITE(allocator_tests, BasicTestingSetup)
 
 BOOST_AUTO_TEST_CASE(arena_tests) {
@@ -229,4 +233,83 @@ BOOST_AUTO_TEST_CASE(lockedpool_tests_live) {
     BOOST_CHECK(pool.stats().used == initial.used);
 }
 
+BOOST_AUTO_TEST_CASE(pool_resource_tests) {
+    PoolResource<128, 8> resource(1024);
+    BOOST_CHECK_EQUAL(resource.ChunkSizeBytes(), 1024);
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 1);
+
+    // Blocks are carved one after the other from the chunk.
+    void *a0 = resource.Allocate(8, 8);
+    void *a1 = resource.Allocate(5, 4);
+    BOOST_CHECK(static_cast<char *>(a1) == static_cast<char *>(a0) + 8);
+
+    // Freed blocks are reused for the same rounded size only.
+    resource.Deallocate(a0, 8, 8);
+    void *b0 = resource.Allocate(16, 8);
+    BOOST_CHECK(b0 != a0);
+    void *b1 = resource.Allocate(7, 8);
+    BOOST_CHECK(b1 == a0);
+
+    // Blocks too large or too aligned for the pool do not use it.
+    void *big = resource.Allocate(129, 8);
+    void *aligned = resource.Allocate(16, 16);
+    resource.Deallocate(big, 129, 8);
+    resource.Deallocate(aligned, 16, 16);
+
+    // A new chunk is only allocated once the current one is used up.
+    for (int i = 0; i < 1024 / 128; i++) {
+        resource.Allocate(128, 8);
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), 2);
+
+    resource.Deallocate(a1, 5, 4);
+    resource.Deallocate(b0, 16, 8);
+    resource.Deallocate(b1, 7, 8);
+}
+
+BOOST_AUTO_TEST_CASE(pool_allocator_map_tests) {
+    typedef PoolAllocator<std::pair<const uint64_t, uint64_t>,
+                          sizeof(std::pair<const uint64_t, uint64_t>) +
+                              sizeof(void *) * 4>
+        Allocator;
+    typedef std::unordered_map<uint64_t, uint64_t, std::hash<uint64_t>,
+                               std::equal_to<uint64_t>, Allocator>
+        Map;
+
+    Allocator::ResourceType resource(4096);
+    Map map(0, std::hash<uint64_t>(), std::equal_to<uint64_t>(),
+            Allocator(&resource));
+    for (uint64_t i = 0; i < 1000; i++) {
+        map[i] = i * 2;
+    }
+    for (uint64_t i = 0; i < 1000; i++) {
+        BOOST_CHECK_EQUAL(map[i], i * 2);
+    }
+
+    // Memory usage is exactly the chunks, plus the bucket array.
+    const size_t chunks = resource.NumAllocatedChunks();
+    BOOST_CHECK(chunks > 1);
+    BOOST_CHECK_EQUAL(
+        memusage::DynamicUsage(map),
+        (memusage::MallocUsage(4096) +
+         memusage::MallocUsage(sizeof(void *) * 3)) *
+                chunks +
+            memusage::MallocUsage(sizeof(void *) * map.bucket_count()));
+
+    // Erased nodes are reused rather than allocating more chunks.
+    for (uint64_t i = 0; i < 1000; i++) {
+        map.erase(i);
+    }
+    for (uint64_t i = 1000; i < 2000; i++) {
+        map[i] = i;
+    }
+    BOOST_CHECK_EQUAL(resource.NumAllocatedChunks(), chunks);
+
+    // Without a resource the allocator behaves like std::allocator.
+    Map plain;
+    BOOST_CHECK(plain.get_allocator().resource() == nullptr);
+    plain[1] = 1;
+    BOOST_CHECK(memusage::DynamicUsage(plain) > 0);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -424,6 +424,22 @@ BOOST_AUTO_TEST_CASE(divide) {
     BOOST_CHECK(R2L / MaxL == ZeroL);
     BOOST_CHECK(MaxL / R2L == 1);
     BOOST_CHECK_THROW(R2L / ZeroL, uint_error);
+
+    // Divisors of a single word take a shortcut, check it against the
+    // remainder.
+    const uint32_t divisors[] = {2, 3, 7, 45, 120, 0xFFFF, 0x8000000F,
+                                 0xFFFFFFFF};
+    for (uint32_t d : divisors) {
+        for (const arith_uint256 &n : {R1L, R2L, MaxL}) {
+            const arith_uint256 q = n / arith_uint256(d);
+            BOOST_CHECK(q == n / d);
+            BOOST_CHECK(n - q * d < d);
+            BOOST_CHECK(q <= n);
+        }
+    }
+    BOOST_CHECK(MaxL / 0xFFFFFFFF ==
+                arith_uint256("0000000100000001000000010000000100000001000000"
+                              "010000000100000001"));
 }
 
 bool almostEqual(double d1, double d2) {
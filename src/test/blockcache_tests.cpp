@@ -0,0 +1,77 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockcache.h"
+#include "blockencodings.h"
+#include "config.h"
+#include "hash.h"
+#include "net.h"
+#include "protocol.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockcache_tests, TestChain100Setup)
+
+BOOST_AUTO_TEST_CASE(blockcache_serialize) {
+    const Config &config = GetConfig();
+    const CBlockIndex *pindex = chainActive.Tip();
+
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, config));
+
+    for (int nFlags : {0, SERIALIZE_BLOCK_LEGACY}) {
+        std::shared_ptr<const CSharedNetMsg> msg =
+            GetSerializedBlock(config, pindex, nFlags);
+        BOOST_REQUIRE(msg);
+        BOOST_CHECK_EQUAL(msg->command, NetMsgType::BLOCK);
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | nFlags);
+        ss << block;
+        BOOST_CHECK(std::vector<uint8_t>(ss.begin(), ss.end()) == *msg->data);
+        BOOST_CHECK(msg->hash ==
+                    Hash(msg->data->data(),
+                         msg->data->data() + msg->data->size()));
+
+        // Asked again, it comes from the cache.
+        BOOST_CHECK(GetSerializedBlock(config, pindex, nFlags) == msg);
+    }
+
+    std::shared_ptr<const CSharedNetMsg> cmpctMsg =
+        GetSerializedCompactBlock(config, pindex, 0);
+    BOOST_REQUIRE(cmpctMsg);
+    BOOST_CHECK_EQUAL(cmpctMsg->command, NetMsgType::CMPCTBLOCK);
+    CDataStream ss(*cmpctMsg->data, SER_NETWORK, PROTOCOL_VERSION);
+    CBlockHeaderAndShortTxIDs cmpctblock;
+    ss >> cmpctblock;
+    BOOST_CHECK(cmpctblock.header.GetHash() == block.GetHash());
+    BOOST_CHECK(GetSerializedCompactBlock(config, pindex, 0) == cmpctMsg);
+    BOOST_CHECK(GetSerializedBlock(config, pindex, 0) != cmpctMsg);
+}
+
+BOOST_AUTO_TEST_CASE(blockcache_size) {
+    const Config &config = GetConfig();
+    const CBlockIndex *pindex = chainActive.Tip();
+
+    // Nothing fits in an empty cache, so every request is serialized again.
+    ForceSetArg("-blockcachesize", "0");
+    InitSerializedBlockCache();
+    std::shared_ptr<const CSharedNetMsg> msg =
+        GetSerializedBlock(config, pindex, 0);
+    BOOST_REQUIRE(msg);
+    std::shared_ptr<const CSharedNetMsg> msg2 =
+        GetSerializedBlock(config, pindex, 0);
+    BOOST_REQUIRE(msg2);
+    BOOST_CHECK(msg != msg2);
+    BOOST_CHECK(*msg->data == *msg2->data);
+
+    ForceSetArg("-blockcachesize", std::to_string(DEFAULT_BLOCK_CACHE_SIZE));
+    InitSerializedBlockCache();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,116 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+#include <vector>
+
+#include <boost/test/unit_test.hpp>
+#include <boost/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+namespace {
+
+std::atomic<size_t> nChecksRun(0);
+std::atomic<size_t> nChecksAlive(0);
+
+/** Check counting how often it runs and how many instances are alive. */
+struct CountingCheck {
+    bool fResult;
+    bool fAlive;
+
+    CountingCheck() : fResult(true), fAlive(false) {}
+    explicit CountingCheck(bool fResultIn) : fResult(fResultIn), fAlive(true) {
+        nChecksAlive++;
+    }
+    CountingCheck(const CountingCheck &check)
+        : fResult(check.fResult), fAlive(check.fAlive) {
+        if (fAlive) {
+            nChecksAlive++;
+        }
+    }
+    ~CountingCheck() {
+        if (fAlive) {
+            nChecksAlive--;
+        }
+    }
+
+    bool operator()() {
+        nChecksRun++;
+        return fResult;
+    }
+
+    void swap(CountingCheck &check) {
+        std::swap(fResult, check.fResult);
+        std::swap(fAlive, check.fAlive);
+    }
+};
+
+void RunBatches(CCheckQueue<CountingCheck> &queue, int nThreads) {
+    boost::thread_group tg;
+    for (int i = 0; i < nThreads; i++) {
+        tg.create_thread([&] { queue.Thread(); });
+    }
+
+    for (size_t nChecks : {0, 1, 3, 100, 1000, 10000, 100000}) {
+        nChecksRun = 0;
+        {
+            CCheckQueueControl<CountingCheck> control(&queue);
+            size_t nAdded = 0;
+            while (nAdded < nChecks) {
+                std::vector<CountingCheck> vChecks;
+                for (size_t i = 0; i < 37 && nAdded < nChecks; i++, nAdded++) {
+                    vChecks.emplace_back(true);
+                }
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(control.Wait());
+        }
+        BOOST_CHECK_EQUAL(nChecksRun, nChecks);
+        BOOST_CHECK_EQUAL(nChecksAlive, 0);
+        BOOST_CHECK(queue.IsIdle());
+    }
+
+    // A failing check fails the whole batch, but not the next one.
+    {
+        CCheckQueueControl<CountingCheck> control(&queue);
+        std::vector<CountingCheck> vChecks(500, CountingCheck(true));
+        vChecks[123] = CountingCheck(false);
+        control.Add(vChecks);
+        BOOST_CHECK(!control.Wait());
+    }
+    BOOST_CHECK_EQUAL(nChecksAlive, 0);
+    {
+        CCheckQueueControl<CountingCheck> control(&queue);
+        std::vector<CountingCheck> vChecks(500, CountingCheck(true));
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+    }
+    BOOST_CHECK_EQUAL(nChecksAlive, 0);
+
+    tg.interrupt_all();
+    tg.join_all();
+}
+
+} // namespace
+
+BOOST_AUTO_TEST_CASE(checkqueue_no_workers) {
+    CCheckQueue<CountingCheck> queue(128);
+    RunBatches(queue, 0);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_workers) {
+    CCheckQueue<CountingCheck> queue(128);
+    RunBatches(queue, 7);
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_more_workers_than_deques) {
+    CCheckQueue<CountingCheck> queue(16);
+    RunBatches(queue, 80);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
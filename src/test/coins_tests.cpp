@@ -7,6 +7,7 @@
 #include "script/standard.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
+#include "txdb.h"
 #include "uint256.h"
 #include "undo.h"
 #include "utilstrencodings.h"
@@ -895,4 +896,78 @@ BOOST_AUTO_TEST_CASE(coin_write) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(coins_background_write) {
+    CCoinsViewTest base;
+    CCoinsViewBackgroundWriter writer(&base);
+    CCoinsViewCache cache(&writer);
+
+    std::vector<COutPoint> outpoints;
+    for (int i = 0; i < 1000; i++) {
+        outpoints.emplace_back(GetRandHash(), i);
+        cache.AddCoin(outpoints.back(),
+                      Coin(CTxOut(Amount(i + 1), CScript() << OP_TRUE), 1,
+                           false),
+                      false);
+    }
+    const uint256 hashBlock = GetRandHash();
+    cache.SetBestBlock(hashBlock);
+
+    // The entries stay readable while they are being written.
+    BOOST_CHECK(writer.StartWrite(cache.DetachCache()));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0);
+    BOOST_CHECK(writer.GetBestBlock() == hashBlock);
+    for (const COutPoint &outpoint : outpoints) {
+        BOOST_CHECK(cache.HaveCoin(outpoint));
+    }
+
+    BOOST_CHECK(writer.WaitForWrite());
+    BOOST_CHECK(!writer.IsWriting());
+    BOOST_CHECK_EQUAL(writer.DynamicMemoryUsage(), 0);
+    BOOST_CHECK(base.GetBestBlock() == hashBlock);
+    for (const COutPoint &outpoint : outpoints) {
+        Coin coin;
+        BOOST_CHECK(base.GetCoin(outpoint, coin) && !coin.IsSpent());
+    }
+
+    // A spent coin must not be read back from the base before the write.
+    BOOST_CHECK(cache.SpendCoin(outpoints[0]));
+    BOOST_CHECK(writer.StartWrite(cache.DetachCache()));
+    BOOST_CHECK(!cache.HaveCoin(outpoints[0]));
+    BOOST_CHECK(cache.HaveCoin(outpoints[1]));
+
+    // A synchronous flush is written after the one in progress.
+    const COutPoint added(GetRandHash(), 0);
+    cache.AddCoin(added,
+                  Coin(CTxOut(Amount(1), CScript() << OP_TRUE), 1, false),
+                  false);
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!writer.IsWriting());
+    Coin coin;
+    BOOST_CHECK(!base.GetCoin(outpoints[0], coin) || coin.IsSpent());
+    BOOST_CHECK(base.GetCoin(added, coin) && !coin.IsSpent());
+}
+
+BOOST_AUTO_TEST_CASE(coins_add_fetched) {
+    CCoinsViewTest base;
+    CCoinsViewCache cache(&base);
+
+    const COutPoint outpoint(GetRandHash(), 0);
+    const CTxOut txout(Amount(10), CScript() << OP_TRUE);
+    cache.AddFetchedCoin(outpoint, Coin(txout, 1, false));
+    BOOST_CHECK(cache.HaveCoinInCache(outpoint));
+    BOOST_CHECK(cache.AccessCoin(outpoint).GetTxOut() == txout);
+
+    // An entry already in the cache is kept.
+    BOOST_CHECK(cache.SpendCoin(outpoint));
+    cache.AddFetchedCoin(outpoint, Coin(txout, 1, false));
+    BOOST_CHECK(!cache.HaveCoin(outpoint));
+
+    // Fetched coins are not written back to the base.
+    const COutPoint fetched(GetRandHash(), 1);
+    cache.AddFetchedCoin(fetched, Coin(txout, 1, false));
+    BOOST_CHECK(cache.Flush());
+    Coin coin;
+    BOOST_CHECK(!base.GetCoin(fetched, coin));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
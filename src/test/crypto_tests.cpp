@@ -3,13 +3,16 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "crypto/aes.h"
+#include "crypto/blake2b.h"
 #include "crypto/chacha20.h"
+#include "crypto/common.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
 #include "crypto/ripemd160.h"
 #include "crypto/sha1.h"
 #include "crypto/sha256.h"
 #include "crypto/sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "test/test_bitcoin.h"
 #include "test/test_random.h"
@@ -20,9 +23,18 @@
 #include <boost/test/unit_test.hpp>
 #include <openssl/aes.h>
 #include <openssl/evp.h>
+#include <sodium.h>
 
 BOOST_FIXTURE_TEST_SUITE(crypto_tests, BasicTestingSetup)
 
+static std::vector<uint8_t> InsecureRandBytes(size_t len) {
+    std::vector<uint8_t> ret(len);
+    for (uint8_t &b : ret) {
+        b = insecure_rand();
+    }
+    return ret;
+}
+
 template <typename Hasher, typename In, typename Out>
 void TestVector(const Hasher &h, const In &in, const Out &out) {
     Out hash;
@@ -362,6 +374,47 @@ BOOST_AUTO_TEST_CASE(sha512_testvectors) {
         "37de8c3ef5459d76a52cedc02dc499a3c9ed9dedbfb3281afd9653b8a112fafc");
 }
 
+BOOST_AUTO_TEST_CASE(sha256_implementations) {
+    // Every implementation the CPU supports must agree with the standard one,
+    // for single hashes of any length as well as for SHA256D64.
+    const sha256_implementation::UseImplementation impls[] = {
+        sha256_implementation::USE_SSE4, sha256_implementation::USE_AVX2,
+        sha256_implementation::USE_SHANI, sha256_implementation::USE_ALL};
+    std::vector<uint8_t> in = InsecureRandBytes(64 * 33);
+
+    SHA256AutoDetect(sha256_implementation::STANDARD);
+    std::vector<uint8_t> expected(CSHA256::OUTPUT_SIZE * in.size());
+    for (size_t len = 0; len < in.size(); len++) {
+        CSHA256().Write(in.data(), len).Finalize(&expected[32 * len]);
+    }
+
+    for (auto impl : impls) {
+        BOOST_TEST_MESSAGE("Using " << SHA256AutoDetect(impl));
+        std::vector<uint8_t> out(expected.size());
+        for (size_t len = 0; len < in.size(); len++) {
+            CSHA256().Write(in.data(), len).Finalize(&out[32 * len]);
+        }
+        BOOST_CHECK(out == expected);
+
+        for (size_t blocks = 0; blocks <= 33; blocks++) {
+            std::vector<uint8_t> out1(32 * blocks), out2(32 * blocks);
+            for (size_t i = 0; i < blocks; i++) {
+                CHash256().Write(&in[64 * i], 64).Finalize(&out1[32 * i]);
+            }
+            SHA256D64(out2.data(), in.data(), blocks);
+            BOOST_CHECK(out1 == out2);
+        }
+
+        // The output may overwrite the input, as done by ComputeMerkleRoot.
+        std::vector<uint8_t> inplace(in);
+        std::vector<uint8_t> out1(32 * 33);
+        SHA256D64(out1.data(), in.data(), 33);
+        SHA256D64(inplace.data(), inplace.data(), 33);
+        BOOST_CHECK(std::equal(out1.begin(), out1.end(), inplace.begin()));
+    }
+    SHA256AutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(hmac_sha256_testvectors) {
     // test cases 1, 2, 3, 4, 6 and 7 of RFC 4231
     TestHMACSHA256(
@@ -607,6 +660,101 @@ BOOST_AUTO_TEST_CASE(chacha20_testvector) {
         "38407a6deb3ab78fab78c9");
 }
 
+/** BLAKE2b of in by libsodium, as a reference. */
+static std::vector<uint8_t> SodiumBlake2b(const std::vector<uint8_t> &in,
+                                          size_t outlen,
+                                          const uint8_t *personal) {
+    std::vector<uint8_t> out(outlen);
+    crypto_generichash_blake2b_state state;
+    crypto_generichash_blake2b_init_salt_personal(&state, nullptr, 0, outlen,
+                                                  nullptr, personal);
+    crypto_generichash_blake2b_update(&state, in.data(), in.size());
+    crypto_generichash_blake2b_final(&state, &out[0], outlen);
+    return out;
+}
+
+static const blake2b_implementation::UseImplementation BLAKE2B_IMPLS[] = {
+    blake2b_implementation::STANDARD, blake2b_implementation::USE_SSE41,
+    blake2b_implementation::USE_AVX2, blake2b_implementation::USE_ALL};
+
+BOOST_AUTO_TEST_CASE(blake2b_testvectors) {
+    const uint8_t personal[CBlake2b::PERSONAL_SIZE] = {'Z', 'c', 'a', 's',
+                                                       'h', 'P', 'o', 'W'};
+    for (auto impl : BLAKE2B_IMPLS) {
+        BOOST_TEST_MESSAGE("Using " << Blake2bAutoDetect(impl));
+
+        // Test vector from RFC 7693, appendix A.
+        std::vector<uint8_t> hash(CBlake2b::MAX_OUTPUT_SIZE);
+        CBlake2b().Write((const uint8_t *)"abc", 3).Finalize(&hash[0]);
+        BOOST_CHECK_EQUAL(
+            HexStr(hash),
+            "ba80a53f981c4d0d6a2797b69f12f6e94c212f14685ac4b74b12bb6fdbffa2d1"
+            "7d87c5392aab792dc252d5de4533cc9518d38aa8dbf1925ab92386edd4009923");
+        // The same, with "c" hashed as the low byte of an index.
+        const uint32_t index = 'c';
+        CBlake2b(CBlake2b::MAX_OUTPUT_SIZE)
+            .Write((const uint8_t *)"ab", 2)
+            .FinalizeIndices(&index, 1, &hash[0]);
+        BOOST_CHECK(hash ==
+                    SodiumBlake2b({'a', 'b', 'c', 0, 0, 0},
+                                  CBlake2b::MAX_OUTPUT_SIZE, nullptr));
+
+        // Compare against libsodium for various lengths, output sizes and
+        // personalizations, writing the input in random pieces.
+        for (size_t len = 0; len <= 3 * CBlake2b::BLOCK_SIZE + 1; len++) {
+            std::vector<uint8_t> in = InsecureRandBytes(len);
+            size_t outlen = 1 + insecure_rand_ctx.randrange(64);
+            const uint8_t *pers = (len & 1) ? personal : nullptr;
+
+            CBlake2b hasher(outlen, pers);
+            size_t pos = 0;
+            while (pos < len) {
+                size_t piece = insecure_rand_ctx.randrange(len - pos + 1);
+                hasher.Write(in.data() + pos, piece);
+                pos += piece;
+            }
+            std::vector<uint8_t> out(outlen);
+            hasher.Finalize(&out[0]);
+            BOOST_CHECK(out == SodiumBlake2b(in, outlen, pers));
+        }
+    }
+    Blake2bAutoDetect();
+}
+
+BOOST_AUTO_TEST_CASE(blake2b_finalize_indices) {
+    // FinalizeIndices must match libsodium hashing each index separately,
+    // whether or not the index fits in the last block, for every
+    // implementation the CPU supports and so whatever its number of lanes.
+    const size_t lengths[] = {0, 1, 108, 124, 125, 128, 140, 252, 256};
+    for (auto impl : BLAKE2B_IMPLS) {
+        BOOST_TEST_MESSAGE("Using " << Blake2bAutoDetect(impl));
+        for (size_t len : lengths) {
+            std::vector<uint8_t> in = InsecureRandBytes(len);
+            CBlake2b base(50);
+            base.Write(in.data(), in.size());
+            for (size_t count = 0; count <= 9; count++) {
+                std::vector<uint32_t> indices(count);
+                for (uint32_t &index : indices) {
+                    index = insecure_rand_ctx.rand32();
+                }
+                std::vector<uint8_t> out(count * base.OutputSize() + 1);
+                base.FinalizeIndices(indices.data(), count, &out[0]);
+                for (size_t i = 0; i < count; i++) {
+                    std::vector<uint8_t> msg(in);
+                    msg.resize(len + 4);
+                    WriteLE32(&msg[len], indices[i]);
+                    std::vector<uint8_t> expected =
+                        SodiumBlake2b(msg, base.OutputSize(), nullptr);
+                    BOOST_CHECK(std::equal(expected.begin(), expected.end(),
+                                           out.begin() +
+                                               i * base.OutputSize()));
+                }
+            }
+        }
+    }
+    Blake2bAutoDetect();
+}
+
 BOOST_AUTO_TEST_CASE(countbits_tests) {
     FastRandomContext ctx;
     for (int i = 0; i <= 64; ++i) {
@@ -0,0 +1,58 @@
+namespace json_tests{
+static unsigned const char base58_encode_decode[] = {
+0x5b, 0x0a, 0x5b, 0x22, 0x22, 0x2c, 0x20, 0x22, 
+0x22, 0x5d, 0x2c, 0x0a, 0x5b, 0x22, 0x36, 0x31, 
+0x22, 0x2c, 0x20, 0x22, 0x32, 0x67, 0x22, 0x5d, 
+0x2c, 0x0a, 0x5b, 0x22, 0x36, 0x32, 0x36, 0x32, 
+0x36, 0x32, 0x22, 0x2c, 0x20, 0x22, 0x61, 0x33, 
+0x67, 0x56, 0x22, 0x5d, 0x2c, 0x0a, 0x5b, 0x22, 
+0x36, 0x33, 0x36, 0x33, 0x36, 0x33, 0x22, 0x2c, 
+0x20, 0x22, 0x61, 0x50, 0x45, 0x72, 0x22, 0x5d, 
+0x2c, 0x0a, 0x5b, 0x22, 0x37, 0x33, 0x36, 0x39, 
+0x36, 0x64, 0x37, 0x30, 0x36, 0x63, 0x37, 0x39, 
+0x32, 0x30, 0x36, 0x31, 0x32, 0x30, 0x36, 0x63, 
+0x36, 0x66, 0x36, 0x65, 0x36, 0x37, 0x32, 0x30, 
+0x37, 0x33, 0x37, 0x34, 0x37, 0x32, 0x36, 0x39, 
+0x36, 0x65, 0x36, 0x37, 0x22, 0x2c, 0x20, 0x22, 
+0x32, 0x63, 0x46, 0x75, 0x70, 0x6a, 0x68, 0x6e, 
+0x45, 0x73, 0x53, 0x6e, 0x35, 0x39, 0x71, 0x48, 
+0x58, 0x73, 0x74, 0x6d, 0x4b, 0x32, 0x66, 0x66, 
+0x70, 0x4c, 0x76, 0x32, 0x22, 0x5d, 0x2c, 0x0a, 
+0x5b, 0x22, 0x30, 0x30, 0x65, 0x62, 0x31, 0x35, 
+0x32, 0x33, 0x31, 0x64, 0x66, 0x63, 0x65, 0x62, 
+0x36, 0x30, 0x39, 0x32, 0x35, 0x38, 0x38, 0x36, 
+0x62, 0x36, 0x37, 0x64, 0x30, 0x36, 0x35, 0x32, 
+0x39, 0x39, 0x39, 0x32, 0x35, 0x39, 0x31, 0x35, 
+0x61, 0x65, 0x62, 0x31, 0x37, 0x32, 0x63, 0x30, 
+0x36, 0x36, 0x34, 0x37, 0x22, 0x2c, 0x20, 0x22, 
+0x31, 0x4e, 0x53, 0x31, 0x37, 0x69, 0x61, 0x67, 
+0x39, 0x6a, 0x4a, 0x67, 0x54, 0x48, 0x44, 0x31, 
+0x56, 0x58, 0x6a, 0x76, 0x4c, 0x43, 0x45, 0x6e, 
+0x5a, 0x75, 0x51, 0x33, 0x72, 0x4a, 0x44, 0x45, 
+0x39, 0x4c, 0x22, 0x5d, 0x2c, 0x0a, 0x5b, 0x22, 
+0x35, 0x31, 0x36, 0x62, 0x36, 0x66, 0x63, 0x64, 
+0x30, 0x66, 0x22, 0x2c, 0x20, 0x22, 0x41, 0x42, 
+0x6e, 0x4c, 0x54, 0x6d, 0x67, 0x22, 0x5d, 0x2c, 
+0x0a, 0x5b, 0x22, 0x62, 0x66, 0x34, 0x66, 0x38, 
+0x39, 0x30, 0x30, 0x31, 0x65, 0x36, 0x37, 0x30, 
+0x32, 0x37, 0x34, 0x64, 0x64, 0x22, 0x2c, 0x20, 
+0x22, 0x33, 0x53, 0x45, 0x6f, 0x33, 0x4c, 0x57, 
+0x4c, 0x6f, 0x50, 0x6e, 0x74, 0x43, 0x22, 0x5d, 
+0x2c, 0x0a, 0x5b, 0x22, 0x35, 0x37, 0x32, 0x65, 
+0x34, 0x37, 0x39, 0x34, 0x22, 0x2c, 0x20, 0x22, 
+0x33, 0x45, 0x46, 0x55, 0x37, 0x6d, 0x22, 0x5d, 
+0x2c, 0x0a, 0x5b, 0x22, 0x65, 0x63, 0x61, 0x63, 
+0x38, 0x39, 0x63, 0x61, 0x64, 0x39, 0x33, 0x39, 
+0x32, 0x33, 0x63, 0x30, 0x32, 0x33, 0x32, 0x31, 
+0x22, 0x2c, 0x20, 0x22, 0x45, 0x4a, 0x44, 0x4d, 
+0x38, 0x64, 0x72, 0x66, 0x58, 0x41, 0x36, 0x75, 
+0x79, 0x41, 0x22, 0x5d, 0x2c, 0x0a, 0x5b, 0x22, 
+0x31, 0x30, 0x63, 0x38, 0x35, 0x31, 0x31, 0x65, 
+0x22, 0x2c, 0x20, 0x22, 0x52, 0x74, 0x35, 0x7a, 
+0x6d, 0x22, 0x5d, 0x2c, 0x0a, 0x5b, 0x22, 0x30, 
+0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 
+0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 
+0x30, 0x30, 0x30, 0x22, 0x2c, 0x20, 0x22, 0x31, 
+0x31, 0x31, 0x31, 0x31, 0x31, 0x31, 0x31, 0x31, 
+0x31, 0x22, 0x5d, 0x0a, 0x5d, 0x0a, 
+};};
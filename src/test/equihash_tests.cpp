@@ -8,11 +8,18 @@
 #endif
 
 #include "arith_uint256.h"
+#include "chainparams.h"
+#include "config.h"
 #include "crypto/sha256.h"
 #include "crypto/equihash.h"
+#include "equihashcache.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
 #include "test/test_bitcoin.h"
 #include "uint256.h"
 #include "utilstrencodings.h"
+#include "validation.h"
 #include "sodium.h"
 
 #include <sstream>
@@ -97,6 +104,14 @@ void TestEquihashValidator(unsigned int n, unsigned int k, const std::string &I,
     bool isValid;
     EhIsValidSolution(n, k, state, GetMinimalFromIndices(soln, cBitLen), isValid);
     BOOST_CHECK(isValid == expected);
+
+    // The CBlake2b based validator must agree with the libsodium one.
+    CBlake2b hasher;
+    EhInitialiseState(n, k, hasher, false);
+    hasher.Write((unsigned char*)&I[0], I.size());
+    hasher.Write(V.begin(), V.size());
+    EhIsValidSolution(n, k, hasher, GetMinimalFromIndices(soln, cBitLen), isValid);
+    BOOST_CHECK(isValid == expected);
 }
 
 BOOST_AUTO_TEST_CASE(solver_testvectors) {
@@ -208,4 +223,90 @@ BOOST_AUTO_TEST_CASE(validator_144_5_cdy_salt) {
     BOOST_CHECK(is_valid);
 }
 
+BOOST_AUTO_TEST_CASE(equihash_cache) {
+    // The solution is only part of the hash of post-fork headers.
+    CBlockHeader header;
+    header.nHeight = Params().GetConsensus().cdyHeight;
+    header.nSolution = ParseHex("01629b3779fd498defb2b0a551f7e111");
+    uint256 key = GetEquihashCacheKey(header);
+
+    EquihashCacheStats before = GetEquihashCacheStats();
+    BOOST_CHECK(!IsKeyInEquihashCache(key));
+    AddKeyInEquihashCache(key);
+    BOOST_CHECK(IsKeyInEquihashCache(key));
+
+    // A different solution must not hit the cache.
+    header.nSolution[0] ^= 1;
+    BOOST_CHECK(GetEquihashCacheKey(header) != key);
+    BOOST_CHECK(!IsKeyInEquihashCache(GetEquihashCacheKey(header)));
+
+    EquihashCacheStats after = GetEquihashCacheStats();
+    BOOST_CHECK_EQUAL(after.nHits - before.nHits, 1U);
+    BOOST_CHECK_EQUAL(after.nMisses - before.nMisses, 2U);
+}
+
+/** A header at height nHeight with the first Equihash solution found for it. */
+static CBlockHeader SolvedHeader(const CChainParams &params, uint32_t nHeight) {
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nHeight = nHeight;
+    header.hashPrevBlock = GetRandHash();
+    header.nTime = 1514764800;
+    header.nBits = 0x207fffff;
+
+    unsigned int n = params.EquihashN(nHeight);
+    unsigned int k = params.EquihashK(nHeight);
+    std::function<bool(std::vector<unsigned char>)> validBlock =
+        [&header](std::vector<unsigned char> soln) {
+            header.nSolution = soln;
+            return true;
+        };
+    // Not every nonce has a solution.
+    while (header.nSolution.empty()) {
+        header.nNonce = ArithToUint256(UintToArith256(header.nNonce) + 1);
+        crypto_generichash_blake2b_state state;
+        EhInitialiseState(n, k, state, params.EquihashUseCDYSalt(nHeight));
+        CEquihashInput I{header};
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << I;
+        ss << header.nNonce;
+        crypto_generichash_blake2b_update(&state, (unsigned char *)&ss[0],
+                                          ss.size());
+        EhBasicSolveUncancellable(n, k, state, validBlock);
+    }
+    return header;
+}
+
+BOOST_AUTO_TEST_CASE(batch_check_equihash_solutions) {
+    // Regtest uses small Equihash parameters, so solving is fast.
+    SelectParams(CBaseChainParams::REGTEST);
+    const Config &config = GetConfig();
+    const CChainParams &params = config.GetChainParams();
+    const uint32_t nHeight = params.GetConsensus().cdyHeight;
+
+    std::vector<CBlockHeader> headers;
+    for (int i = 0; i < 4; i++) {
+        headers.push_back(SolvedHeader(params, nHeight));
+        BOOST_CHECK_EQUAL(headers.back().nSolution.size(),
+                          params.EquihashSolutionWidth(nHeight));
+    }
+    std::vector<char> vValid = BatchCheckEquihashSolutions(config, headers);
+    BOOST_CHECK(vValid == std::vector<char>(4, true));
+
+    // A bad solution is reported on its own and the others are still
+    // checked. A solution of the wrong size and a pre-fork header are left
+    // unchecked.
+    headers[1].nSolution[0] ^= 1;
+    headers[2].nSolution.pop_back();
+    CBlockHeader prefork = SolvedHeader(params, nHeight);
+    prefork.nHeight = nHeight - 1;
+    headers.push_back(prefork);
+    headers.push_back(SolvedHeader(params, nHeight));
+    vValid = BatchCheckEquihashSolutions(config, headers);
+    BOOST_CHECK(vValid == std::vector<char>({true, false, false, true, false,
+                                             true}));
+
+    SelectParams(CBaseChainParams::MAIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
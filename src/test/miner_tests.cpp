@@ -4,6 +4,7 @@
 
 #include "miner.h"
 
+#include "arith_uint256.h"
 #include "chainparams.h"
 #include "coins.h"
 #include "config.h"
@@ -11,6 +12,7 @@
 #include "consensus/merkle.h"
 #include "consensus/validation.h"
 #include "policy/policy.h"
+#include "pow.h"
 #include "pubkey.h"
 #include "script/standard.h"
 #include "txmempool.h"
@@ -209,6 +211,83 @@ void TestPackageSelection(const CChainParams &chainparams, CScript scriptPubKey,
     BOOST_CHECK(pblocktemplate->block.vtx[8]->GetId() == hashLowFeeTx2);
 }
 
+// Test that the templates of a BlockTemplateEngine follow the mempool, and
+// hold the same transactions as templates created from scratch.
+void TestBlockTemplateEngine(const CChainParams &chainparams,
+                             CScript scriptPubKey,
+                             std::vector<CTransactionRef> &txFirst) {
+    TestMemPoolEntryHelper entry;
+
+    GlobalConfig config;
+    config.SetBlockPriorityPercentage(0);
+
+    BlockTemplateEngine engine(config, mempool);
+    std::unique_ptr<CBlockTemplate> pblocktemplate =
+        engine.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 1UL);
+
+    // A low fee parent and an unrelated medium fee transaction.
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vin[0].prevout.hash = txFirst[0]->GetId();
+    tx.vin[0].prevout.n = 0;
+    tx.vout.resize(1);
+    tx.vout[0].nValue = Amount(5000000000LL - 1000);
+    uint256 hashParentTx = tx.GetId();
+    mempool.addUnchecked(hashParentTx, entry.Fee(Amount(1000))
+                                           .Time(GetTime())
+                                           .SpendsCoinbase(true)
+                                           .FromTx(tx));
+
+    tx.vin[0].prevout.hash = txFirst[1]->GetId();
+    tx.vout[0].nValue = Amount(5000000000LL - 10000);
+    CTransaction mediumFeeTx(tx);
+    mempool.addUnchecked(mediumFeeTx.GetId(), entry.Fee(Amount(10000))
+                                                  .Time(GetTime())
+                                                  .SpendsCoinbase(true)
+                                                  .FromTx(tx));
+
+    pblocktemplate = engine.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3UL);
+
+    // A child of the parent is added to the template with it.
+    tx.vin[0].prevout.hash = hashParentTx;
+    tx.vout[0].nValue = Amount(5000000000LL - 1000 - 50000);
+    uint256 hashHighFeeTx = tx.GetId();
+    mempool.addUnchecked(hashHighFeeTx, entry.Fee(Amount(50000))
+                                            .Time(GetTime())
+                                            .SpendsCoinbase(false)
+                                            .FromTx(tx));
+
+    pblocktemplate = engine.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 4UL);
+    BOOST_CHECK(pblocktemplate->block.vtx[3]->GetId() == hashHighFeeTx);
+    BOOST_CHECK(pblocktemplate->block.vtx[0]->vout[0].nValue ==
+                GetBlockSubsidy(chainActive.Height() + 1,
+                                chainparams.GetConsensus()) +
+                    Amount(61000));
+
+    std::unique_ptr<CBlockTemplate> pblocktemplateFull =
+        BlockAssembler(config, chainparams).CreateNewBlock(scriptPubKey);
+    std::set<uint256> setTxs, setTxsFull;
+    for (size_t i = 1; i < pblocktemplate->block.vtx.size(); i++) {
+        setTxs.insert(pblocktemplate->block.vtx[i]->GetId());
+    }
+    for (size_t i = 1; i < pblocktemplateFull->block.vtx.size(); i++) {
+        setTxsFull.insert(pblocktemplateFull->block.vtx[i]->GetId());
+    }
+    BOOST_CHECK(setTxs == setTxsFull);
+
+    // A transaction leaving the mempool leaves the template.
+    mempool.removeRecursive(mediumFeeTx);
+    pblocktemplate = engine.CreateNewBlock(scriptPubKey);
+    BOOST_CHECK_EQUAL(pblocktemplate->block.vtx.size(), 3UL);
+    for (const CTransactionRef &ptx : pblocktemplate->block.vtx) {
+        BOOST_CHECK(ptx->GetId() != mediumFeeTx.GetId());
+    }
+}
+
 void TestCoinbaseMessageEB(uint64_t eb, std::string cbmsg) {
 
     GlobalConfig config;
@@ -708,6 +787,10 @@ BOOST_AUTO_TEST_CASE(CreateNewBlock_validity) {
 
     TestPackageSelection(chainparams, scriptPubKey, txFirst);
 
+    mempool.clear();
+
+    TestBlockTemplateEngine(chainparams, scriptPubKey, txFirst);
+
     fCheckpointsEnabled = true;
 }
 
@@ -781,4 +864,49 @@ BOOST_AUTO_TEST_CASE(BlockAssembler_construction) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(SolveEquihash_regtest) {
+    // Regtest uses small Equihash parameters, so solving is fast.
+    SelectParams(CBaseChainParams::REGTEST);
+    GlobalConfig config;
+    const Consensus::Params &consensus = config.GetChainParams().GetConsensus();
+
+    CBlock block;
+    block.nVersion = 4;
+    block.nHeight = consensus.cdyHeight;
+    block.nTime = 1514764800;
+    block.nBits = UintToArith256(consensus.powLimit).GetCompact();
+    block.hashMerkleRoot = GetRandHash();
+    EquihashSolverStats stats;
+
+    // Half of all solutions meet the regtest target, so a few nonces suffice.
+    uint64_t nMaxTries = 100;
+    BOOST_CHECK(SolveEquihash(config, &block, 2, nMaxTries, 0, stats));
+    BOOST_CHECK(nMaxTries < 100);
+    BOOST_CHECK(CheckEquihashSolution(&block, config.GetChainParams()));
+    BOOST_CHECK(
+        CheckProofOfWork(block.GetHash(), block.nBits, true, config));
+    BOOST_CHECK_EQUAL(stats.nNonces, 100 - nMaxTries);
+    BOOST_CHECK(stats.nSolutions > 0);
+
+    // Running out of tries or time gives up without touching the block.
+    const uint256 nonce = block.nNonce;
+    nMaxTries = 0;
+    BOOST_CHECK(!SolveEquihash(config, &block, 2, nMaxTries, 0, stats));
+    nMaxTries = 100;
+    BOOST_CHECK(!SolveEquihash(config, &block, 2, nMaxTries,
+                               GetTimeMicros() - 1, stats));
+    BOOST_CHECK(block.nNonce == nonce);
+
+    // The solver threads are kept between calls until stopped, and started
+    // again when needed.
+    StopEquihashSolverThreads();
+    block.hashMerkleRoot = GetRandHash();
+    nMaxTries = 100;
+    BOOST_CHECK(SolveEquihash(config, &block, 3, nMaxTries, 0, stats));
+    BOOST_CHECK(CheckEquihashSolution(&block, config.GetChainParams()));
+    StopEquihashSolverThreads();
+
+    SelectParams(CBaseChainParams::MAIN);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,127 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "chainparams.h"
+#include "config.h"
+#include "hash.h"
+#include "net.h"
+#include "net_processing.h"
+#include "netmessagemaker.h"
+#include "protocol.h"
+#include "streams.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+
+/** Queue msg to node as if the socket handler thread received it. */
+void ReceiveMessage(CNode &node, CSerializedNetMsg &&msg) {
+    const CMessageHeader::MessageMagic &magic = node.GetMagic(Params());
+    CMessageHeader hdr(magic, msg.command.c_str(), msg.data.size());
+    uint256 hash = Hash(msg.data.begin(), msg.data.end());
+    memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
+    std::vector<uint8_t> header;
+    CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
+
+    CNetMessage netmsg(magic, SER_NETWORK, INIT_PROTO_VERSION);
+    BOOST_CHECK_EQUAL(
+        netmsg.readHeader(reinterpret_cast<const char *>(header.data()),
+                          header.size()),
+        int(header.size()));
+    if (!msg.data.empty()) {
+        BOOST_CHECK_EQUAL(
+            netmsg.readData(reinterpret_cast<const char *>(msg.data.data()),
+                            msg.data.size()),
+            int(msg.data.size()));
+    }
+    BOOST_CHECK(netmsg.complete());
+
+    LOCK(node.cs_vProcessMsg);
+    node.nProcessQueueSize +=
+        netmsg.vRecv.size() + CMessageHeader::HEADER_SIZE;
+    node.vProcessMsg.push_back(std::move(netmsg));
+}
+
+size_t ProcessQueueLength(CNode &node) {
+    LOCK(node.cs_vProcessMsg);
+    return node.vProcessMsg.size();
+}
+
+uint64_t SentBytes(CNode &node, const std::string &strCommand) {
+    CNodeStats stats;
+    node.copyStats(stats);
+    return stats.mapSendBytesPerMsgCmd[strCommand];
+}
+
+} // namespace
+
+BOOST_FIXTURE_TEST_SUITE(net_processing_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(concurrent_messages_order) {
+    const Config &config = GetConfig();
+    std::atomic<bool> interruptDummy(false);
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+
+    CAddress addr(CService(CNetAddr(), Params().GetDefaultPort()), NODE_NONE);
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, addr, 0, 0, "", true);
+    node.SetSendVersion(PROTOCOL_VERSION);
+    GetNodeSignals().InitializeNode(config, &node, *connman);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fSuccessfullyConnected = true;
+
+    BOOST_CHECK(NetMsgType::IsConcurrent(NetMsgType::PING));
+    BOOST_CHECK(!NetMsgType::IsConcurrent(NetMsgType::SENDHEADERS));
+
+    // Nothing to do on an empty queue.
+    BOOST_CHECK(!ProcessConcurrentMessages(config, &node, *connman,
+                                           interruptDummy));
+
+    // A ping behind a message needing cs_main waits for it.
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::SENDHEADERS));
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::PING, uint64_t(1)));
+    BOOST_CHECK(!ProcessConcurrentMessages(config, &node, *connman,
+                                           interruptDummy));
+    BOOST_CHECK_EQUAL(ProcessQueueLength(node), 2U);
+    BOOST_CHECK_EQUAL(SentBytes(node, NetMsgType::PONG), 0U);
+
+    // The message handler thread takes the messages in order, after which
+    // the ping is left to the workers.
+    BOOST_CHECK(ProcessMessages(config, &node, *connman, interruptDummy));
+    BOOST_CHECK_EQUAL(ProcessQueueLength(node), 1U);
+    BOOST_CHECK_EQUAL(SentBytes(node, NetMsgType::PONG), 0U);
+
+    // Two pings in a row are taken one at a time. The pong stays in the send
+    // queue of the dummy socket, which holds back the second ping.
+    ReceiveMessage(node, msgMaker.Make(NetMsgType::PING, uint64_t(2)));
+    BOOST_CHECK(!ProcessConcurrentMessages(config, &node, *connman,
+                                           interruptDummy));
+    BOOST_CHECK_EQUAL(ProcessQueueLength(node), 1U);
+    BOOST_CHECK_GT(SentBytes(node, NetMsgType::PONG), 0U);
+    const uint64_t nPongBytes = SentBytes(node, NetMsgType::PONG);
+    BOOST_CHECK(node.fPauseSend);
+    BOOST_CHECK(!ProcessConcurrentMessages(config, &node, *connman,
+                                           interruptDummy));
+    BOOST_CHECK_EQUAL(ProcessQueueLength(node), 1U);
+    node.fPauseSend = false;
+
+    // Pending getdata responses go first, and need cs_main.
+    node.vRecvGetData.push_back(CInv(MSG_TX, uint256()));
+    BOOST_CHECK(!ProcessConcurrentMessages(config, &node, *connman,
+                                           interruptDummy));
+    BOOST_CHECK_EQUAL(ProcessQueueLength(node), 1U);
+    BOOST_CHECK_EQUAL(SentBytes(node, NetMsgType::PONG), nPongBytes);
+
+    node.vRecvGetData.clear();
+    BOOST_CHECK(!ProcessConcurrentMessages(config, &node, *connman,
+                                           interruptDummy));
+    BOOST_CHECK_EQUAL(ProcessQueueLength(node), 0U);
+    BOOST_CHECK_EQUAL(SentBytes(node, NetMsgType::PONG), 2 * nPongBytes);
+
+    bool fUpdateConnectionTime = false;
+    GetNodeSignals().FinalizeNode(node.GetId(), fUpdateConnectionTime);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,66 @@
+// Copyright (c) 2018 The Bitcoin Candy developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "netmsgstats.h"
+#include "protocol.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(netmsgstats_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(histogram_buckets) {
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(0), 0);
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(1), 1);
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(2), 2);
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(3), 2);
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(4), 3);
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(1000), 10);
+    BOOST_CHECK_EQUAL(CHistogram::GetBucket(uint64_t(-1)),
+                      CHistogram::BUCKETS - 1);
+    for (int i = 0; i + 1 < CHistogram::BUCKETS; i++) {
+        BOOST_CHECK_EQUAL(CHistogram::GetBucket(CHistogram::GetBucketMax(i)),
+                          i);
+        BOOST_CHECK_EQUAL(
+            CHistogram::GetBucket(CHistogram::GetBucketMax(i) + 1), i + 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(histogram_snapshot) {
+    CHistogram histogram;
+    BOOST_CHECK_EQUAL(histogram.GetSnapshot().nCount, 0);
+    BOOST_CHECK_EQUAL(histogram.GetSnapshot().GetPercentile(0.5), 0);
+
+    // 90 small values and 10 large ones.
+    for (int i = 0; i < 90; i++) {
+        histogram.Add(5);
+    }
+    for (int i = 0; i < 10; i++) {
+        histogram.Add(100000);
+    }
+    const CHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.nCount, 100);
+    BOOST_CHECK_EQUAL(snapshot.nTotal, 90 * 5 + 10 * 100000);
+    BOOST_CHECK_EQUAL(snapshot.nMax, 100000);
+    BOOST_CHECK_EQUAL(snapshot.vBuckets[CHistogram::GetBucket(5)], 90);
+    BOOST_CHECK_EQUAL(snapshot.vBuckets[CHistogram::GetBucket(100000)], 10);
+    // Percentiles are the upper bound of their bucket, capped by the max.
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(0.5), 7);
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(0.9), 7);
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(0.99), 100000);
+}
+
+BOOST_AUTO_TEST_CASE(netmsgstats_commands) {
+    // Every command has its own statistics, unknown ones share theirs.
+    CNetMsgCmdStats &ping = GetNetMsgCmdStats(NetMsgType::PING);
+    BOOST_CHECK(&ping != &GetNetMsgCmdStats(NetMsgType::PONG));
+    BOOST_CHECK(&GetNetMsgCmdStats("unknown1") ==
+                &GetNetMsgCmdStats("unknown2"));
+    BOOST_CHECK(&GetNetMsgCmdStats("unknown1") != &ping);
+    BOOST_CHECK_EQUAL(GetAllNetMsgCmdStats().size(),
+                      getAllNetMessageTypes().size() + 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
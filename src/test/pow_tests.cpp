@@ -371,4 +371,151 @@ BOOST_AUTO_TEST_CASE(cash_difficulty_test) {
     }
 }
 
+/**
+ * LwmaCalculateNextWorkRequired as it was before the sums were kept in the
+ * block index, walking the whole window for every block.
+ */
+static unsigned int
+LwmaCalculateNextWorkRequiredReference(const CBlockIndex *pindexPrev,
+                                       const Consensus::Params &params) {
+    int N = params.nZawyLwmaAveragingWindow;
+    const int T = params.nPowTargetSpacingCDY;
+    const int height = pindexPrev->nHeight + 1;
+    const int nNewRuleHeight = params.nNewRuleHeight;
+    const int CDYEquihashForkHeight = params.CDYEquihashForkHeight;
+    double adjust = 1;
+
+    assert(height > N);
+    if (height > nNewRuleHeight) N = 45;
+    arith_uint256 sum_target, sum_last10_target, sum_last5_target;
+    int sum_time = 0, nWeight = 0;
+    int sum_last10_time = 0;
+    int sum_last5_time = 0;
+
+    for (int i = height - N; i < height; i++) {
+        const CBlockIndex *block = pindexPrev->GetAncestor(i);
+        const CBlockIndex *block_Prev = block->GetAncestor(i - 1);
+        int64_t solvetime = block->GetBlockTime() - block_Prev->GetBlockTime();
+        if (height > nNewRuleHeight && solvetime >= 8 * T) solvetime = 8 * T;
+
+        nWeight++;
+        sum_time += solvetime * nWeight;
+        arith_uint256 target;
+        target.SetCompact(block->nBits);
+        sum_target += target;
+        if (i >= height - 10) {
+            sum_last10_time += solvetime;
+            sum_last10_target += target;
+            if (i >= height - 5) {
+                sum_last5_time += solvetime;
+                sum_last5_target += target;
+            }
+        }
+    }
+
+    if (sum_time < N * N * T / 20) {
+        sum_time = N * N * T / 20;
+    }
+
+    const arith_uint256 pow_limit = UintToArith256(params.PowLimit(true));
+    arith_uint256 next_target;
+    next_target = 2 * (sum_time / (N * (N + 1))) * (sum_target / N) * adjust / T;
+    if (height > CDYEquihashForkHeight && sum_last5_time <= 90) {
+        arith_uint256 avg_last5_target = sum_last5_target / 5;
+        if (next_target > avg_last5_target / 4)
+            next_target = avg_last5_target / 4;
+    } else if (height > nNewRuleHeight && sum_last10_time <= 5 * 60) {
+        arith_uint256 avg_last10_target = sum_last10_target / 10;
+        if (next_target > avg_last10_target / 2)
+            next_target = avg_last10_target / 2;
+    } else if (height > nNewRuleHeight && sum_last10_time <= 10 * 60) {
+        arith_uint256 avg_last10_target = sum_last10_target / 10;
+        if (next_target > avg_last10_target * 2 / 3)
+            next_target = avg_last10_target * 2 / 3;
+    }
+    if (height > nNewRuleHeight) {
+        arith_uint256 last_target;
+        last_target.SetCompact(pindexPrev->nBits);
+        if (next_target > last_target * 13 / 10)
+            next_target = last_target * 13 / 10;
+    }
+    if (next_target > pow_limit) {
+        return pow_limit.GetCompact();
+    }
+    return next_target.GetCompact();
+}
+
+BOOST_AUTO_TEST_CASE(lwma_incremental_matches_reference) {
+    SelectParams(CBaseChainParams::MAIN);
+    // Mainnet parameters, with the rule changes moved close to genesis so
+    // that a short chain goes through all of them.
+    Consensus::Params params = Params().GetConsensus();
+    params.nNewRuleHeight = 400;
+    params.CDYEquihashForkHeight = 800;
+    const int64_t T = params.nPowTargetSpacingCDY;
+    const arith_uint256 powLimit = UintToArith256(params.PowLimit(true));
+
+    FastRandomContext rng(true);
+    std::vector<CBlockIndex> blocks(1500);
+    blocks[0].nHeight = 0;
+    blocks[0].nTime = 1500000000;
+    blocks[0].nBits = arith_uint256(powLimit >> 8).GetCompact();
+    for (size_t i = 1; i < blocks.size(); i++) {
+        // Mostly sensible solvetimes, with bursts of fast blocks, stalls
+        // over the 8T cap and timestamps going backwards.
+        int64_t solvetime;
+        switch (rng.randrange(8)) {
+            case 0:
+                solvetime = rng.randrange(20);
+                break;
+            case 1:
+                solvetime = 8 * T + rng.randrange(10 * T);
+                break;
+            case 2:
+                solvetime = -int64_t(rng.randrange(2 * T));
+                break;
+            default:
+                solvetime = rng.randrange(3 * T);
+        }
+        blocks[i].pprev = &blocks[i - 1];
+        blocks[i].nHeight = i;
+        blocks[i].nTime = blocks[i - 1].nTime + solvetime;
+        blocks[i].BuildSkip();
+
+        if (int64_t(i) <= params.nZawyLwmaAveragingWindow) {
+            blocks[i].nBits = arith_uint256(powLimit >> rng.randrange(16)).GetCompact();
+            continue;
+        }
+        // Use the result as the target of the block, the way a chain would.
+        blocks[i].nBits =
+            LwmaCalculateNextWorkRequired(&blocks[i - 1], params);
+        BOOST_CHECK_EQUAL(
+            blocks[i].nBits,
+            LwmaCalculateNextWorkRequiredReference(&blocks[i - 1], params));
+    }
+
+    // Sums rolled forward from the parent match sums computed from scratch.
+    for (size_t i = 1400; i < blocks.size(); i++) {
+        ClearLwmaStateCache();
+        GetLwmaState(&blocks[i - 1], params);
+        const CLwmaState rolled = GetLwmaState(&blocks[i], params);
+        ClearLwmaStateCache();
+        const CLwmaState fresh = GetLwmaState(&blocks[i], params);
+        BOOST_CHECK_EQUAL(rolled.nWindow, fresh.nWindow);
+        BOOST_CHECK_EQUAL(rolled.nWeightedTime, fresh.nWeightedTime);
+        BOOST_CHECK_EQUAL(rolled.nTime, fresh.nTime);
+        BOOST_CHECK(rolled.nTargetSum == fresh.nTargetSum);
+    }
+
+    // Another block at the same height does not get the cached sums.
+    const CLwmaState tip = GetLwmaState(&blocks.back(), params);
+    CBlockIndex fork = blocks.back();
+    fork.nBits = arith_uint256(powLimit >> 20).GetCompact();
+    const CLwmaState forked = GetLwmaState(&fork, params);
+    BOOST_CHECK(forked.nTargetSum != tip.nTargetSum);
+    ClearLwmaStateCache();
+    BOOST_CHECK(GetLwmaState(&fork, params).nTargetSum == forked.nTargetSum);
+    ClearLwmaStateCache();
+}
+
 BOOST_AUTO_TEST_SUITE_END()
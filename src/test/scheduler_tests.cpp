@@ -126,4 +126,49 @@ BOOST_AUTO_TEST_CASE(manythreads) {
     BOOST_CHECK_EQUAL(counterSum, 200);
 }
 
+BOOST_AUTO_TEST_CASE(singlethreadedscheduler_ordered) {
+    CScheduler scheduler;
+
+    // Each queue must be ordered with respect to itself, but not to the other.
+    SingleThreadedSchedulerClient queue1(&scheduler);
+    SingleThreadedSchedulerClient queue2(&scheduler);
+
+    // More threads than queues.
+    boost::thread_group threads;
+    for (int i = 0; i < 5; ++i) {
+        threads.create_thread(
+            boost::bind(&CScheduler::serviceQueue, &scheduler));
+    }
+
+    // Not atomic: the callbacks of a queue must never run concurrently, and
+    // must run in the order they were added.
+    int counter1 = 0;
+    int counter2 = 0;
+    bool ordered1 = true;
+    bool ordered2 = true;
+    for (int i = 0; i < 100; ++i) {
+        queue1.AddToProcessQueue(
+            [i, &counter1, &ordered1]() { ordered1 &= i == counter1++; });
+        queue2.AddToProcessQueue(
+            [i, &counter2, &ordered2]() { ordered2 &= i == counter2++; });
+    }
+
+    scheduler.stop(true);
+    threads.join_all();
+
+    BOOST_CHECK_EQUAL(counter1, 100);
+    BOOST_CHECK_EQUAL(counter2, 100);
+    BOOST_CHECK(ordered1);
+    BOOST_CHECK(ordered2);
+    BOOST_CHECK_EQUAL(queue1.CallbacksPending(), 0U);
+
+    // Without threads, EmptyQueue runs what is left on the calling thread.
+    queue1.AddToProcessQueue([&counter1]() { counter1++; });
+    queue1.AddToProcessQueue([&counter1]() { counter1++; });
+    BOOST_CHECK_EQUAL(queue1.CallbacksPending(), 2U);
+    queue1.EmptyQueue();
+    BOOST_CHECK_EQUAL(counter1, 102);
+    BOOST_CHECK_EQUAL(queue1.CallbacksPending(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
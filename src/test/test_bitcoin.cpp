@@ -10,6 +10,9 @@
 #include "config.h"
 #include "consensus/consensus.h"
 #include "consensus/validation.h"
+#include "crypto/blake2b.h"
+#include "crypto/sha256.h"
+#include "equihashcache.h"
 #include "key.h"
 #include "miner.h"
 #include "net_processing.h"
@@ -47,11 +50,14 @@ extern bool fPrintToConsole;
 extern void noui_connect();
 
 BasicTestingSetup::BasicTestingSetup(const std::string &chainName) {
+    SHA256AutoDetect();
+    Blake2bAutoDetect();
     ECC_Start();
     SetupEnvironment();
     SetupNetworking();
     InitSignatureCache();
     InitScriptExecutionCache();
+    InitEquihashCache();
     // Don't want to write to debug.log file.
     fPrintToDebugLog = false;
     fCheckBlockIndex = true;
@@ -8,7 +8,9 @@
 #include "config.h"
 #include "consensus/consensus.h"
 #include "primitives/transaction.h"
+#include "random.h"
 #include "test/test_bitcoin.h"
+#include "txdb.h"
 #include "util.h"
 
 #include <cstdint>
@@ -76,4 +78,57 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_AUTO_TEST_CASE(block_index_solution_eviction) {
+    CBlockHeader header;
+    header.nVersion = 4;
+    header.nTime = 1514764800;
+    header.nBits = 0x207fffff;
+    header.nSolution = std::vector<unsigned char>(100, 0x42);
+    const uint256 hash = header.GetHash();
+    CBlockIndex index(header);
+    index.phashBlock = &hash;
+
+    BOOST_CHECK(pblocktree->WriteBatchSync(
+        std::vector<std::pair<int, const CBlockFileInfo *>>(), 0,
+        std::vector<const CBlockIndex *>(1, &index)));
+    index.EvictSolution();
+    BOOST_CHECK(index.fSolutionEvicted);
+    BOOST_CHECK(index.nSolution.empty());
+
+    // The solution is read back from the database, then from the cache.
+    const SolutionCacheStats before = pblocktree->GetSolutionCacheStats();
+    std::vector<unsigned char> solution;
+    BOOST_CHECK(index.GetSolution(solution));
+    BOOST_CHECK(solution == header.nSolution);
+    CBlockHeader read;
+    BOOST_CHECK(index.GetBlockHeader(read));
+    BOOST_CHECK(read.GetHash() == hash);
+    // Writing the entry again keeps its solution.
+    CDiskBlockIndex diskindex(&index);
+    BOOST_CHECK(diskindex.ReadSolution());
+    BOOST_CHECK(diskindex.nSolution == header.nSolution);
+    const SolutionCacheStats after = pblocktree->GetSolutionCacheStats();
+    BOOST_CHECK_EQUAL(after.nMisses, before.nMisses + 1);
+    BOOST_CHECK_EQUAL(after.nHits, before.nHits + 2);
+
+    // The solution can be left to read later, without holding cs_main.
+    BOOST_CHECK(index.GetBlockHeader(read, false));
+    BOOST_CHECK(read.nSolution.empty());
+    BOOST_CHECK(pblocktree->ReadSolution(hash, read.nSolution));
+    BOOST_CHECK(read.GetHash() == hash);
+
+    // A solution missing from the database is reported, not thrown.
+    const uint256 hashMissing = GetRandHash();
+    CBlockIndex missing(header);
+    missing.phashBlock = &hashMissing;
+    missing.EvictSolution();
+    BOOST_CHECK(!missing.GetSolution(solution));
+    BOOST_CHECK(!missing.GetBlockHeader(read));
+
+    // Headers from before the fork have no solution to evict.
+    CBlockIndex legacy;
+    legacy.EvictSolution();
+    BOOST_CHECK(!legacy.fSolutionEvicted);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -8,12 +8,17 @@
 #include "chainparams.h"
 #include "config.h"
 #include "hash.h"
+#include "memusage.h"
 #include "pow.h"
 #include "uint256.h"
 
+#include "util.h"
+
 #include <boost/thread.hpp>
 
+#include <atomic>
 #include <cstdint>
+#include <thread>
 
 static const char DB_COIN = 'C';
 static const char DB_COINS = 'c';
@@ -66,6 +71,7 @@ uint256 CCoinsViewDB::GetBestBlock() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    int64_t nStart = GetTimeMicros();
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -89,18 +95,152 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
 
     bool ret = db.WriteBatch(batch);
     LogPrint("coindb", "Committed %u changed transaction outputs (out of %u) "
-                       "to coin database...\n",
-             (unsigned int)changed, (unsigned int)count);
+                       "to coin database (%.1fMiB) in %.2fms\n",
+             (unsigned int)changed, (unsigned int)count,
+             batch.SizeEstimate() * (1.0 / (1 << 20)),
+             (GetTimeMicros() - nStart) * 0.001);
     return ret;
 }
 
+CCoinsViewBackgroundWriter::CCoinsViewBackgroundWriter(CCoinsView *viewIn)
+    : CCoinsViewBacked(viewIn), fLastWriteFailed(false), nUsage(0) {}
+
+CCoinsViewBackgroundWriter::~CCoinsViewBackgroundWriter() {
+    WaitForWrite();
+}
+
+bool CCoinsViewBackgroundWriter::GetCoin(const COutPoint &outpoint,
+                                         Coin &coin) const {
+    {
+        LOCK(cs);
+        if (pWriting) {
+            CCoinsMap::const_iterator it = pWriting->map.find(outpoint);
+            if (it != pWriting->map.end()) {
+                coin = it->second.coin;
+                return !coin.IsSpent();
+            }
+        }
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewBackgroundWriter::HaveCoin(const COutPoint &outpoint) const {
+    {
+        LOCK(cs);
+        if (pWriting) {
+            CCoinsMap::const_iterator it = pWriting->map.find(outpoint);
+            if (it != pWriting->map.end()) {
+                return !it->second.coin.IsSpent();
+            }
+        }
+    }
+    return base->HaveCoin(outpoint);
+}
+
+uint256 CCoinsViewBackgroundWriter::GetBestBlock() const {
+    {
+        LOCK(cs);
+        if (pWriting && !pWriting->hashBlock.IsNull()) {
+            return pWriting->hashBlock;
+        }
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundWriter::BatchWrite(CCoinsMap &mapCoins,
+                                            const uint256 &hashBlock) {
+    if (!WaitForWrite()) {
+        return false;
+    }
+    return base->BatchWrite(mapCoins, hashBlock);
+}
+
+CCoinsViewCursor *CCoinsViewBackgroundWriter::Cursor() const {
+    // The base can only be iterated once it has all the entries.
+    WaitForWrite();
+    return base->Cursor();
+}
+
+bool CCoinsViewBackgroundWriter::StartWrite(
+    std::unique_ptr<CCoinsCacheSnapshot> snapshot) {
+    LOCK(csThread);
+    if (!WaitForWrite()) {
+        return false;
+    }
+    {
+        LOCK(cs);
+        pWriting = std::move(snapshot);
+        nUsage = pWriting->nUsage;
+    }
+    writerThread = std::thread(&CCoinsViewBackgroundWriter::ThreadWrite, this);
+    return true;
+}
+
+bool CCoinsViewBackgroundWriter::WaitForWrite() const {
+    LOCK(csThread);
+    if (writerThread.joinable()) {
+        writerThread.join();
+    }
+    LOCK(cs);
+    return !fLastWriteFailed;
+}
+
+bool CCoinsViewBackgroundWriter::IsWriting() const {
+    LOCK(cs);
+    return pWriting != nullptr;
+}
+
+void CCoinsViewBackgroundWriter::ThreadWrite() {
+    RenameThread("bitcoin-coinswr");
+    int64_t nStart = GetTimeMicros();
+
+    // The snapshot is only read until the write is committed, here as well
+    // as by GetCoin, so the base consumes a copy of the modified entries.
+    CCoinsMap mapDirty;
+    for (const auto &entry : pWriting->map) {
+        if (entry.second.flags & CCoinsCacheEntry::DIRTY) {
+            mapDirty.emplace(entry.first, entry.second);
+        }
+    }
+    const size_t nCount = pWriting->map.size();
+    const size_t nChanged = mapDirty.size();
+    nUsage += memusage::DynamicUsage(mapDirty);
+
+    bool fOk = false;
+    try {
+        fOk = base->BatchWrite(mapDirty, pWriting->hashBlock);
+    } catch (const std::runtime_error &e) {
+        LogPrintf("Error writing to coin database: %s\n", e.what());
+    }
+
+    LogPrintf("Wrote %u changed coins (out of %u, %.1fMiB) to the coin "
+              "database in the background in %.2fs%s\n",
+              nChanged, nCount, pWriting->nUsage * (1.0 / (1 << 20)),
+              (GetTimeMicros() - nStart) * 0.000001, fOk ? "" : ", failed");
+
+    // Free the snapshot outside of the lock. On failure it is kept, so that
+    // reads stay consistent until the node shuts down.
+    std::unique_ptr<CCoinsCacheSnapshot> written;
+    {
+        LOCK(cs);
+        fLastWriteFailed = !fOk;
+        if (fOk) {
+            written = std::move(pWriting);
+            nUsage = 0;
+        } else {
+            nUsage = pWriting->nUsage;
+        }
+    }
+}
+
 size_t CCoinsViewDB::EstimateSize() const {
     return db.EstimateSize(DB_COIN, char(DB_COIN + 1));
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe)
     : CDBWrapper(GetDataDir() / "blocks" / "index", nCacheSize, fMemory,
-                 fWipe) {}
+                 fWipe),
+      nSolutionHits(0), nSolutionMisses(0) {}
 
 bool CBlockTreeDB::ReadBlockFileInfo(int nFile, CBlockFileInfo &info) {
     return Read(std::make_pair(DB_BLOCK_FILES, nFile), info);
@@ -189,8 +329,13 @@ bool CBlockTreeDB::WriteBatchSync(
     for (std::vector<const CBlockIndex *>::const_iterator it =
              blockinfo.begin();
          it != blockinfo.end(); it++) {
+        CDiskBlockIndex diskindex(*it);
+        // Entries written again keep their solution.
+        if (!diskindex.ReadSolution()) {
+            return false;
+        }
         batch.Write(std::make_pair(DB_BLOCK_INDEX, (*it)->GetBlockHash()),
-                    CDiskBlockIndex(*it));
+                    diskindex);
     }
     return WriteBatch(batch, true);
 }
@@ -220,58 +365,191 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(
-    std::function<CBlockIndex *(const uint256 &)> insertBlockIndex) {
-    const Config &config = GetConfig();
+namespace {
+//! An entry of the block index database, read and checked by a worker thread.
+struct LoadedBlockIndex {
+    uint256 hash;
+    CDiskBlockIndex diskindex;
+};
+} // namespace
 
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+/**
+ * Read the block index entries whose hash starts with a byte in [nBegin,
+ * nEnd), hash their header and check its proof of work.
+ */
+static bool LoadBlockIndexRange(CBlockTreeDB &db, const Config &config,
+                                int nBegin, int nEnd,
+                                std::vector<LoadedBlockIndex> &entries,
+                                const std::atomic<bool> &fAbort,
+                                std::string &strError) {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+    uint256 start;
+    *start.begin() = nBegin;
+    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, start));
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
+    const int cdyHeight = config.GetChainParams().GetConsensus().cdyHeight;
+    while (pcursor->Valid() && !fAbort) {
         std::pair<char, uint256> key;
-        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX) {
+        if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX ||
+            *key.second.begin() >= nEnd) {
             break;
         }
 
-        CDiskBlockIndex diskindex;
+        entries.emplace_back();
+        LoadedBlockIndex &entry = entries.back();
+        CDiskBlockIndex &diskindex = entry.diskindex;
         if (!pcursor->GetValue(diskindex)) {
-            return error("LoadBlockIndex() : failed to read value");
+            strError = "failed to read value";
+            return false;
         }
-
-        // Construct block index object
-        CBlockIndex *pindexNew = insertBlockIndex(diskindex.GetBlockHash());
-        pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
-        pindexNew->nHeight = diskindex.nHeight;
-        pindexNew->nFile = diskindex.nFile;
-        pindexNew->nDataPos = diskindex.nDataPos;
-        pindexNew->nUndoPos = diskindex.nUndoPos;
-        pindexNew->nVersion = diskindex.nVersion;
-        pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
-        memcpy(pindexNew->nReserved, diskindex.nReserved, sizeof(pindexNew->nReserved));
-        pindexNew->nTime = diskindex.nTime;
-        pindexNew->nBits = diskindex.nBits;
-        pindexNew->nNonce = diskindex.nNonce;
-        pindexNew->nSolution      = diskindex.nSolution;
-        pindexNew->nStatus = diskindex.nStatus;
-        pindexNew->nTx = diskindex.nTx;
+        entry.hash = diskindex.GetBlockHash();
 
         // TODO(h4x3rotab): Check Equihash solution? Not sure why Zcash doesn't do it here.
-        bool postfork = pindexNew->nHeight >= (uint32_t)config.GetChainParams().GetConsensus().cdyHeight;
-        if (!CheckProofOfWork(pindexNew->GetBlockHash(), pindexNew->nBits, postfork,
-                              config)) {
-            return error("LoadBlockIndex(): CheckProofOfWork failed: %s",
-                         pindexNew->ToString());
+        bool postfork = diskindex.nHeight >= cdyHeight;
+        if (!CheckProofOfWork(entry.hash, diskindex.nBits, postfork, config)) {
+            strError = strprintf("CheckProofOfWork failed: %s",
+                                 diskindex.ToString());
+            return false;
         }
 
+        // The solution is only needed again to serve the header, so leave it
+        // in the database rather than in memory.
+        diskindex.fSolutionEvicted = !diskindex.nSolution.empty();
+        std::vector<unsigned char>().swap(diskindex.nSolution);
+
         pcursor->Next();
     }
 
     return true;
 }
 
+bool CBlockTreeDB::LoadBlockIndexGuts(
+    std::function<CBlockIndex *(const uint256 &)> insertBlockIndex) {
+    const Config &config = GetConfig();
+
+    // Entries are keyed by block hash, which is uniformly distributed, so
+    // splitting the key space on the first byte of the hash balances the
+    // work. Deserializing and hashing the headers dominates, so it is spread
+    // over worker threads, and only the linking of the entries is done
+    // serially afterwards.
+    const int nThreads =
+        std::max(1, std::min(GetNumCores(), MAX_BLOCK_INDEX_LOAD_THREADS));
+    std::vector<std::vector<LoadedBlockIndex>> vEntries(nThreads);
+    std::vector<std::string> vErrors(nThreads);
+    std::atomic<bool> fAbort(false);
+
+    int64_t nStart = GetTimeMillis();
+    std::vector<std::thread> threads;
+    for (int i = 0; i < nThreads; i++) {
+        threads.emplace_back([&, i] {
+            RenameThread("bitcoin-loadidx");
+            if (!LoadBlockIndexRange(*this, config, (256 * i) / nThreads,
+                                     (256 * (i + 1)) / nThreads, vEntries[i],
+                                     fAbort, vErrors[i])) {
+                fAbort = true;
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+    for (const std::string &strError : vErrors) {
+        if (!strError.empty()) {
+            return error("LoadBlockIndex(): %s", strError);
+        }
+    }
+    boost::this_thread::interruption_point();
+
+    size_t nEntries = 0;
+    for (const std::vector<LoadedBlockIndex> &entries : vEntries) {
+        nEntries += entries.size();
+    }
+    int64_t nRead = GetTimeMillis();
+    LogPrintf("%s: read %u block index entries using %d threads in %dms\n",
+              __func__, nEntries, nThreads, nRead - nStart);
+
+    // Load mapBlockIndex
+    for (std::vector<LoadedBlockIndex> &entries : vEntries) {
+        for (const LoadedBlockIndex &entry : entries) {
+            const CDiskBlockIndex &diskindex = entry.diskindex;
+
+            // Construct block index object
+            CBlockIndex *pindexNew = insertBlockIndex(entry.hash);
+            pindexNew->pprev = insertBlockIndex(diskindex.hashPrev);
+            pindexNew->nHeight = diskindex.nHeight;
+            pindexNew->nFile = diskindex.nFile;
+            pindexNew->nDataPos = diskindex.nDataPos;
+            pindexNew->nUndoPos = diskindex.nUndoPos;
+            pindexNew->nVersion = diskindex.nVersion;
+            pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+            memcpy(pindexNew->nReserved, diskindex.nReserved, sizeof(pindexNew->nReserved));
+            pindexNew->nTime = diskindex.nTime;
+            pindexNew->nBits = diskindex.nBits;
+            pindexNew->nNonce = diskindex.nNonce;
+            pindexNew->fSolutionEvicted = diskindex.fSolutionEvicted;
+            pindexNew->nStatus = diskindex.nStatus;
+            pindexNew->nTx = diskindex.nTx;
+        }
+        // Release each batch as soon as it is linked.
+        std::vector<LoadedBlockIndex>().swap(entries);
+    }
+    LogPrintf("%s: linked block index entries in %dms\n", __func__,
+              GetTimeMillis() - nRead);
+
+    return true;
+}
+
+bool CBlockTreeDB::ReadSolution(const uint256 &hash,
+                                std::vector<unsigned char> &solution) {
+    {
+        LOCK(cs_solutions);
+        auto it = mapSolutions.find(hash);
+        if (it != mapSolutions.end()) {
+            nSolutionHits++;
+            lruSolutions.splice(lruSolutions.begin(), lruSolutions,
+                                it->second);
+            solution = it->second->second;
+            return true;
+        }
+        nSolutionMisses++;
+    }
+
+    CDiskBlockIndex diskindex;
+    if (!Read(std::make_pair(DB_BLOCK_INDEX, hash), diskindex)) {
+        return false;
+    }
+    solution = diskindex.nSolution;
+
+    LOCK(cs_solutions);
+    if (mapSolutions.count(hash)) {
+        // Another thread read it meanwhile.
+        return true;
+    }
+    lruSolutions.emplace_front(hash, solution);
+    mapSolutions.emplace(hash, lruSolutions.begin());
+    if (lruSolutions.size() > SOLUTION_CACHE_ENTRIES) {
+        mapSolutions.erase(lruSolutions.back().first);
+        lruSolutions.pop_back();
+    }
+    return true;
+}
+
+SolutionCacheStats CBlockTreeDB::GetSolutionCacheStats() {
+    LOCK(cs_solutions);
+    SolutionCacheStats stats;
+    stats.nEntries = lruSolutions.size();
+    stats.nUsage = memusage::DynamicUsage(mapSolutions);
+    for (const auto &entry : lruSolutions) {
+        // One list node per entry, plus the solution itself.
+        stats.nUsage += memusage::MallocUsage(sizeof(entry) + 2 * sizeof(void *)) +
+                        memusage::DynamicUsage(entry.second);
+    }
+    stats.nHits = nSolutionHits;
+    stats.nMisses = nSolutionMisses;
+    return stats;
+}
+
 namespace {
 //! Legacy class to deserialize pre-pertxout database entries without reindex.
 class CCoins {
@@ -9,9 +9,15 @@
 #include "chain.h"
 #include "coins.h"
 #include "dbwrapper.h"
+#include "sync.h"
 
+#include <atomic>
+#include <list>
 #include <map>
+#include <memory>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -25,6 +31,11 @@ static constexpr int DB_PEAK_USAGE_FACTOR = 2;
 static constexpr int MAX_BLOCK_COINSDB_USAGE = 200 * DB_PEAK_USAGE_FACTOR;
 //! Always periodic flush if less than this much space still available.
 static constexpr int MIN_BLOCK_COINSDB_USAGE = 50 * DB_PEAK_USAGE_FACTOR;
+//! Number of Equihash solutions read back from the block tree DB that are
+//! kept in memory, enough for one full HEADERS message.
+static const size_t SOLUTION_CACHE_ENTRIES = 2000;
+//! Maximum number of threads reading the block index at startup.
+static const int MAX_BLOCK_INDEX_LOAD_THREADS = 16;
 //! -dbcache default (MiB)
 static const int64_t nDefaultDbCache = 450;
 //! max. -dbcache (MiB)
@@ -40,6 +51,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 
 struct CDiskTxPos : public CDiskBlockPos {
     unsigned int nTxOffset; // after header
@@ -104,6 +117,60 @@ private:
     friend class CCoinsViewDB;
 };
 
+/**
+ * CCoinsView writing the entries of a CCoinsViewCache to its base on a
+ * separate thread, so that the cache can be emptied and used again right away.
+ * Until the write is committed, the entries are still read from here.
+ *
+ * Only one write is in progress at a time: starting another one, or writing
+ * synchronously through BatchWrite, first waits for it.
+ */
+class CCoinsViewBackgroundWriter : public CCoinsViewBacked {
+private:
+    //! Protects pWriting and fLastWriteFailed.
+    mutable CCriticalSection cs;
+    std::unique_ptr<CCoinsCacheSnapshot> pWriting;
+    bool fLastWriteFailed;
+
+    //! Serializes starting and waiting for writes.
+    mutable CCriticalSection csThread;
+    mutable std::thread writerThread;
+
+    std::atomic<size_t> nUsage;
+
+    void ThreadWrite();
+
+public:
+    explicit CCoinsViewBackgroundWriter(CCoinsView *viewIn);
+    ~CCoinsViewBackgroundWriter();
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    CCoinsViewCursor *Cursor() const override;
+
+    /**
+     * Start writing snapshot to the base, after the previous write finished.
+     * Returns false if the previous write failed.
+     */
+    bool StartWrite(std::unique_ptr<CCoinsCacheSnapshot> snapshot);
+    //! Wait for the current write, and return whether the last one succeeded.
+    bool WaitForWrite() const;
+    //! Whether a write is in progress, or failed.
+    bool IsWriting() const;
+    //! Memory used by the entries being written.
+    size_t DynamicMemoryUsage() const { return nUsage; }
+};
+
+/** Statistics of the cache of Equihash solutions read from the block tree */
+struct SolutionCacheStats {
+    size_t nEntries;
+    size_t nUsage;
+    uint64_t nHits;
+    uint64_t nMisses;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper {
 public:
@@ -113,6 +180,16 @@ private:
     CBlockTreeDB(const CBlockTreeDB &);
     void operator=(const CBlockTreeDB &);
 
+    typedef std::list<std::pair<uint256, std::vector<unsigned char>>>
+        SolutionList;
+    CCriticalSection cs_solutions;
+    //! Solutions recently read back, the most recently used first.
+    SolutionList lruSolutions;
+    std::unordered_map<uint256, SolutionList::iterator, BlockHasher>
+        mapSolutions;
+    uint64_t nSolutionHits;
+    uint64_t nSolutionMisses;
+
 public:
     bool WriteBatchSync(
         const std::vector<std::pair<int, const CBlockFileInfo *>> &fileInfo,
@@ -127,6 +204,9 @@ public:
     bool ReadFlag(const std::string &name, bool &fValue);
     bool LoadBlockIndexGuts(
         std::function<CBlockIndex *(const uint256 &)> insertBlockIndex);
+    /** Read the Equihash solution of a block index entry. */
+    bool ReadSolution(const uint256 &hash, std::vector<unsigned char> &solution);
+    SolutionCacheStats GetSolutionCacheStats();
 };
 
 #endif // BITCOIN_TXDB_H
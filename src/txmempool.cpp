@@ -21,16 +21,18 @@
 
 #include <boost/range/adaptor/reversed.hpp>
 
+#include <algorithm>
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef &_tx, const Amount _nFee,
                                  int64_t _nTime, double _entryPriority,
                                  unsigned int _entryHeight,
                                  Amount _inChainInputValue,
                                  bool _spendsCoinbase, int64_t _sigOpsCount,
                                  LockPoints lp)
-    : tx(_tx), nFee(_nFee), nTime(_nTime), entryPriority(_entryPriority),
-      entryHeight(_entryHeight), inChainInputValue(_inChainInputValue),
-      spendsCoinbase(_spendsCoinbase), sigOpCount(_sigOpsCount),
-      lockPoints(lp) {
+    : tx(_tx), nFee(_nFee), inChainInputValue(_inChainInputValue),
+      nTime(_nTime), entryPriority(_entryPriority), lockPoints(lp),
+      entryHeight(_entryHeight), sigOpCount(_sigOpsCount),
+      spendsCoinbase(_spendsCoinbase) {
     nTxSize = GetTransactionSize(*tx);
     nModSize = tx->CalculateModifiedSize(GetTxSize());
     nUsageSize = RecursiveDynamicUsage(*tx) + memusage::DynamicUsage(tx);
@@ -81,14 +83,15 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints &lp) {
 void CTxMemPool::UpdateForDescendants(txiter updateIt,
                                       cacheMap &cachedDescendants,
                                       const std::set<uint256> &setExclude) {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    const vecEntries &vChildren = GetMemPoolChildren(updateIt);
+    setEntries stageEntries(vChildren.begin(), vChildren.end());
+    setEntries setAllDescendants;
 
     while (!stageEntries.empty()) {
         const txiter cit = *stageEntries.begin();
         setAllDescendants.insert(cit);
         stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
+        const vecEntries &setChildren = GetMemPoolChildren(cit);
         for (const txiter childEntry : setChildren) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
@@ -207,7 +210,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(
         // If we're not searching for parents, we require this to be an entry in
         // the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        const vecEntries &vParents = GetMemPoolParents(it);
+        parentHashes.insert(vParents.begin(), vParents.end());
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
@@ -240,7 +244,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(
             return false;
         }
 
-        const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
+        const vecEntries &setMemPoolParents = GetMemPoolParents(stageit);
         for (const txiter &phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
             if (setAncestors.count(phash) == 0) {
@@ -261,7 +265,7 @@ bool CTxMemPool::CalculateMemPoolAncestors(
 
 void CTxMemPool::UpdateAncestorsOf(bool add, txiter it,
                                    setEntries &setAncestors) {
-    setEntries parentIters = GetMemPoolParents(it);
+    const vecEntries &parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
     for (txiter piter : parentIters) {
         UpdateChild(piter, it, add);
@@ -291,7 +295,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it,
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it) {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const vecEntries &setMemPoolChildren = GetMemPoolChildren(it);
     for (txiter updateIt : setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -306,7 +310,7 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove,
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block. Here we only update statistics and not data in
-        // mapLinks (which we need to preserve until we're finished with all
+        // vTxLinks (which we need to preserve until we're finished with all
         // operations that need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
             setEntries setDescendants;
@@ -332,16 +336,16 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove,
         // should be a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state. In this case, the set of
-        // ancestors reachable via mapLinks will be the same as the set of
+        // ancestors reachable via vTxLinks will be the same as the set of
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called. So if we're being
         // called during a reorg, ie before UpdateTransactionsFromBlock() has
-        // been called, then mapLinks[] will differ from the set of mempool
+        // been called, then vTxLinks[] will differ from the set of mempool
         // parents we'd calculate by searching, and it's important that we use
-        // the mapLinks[] notion of ancestor transactions as the set of things
+        // the vTxLinks[] notion of ancestor transactions as the set of things
         // to update for removal.
         CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit,
                                   nNoLimit, nNoLimit, dummy, false);
@@ -418,7 +422,9 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
     // Used by AcceptToMemoryPool(), which DOES do all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    vTxHashes.emplace_back(newit->GetTx().GetHash(), newit);
+    vTxLinks.emplace_back();
+    newit->vTxHashesIdx = vTxHashes.size() - 1;
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting into
@@ -464,9 +470,6 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
     totalTxSize += entry.GetTxSize();
     minerPolicyEstimator->processTransaction(entry, validFeeEstimate);
 
-    vTxHashes.emplace_back(tx.GetHash(), newit);
-    newit->vTxHashesIdx = vTxHashes.size() - 1;
-
     return true;
 }
 
@@ -477,22 +480,27 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
         mapNextTx.erase(txin.prevout);
     }
 
+    const TxLinks &links = vTxLinks[it->vTxHashesIdx];
+    cachedInnerUsage -= memusage::DynamicUsage(links.parents) +
+                        memusage::DynamicUsage(links.children);
+
     if (vTxHashes.size() > 1) {
         vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
+        vTxLinks[it->vTxHashesIdx] = std::move(vTxLinks.back());
         vTxHashes[it->vTxHashesIdx].second->vTxHashesIdx = it->vTxHashesIdx;
         vTxHashes.pop_back();
+        vTxLinks.pop_back();
         if (vTxHashes.size() * 2 < vTxHashes.capacity()) {
             vTxHashes.shrink_to_fit();
+            vTxLinks.shrink_to_fit();
         }
     } else {
         vTxHashes.clear();
+        vTxLinks.clear();
     }
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) +
-                        memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     minerPolicyEstimator->removeTx(txid);
@@ -518,7 +526,7 @@ void CTxMemPool::CalculateDescendants(txiter entryit,
         setDescendants.insert(it);
         stage.erase(it);
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const vecEntries &setChildren = GetMemPoolChildren(it);
         for (const txiter &childiter : setChildren) {
             if (!setDescendants.count(childiter)) {
                 stage.insert(childiter);
@@ -665,7 +673,7 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
 }
 
 void CTxMemPool::_clear() {
-    mapLinks.clear();
+    vTxLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
     vTxHashes.clear();
@@ -708,9 +716,9 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction &tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
+        assert(it->vTxHashesIdx < vTxLinks.size());
+        assert(vTxHashes[it->vTxHashesIdx].second == it);
+        const TxLinks &links = vTxLinks[it->vTxHashesIdx];
         innerUsage += memusage::DynamicUsage(links.parents) +
                       memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
@@ -741,7 +749,10 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        const vecEntries &vParents = GetMemPoolParents(it);
+        assert(vParents.size() == setParentCheck.size());
+        assert(setParentCheck ==
+               setEntries(vParents.begin(), vParents.end()));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -778,7 +789,10 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const {
                 childSizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        const vecEntries &vChildren = GetMemPoolChildren(it);
+        assert(vChildren.size() == setChildrenCheck.size());
+        assert(setChildrenCheck ==
+               setEntries(vChildren.begin(), vChildren.end()));
         // Also check to make sure size is greater than sum with immediate
         // children. Just a sanity check, not definitive that this calc is
         // correct...
@@ -910,6 +924,19 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const {
     return ret;
 }
 
+std::vector<CTxMemPoolEntry> CTxMemPool::entryAll() const {
+    LOCK(cs);
+    auto iters = GetSortedDepthAndScore();
+
+    std::vector<CTxMemPoolEntry> ret;
+    ret.reserve(mapTx.size());
+    for (auto it : iters) {
+        ret.push_back(*it);
+    }
+
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const uint256 &txid) const {
     LOCK(cs);
     indexed_transaction_set::const_iterator i = mapTx.find(txid);
@@ -1087,7 +1114,7 @@ size_t CTxMemPool::DynamicMemoryUsage() const {
                mapTx.size() +
            memusage::DynamicUsage(mapNextTx) +
            memusage::DynamicUsage(mapDeltas) +
-           memusage::DynamicUsage(mapLinks) +
+           memusage::DynamicUsage(vTxLinks) +
            memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
 }
 
@@ -1130,38 +1157,49 @@ bool CTxMemPool::addUnchecked(const uint256 &hash, const CTxMemPoolEntry &entry,
     return addUnchecked(hash, entry, setAncestors, validFeeEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+// Add or remove an entry of a link vector, keeping cachedInnerUsage in step
+// with its allocation.
+static void UpdateLinks(CTxMemPool::vecEntries &links, CTxMemPool::txiter it,
+                        bool add, uint64_t &cachedInnerUsage) {
+    auto pos = std::find(links.begin(), links.end(), it);
+    if (add == (pos != links.end())) {
+        return;
+    }
+    cachedInnerUsage -= memusage::DynamicUsage(links);
+    if (add) {
+        links.push_back(it);
+    } else {
+        *pos = links.back();
+        links.pop_back();
+        if (links.empty()) {
+            links.shrink_to_fit();
+        }
     }
+    cachedInnerUsage += memusage::DynamicUsage(links);
+}
+
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add) {
+    UpdateLinks(vTxLinks[entry->vTxHashesIdx].children, child, add,
+                cachedInnerUsage);
 }
 
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add) {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    UpdateLinks(vTxLinks[entry->vTxHashesIdx].parents, parent, add,
+                cachedInnerUsage);
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::vecEntries &
 CTxMemPool::GetMemPoolParents(txiter entry) const {
     assert(entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    assert(entry->vTxHashesIdx < vTxLinks.size());
+    return vTxLinks[entry->vTxHashesIdx].parents;
 }
 
-const CTxMemPool::setEntries &
+const CTxMemPool::vecEntries &
 CTxMemPool::GetMemPoolChildren(txiter entry) const {
     assert(entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    assert(entry->vTxHashesIdx < vTxLinks.size());
+    return vTxLinks[entry->vTxHashesIdx].children;
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -79,32 +79,34 @@ class CTxMemPool;
 
 class CTxMemPoolEntry {
 private:
+    // The fields are ordered to avoid padding, and the sizes and counts of a
+    // single transaction fit in 32 bits, as there are many entries.
     CTransactionRef tx;
     //!< Cached to avoid expensive parent-transaction lookups
     Amount nFee;
-    //!< ... and avoid recomputing tx size
-    size_t nTxSize;
-    //!< ... and modified size for priority
-    size_t nModSize;
-    //!< ... and total memory usage
-    size_t nUsageSize;
-    //!< Local time when entering the mempool
-    int64_t nTime;
-    //!< Priority when entering the mempool
-    double entryPriority;
-    //!< Chain height when entering the mempool
-    unsigned int entryHeight;
     //!< Sum of all txin values that are already in blockchain
     Amount inChainInputValue;
-    //!< keep track of transactions that spend a coinbase
-    bool spendsCoinbase;
-    //!< Total sigop plus P2SH sigops count
-    int64_t sigOpCount;
     //!< Used for determining the priority of the transaction for mining in a
     //! block
     Amount feeDelta;
+    //!< Local time when entering the mempool
+    int64_t nTime;
+    //!< Priority when entering the mempool
+    double entryPriority;
     //!< Track the height and time at which tx was final
     LockPoints lockPoints;
+    //!< Cached to avoid recomputing tx size
+    uint32_t nTxSize;
+    //!< ... and modified size for priority
+    uint32_t nModSize;
+    //!< ... and total memory usage
+    uint32_t nUsageSize;
+    //!< Chain height when entering the mempool
+    uint32_t entryHeight;
+    //!< Total sigop plus P2SH sigops count
+    int32_t sigOpCount;
+    //!< keep track of transactions that spend a coinbase
+    bool spendsCoinbase;
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -143,6 +145,8 @@ public:
     size_t GetTxSize() const { return nTxSize; }
     int64_t GetTime() const { return nTime; }
     unsigned int GetHeight() const { return entryHeight; }
+    double GetEntryPriority() const { return entryPriority; }
+    Amount GetInChainInputValue() const { return inChainInputValue; }
     int64_t GetSigOpCount() const { return sigOpCount; }
     Amount GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
@@ -173,8 +177,8 @@ public:
         return nSigOpCountWithAncestors;
     }
 
-    //!< Index in mempool's vTxHashes
-    mutable size_t vTxHashesIdx;
+    //!< Index in mempool's vTxHashes and vTxLinks
+    mutable uint32_t vTxHashesIdx;
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -412,7 +416,7 @@ public:
  *
  * In order for the feerate sort to remain correct, we must update transactions
  * in the mempool when new descendants arrive. To facilitate this, we track the
- * set of in-mempool direct parents and direct children in mapLinks. Within each
+ * set of in-mempool direct parents and direct children in vTxLinks. Within each
  * CTxMemPoolEntry, we track the size and fees of all descendants.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
@@ -445,7 +449,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock(). Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * vTxLinks may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely on them to
  * walk the mempool are not generally safe to use).
  *
@@ -521,6 +525,8 @@ public:
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
     //!< All tx hashes/entries in mapTx, in random order
     std::vector<std::pair<uint256, txiter>> vTxHashes;
+    //!< In-mempool direct parents or children of an entry, in no order
+    typedef std::vector<txiter> vecEntries;
 
     struct CompareIteratorByHash {
         bool operator()(const txiter &a, const txiter &b) const {
@@ -529,19 +535,24 @@ public:
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
 
-    const setEntries &GetMemPoolParents(txiter entry) const;
-    const setEntries &GetMemPoolChildren(txiter entry) const;
+    const vecEntries &GetMemPoolParents(txiter entry) const;
+    const vecEntries &GetMemPoolChildren(txiter entry) const;
 
 private:
     typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
 
+    /**
+     * A transaction has few in-mempool parents and children (they are bounded
+     * by the ancestor and descendant limits), so that small vectors take less
+     * memory than sets, and are fast enough to search.
+     */
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        vecEntries parents;
+        vecEntries children;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    //!< The links of each entry, at the entry's index in vTxHashes
+    std::vector<TxLinks> vTxLinks;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
@@ -643,7 +654,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      * fSearchForParents = whether to search a tx's vin for in-mempool parents,
-     * or look up parents from mapLinks. Must be true for entries not in the
+     * or look up parents from vTxLinks. Must be true for entries not in the
      * mempool
      */
     bool CalculateMemPoolAncestors(
@@ -709,6 +720,8 @@ public:
     CTransactionRef get(const uint256 &hash) const;
     TxMempoolInfo info(const uint256 &hash) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /** Copies of all entries, with parents before their children. */
+    std::vector<CTxMemPoolEntry> entryAll() const;
 
     /**
      * Estimate fee rate needed to get into the next nBlocks. If no answer can
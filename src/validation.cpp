@@ -44,6 +44,8 @@
 
 #include <atomic>
 #include <sstream>
+#include <thread>
+#include <unordered_set>
 
 #include <boost/algorithm/string/join.hpp>
 #include <boost/algorithm/string/replace.hpp>
@@ -84,6 +86,7 @@ bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
 bool fCheckBlockIndex = false;
 bool fCheckpointsEnabled = DEFAULT_CHECKPOINTS_ENABLED;
+bool fCheckBlockReads = DEFAULT_CHECK_BLOCK_READS;
 size_t nCoinCacheUsage = 5000 * 300;
 uint64_t nPruneTarget = 0;
 int64_t nMaxTipAge = DEFAULT_MAX_TIP_AGE;
@@ -207,7 +210,7 @@ public:
             &MemPoolConflictRemovalTracker::NotifyEntryRemoved, this, _1, _2));
         for (const auto &tx : conflictedTxs) {
             GetMainSignals().SyncTransaction(
-                *tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+                tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
         }
         conflictedTxs.clear();
     }
@@ -230,6 +233,7 @@ CBlockIndex *FindForkInGlobalIndex(const CChain &chain,
 }
 
 CCoinsViewCache *pcoinsTip = nullptr;
+CCoinsViewBackgroundWriter *pcoinsWriter = nullptr;
 CBlockTreeDB *pblocktree = nullptr;
 
 enum FlushStateMode {
@@ -665,32 +669,25 @@ bool IsMonolithEnabled(const Config &config, const CBlockIndex *pindexPrev) {
 }
 
 
+static bool CheckInputScripts(const CTransaction &tx, CValidationState &state,
+                              const CCoinsViewCache &inputs,
+                              const uint32_t flags, bool sigCacheStore,
+                              const PrecomputedTransactionData &txdata,
+                              std::vector<CScriptCheck> *pvChecks = nullptr);
+
 // Used to avoid mempool polluting consensus critical paths if CCoinsViewMempool
 // were somehow broken and returning the wrong scriptPubKeys
-static bool CheckInputsFromMempoolAndCache(const CTransaction &tx,
-                                           CValidationState &state,
-                                           const CCoinsViewCache &view,
-                                           CTxMemPool &pool, uint32_t flags,
-                                           bool cacheSigStore,
-                                           PrecomputedTransactionData &txdata) {
+static void CheckCoinsFromMempoolAndCache(const CTransaction &tx,
+                                          const CCoinsViewCache &view,
+                                          CTxMemPool &pool) {
     AssertLockHeld(cs_main);
-
-    // pool.cs should be locked already, but go ahead and re-take the lock here
-    // to enforce that mempool doesn't change between when we check the view and
-    // when we actually call through to CheckInputs
-    LOCK(pool.cs);
+    AssertLockHeld(pool.cs);
 
     assert(!tx.IsCoinBase());
     for (const CTxIn &txin : tx.vin) {
+        // The inputs were checked to be available before calling this.
         const Coin &coin = view.AccessCoin(txin.prevout);
-
-        // At this point we haven't actually checked if the coins are all
-        // available (or shouldn't assume we have, since CheckInputs does). So
-        // we just return failure if the inputs are not available here, and then
-        // only have to check equivalence for available inputs.
-        if (coin.IsSpent()) {
-            return false;
-        }
+        assert(!coin.IsSpent());
 
         const CTransactionRef &txFrom = pool.get(txin.prevout.hash);
         if (txFrom) {
@@ -703,24 +700,106 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction &tx,
             assert(coinFromDisk.GetTxOut() == coin.GetTxOut());
         }
     }
+}
 
-    return CheckInputs(tx, state, view, true, flags, cacheSigStore, true,
-                       txdata);
+/**
+ * A transaction on its way into the mempool. The checks which need the chain
+ * state fill it in under cs_main, so that the script checks can then run
+ * without any lock, using only what is stored here.
+ */
+struct MempoolAdmission {
+    const CTransactionRef ptx;
+    const int64_t nAcceptTime;
+    const bool fLimitFree;
+    const bool fOverrideMempoolLimit;
+    const Amount nAbsurdFee;
+    CValidationState &state;
+    bool *pfMissingInputs;
+    std::vector<COutPoint> &coins_to_uncache;
+
+    //! The coins spent by the transaction, detached from the mempool.
+    CCoinsView dummy;
+    CCoinsViewCache view;
+    std::unique_ptr<CTxMemPoolEntry> entry;
+    CTxMemPool::setEntries setAncestors;
+
+    uint32_t extraFlags;
+    uint32_t scriptVerifyFlags;
+    uint32_t currentBlockScriptVerifyFlags;
+    //! Script cache key for the current block's flags.
+    uint256 hashCacheEntry;
+    //! Whether the scripts are in the script cache for either set of flags.
+    bool fStandardCached;
+    bool fBlockCached;
+    //! Whether the scripts passed with the current block's flags.
+    bool fBlockFlagsOk;
+    //! Result of MempoolScriptChecks, when run on a CCheckQueue.
+    bool fScriptsOk;
+
+    //! The tip the transaction was checked against.
+    const CBlockIndex *pindexTip;
+
+    MempoolAdmission(const CTransactionRef &ptxIn, int64_t nAcceptTimeIn,
+                     bool fLimitFreeIn, bool fOverrideMempoolLimitIn,
+                     const Amount nAbsurdFeeIn, CValidationState &stateIn,
+                     bool *pfMissingInputsIn,
+                     std::vector<COutPoint> &coins_to_uncacheIn)
+        : ptx(ptxIn), nAcceptTime(nAcceptTimeIn), fLimitFree(fLimitFreeIn),
+          fOverrideMempoolLimit(fOverrideMempoolLimitIn),
+          nAbsurdFee(nAbsurdFeeIn), state(stateIn),
+          pfMissingInputs(pfMissingInputsIn),
+          coins_to_uncache(coins_to_uncacheIn), view(&dummy),
+          extraFlags(SCRIPT_VERIFY_NONE), scriptVerifyFlags(0),
+          currentBlockScriptVerifyFlags(0), fStandardCached(false),
+          fBlockCached(false), fBlockFlagsOk(false), fScriptsOk(false),
+          pindexTip(nullptr) {}
+
+    MempoolAdmission(const MempoolAdmission &) = delete;
+    MempoolAdmission &operator=(const MempoolAdmission &) = delete;
+};
+
+static bool CalculateAdmissionAncestors(CTxMemPool &pool,
+                                        MempoolAdmission &admission) {
+    AssertLockHeld(pool.cs);
+
+    // Calculate in-mempool ancestors, up to a limit.
+    admission.setAncestors.clear();
+    size_t nLimitAncestors =
+        GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize =
+        GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    size_t nLimitDescendants =
+        GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize =
+        GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    std::string errString;
+    if (!pool.CalculateMemPoolAncestors(
+            *admission.entry, admission.setAncestors, nLimitAncestors,
+            nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize,
+            errString)) {
+        return admission.state.DoS(0, false, REJECT_NONSTANDARD,
+                                   "too-long-mempool-chain", false, errString);
+    }
+    return true;
 }
 
-static bool AcceptToMemoryPoolWorker(
-    const Config &config, CTxMemPool &pool, CValidationState &state,
-    const CTransactionRef &ptx, bool fLimitFree, bool *pfMissingInputs,
-    int64_t nAcceptTime, bool fOverrideMempoolLimit, const Amount nAbsurdFee,
-    std::vector<COutPoint> &coins_to_uncache) {
+/**
+ * First stage of the mempool admission: everything but the script checks, which
+ * needs cs_main. On success, the coins spent by the transaction and the script
+ * flags to use are stored in admission.
+ */
+static bool MempoolPreChecks(const Config &config, CTxMemPool &pool,
+                             MempoolAdmission &admission) {
     AssertLockHeld(cs_main);
 
-    const CTransaction &tx = *ptx;
+    const CTransaction &tx = *admission.ptx;
     const uint256 txid = tx.GetId();
-    if (pfMissingInputs) {
-        *pfMissingInputs = false;
+    CValidationState &state = admission.state;
+    CCoinsViewCache &view = admission.view;
+    std::vector<COutPoint> &coins_to_uncache = admission.coins_to_uncache;
+    if (admission.pfMissingInputs) {
+        *admission.pfMissingInputs = false;
     }
-
     // Coinbase is only valid in a block, not as a loose transaction.
     if (!CheckRegularTransaction(tx, state)) {
         // state filled in by CheckRegularTransaction.
@@ -769,289 +848,376 @@ static bool AcceptToMemoryPoolWorker(
         }
     }
 
+    Amount nValueIn(0);
+    LockPoints lp;
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
-
-        Amount nValueIn(0);
-        LockPoints lp;
-        {
-            LOCK(pool.cs);
-            CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
-            view.SetBackend(viewMemPool);
-
-            // Do we already have it?
-            for (size_t out = 0; out < tx.vout.size(); out++) {
-                COutPoint outpoint(txid, out);
-                bool had_coin_in_cache = pcoinsTip->HaveCoinInCache(outpoint);
-                if (view.HaveCoin(outpoint)) {
-                    if (!had_coin_in_cache) {
-                        coins_to_uncache.push_back(outpoint);
-                    }
-
-                    return state.Invalid(false, REJECT_ALREADY_KNOWN,
-                                         "txn-already-known");
-                }
-            }
-
-            // Do all inputs exist?
-            for (const CTxIn txin : tx.vin) {
-                if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
-                    coins_to_uncache.push_back(txin.prevout);
+        LOCK(pool.cs);
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        view.SetBackend(viewMemPool);
+
+        // Do we already have it?
+        for (size_t out = 0; out < tx.vout.size(); out++) {
+            COutPoint outpoint(txid, out);
+            bool had_coin_in_cache = pcoinsTip->HaveCoinInCache(outpoint);
+            if (view.HaveCoin(outpoint)) {
+                if (!had_coin_in_cache) {
+                    coins_to_uncache.push_back(outpoint);
                 }
 
-                if (!view.HaveCoin(txin.prevout)) {
-                    if (pfMissingInputs) {
-                        *pfMissingInputs = true;
-                    }
-
-                    // fMissingInputs and !state.IsInvalid() is used to detect
-                    // this condition, don't set state.Invalid()
-                    return false;
-                }
+                return state.Invalid(false, REJECT_ALREADY_KNOWN,
+                                     "txn-already-known");
             }
+        }
 
-            // Are the actual inputs available?
-            if (!view.HaveInputs(tx)) {
-                return state.Invalid(false, REJECT_DUPLICATE,
-                                     "bad-txns-inputs-spent");
+        // Do all inputs exist?
+        for (const CTxIn txin : tx.vin) {
+            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                coins_to_uncache.push_back(txin.prevout);
             }
 
-            // Bring the best block into scope.
-            view.GetBestBlock();
-
-            nValueIn = view.GetValueIn(tx);
-
-            // We have all inputs cached now, so switch back to dummy, so we
-            // don't need to keep lock on mempool.
-            view.SetBackend(dummy);
+            if (!view.HaveCoin(txin.prevout)) {
+                if (admission.pfMissingInputs) {
+                    *admission.pfMissingInputs = true;
+                }
 
-            // Only accept BIP68 sequence locked transactions that can be mined
-            // in the next block; we don't want our mempool filled up with
-            // transactions that can't be mined yet. Must keep pool.cs for this
-            // unless we change CheckSequenceLocks to take a CoinsViewCache
-            // instead of create its own.
-            if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp)) {
-                return state.DoS(0, false, REJECT_NONSTANDARD,
-                                 "non-BIP68-final");
+                // fMissingInputs and !state.IsInvalid() is used to detect
+                // this condition, don't set state.Invalid()
+                return false;
             }
         }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view)) {
-            return state.Invalid(false, REJECT_NONSTANDARD,
-                                 "bad-txns-nonstandard-inputs");
+        // Are the actual inputs available?
+        if (!view.HaveInputs(tx)) {
+            return state.Invalid(false, REJECT_DUPLICATE,
+                                 "bad-txns-inputs-spent");
         }
+        CheckCoinsFromMempoolAndCache(tx, view, pool);
 
-        int64_t nSigOpsCount =
-            GetTransactionSigOpCount(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+        // Bring the best block into scope.
+        view.GetBestBlock();
 
-        Amount nValueOut = tx.GetValueOut();
-        Amount nFees = nValueIn - nValueOut;
-        // nModifiedFees includes any fee deltas from PrioritiseTransaction
-        Amount nModifiedFees = nFees;
-        double nPriorityDummy = 0;
-        pool.ApplyDeltas(txid, nPriorityDummy, nModifiedFees);
+        nValueIn = view.GetValueIn(tx);
 
-        Amount inChainInputValue;
-        double dPriority =
-            view.GetPriority(tx, chainActive.Height(), inChainInputValue);
+        // We have all inputs cached now, so switch back to dummy, so we
+        // don't need to keep lock on mempool.
+        view.SetBackend(admission.dummy);
 
-        // Keep track of transactions that spend a coinbase, which we re-scan
-        // during reorgs to ensure COINBASE_MATURITY is still met.
-        bool fSpendsCoinbase = false;
-        for (const CTxIn &txin : tx.vin) {
-            const Coin &coin = view.AccessCoin(txin.prevout);
-            if (coin.IsCoinBase()) {
-                fSpendsCoinbase = true;
-                break;
-            }
+        // Only accept BIP68 sequence locked transactions that can be mined
+        // in the next block; we don't want our mempool filled up with
+        // transactions that can't be mined yet. Must keep pool.cs for this
+        // unless we change CheckSequenceLocks to take a CoinsViewCache
+        // instead of create its own.
+        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp)) {
+            return state.DoS(0, false, REJECT_NONSTANDARD,
+                             "non-BIP68-final");
         }
+    }
 
-        CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, dPriority,
-                              chainActive.Height(), inChainInputValue,
-                              fSpendsCoinbase, nSigOpsCount, lp);
-        unsigned int nSize = entry.GetTxSize();
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, view)) {
+        return state.Invalid(false, REJECT_NONSTANDARD,
+                             "bad-txns-nonstandard-inputs");
+    }
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS_PER_MB; we still consider this an invalid rather
-        // than merely non-standard transaction.
-        if (nSigOpsCount > MAX_STANDARD_TX_SIGOPS) {
-            return state.DoS(0, false, REJECT_NONSTANDARD,
-                             "bad-txns-too-many-sigops", false,
-                             strprintf("%d", nSigOpsCount));
+    int64_t nSigOpsCount =
+        GetTransactionSigOpCount(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+
+    Amount nValueOut = tx.GetValueOut();
+    Amount nFees = nValueIn - nValueOut;
+    // nModifiedFees includes any fee deltas from PrioritiseTransaction
+    Amount nModifiedFees = nFees;
+    double nPriorityDummy = 0;
+    pool.ApplyDeltas(txid, nPriorityDummy, nModifiedFees);
+
+    Amount inChainInputValue;
+    double dPriority =
+        view.GetPriority(tx, chainActive.Height(), inChainInputValue);
+
+    // Keep track of transactions that spend a coinbase, which we re-scan
+    // during reorgs to ensure COINBASE_MATURITY is still met.
+    bool fSpendsCoinbase = false;
+    for (const CTxIn &txin : tx.vin) {
+        const Coin &coin = view.AccessCoin(txin.prevout);
+        if (coin.IsCoinBase()) {
+            fSpendsCoinbase = true;
+            break;
         }
+    }
 
-        Amount mempoolRejectFee =
-            pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) *
-                           1000000)
-                .GetFee(nSize);
-        if (mempoolRejectFee > Amount(0) && nModifiedFees < mempoolRejectFee) {
+    admission.entry.reset(new CTxMemPoolEntry(
+        admission.ptx, nFees, admission.nAcceptTime, dPriority,
+        chainActive.Height(), inChainInputValue, fSpendsCoinbase, nSigOpsCount,
+        lp));
+    unsigned int nSize = admission.entry->GetTxSize();
+
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS_PER_MB; we still consider this an invalid rather
+    // than merely non-standard transaction.
+    if (nSigOpsCount > MAX_STANDARD_TX_SIGOPS) {
+        return state.DoS(0, false, REJECT_NONSTANDARD,
+                         "bad-txns-too-many-sigops", false,
+                         strprintf("%d", nSigOpsCount));
+    }
+
+    Amount mempoolRejectFee =
+        pool.GetMinFee(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) *
+                       1000000)
+            .GetFee(nSize);
+    if (mempoolRejectFee > Amount(0) && nModifiedFees < mempoolRejectFee) {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
+                         "mempool min fee not met", false,
+                         strprintf("%d < %d", nFees, mempoolRejectFee));
+    }
+
+    if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) &&
+        nModifiedFees < ::minRelayTxFee.GetFee(nSize) &&
+        !AllowFree(admission.entry->GetPriority(chainActive.Height() + 1))) {
+        // Require that free transactions have sufficient priority to be
+        // mined in the next block.
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
+                         "insufficient priority");
+    }
+
+    // Continuously rate-limit free (really, very-low-fee) transactions.
+    // This mitigates 'penny-flooding' -- sending thousands of free
+    // transactions just to be annoying or make others' transactions take
+    // longer to confirm.
+    if (admission.fLimitFree && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
+        static CCriticalSection csFreeLimiter;
+        static double dFreeCount;
+        static int64_t nLastTime;
+        int64_t nNow = GetTime();
+
+        LOCK(csFreeLimiter);
+
+        // Use an exponentially decaying ~10-minute window:
+        dFreeCount *= pow(1.0 - 1.0 / 600.0, double(nNow - nLastTime));
+        nLastTime = nNow;
+        // -limitfreerelay unit is thousand-bytes-per-minute
+        // At default rate it would take over a month to fill 1GB
+        if (dFreeCount + nSize >=
+            GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000) {
             return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
-                             "mempool min fee not met", false,
-                             strprintf("%d < %d", nFees, mempoolRejectFee));
+                             "rate limited free transaction");
         }
 
-        if (GetBoolArg("-relaypriority", DEFAULT_RELAYPRIORITY) &&
-            nModifiedFees < ::minRelayTxFee.GetFee(nSize) &&
-            !AllowFree(entry.GetPriority(chainActive.Height() + 1))) {
-            // Require that free transactions have sufficient priority to be
-            // mined in the next block.
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
-                             "insufficient priority");
-        }
-
-        // Continuously rate-limit free (really, very-low-fee) transactions.
-        // This mitigates 'penny-flooding' -- sending thousands of free
-        // transactions just to be annoying or make others' transactions take
-        // longer to confirm.
-        if (fLimitFree && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
-            static CCriticalSection csFreeLimiter;
-            static double dFreeCount;
-            static int64_t nLastTime;
-            int64_t nNow = GetTime();
-
-            LOCK(csFreeLimiter);
-
-            // Use an exponentially decaying ~10-minute window:
-            dFreeCount *= pow(1.0 - 1.0 / 600.0, double(nNow - nLastTime));
-            nLastTime = nNow;
-            // -limitfreerelay unit is thousand-bytes-per-minute
-            // At default rate it would take over a month to fill 1GB
-            if (dFreeCount + nSize >=
-                GetArg("-limitfreerelay", DEFAULT_LIMITFREERELAY) * 10 * 1000) {
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
-                                 "rate limited free transaction");
-            }
+        LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount,
+                 dFreeCount + nSize);
+        dFreeCount += nSize;
+    }
 
-            LogPrint("mempool", "Rate limit dFreeCount: %g => %g\n", dFreeCount,
-                     dFreeCount + nSize);
-            dFreeCount += nSize;
-        }
-
-        if (nAbsurdFee != Amount(0) && nFees > nAbsurdFee) {
-            return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee",
-                                 strprintf("%d > %d", nFees, nAbsurdFee));
-        }
-
-        // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors =
-            GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize =
-            GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
-        size_t nLimitDescendants =
-            GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize =
-            GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) *
-            1000;
-        std::string errString;
-        if (!pool.CalculateMemPoolAncestors(
-                entry, setAncestors, nLimitAncestors, nLimitAncestorSize,
-                nLimitDescendants, nLimitDescendantSize, errString)) {
-            return state.DoS(0, false, REJECT_NONSTANDARD,
-                             "too-long-mempool-chain", false, errString);
-        }
+    if (admission.nAbsurdFee != Amount(0) && nFees > admission.nAbsurdFee) {
+        return state.Invalid(false, REJECT_HIGHFEE, "absurdly-high-fee",
+                             strprintf("%d > %d", nFees, admission.nAbsurdFee));
+    }
 
-        // Set extraFlags as a set of flags that needs to be activated.
-        uint32_t extraFlags = SCRIPT_VERIFY_NONE;
-        if (hasMonolith) {
-            extraFlags |= SCRIPT_ENABLE_MONOLITH_OPCODES;
-        }
+    if (!CalculateAdmissionAncestors(pool, admission)) {
+        return false;
+    }
 
-        // Check inputs based on the set of flags we activate.
-        uint32_t scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-        if (!Params().RequireStandard()) {
-            scriptVerifyFlags =
-                GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
-        }
+    // Set extraFlags as a set of flags that needs to be activated.
+    admission.extraFlags = SCRIPT_VERIFY_NONE;
+    if (hasMonolith) {
+        admission.extraFlags |= SCRIPT_ENABLE_MONOLITH_OPCODES;
+    }
 
-        // Make sure whatever we need to activate is actually activated.
-        scriptVerifyFlags |= extraFlags;
+    // Check inputs based on the set of flags we activate.
+    uint32_t scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+    if (!Params().RequireStandard()) {
+        scriptVerifyFlags =
+            GetArg("-promiscuousmempoolflags", scriptVerifyFlags);
+    }
 
-        // Check against previous transactions. This is done last to help
-        // prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false,
-                         txdata)) {
-            // State filled in by CheckInputs.
-            return false;
+    // Make sure whatever we need to activate is actually activated.
+    admission.scriptVerifyFlags = scriptVerifyFlags | admission.extraFlags;
+
+    // The script checks are also made against the current block tip's flags,
+    // see MempoolScriptChecks.
+    admission.currentBlockScriptVerifyFlags =
+        GetBlockScriptFlags(config, chainActive.Tip());
+
+    if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view))) {
+        return false;
+    }
+
+    // The script cache needs cs_main, so look the scripts up now. As in
+    // CheckInputs, an entry for flags we don't store is removed.
+    admission.fStandardCached = IsKeyInScriptCache(
+        GetScriptCacheKey(tx, admission.scriptVerifyFlags), true);
+    admission.hashCacheEntry =
+        GetScriptCacheKey(tx, admission.currentBlockScriptVerifyFlags);
+    admission.fBlockCached = IsKeyInScriptCache(admission.hashCacheEntry, false);
+
+    admission.pindexTip = chainActive.Tip();
+    return true;
+}
+
+/**
+ * Second stage of the mempool admission: the script checks. This only uses
+ * what MempoolPreChecks stored in admission, and doesn't need any lock, so
+ * that several transactions can be checked in parallel.
+ */
+static bool MempoolScriptChecks(MempoolAdmission &admission) {
+    const CTransaction &tx = *admission.ptx;
+    const uint256 txid = tx.GetId();
+    CValidationState &state = admission.state;
+    const CCoinsViewCache &view = admission.view;
+
+    // Check against previous transactions. This is done last to help
+    // prevent CPU exhaustion denial-of-service attacks.
+    PrecomputedTransactionData txdata(tx);
+    if (!admission.fStandardCached &&
+        !CheckInputScripts(tx, state, view, admission.scriptVerifyFlags, true,
+                           txdata)) {
+        // State filled in by CheckInputScripts.
+        return false;
+    }
+
+    // Check again against the current block tip's script verification flags
+    // to cache our script execution flags. This is, of course, useless if
+    // the next block has different script flags from the previous one, but
+    // because the cache tracks script flags for us it will auto-invalidate
+    // and we'll just have a few blocks of extra misses on soft-fork
+    // activation.
+    //
+    // This is also useful in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain CHECKSIG
+    // NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks (using TestBlockValidity), however allowing such
+    // transactions into the mempool can be exploited as a DoS attack.
+    if (admission.fBlockCached) {
+        return true;
+    }
+    if (CheckInputScripts(tx, state, view,
+                          admission.currentBlockScriptVerifyFlags, true,
+                          txdata)) {
+        // Cached by MempoolFinalize, which holds cs_main.
+        admission.fBlockFlagsOk = true;
+        return true;
+    }
+
+    // If we're using promiscuousmempoolflags, we may hit this normally.
+    // Check if current block has some flags that scriptVerifyFlags does
+    // not before printing an ominous warning.
+    if (!(~admission.scriptVerifyFlags &
+          admission.currentBlockScriptVerifyFlags)) {
+        return error("%s: BUG! PLEASE REPORT THIS! ConnectInputs failed "
+                     "against MANDATORY but not STANDARD flags %s, %s",
+                     __func__, txid.ToString(), FormatStateMessage(state));
+    }
+
+    if (!CheckInputScripts(tx, state, view,
+                           MANDATORY_SCRIPT_VERIFY_FLAGS | admission.extraFlags,
+                           true, txdata)) {
+        return error("%s: ConnectInputs failed against MANDATORY but not "
+                     "STANDARD flags due to promiscuous mempool %s, %s",
+                     __func__, txid.ToString(), FormatStateMessage(state));
+    }
+
+    LogPrintf("Warning: -promiscuousmempool flags set to not include "
+              "currently enforced soft forks, this may break mining or "
+              "otherwise cause instability!\n");
+    return true;
+}
+
+/**
+ * Last stage of the mempool admission: store the transaction in the mempool.
+ * If cs_main was released since MempoolPreChecks, fRecheck must be set, and
+ * the mempool is checked again for what may have changed in between. The tip
+ * must not have changed.
+ */
+static bool MempoolFinalize(CTxMemPool &pool, MempoolAdmission &admission,
+                            bool fRecheck) {
+    AssertLockHeld(cs_main);
+    assert(admission.pindexTip == chainActive.Tip());
+
+    const CTransactionRef &ptx = admission.ptx;
+    const CTransaction &tx = *ptx;
+    const uint256 txid = tx.GetId();
+    CValidationState &state = admission.state;
+
+    if (fRecheck) {
+        if (pool.exists(txid)) {
+            return state.Invalid(false, REJECT_ALREADY_KNOWN,
+                                 "txn-already-in-mempool");
         }
 
-        // Check again against the current block tip's script verification flags
-        // to cache our script execution flags. This is, of course, useless if
-        // the next block has different script flags from the previous one, but
-        // because the cache tracks script flags for us it will auto-invalidate
-        // and we'll just have a few blocks of extra misses on soft-fork
-        // activation.
-        //
-        // This is also useful in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain CHECKSIG
-        // NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks (using TestBlockValidity), however allowing such
-        // transactions into the mempool can be exploited as a DoS attack.
-        uint32_t currentBlockScriptVerifyFlags =
-            GetBlockScriptFlags(config, chainActive.Tip());
-
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool,
-                                            currentBlockScriptVerifyFlags, true,
-                                            txdata)) {
-            // If we're using promiscuousmempoolflags, we may hit this normally.
-            // Check if current block has some flags that scriptVerifyFlags does
-            // not before printing an ominous warning.
-            if (!(~scriptVerifyFlags & currentBlockScriptVerifyFlags)) {
-                return error(
-                    "%s: BUG! PLEASE REPORT THIS! ConnectInputs failed against "
-                    "MANDATORY but not STANDARD flags %s, %s",
-                    __func__, txid.ToString(), FormatStateMessage(state));
+        LOCK(pool.cs);
+        for (const CTxIn &txin : tx.vin) {
+            if (pool.mapNextTx.count(txin.prevout)) {
+                // Disable replacement feature for good
+                return state.Invalid(false, REJECT_CONFLICT,
+                                     "txn-mempool-conflict");
             }
+        }
 
-            if (!CheckInputs(tx, state, view, true,
-                             MANDATORY_SCRIPT_VERIFY_FLAGS | extraFlags, true, false,
-                             txdata)) {
-                return error(
-                    "%s: ConnectInputs failed against MANDATORY but not "
-                    "STANDARD flags due to promiscuous mempool %s, %s",
-                    __func__, txid.ToString(), FormatStateMessage(state));
+        // A transaction in the mempool we spend may have been evicted.
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        for (const CTxIn &txin : tx.vin) {
+            if (!viewMemPool.HaveCoin(txin.prevout)) {
+                if (admission.pfMissingInputs) {
+                    *admission.pfMissingInputs = true;
+                }
+                return false;
             }
+        }
 
-            LogPrintf("Warning: -promiscuousmempool flags set to not include "
-                      "currently enforced soft forks, this may break mining or "
-                      "otherwise cause instability!\n");
+        // The ancestors found before may have left the mempool.
+        if (!CalculateAdmissionAncestors(pool, admission)) {
+            return false;
         }
+    }
+
+    if (admission.fBlockFlagsOk) {
+        AddKeyInScriptCache(admission.hashCacheEntry);
+    }
 
-        // This transaction should only count for fee estimation if
-        // the node is not behind and it is not dependent on any other
-        // transactions in the mempool.
-        bool validForFeeEstimation =
-            IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
+    // This transaction should only count for fee estimation if
+    // the node is not behind and it is not dependent on any other
+    // transactions in the mempool.
+    bool validForFeeEstimation =
+        IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
 
-        // Store transaction in memory.
-        pool.addUnchecked(txid, entry, setAncestors, validForFeeEstimation);
+    // Store transaction in memory.
+    pool.addUnchecked(txid, *admission.entry, admission.setAncestors,
+                      validForFeeEstimation);
 
-        // Trim mempool and check if tx was trimmed.
-        if (!fOverrideMempoolLimit) {
-            LimitMempoolSize(
-                pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
-                GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
-            if (!pool.exists(txid)) {
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE,
-                                 "mempool full");
-            }
+    // Trim mempool and check if tx was trimmed.
+    if (!admission.fOverrideMempoolLimit) {
+        LimitMempoolSize(
+            pool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+            GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(txid)) {
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
         }
     }
 
     GetMainSignals().SyncTransaction(
-        tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+        ptx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
 
     return true;
 }
 
+static bool AcceptToMemoryPoolWorker(
+    const Config &config, CTxMemPool &pool, CValidationState &state,
+    const CTransactionRef &ptx, bool fLimitFree, bool *pfMissingInputs,
+    int64_t nAcceptTime, bool fOverrideMempoolLimit, const Amount nAbsurdFee,
+    std::vector<COutPoint> &coins_to_uncache) {
+    AssertLockHeld(cs_main);
+
+    MempoolAdmission admission(ptx, nAcceptTime, fLimitFree,
+                               fOverrideMempoolLimit, nAbsurdFee, state,
+                               pfMissingInputs, coins_to_uncache);
+    return MempoolPreChecks(config, pool, admission) &&
+           MempoolScriptChecks(admission) &&
+           MempoolFinalize(pool, admission, false);
+}
+
 /**
  * (try to) add transaction to memory pool with a specified acceptance time.
  */
@@ -1088,6 +1254,149 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                                       fOverrideMempoolLimit, nAbsurdFee);
 }
 
+/**
+ * Closure representing the script checks of one transaction on its way into
+ * the mempool, so that a batch of transactions can be checked on a
+ * CCheckQueue. The result is stored in the admission rather than failing the
+ * batch.
+ */
+class CMempoolScriptCheck {
+private:
+    MempoolAdmission *padmission;
+
+public:
+    CMempoolScriptCheck() : padmission(nullptr) {}
+    explicit CMempoolScriptCheck(MempoolAdmission &admissionIn)
+        : padmission(&admissionIn) {}
+
+    bool operator()() {
+        padmission->fScriptsOk = MempoolScriptChecks(*padmission);
+        return true;
+    }
+
+    void swap(CMempoolScriptCheck &check) {
+        std::swap(padmission, check.padmission);
+    }
+};
+
+static CCheckQueue<CMempoolScriptCheck> mempoolscriptcheckqueue(4);
+// Serializes users of mempoolscriptcheckqueue, which only supports one master.
+static CCriticalSection cs_mempoolscriptcheck;
+
+void ThreadMempoolScriptCheck() {
+    RenameThread("bitcoin-mempscri");
+    mempoolscriptcheckqueue.Thread();
+}
+
+void AcceptToMemoryPoolBatch(const Config &config, CTxMemPool &pool,
+                             std::vector<MempoolAcceptRequest> &vRequests) {
+    const int64_t nAcceptTime = GetTime();
+    std::vector<std::vector<COutPoint>> vCoinsToUncache(vRequests.size());
+    std::vector<std::unique_ptr<MempoolAdmission>> vAdmissions(
+        vRequests.size());
+
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < vRequests.size(); i++) {
+            MempoolAcceptRequest &request = vRequests[i];
+            request.state = CValidationState();
+            request.fAccepted = false;
+            std::unique_ptr<MempoolAdmission> admission(new MempoolAdmission(
+                request.tx, nAcceptTime, request.fLimitFree, false, Amount(0),
+                request.state, &request.fMissingInputs, vCoinsToUncache[i]));
+            if (MempoolPreChecks(config, pool, *admission)) {
+                vAdmissions[i] = std::move(admission);
+            }
+        }
+    }
+    int64_t nTimePreChecks = GetTimeMicros();
+
+    // The expensive part runs without cs_main, on the script check threads
+    // when they are free.
+    std::vector<CMempoolScriptCheck> vChecks;
+    for (const std::unique_ptr<MempoolAdmission> &admission : vAdmissions) {
+        if (admission) {
+            vChecks.emplace_back(*admission);
+        }
+    }
+    {
+        TRY_LOCK(cs_mempoolscriptcheck, lockQueue);
+        if (lockQueue && nScriptCheckThreads && vChecks.size() > 1) {
+            CCheckQueueControl<CMempoolScriptCheck> control(
+                &mempoolscriptcheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            for (CMempoolScriptCheck &check : vChecks) {
+                check();
+            }
+        }
+    }
+    int64_t nTimeScripts = GetTimeMicros();
+
+    LOCK(cs_main);
+    bool fAnyAccepted = false;
+    for (size_t i = 0; i < vRequests.size(); i++) {
+        MempoolAcceptRequest &request = vRequests[i];
+        MempoolAdmission *admission = vAdmissions[i].get();
+        if (!admission || !admission->fScriptsOk) {
+            continue;
+        }
+        if (admission->pindexTip != chainActive.Tip()) {
+            // The coins the scripts were checked against may be gone.
+            request.state = CValidationState();
+            request.fAccepted = AcceptToMemoryPoolWorker(
+                config, pool, request.state, request.tx, request.fLimitFree,
+                &request.fMissingInputs, nAcceptTime, false, Amount(0),
+                vCoinsToUncache[i]);
+        } else {
+            request.fAccepted = MempoolFinalize(pool, *admission, true);
+        }
+        fAnyAccepted |= request.fAccepted;
+    }
+
+    // Transactions spending the outputs of others in the batch were missing
+    // their inputs; try them again, in order, now that these are in.
+    if (fAnyAccepted) {
+        for (size_t i = 0; i < vRequests.size(); i++) {
+            MempoolAcceptRequest &request = vRequests[i];
+            if (request.fAccepted || !request.fMissingInputs) {
+                continue;
+            }
+            request.state = CValidationState();
+            request.fAccepted = AcceptToMemoryPoolWorker(
+                config, pool, request.state, request.tx, request.fLimitFree,
+                &request.fMissingInputs, nAcceptTime, false, Amount(0),
+                vCoinsToUncache[i]);
+        }
+    }
+
+    size_t nAccepted = 0;
+    for (size_t i = 0; i < vRequests.size(); i++) {
+        if (vRequests[i].fAccepted) {
+            nAccepted++;
+            continue;
+        }
+        for (const COutPoint &outpoint : vCoinsToUncache[i]) {
+            pcoinsTip->Uncache(outpoint);
+        }
+    }
+    int64_t nTimeFinalize = GetTimeMicros();
+    LogPrint("bench",
+             "    - Mempool batch: %u/%u accepted, prechecks %.2fms, scripts "
+             "%.2fms, finalize %.2fms\n",
+             nAccepted, vRequests.size(),
+             (nTimePreChecks - nTimeStart) * 0.001,
+             (nTimeScripts - nTimePreChecks) * 0.001,
+             (nTimeFinalize - nTimeScripts) * 0.001);
+
+    // After we've (potentially) uncached entries, ensure our coins cache is
+    // still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(stateDummy, FLUSH_STATE_PERIODIC);
+}
+
 /** Return transaction in txOut, and if it was found inside a block, its hash is
  * placed in hashBlock */
 bool GetTransaction(const Config &config, const uint256 &txid,
@@ -1180,7 +1489,7 @@ bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos,
 }
 
 bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
-                       const Config &config) {
+                       const Config &config, bool fCheckPOW) {
     block.SetNull();
 
     // Open history file to read
@@ -1198,6 +1507,10 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
                      e.what(), pos.ToString());
     }
 
+    if (!fCheckPOW) {
+        return true;
+    }
+
     const Consensus::Params& consensusParams = Params().GetConsensus();
     // Check Equihash solution
     bool postfork = block.nHeight >= (uint32_t)consensusParams.cdyHeight;
@@ -1213,7 +1526,12 @@ bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
 
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Config &config) {
-    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), config)) {
+    // The header of a block with BLOCK_VALID_TREE passed CheckBlockHeader
+    // before it was written, and the hash comparison below (which covers the
+    // Equihash solution) guarantees we read back that same header.
+    const bool fCheckPOW =
+        fCheckBlockReads || !pindex->IsValid(BlockValidity::TREE);
+    if (!ReadBlockFromDisk(block, pindex->GetBlockPos(), config, fCheckPOW)) {
         return false;
     }
 
@@ -1505,44 +1823,20 @@ bool CheckTxInputs(const CTransaction &tx, CValidationState &state,
 }
 } // namespace Consensus
 
-bool CheckInputs(const CTransaction &tx, CValidationState &state,
-                 const CCoinsViewCache &inputs, bool fScriptChecks,
-                 const uint32_t flags, bool sigCacheStore,
-                 bool scriptCacheStore,
-                 const PrecomputedTransactionData &txdata,
-                 std::vector<CScriptCheck> *pvChecks) {
-    assert(!tx.IsCoinBase());
-
-    if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs))) {
-        return false;
-    }
-
+/**
+ * Check the scripts of tx against the coins it spends, or add them to
+ * pvChecks if it is given. This doesn't use the script cache, which needs
+ * cs_main, so that it can run on any thread.
+ */
+static bool CheckInputScripts(const CTransaction &tx, CValidationState &state,
+                              const CCoinsViewCache &inputs,
+                              const uint32_t flags, bool sigCacheStore,
+                              const PrecomputedTransactionData &txdata,
+                              std::vector<CScriptCheck> *pvChecks) {
     if (pvChecks) {
         pvChecks->reserve(tx.vin.size());
     }
 
-    // The first loop above does all the inexpensive checks. Only if ALL inputs
-    // pass do we perform expensive ECDSA signature checks. Helps prevent CPU
-    // exhaustion attacks.
-
-    // Skip script verification when connecting blocks under the assumedvalid
-    // block. Assuming the assumedvalid block is valid this is safe because
-    // block merkle hashes are still computed and checked, of course, if an
-    // assumed valid block is invalid due to false scriptSigs this optimization
-    // would allow an invalid chain to be accepted.
-    if (!fScriptChecks) {
-        return true;
-    }
-
-    // First check if script executions have been cached with the same flags.
-    // Note that this assumes that the inputs provided are correct (ie that the
-    // transaction hash which is in tx's prevouts properly commits to the
-    // scriptPubKey in the inputs view of that transaction).
-    uint256 hashCacheEntry = GetScriptCacheKey(tx, flags);
-    if (IsKeyInScriptCache(hashCacheEntry, !scriptCacheStore)) {
-        return true;
-    }
-
     for (size_t i = 0; i < tx.vin.size(); i++) {
         const COutPoint &prevout = tx.vin[i].prevout;
         const Coin &coin = inputs.AccessCoin(prevout);
@@ -1603,6 +1897,48 @@ bool CheckInputs(const CTransaction &tx, CValidationState &state,
         }
     }
 
+    return true;
+}
+
+bool CheckInputs(const CTransaction &tx, CValidationState &state,
+                 const CCoinsViewCache &inputs, bool fScriptChecks,
+                 const uint32_t flags, bool sigCacheStore,
+                 bool scriptCacheStore,
+                 const PrecomputedTransactionData &txdata,
+                 std::vector<CScriptCheck> *pvChecks) {
+    assert(!tx.IsCoinBase());
+
+    if (!Consensus::CheckTxInputs(tx, state, inputs, GetSpendHeight(inputs))) {
+        return false;
+    }
+
+    // The first loop above does all the inexpensive checks. Only if ALL inputs
+    // pass do we perform expensive ECDSA signature checks. Helps prevent CPU
+    // exhaustion attacks.
+
+    // Skip script verification when connecting blocks under the assumedvalid
+    // block. Assuming the assumedvalid block is valid this is safe because
+    // block merkle hashes are still computed and checked, of course, if an
+    // assumed valid block is invalid due to false scriptSigs this optimization
+    // would allow an invalid chain to be accepted.
+    if (!fScriptChecks) {
+        return true;
+    }
+
+    // First check if script executions have been cached with the same flags.
+    // Note that this assumes that the inputs provided are correct (ie that the
+    // transaction hash which is in tx's prevouts properly commits to the
+    // scriptPubKey in the inputs view of that transaction).
+    uint256 hashCacheEntry = GetScriptCacheKey(tx, flags);
+    if (IsKeyInScriptCache(hashCacheEntry, !scriptCacheStore)) {
+        return true;
+    }
+
+    if (!CheckInputScripts(tx, state, inputs, flags, sigCacheStore, txdata,
+                           pvChecks)) {
+        return false;
+    }
+
     if (scriptCacheStore && !pvChecks) {
         // We executed all of the provided scripts, and were told to cache the
         // result. Do so now.
@@ -1843,6 +2179,83 @@ void ThreadScriptCheck() {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure representing the verification of one Equihash solution, so that the
+ * headers of a HEADERS message can be checked on a CCheckQueue.
+ */
+class CEquihashCheck {
+private:
+    const CBlockHeader *pheader;
+    const CChainParams *pparams;
+    char *pfValid;
+
+public:
+    CEquihashCheck() : pheader(nullptr), pparams(nullptr), pfValid(nullptr) {}
+    CEquihashCheck(const CBlockHeader &headerIn, const CChainParams &paramsIn,
+                   char &fValidIn)
+        : pheader(&headerIn), pparams(&paramsIn), pfValid(&fValidIn) {}
+
+    // The result is reported through pfValid, so that an invalid solution
+    // does not stop the queue from checking the others.
+    bool operator()() {
+        *pfValid = CheckEquihashSolution(pheader, *pparams);
+        return true;
+    }
+
+    void swap(CEquihashCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(pparams, check.pparams);
+        std::swap(pfValid, check.pfValid);
+    }
+};
+
+static CCheckQueue<CEquihashCheck> equihashcheckqueue(16);
+// Serializes users of equihashcheckqueue, which only supports one master.
+static CCriticalSection cs_equihashcheck;
+
+void ThreadEquihashCheck() {
+    RenameThread("bitcoin-eqhcheck");
+    equihashcheckqueue.Thread();
+}
+
+/**
+ * Closure representing the read of one coin from the coin database, so that
+ * the coins spent by a block can be fetched on a CCheckQueue.
+ */
+class CCoinPrefetch {
+private:
+    const CCoinsView *pview;
+    const COutPoint *poutpoint;
+    Coin *pcoin;
+
+public:
+    CCoinPrefetch() : pview(nullptr), poutpoint(nullptr), pcoin(nullptr) {}
+    CCoinPrefetch(const CCoinsView &viewIn, const COutPoint &outpointIn,
+                  Coin &coinIn)
+        : pview(&viewIn), poutpoint(&outpointIn), pcoin(&coinIn) {}
+
+    bool operator()() {
+        // A coin which is not found is left spent.
+        pview->GetCoin(*poutpoint, *pcoin);
+        return true;
+    }
+
+    void swap(CCoinPrefetch &check) {
+        std::swap(pview, check.pview);
+        std::swap(poutpoint, check.poutpoint);
+        std::swap(pcoin, check.pcoin);
+    }
+};
+
+static CCheckQueue<CCoinPrefetch> coinprefetchqueue(16);
+// Serializes users of coinprefetchqueue, which only supports one master.
+static CCriticalSection cs_coinprefetch;
+
+void ThreadCoinPrefetch() {
+    RenameThread("bitcoin-coinpref");
+    coinprefetchqueue.Thread();
+}
+
 // Protected by cs_main
 VersionBitsCache versionbitscache;
 
@@ -2348,16 +2761,25 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
         }
         int64_t nMempoolSizeMax =
             GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize =
+        const bool fBackgroundFlush =
+            pcoinsWriter &&
+            GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH);
+        // A write in progress in the background still holds its entries.
+        const bool fWriting = pcoinsWriter && pcoinsWriter->IsWriting();
+        int64_t tipCacheSize =
             pcoinsTip->DynamicMemoryUsage() * DB_PEAK_USAGE_FACTOR;
+        int64_t cacheSize =
+            tipCacheSize +
+            (pcoinsWriter ? pcoinsWriter->DynamicMemoryUsage() : 0) *
+                DB_PEAK_USAGE_FACTOR;
         int64_t nTotalSpace =
             nCoinCacheUsage +
             std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 200 MiB or 50% and 50MiB
         // of the limit, but we have time now (not in the middle of a block
-        // processing).
+        // processing), and are not writing it already.
         bool fCacheLarge =
-            mode == FLUSH_STATE_PERIODIC &&
+            mode == FLUSH_STATE_PERIODIC && !fWriting &&
             cacheSize >
                 std::min(std::max(nTotalSpace / 2,
                                   nTotalSpace -
@@ -2368,6 +2790,13 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
         // The cache is over the limit, we have to write now.
         bool fCacheCritical =
             mode == FLUSH_STATE_IF_NEEDED && cacheSize > nTotalSpace;
+        // When writing in the background, the entries being written and the
+        // new ones share the space: hand the cache over once it takes half of
+        // it, so that the write can finish before the other half fills up.
+        bool fCacheHalfFull =
+            fBackgroundFlush && !fWriting &&
+            (mode == FLUSH_STATE_IF_NEEDED || mode == FLUSH_STATE_PERIODIC) &&
+            tipCacheSize > nTotalSpace / 2;
         // It's been a while since we wrote the block index to disk. Do this
         // frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite =
@@ -2376,11 +2805,12 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
         // It's been very long since we flushed the cache. Do this infrequently,
         // to optimize cache usage.
         bool fPeriodicFlush =
-            mode == FLUSH_STATE_PERIODIC &&
+            mode == FLUSH_STATE_PERIODIC && !fWriting &&
             nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
         bool fDoFullFlush = (mode == FLUSH_STATE_ALWAYS) || fCacheLarge ||
-                            fCacheCritical || fPeriodicFlush || fFlushForPrune;
+                            fCacheCritical || fCacheHalfFull ||
+                            fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
         if (fDoFullFlush || fPeriodicWrite) {
             // Depend on nMinDiskSpace to ensure we can write block index
@@ -2397,19 +2827,21 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
                     vFiles.push_back(std::make_pair(*it, &vinfoBlockFile[*it]));
                     setDirtyFileInfo.erase(it++);
                 }
-                std::vector<const CBlockIndex *> vBlocks;
-                vBlocks.reserve(setDirtyBlockIndex.size());
-                for (std::set<CBlockIndex *>::iterator it =
-                         setDirtyBlockIndex.begin();
-                     it != setDirtyBlockIndex.end();) {
-                    vBlocks.push_back(*it);
-                    setDirtyBlockIndex.erase(it++);
-                }
+                std::vector<CBlockIndex *> vDirtyBlocks(
+                    setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+                setDirtyBlockIndex.clear();
+                std::vector<const CBlockIndex *> vBlocks(vDirtyBlocks.begin(),
+                                                         vDirtyBlocks.end());
                 if (!pblocktree->WriteBatchSync(vFiles, nLastBlockFile,
                                                 vBlocks)) {
                     return AbortNode(state,
                                      "Failed to write to block index database");
                 }
+                // The solutions are now in the block index database, so they
+                // no longer need to take memory.
+                for (CBlockIndex *pindex : vDirtyBlocks) {
+                    pindex->EvictSolution();
+                }
             }
             // Finally remove any pruned files
             if (fFlushForPrune) UnlinkPrunedFiles(setFilesToPrune);
@@ -2427,9 +2859,26 @@ static bool FlushStateToDisk(CValidationState &state, FlushStateMode mode,
                 return state.Error("out of disk space");
             }
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush()) {
+            // Unless the flush has to be on disk when we return, hand the
+            // cache over to be written in the background and start over with
+            // an empty one, so that block processing is not held up.
+            const bool fBackground = fBackgroundFlush &&
+                                     mode != FLUSH_STATE_ALWAYS &&
+                                     !fFlushForPrune;
+            const int64_t nFlushStart = GetTimeMicros();
+            const size_t nFlushCoins = pcoinsTip->GetCacheSize();
+            const size_t nFlushUsage = pcoinsTip->DynamicMemoryUsage();
+            if (fBackground) {
+                if (!pcoinsWriter->StartWrite(pcoinsTip->DetachCache())) {
+                    return AbortNode(state, "Failed to write to coin database");
+                }
+            } else if (!pcoinsTip->Flush()) {
                 return AbortNode(state, "Failed to write to coin database");
             }
+            LogPrintf("%s %u coins (%.1fMiB) to the coin database in %.2fms\n",
+                      fBackground ? "Started writing" : "Wrote", nFlushCoins,
+                      nFlushUsage * (1.0 / (1 << 20)),
+                      (GetTimeMicros() - nFlushStart) * 0.001);
             nLastFlush = nNow;
         }
         if (fDoFullFlush ||
@@ -2626,7 +3075,7 @@ static bool DisconnectTip(const Config &config, CValidationState &state,
     // 0-confirmed or conflicted:
     for (const auto &tx : block.vtx) {
         GetMainSignals().SyncTransaction(
-            *tx, pindexDelete->pprev,
+            tx, pindexDelete->pprev,
             CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
     }
     return true;
@@ -3123,7 +3572,7 @@ bool ActivateBestChain(const Config &config, CValidationState &state,
                 assert(pair.second);
                 const CBlock &block = *(pair.second);
                 for (unsigned int i = 0; i < block.vtx.size(); i++)
-                    GetMainSignals().SyncTransaction(*block.vtx[i], pair.first,
+                    GetMainSignals().SyncTransaction(block.vtx[i], pair.first,
                                                      i);
             }
         }
@@ -3581,12 +4030,13 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos,
 }
 
 static bool CheckBlockHeader(const Config &config, const CBlockHeader &block,
-                             CValidationState &state, bool fCheckPOW = true) {
+                             CValidationState &state, bool fCheckPOW = true,
+                             bool fCheckEquihash = true) {
     // Yang Check proof of work matches claimed amount
     const Consensus::Params &consensusParams = Params().GetConsensus();
     bool postfork = block.nHeight >= (uint32_t)consensusParams.cdyHeight;
     
-    if (fCheckPOW && postfork) {
+    if (fCheckPOW && fCheckEquihash && postfork) {
         const CChainParams& chainparams = Params();
         const size_t sol_size = chainparams.EquihashSolutionWidth(block.nHeight);
         if(block.nSolution.size() != sol_size) {
@@ -3913,10 +4363,14 @@ bool ContextualCheckBlock(const Config &config, const CBlock &block,
 /**
  * If the provided block header is valid, add it to the block index.
  *
+ * fCheckEquihash may only be false if the Equihash solution of this header
+ * has already been found valid, see BatchCheckEquihashSolutions.
+ *
  * Returns true if the block is succesfully added to the block index.
  */
 static bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
-                              CValidationState &state, CBlockIndex **ppindex) {
+                              CValidationState &state, CBlockIndex **ppindex,
+                              bool fCheckEquihash = true) {
     AssertLockHeld(cs_main);
     const CChainParams &chainparams = config.GetChainParams();
 
@@ -3941,7 +4395,7 @@ static bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
             return true;
         }
 
-        if (!CheckBlockHeader(config, block, state)) {
+        if (!CheckBlockHeader(config, block, state, true, fCheckEquihash)) {
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__,
                          hash.ToString(), FormatStateMessage(state));
         }
@@ -3986,17 +4440,76 @@ static bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
     return true;
 }
 
+std::vector<char>
+BatchCheckEquihashSolutions(const Config &config,
+                            const std::vector<CBlockHeader> &headers) {
+    const CChainParams &chainparams = config.GetChainParams();
+    const Consensus::Params &consensusParams = chainparams.GetConsensus();
+
+    std::vector<uint256> vHashes;
+    vHashes.reserve(headers.size());
+    for (const CBlockHeader &header : headers) {
+        vHashes.push_back(header.GetHash());
+    }
+
+    std::vector<char> vValid(headers.size(), false);
+    std::vector<CEquihashCheck> vChecks;
+    vChecks.reserve(headers.size());
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < headers.size(); i++) {
+            const CBlockHeader &header = headers[i];
+            // Solutions of the wrong size are left to AcceptBlockHeader to
+            // reject.
+            if (header.nHeight < (uint32_t)consensusParams.cdyHeight ||
+                mapBlockIndex.count(vHashes[i]) ||
+                header.nSolution.size() !=
+                    chainparams.EquihashSolutionWidth(header.nHeight)) {
+                continue;
+            }
+            vChecks.emplace_back(header, chainparams, vValid[i]);
+        }
+    }
+
+    if (vChecks.empty()) {
+        return vValid;
+    }
+
+    int64_t nTimeStart = GetTimeMicros();
+    {
+        LOCK(cs_equihashcheck);
+        CCheckQueueControl<CEquihashCheck> control(&equihashcheckqueue);
+        size_t nChecks = vChecks.size();
+        control.Add(vChecks);
+        control.Wait();
+        LogPrint("bench", "    - Verify %u Equihash solutions: %.2fms\n",
+                 nChecks, 0.001 * (GetTimeMicros() - nTimeStart));
+    }
+    return vValid;
+}
+
 // Exposed wrapper for AcceptBlockHeader
 bool ProcessNewBlockHeaders(const Config &config,
                             const std::vector<CBlockHeader> &headers,
                             CValidationState &state,
                             const CBlockIndex **ppindex) {
+    // Verifying Equihash solutions dominates header processing, so do it for
+    // the whole batch up front, in parallel and without holding cs_main. Only
+    // the headers whose solution was not found valid are checked again, to
+    // reject them and punish the peer as before.
+    std::vector<char> vEquihashValid;
+    if (headers.size() > 1) {
+        vEquihashValid = BatchCheckEquihashSolutions(config, headers);
+    } else {
+        vEquihashValid.assign(headers.size(), false);
+    }
     {
         LOCK(cs_main);
-        for (const CBlockHeader &header : headers) {
+        for (size_t i = 0; i < headers.size(); i++) {
             // Use a temp pindex instead of ppindex to avoid a const_cast
             CBlockIndex *pindex = nullptr;
-            if (!AcceptBlockHeader(config, header, state, &pindex)) {
+            if (!AcceptBlockHeader(config, headers[i], state, &pindex,
+                                   !vEquihashValid[i])) {
                 return false;
             }
 
@@ -4170,9 +4683,122 @@ static bool AcceptBlock(const Config &config,
     return true;
 }
 
+/**
+ * Reads the coins spent by a block from the coin database on the prefetch
+ * threads while the block is being checked, then adds them to pcoinsTip, so
+ * that ConnectBlock finds them in memory instead of waiting on the disk for
+ * each input in turn.
+ *
+ * This is only done for a block building on the tip of pcoinsTip, and the
+ * coins are only added if the tip did not move in the meantime: the coins
+ * read are then still the current ones.
+ */
+class CBlockCoinsPrefetch {
+private:
+    const CBlock &block;
+    CCriticalBlock lockQueue;
+    std::unique_ptr<CCheckQueueControl<CCoinPrefetch>> control;
+    std::vector<COutPoint> vOutpoints;
+    std::vector<Coin> vCoins;
+    size_t nInputs;
+    size_t nInCache;
+    int64_t nTimeStart;
+
+public:
+    explicit CBlockCoinsPrefetch(const CBlock &blockIn)
+        : block(blockIn), lockQueue(cs_coinprefetch, "cs_coinprefetch",
+                                    __FILE__, __LINE__, true),
+          nInputs(0), nInCache(0), nTimeStart(GetTimeMicros()) {
+        // Another block is being prefetched, or there are no threads to
+        // overlap the reads with the checks.
+        if (!lockQueue || !pcoinsWriter || !nScriptCheckThreads) {
+            return;
+        }
+
+        std::unordered_set<uint256, SaltedTxidHasher> setBlockTxids;
+        for (const CTransactionRef &tx : block.vtx) {
+            setBlockTxids.insert(tx->GetId());
+        }
+
+        {
+            LOCK(cs_main);
+            if (pcoinsTip->GetBestBlock() != block.hashPrevBlock) {
+                return;
+            }
+            for (const CTransactionRef &tx : block.vtx) {
+                if (tx->IsCoinBase()) {
+                    continue;
+                }
+                for (const CTxIn &txin : tx->vin) {
+                    // Outputs created in this block are not in the database.
+                    if (setBlockTxids.count(txin.prevout.hash)) {
+                        continue;
+                    }
+                    nInputs++;
+                    if (pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                        nInCache++;
+                    } else {
+                        vOutpoints.push_back(txin.prevout);
+                    }
+                }
+            }
+        }
+
+        if (vOutpoints.empty()) {
+            return;
+        }
+
+        // The checks point into vOutpoints and vCoins, which are not resized
+        // from here on.
+        vCoins.resize(vOutpoints.size());
+        std::vector<CCoinPrefetch> vChecks;
+        vChecks.reserve(vOutpoints.size());
+        for (size_t i = 0; i < vOutpoints.size(); i++) {
+            vChecks.emplace_back(*pcoinsWriter, vOutpoints[i], vCoins[i]);
+        }
+        control.reset(
+            new CCheckQueueControl<CCoinPrefetch>(&coinprefetchqueue));
+        control->Add(vChecks);
+    }
+
+    /** Wait for the reads, and add the coins found to pcoinsTip. */
+    void Finish() {
+        AssertLockHeld(cs_main);
+        if (!control) {
+            return;
+        }
+        control->Wait();
+        control.reset();
+
+        size_t nFound = 0;
+        const bool fTipUnchanged =
+            pcoinsTip->GetBestBlock() == block.hashPrevBlock;
+        if (fTipUnchanged) {
+            for (size_t i = 0; i < vOutpoints.size(); i++) {
+                if (!vCoins[i].IsSpent()) {
+                    pcoinsTip->AddFetchedCoin(vOutpoints[i],
+                                              std::move(vCoins[i]));
+                    nFound++;
+                }
+            }
+        }
+
+        LogPrint("bench", "    - Prefetch coins: %u inputs, %u in cache "
+                          "(%.1f%%), %u read, %u found%s [%.2fms]\n",
+                 nInputs, nInCache, 100.0 * nInCache / nInputs,
+                 vOutpoints.size(), nFound,
+                 fTipUnchanged ? "" : ", tip changed",
+                 0.001 * (GetTimeMicros() - nTimeStart));
+    }
+};
+
 bool ProcessNewBlock(const Config &config,
                      const std::shared_ptr<const CBlock> pblock,
                      bool fForceProcessing, bool *fNewBlock) {
+    // Let the subscribers catch up if they fell too far behind, before taking
+    // cs_main which they may need.
+    LimitValidationInterfaceQueue();
+
     {
         CBlockIndex *pindex = nullptr;
         if (fNewBlock) {
@@ -4181,6 +4807,9 @@ bool ProcessNewBlock(const Config &config,
 
         const CChainParams &chainparams = config.GetChainParams();
 
+        // Start reading the coins the block spends while it is checked.
+        CBlockCoinsPrefetch prefetch(*pblock);
+
         CValidationState state;
         // Ensure that CheckBlock() passes before calling AcceptBlock, as
         // belt-and-suspenders.
@@ -4188,6 +4817,10 @@ bool ProcessNewBlock(const Config &config,
 
         LOCK(cs_main);
 
+        if (ret) {
+            prefetch.Finish();
+        }
+
         if (ret) {
             // Store to disk
             ret = AcceptBlock(config, pblock, state, &pindex, fForceProcessing,
@@ -4517,6 +5150,7 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
     boost::this_thread::interruption_point();
 
     // Calculate nChainWork
+    int64_t nStart = GetTimeMillis();
     std::vector<std::pair<int, CBlockIndex *>> vSortedByHeight;
     vSortedByHeight.reserve(mapBlockIndex.size());
     for (const std::pair<uint256, CBlockIndex *> &item : mapBlockIndex) {
@@ -4575,6 +5209,8 @@ static bool LoadBlockIndexDB(const CChainParams &chainparams) {
             pindexBestHeader = pindex;
         }
     }
+    LogPrintf("%s: computed chain work of %u entries in %dms\n", __func__,
+              vSortedByHeight.size(), GetTimeMillis() - nStart);
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -4900,6 +5536,7 @@ void UnloadBlockIndex() {
         warningcache[b].clear();
     }
 
+    ClearLwmaStateCache();
     for (BlockMap::value_type &entry : mapBlockIndex) {
         delete entry.second;
     }
@@ -5469,7 +6106,165 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params &params,
                                        versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+//! Mempool snapshot with the transactions only, re-accepted one by one.
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_ENTRIES = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+//! Maximum number of threads reading the records of the mempool snapshot
+static const int MAX_MEMPOOL_LOAD_THREADS = 16;
+
+/**
+ * A mempool entry as written to mempool.dat, with what was computed when its
+ * transaction was accepted, so that it can be restored without looking up the
+ * coins it spends again or running its scripts.
+ *
+ * Each record is preceded by its size, so the file can be split into records
+ * without deserializing them, and the records read in parallel.
+ */
+struct MempoolSnapshotEntry {
+    CTransactionRef tx;
+    int64_t nTime;
+    Amount nFeeDelta;
+    Amount nFee;
+    double entryPriority;
+    uint32_t entryHeight;
+    Amount inChainInputValue;
+    bool spendsCoinbase;
+    int64_t sigOpCount;
+
+    MempoolSnapshotEntry()
+        : nTime(0), entryPriority(0), entryHeight(0), spendsCoinbase(false),
+          sigOpCount(0) {}
+    MempoolSnapshotEntry(const CTxMemPoolEntry &entry)
+        : tx(entry.GetSharedTx()), nTime(entry.GetTime()),
+          nFeeDelta(entry.GetModifiedFee() - entry.GetFee()),
+          nFee(entry.GetFee()), entryPriority(entry.GetEntryPriority()),
+          entryHeight(entry.GetHeight()),
+          inChainInputValue(entry.GetInChainInputValue()),
+          spendsCoinbase(entry.GetSpendsCoinbase()),
+          sigOpCount(entry.GetSigOpCount()) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(tx);
+        READWRITE(nTime);
+        READWRITE(nFeeDelta);
+        READWRITE(nFee);
+        READWRITE(entryPriority);
+        READWRITE(entryHeight);
+        READWRITE(inChainInputValue);
+        READWRITE(spendsCoinbase);
+        READWRITE(sigOpCount);
+    }
+};
+
+/**
+ * Add an entry of a mempool snapshot taken at the current tip. Its fee and
+ * sigop count were computed against the same coins, and its scripts checked,
+ * when it was first accepted: only what depends on the rest of the mempool
+ * and on the time is checked again.
+ */
+static bool AcceptSnapshotEntryToMemoryPool(const Config &config,
+                                            CTxMemPool &pool,
+                                            CValidationState &state,
+                                            const MempoolSnapshotEntry &snap) {
+    AssertLockHeld(cs_main);
+
+    const CTransaction &tx = *snap.tx;
+    const uint256 txid = tx.GetId();
+
+    CValidationState ctxState;
+    if (!ContextualCheckTransactionForCurrentBlock(
+            config, tx, ctxState, STANDARD_LOCKTIME_VERIFY_FLAGS)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD,
+                         ctxState.GetRejectReason());
+    }
+
+    if (pool.exists(txid)) {
+        return state.Invalid(false, REJECT_ALREADY_KNOWN,
+                             "txn-already-in-mempool");
+    }
+
+    LockPoints lp;
+    {
+        LOCK(pool.cs);
+        for (const CTxIn &txin : tx.vin) {
+            if (pool.mapNextTx.count(txin.prevout)) {
+                return state.Invalid(false, REJECT_CONFLICT,
+                                     "txn-mempool-conflict");
+            }
+        }
+
+        CCoinsViewMemPool viewMemPool(pcoinsTip, pool);
+        CCoinsViewCache view(&viewMemPool);
+        if (!view.HaveInputs(tx)) {
+            return state.Invalid(false, REJECT_DUPLICATE,
+                                 "bad-txns-inputs-spent");
+        }
+
+        if (!CheckSequenceLocks(tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp)) {
+            return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
+        }
+    }
+
+    CTxMemPoolEntry entry(snap.tx, snap.nFee, snap.nTime, snap.entryPriority,
+                          snap.entryHeight, snap.inChainInputValue,
+                          snap.spendsCoinbase, snap.sigOpCount, lp);
+
+    CTxMemPool::setEntries setAncestors;
+    size_t nLimitAncestors =
+        GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize =
+        GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT) * 1000;
+    size_t nLimitDescendants =
+        GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize =
+        GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT) * 1000;
+    std::string errString;
+    if (!pool.CalculateMemPoolAncestors(
+            entry, setAncestors, nLimitAncestors, nLimitAncestorSize,
+            nLimitDescendants, nLimitDescendantSize, errString)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain",
+                         false, errString);
+    }
+
+    pool.addUnchecked(txid, entry, setAncestors, false);
+
+    GetMainSignals().SyncTransaction(
+        snap.tx, nullptr, CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK);
+
+    return true;
+}
+
+/**
+ * Deserialize the records [nBegin, nEnd) of a mempool snapshot. A record which
+ * cannot be read, or whose transaction is invalid by itself, is left without
+ * transaction.
+ */
+static void
+ReadMempoolSnapshotRange(const std::vector<std::vector<char>> &vRecords,
+                         size_t nBegin, size_t nEnd,
+                         std::vector<MempoolSnapshotEntry> &vEntries) {
+    for (size_t i = nBegin; i < nEnd; i++) {
+        try {
+            CDataStream ssRecord(vRecords[i], SER_DISK, CLIENT_VERSION);
+            ssRecord >> vEntries[i];
+            if (!ssRecord.empty()) {
+                throw std::ios_base::failure("record size mismatch");
+            }
+        } catch (const std::exception &e) {
+            LogPrintf("Failed to deserialize mempool entry %u: %s\n", i,
+                      e.what());
+            vEntries[i].tx.reset();
+            continue;
+        }
+        CValidationState state;
+        if (!CheckRegularTransaction(*vEntries[i].tx, state)) {
+            vEntries[i].tx.reset();
+        }
+    }
+}
 
 bool LoadMempool(const Config &config) {
     int64_t nExpiryTimeout =
@@ -5486,36 +6281,97 @@ bool LoadMempool(const Config &config) {
     int64_t skipped = 0;
     int64_t failed = 0;
     int64_t nNow = GetTime();
+    int64_t nStart = GetTimeMicros();
+    uint256 hashTip;
+    bool fTipMatches = false;
 
     try {
         uint64_t version;
         file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
+        if (version != MEMPOOL_DUMP_VERSION &&
+            version != MEMPOOL_DUMP_VERSION_NO_ENTRIES) {
             return false;
         }
 
-        uint64_t num;
-        file >> num;
+        std::vector<MempoolSnapshotEntry> vEntries;
+        if (version == MEMPOOL_DUMP_VERSION_NO_ENTRIES) {
+            uint64_t num;
+            file >> num;
+            while (num--) {
+                MempoolSnapshotEntry snap;
+                file >> snap.tx;
+                file >> snap.nTime;
+                file >> snap.nFeeDelta;
+                vEntries.push_back(snap);
+            }
+        } else {
+            uint64_t num;
+            file >> hashTip;
+            file >> num;
+            {
+                LOCK(cs_main);
+                fTipMatches = chainActive.Tip() &&
+                              chainActive.Tip()->GetBlockHash() == hashTip;
+            }
+
+            // Split the records without deserializing them, then read them
+            // on several threads.
+            std::vector<std::vector<char>> vRecords;
+            vRecords.reserve(num);
+            while (num--) {
+                uint32_t nSize;
+                file >> nSize;
+                if (nSize > MAX_SIZE) {
+                    throw std::ios_base::failure("mempool record too large");
+                }
+                vRecords.emplace_back(nSize);
+                file.read(vRecords.back().data(), nSize);
+            }
+
+            vEntries.resize(vRecords.size());
+            const int nThreads =
+                std::max(1, std::min(GetNumCores(), MAX_MEMPOOL_LOAD_THREADS));
+            std::vector<std::thread> threads;
+            for (int i = 0; i < nThreads; i++) {
+                threads.emplace_back([&, i] {
+                    RenameThread("bitcoin-loadmemp");
+                    ReadMempoolSnapshotRange(
+                        vRecords, (vRecords.size() * i) / nThreads,
+                        (vRecords.size() * (i + 1)) / nThreads, vEntries);
+                });
+            }
+            for (std::thread &thread : threads) {
+                thread.join();
+            }
+        }
+
         double prioritydummy = 0;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            Amount amountdelta(nFeeDelta);
+        for (const MempoolSnapshotEntry &snap : vEntries) {
+            if (!snap.tx) {
+                ++failed;
+                continue;
+            }
+
+            Amount amountdelta = snap.nFeeDelta;
             if (amountdelta != Amount(0)) {
-                mempool.PrioritiseTransaction(tx->GetId(),
-                                              tx->GetId().ToString(),
+                mempool.PrioritiseTransaction(snap.tx->GetId(),
+                                              snap.tx->GetId().ToString(),
                                               prioritydummy, amountdelta);
             }
             CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
+            if (snap.nTime + nExpiryTimeout > nNow) {
                 LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(config, mempool, state, tx, true,
-                                           nullptr, nTime);
+                // The tip may have moved since it was compared, for instance
+                // if a block was connected meanwhile.
+                if (fTipMatches &&
+                    chainActive.Tip()->GetBlockHash() == hashTip) {
+                    AcceptSnapshotEntryToMemoryPool(config, mempool, state,
+                                                    snap);
+                } else {
+                    fTipMatches = false;
+                    AcceptToMemoryPoolWithTime(config, mempool, state, snap.tx,
+                                               true, nullptr, snap.nTime);
+                }
                 if (state.IsValid()) {
                     ++count;
                 } else {
@@ -5543,9 +6399,21 @@ bool LoadMempool(const Config &config) {
         return false;
     }
 
+    {
+        // Entries restored from the snapshot were not checked against the
+        // size limit one by one.
+        LOCK(cs_main);
+        LimitMempoolSize(
+            mempool, GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000,
+            nExpiryTimeout);
+    }
+
+    double dElapsed = (GetTimeMicros() - nStart) * 0.000001;
     LogPrintf("Imported mempool transactions from disk: %i successes, %i "
-              "failed, %i expired\n",
-              count, failed, skipped);
+              "failed, %i expired in %.2fs (%.0f tx/s, %s)\n",
+              count, failed, skipped, dElapsed,
+              dElapsed > 0 ? (count + failed + skipped) / dElapsed : 0.0,
+              fTipMatches ? "restored at the same tip" : "revalidated");
     return true;
 }
 
@@ -5553,15 +6421,20 @@ void DumpMempool(void) {
     int64_t start = GetTimeMicros();
 
     std::map<uint256, Amount> mapDeltas;
-    std::vector<TxMempoolInfo> vinfo;
+    std::vector<CTxMemPoolEntry> vEntries;
+    uint256 hashTip;
 
     {
-        LOCK(mempool.cs);
+        // The mempool is consistent with the tip while cs_main is held.
+        LOCK2(cs_main, mempool.cs);
+        if (chainActive.Tip()) {
+            hashTip = chainActive.Tip()->GetBlockHash();
+        }
         for (const auto &i : mempool.mapDeltas) {
             mapDeltas[i.first] = i.second.second;
         }
 
-        vinfo = mempool.infoAll();
+        vEntries = mempool.entryAll();
     }
 
     int64_t mid = GetTimeMicros();
@@ -5576,13 +6449,16 @@ void DumpMempool(void) {
 
         uint64_t version = MEMPOOL_DUMP_VERSION;
         file << version;
+        file << hashTip;
 
-        file << uint64_t(vinfo.size());
-        for (const auto &i : vinfo) {
-            file << *(i.tx);
-            file << int64_t(i.nTime);
-            file << i.nFeeDelta; // int64_t(i.nFeeDelta.GetSatoshis());
-            mapDeltas.erase(i.tx->GetId());
+        file << uint64_t(vEntries.size());
+        CDataStream ssRecord(SER_DISK, CLIENT_VERSION);
+        for (const CTxMemPoolEntry &entry : vEntries) {
+            ssRecord.clear();
+            ssRecord << MempoolSnapshotEntry(entry);
+            file << uint32_t(ssRecord.size());
+            file.write(ssRecord.data(), ssRecord.size());
+            mapDeltas.erase(entry.GetTx().GetId());
         }
 
         file << mapDeltas;
@@ -5591,8 +6467,9 @@ void DumpMempool(void) {
         RenameOver(GetDataDir() / "mempool.dat.new",
                    GetDataDir() / "mempool.dat");
         int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n",
-                  (mid - start) * 0.000001, (last - mid) * 0.000001);
+        LogPrintf("Dumped mempool: %u transactions, %gs to copy, %gs to dump\n",
+                  vEntries.size(), (mid - start) * 0.000001,
+                  (last - mid) * 0.000001);
     } catch (const std::exception &e) {
         LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
     }
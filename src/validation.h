@@ -14,6 +14,7 @@
 #include <amount.h>
 #include <chain.h>
 #include <coins.h>
+#include <consensus/validation.h>
 #include <protocol.h> // For CMessageHeader::MessageMagic
 #include <script/script_error.h>
 #include <sync.h>
@@ -33,6 +34,7 @@
 
 class CBlockIndex;
 class CBlockTreeDB;
+class CCoinsViewBackgroundWriter;
 class CBloomFilter;
 class CChainParams;
 class CConnman;
@@ -88,7 +90,7 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /**
@@ -169,6 +171,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 /** Default for -permitbaremultisig */
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
+/** Default for -checkblockreads */
+static const bool DEFAULT_CHECK_BLOCK_READS = false;
 static const bool DEFAULT_TXINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
@@ -207,6 +211,11 @@ extern bool fIsBareMultisigStd;
 extern bool fRequireStandard;
 extern bool fCheckBlockIndex;
 extern bool fCheckpointsEnabled;
+/**
+ * Re-verify the Equihash solution and proof of work of every block read back
+ * from disk, even when its index entry already has BLOCK_VALID_TREE.
+ */
+extern bool fCheckBlockReads;
 extern size_t nCoinCacheUsage;
 
 /** 
@@ -316,6 +325,20 @@ bool ProcessNewBlockHeaders(const Config &config,
                             CValidationState &state,
                             const CBlockIndex **ppindex = nullptr);
 
+/**
+ * Verify the Equihash solutions of a batch of headers in parallel on the
+ * equihash check threads. Call without cs_main held: it is only taken briefly
+ * to skip the headers already in the block index, which AcceptBlockHeader
+ * would not check again either.
+ *
+ * @return For each header, whether its solution was verified and found valid.
+ *         Headers which were skipped, or whose solution has the wrong size,
+ *         are reported as not valid.
+ */
+std::vector<char>
+BatchCheckEquihashSolutions(const Config &config,
+                            const std::vector<CBlockHeader> &headers);
+
 /**
  * Check whether enough disk space is available for an incoming block.
  */
@@ -355,6 +378,24 @@ void UnloadBlockIndex();
  */
 void ThreadScriptCheck();
 
+/**
+ * Run an instance of the Equihash solution checking thread, used to verify
+ * batches of block headers in parallel.
+ */
+void ThreadEquihashCheck();
+
+/**
+ * Run an instance of the coin prefetching thread, used to read the coins spent
+ * by a new block while it is checked.
+ */
+void ThreadCoinPrefetch();
+
+/**
+ * Run an instance of the mempool script checking thread, used to verify the
+ * scripts of a batch of transactions entering the mempool in parallel.
+ */
+void ThreadMempoolScriptCheck();
+
 /**
  * Check whether we are doing an initial block download (synchronizing from disk
  * or network)
@@ -460,6 +501,29 @@ bool AcceptToMemoryPool(const Config &config, CTxMemPool &pool,
                         bool fOverrideMempoolLimit = false,
                         const Amount nAbsurdFee = Amount(0));
 
+/** A transaction to add to the mempool with AcceptToMemoryPoolBatch. */
+struct MempoolAcceptRequest {
+    CTransactionRef tx;
+    bool fLimitFree;
+
+    //! Filled in as AcceptToMemoryPool would.
+    CValidationState state;
+    bool fMissingInputs;
+    bool fAccepted;
+
+    MempoolAcceptRequest(const CTransactionRef &txIn, bool fLimitFreeIn)
+        : tx(txIn), fLimitFree(fLimitFreeIn), fMissingInputs(false),
+          fAccepted(false) {}
+};
+
+/**
+ * (try to) add a batch of transactions to the memory pool. The scripts are
+ * checked without holding cs_main, in parallel, so the caller should not hold
+ * it. Transactions spending others in the batch should come after them.
+ */
+void AcceptToMemoryPoolBatch(const Config &config, CTxMemPool &pool,
+                             std::vector<MempoolAcceptRequest> &vRequests);
+
 /** Convert CValidationState to a human-readable message for logging */
 std::string FormatStateMessage(const CValidationState &state);
 
@@ -624,7 +688,12 @@ public:
 bool WriteBlockToDisk(const CBlock &block, CDiskBlockPos &pos,
                       const CMessageHeader::MessageMagic &messageStart);
 bool ReadBlockFromDisk(CBlock &block, const CDiskBlockPos &pos,
-                       const Config &config);
+                       const Config &config, bool fCheckPOW = true);
+/**
+ * Read the block referenced by pindex. Blocks whose header was already
+ * validated when it was written (BLOCK_VALID_TREE or better) only have their
+ * hash compared against the index, unless -checkblockreads is set.
+ */
 bool ReadBlockFromDisk(CBlock &block, const CBlockIndex *pindex,
                        const Config &config);
 
@@ -739,6 +808,12 @@ extern CChain chainActive;
  */
 extern CCoinsViewCache *pcoinsTip;
 
+/**
+ * Base of pcoinsTip writing it to the coin database in the background, if any
+ * (protected by cs_main)
+ */
+extern CCoinsViewBackgroundWriter *pcoinsWriter;
+
 /** Global variable that points to the active block tree (protected by cs_main)
  */
 extern CBlockTreeDB *pblocktree;
@@ -5,7 +5,16 @@
 
 #include "validationinterface.h"
 
+#include "chain.h"
+#include "scheduler.h"
+#include "sync.h"
+#include "utiltime.h"
+
+#include <future>
+#include <typeinfo>
+
 #include <boost/bind/bind.hpp> // For Boost Bind
+#include <boost/core/demangle.hpp>
 #include <boost/signals2.hpp>   // For Boost Signals2
 using namespace boost::placeholders; // This allows you to use _1, _2 directly
 
@@ -15,61 +24,250 @@ CMainSignals &GetMainSignals() {
     return g_signals;
 }
 
+namespace {
+
+struct SubscriberStats {
+    std::string name;
+    std::atomic<uint64_t> nCalls{0};
+    std::atomic<int64_t> nTotalMicros{0};
+    std::atomic<int64_t> nMaxMicros{0};
+
+    void Record(int64_t nMicros) {
+        nCalls++;
+        nTotalMicros += nMicros;
+        int64_t nMax = nMaxMicros;
+        while (nMicros > nMax &&
+               !nMaxMicros.compare_exchange_weak(nMax, nMicros)) {
+        }
+    }
+};
+
+/** Slot calling f, and recording the time it took in stats. */
+template <typename F> struct TimedSlot {
+    std::shared_ptr<SubscriberStats> stats;
+    F f;
+
+    template <typename... Args> void operator()(Args &&... args) const {
+        int64_t nStart = GetTimeMicros();
+        f(std::forward<Args>(args)...);
+        stats->Record(GetTimeMicros() - nStart);
+    }
+};
+
+struct Subscriber {
+    CValidationInterface *pinterface;
+    std::shared_ptr<SubscriberStats> stats;
+    std::vector<boost::signals2::connection> connections;
+};
+
+CCriticalSection cs_subscribers;
+std::vector<Subscriber> vSubscribers;
+
+template <typename Signal, typename F>
+void Connect(Subscriber &subscriber, Signal &signal, F f) {
+    subscriber.connections.push_back(
+        signal.connect(TimedSlot<F>{subscriber.stats, f}));
+}
+
+} // namespace
+
+CMainSignals::CMainSignals() {}
+
+CMainSignals::~CMainSignals() {}
+
+void CMainSignals::RegisterBackgroundSignalScheduler(CScheduler &scheduler) {
+    assert(!m_schedulerClient);
+    m_scheduler = &scheduler;
+    m_schedulerClient.reset(new SingleThreadedSchedulerClient(&scheduler));
+}
+
+void CMainSignals::UnregisterBackgroundSignalScheduler() {
+    m_schedulerClient.reset();
+    m_scheduler = nullptr;
+}
+
+void CMainSignals::FlushBackgroundCallbacks() {
+    if (m_schedulerClient && !m_scheduler->AreThreadsServicingQueue()) {
+        m_schedulerClient->EmptyQueue();
+    }
+}
+
+size_t CMainSignals::CallbacksPending() {
+    return m_schedulerClient ? m_schedulerClient->CallbacksPending() : 0;
+}
+
+void CMainSignals::GetQueueStats(uint64_t &nDelivered,
+                                 int64_t &nTotalWaitMicros,
+                                 int64_t &nMaxWaitMicros) const {
+    nDelivered = nQueueDelivered;
+    nTotalWaitMicros = nQueueWaitMicros;
+    nMaxWaitMicros = nQueueMaxWaitMicros;
+}
+
+void CMainSignals::Enqueue(std::function<void()> func) {
+    if (!m_schedulerClient) {
+        func();
+        return;
+    }
+    int64_t nQueued = GetTimeMicros();
+    m_schedulerClient->AddToProcessQueue([this, nQueued, func] {
+        int64_t nWait = GetTimeMicros() - nQueued;
+        nQueueDelivered++;
+        nQueueWaitMicros += nWait;
+        int64_t nMax = nQueueMaxWaitMicros;
+        while (nWait > nMax &&
+               !nQueueMaxWaitMicros.compare_exchange_weak(nMax, nWait)) {
+        }
+        func();
+    });
+}
+
+void CMainSignals::UpdatedBlockTip(const CBlockIndex *pindexNew,
+                                   const CBlockIndex *pindexFork,
+                                   bool fInitialDownload) {
+    Enqueue([this, pindexNew, pindexFork, fInitialDownload] {
+        m_UpdatedBlockTip(pindexNew, pindexFork, fInitialDownload);
+    });
+}
+
+void CMainSignals::SyncTransaction(const CTransactionRef &ptx,
+                                   const CBlockIndex *pindex, int posInBlock) {
+    Enqueue([this, ptx, pindex, posInBlock] {
+        m_SyncTransaction(*ptx, pindex, posInBlock);
+    });
+}
+
+void CMainSignals::UpdatedTransaction(const uint256 &hash) {
+    Enqueue([this, hash] { m_UpdatedTransaction(hash); });
+}
+
+void CMainSignals::SetBestChain(const CBlockLocator &locator) {
+    Enqueue([this, locator] { m_SetBestChain(locator); });
+}
+
+void CMainSignals::Inventory(const uint256 &hash) {
+    Enqueue([this, hash] { m_Inventory(hash); });
+}
+
+void CMainSignals::Broadcast(int64_t nBestBlockTime, CConnman *connman) {
+    m_Broadcast(nBestBlockTime, connman);
+}
+
+void CMainSignals::BlockChecked(const CBlock &block,
+                                const CValidationState &state) {
+    m_BlockChecked(block, state);
+}
+
+void CMainSignals::ScriptForMining(
+    std::shared_ptr<CReserveScript> &coinbaseScript) {
+    m_ScriptForMining(coinbaseScript);
+}
+
+void CMainSignals::BlockFound(const uint256 &hash) {
+    m_BlockFound(hash);
+}
+
+void CMainSignals::NewPoWValidBlock(const CBlockIndex *pindex,
+                                    const std::shared_ptr<const CBlock> &block) {
+    m_NewPoWValidBlock(pindex, block);
+}
+
 void RegisterValidationInterface(CValidationInterface *pwalletIn) {
-    g_signals.UpdatedBlockTip.connect(boost::bind(
-        &CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.SyncTransaction.connect(boost::bind(
-        &CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
-    g_signals.UpdatedTransaction.connect(
-        boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SetBestChain.connect(
-        boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.Inventory.connect(
-        boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.Broadcast.connect(boost::bind(
-        &CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.BlockChecked.connect(
-        boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.ScriptForMining.connect(
-        boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
-    g_signals.BlockFound.connect(
-        boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.NewPoWValidBlock.connect(boost::bind(
-        &CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    Subscriber subscriber;
+    subscriber.pinterface = pwalletIn;
+    subscriber.stats = std::make_shared<SubscriberStats>();
+    subscriber.stats->name = boost::core::demangle(typeid(*pwalletIn).name());
+
+    Connect(subscriber, g_signals.m_UpdatedBlockTip,
+            boost::bind(&CValidationInterface::UpdatedBlockTip, pwalletIn, _1,
+                        _2, _3));
+    Connect(subscriber, g_signals.m_SyncTransaction,
+            boost::bind(&CValidationInterface::SyncTransaction, pwalletIn, _1,
+                        _2, _3));
+    Connect(subscriber, g_signals.m_UpdatedTransaction,
+            boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn,
+                        _1));
+    Connect(subscriber, g_signals.m_SetBestChain,
+            boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
+    Connect(subscriber, g_signals.m_Inventory,
+            boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
+    Connect(subscriber, g_signals.m_Broadcast,
+            boost::bind(&CValidationInterface::ResendWalletTransactions,
+                        pwalletIn, _1, _2));
+    Connect(subscriber, g_signals.m_BlockChecked,
+            boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1,
+                        _2));
+    Connect(subscriber, g_signals.m_ScriptForMining,
+            boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn,
+                        _1));
+    Connect(subscriber, g_signals.m_BlockFound,
+            boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn,
+                        _1));
+    Connect(subscriber, g_signals.m_NewPoWValidBlock,
+            boost::bind(&CValidationInterface::NewPoWValidBlock, pwalletIn, _1,
+                        _2));
+
+    LOCK(cs_subscribers);
+    vSubscribers.push_back(std::move(subscriber));
 }
 
 void UnregisterValidationInterface(CValidationInterface *pwalletIn) {
-    g_signals.BlockFound.disconnect(
-        boost::bind(&CValidationInterface::ResetRequestCount, pwalletIn, _1));
-    g_signals.ScriptForMining.disconnect(
-        boost::bind(&CValidationInterface::GetScriptForMining, pwalletIn, _1));
-    g_signals.BlockChecked.disconnect(
-        boost::bind(&CValidationInterface::BlockChecked, pwalletIn, _1, _2));
-    g_signals.Broadcast.disconnect(boost::bind(
-        &CValidationInterface::ResendWalletTransactions, pwalletIn, _1, _2));
-    g_signals.Inventory.disconnect(
-        boost::bind(&CValidationInterface::Inventory, pwalletIn, _1));
-    g_signals.SetBestChain.disconnect(
-        boost::bind(&CValidationInterface::SetBestChain, pwalletIn, _1));
-    g_signals.UpdatedTransaction.disconnect(
-        boost::bind(&CValidationInterface::UpdatedTransaction, pwalletIn, _1));
-    g_signals.SyncTransaction.disconnect(boost::bind(
-        &CValidationInterface::SyncTransaction, pwalletIn, _1, _2, _3));
-    g_signals.UpdatedBlockTip.disconnect(boost::bind(
-        &CValidationInterface::UpdatedBlockTip, pwalletIn, _1, _2, _3));
-    g_signals.NewPoWValidBlock.disconnect(boost::bind(
-        &CValidationInterface::NewPoWValidBlock, pwalletIn, _1, _2));
+    LOCK(cs_subscribers);
+    for (auto it = vSubscribers.begin(); it != vSubscribers.end();) {
+        if (it->pinterface != pwalletIn) {
+            ++it;
+            continue;
+        }
+        for (boost::signals2::connection &connection : it->connections) {
+            connection.disconnect();
+        }
+        it = vSubscribers.erase(it);
+    }
 }
 
 void UnregisterAllValidationInterfaces() {
-    g_signals.BlockFound.disconnect_all_slots();
-    g_signals.ScriptForMining.disconnect_all_slots();
-    g_signals.BlockChecked.disconnect_all_slots();
-    g_signals.Broadcast.disconnect_all_slots();
-    g_signals.Inventory.disconnect_all_slots();
-    g_signals.SetBestChain.disconnect_all_slots();
-    g_signals.UpdatedTransaction.disconnect_all_slots();
-    g_signals.SyncTransaction.disconnect_all_slots();
-    g_signals.UpdatedBlockTip.disconnect_all_slots();
-    g_signals.NewPoWValidBlock.disconnect_all_slots();
+    g_signals.m_BlockFound.disconnect_all_slots();
+    g_signals.m_ScriptForMining.disconnect_all_slots();
+    g_signals.m_BlockChecked.disconnect_all_slots();
+    g_signals.m_Broadcast.disconnect_all_slots();
+    g_signals.m_Inventory.disconnect_all_slots();
+    g_signals.m_SetBestChain.disconnect_all_slots();
+    g_signals.m_UpdatedTransaction.disconnect_all_slots();
+    g_signals.m_SyncTransaction.disconnect_all_slots();
+    g_signals.m_UpdatedBlockTip.disconnect_all_slots();
+    g_signals.m_NewPoWValidBlock.disconnect_all_slots();
+
+    LOCK(cs_subscribers);
+    vSubscribers.clear();
+}
+
+void CallFunctionInValidationInterfaceQueue(std::function<void()> func) {
+    if (!g_signals.m_schedulerClient) {
+        func();
+        return;
+    }
+    g_signals.m_schedulerClient->AddToProcessQueue(std::move(func));
+}
+
+void SyncWithValidationInterfaceQueue() {
+    std::promise<void> promise;
+    CallFunctionInValidationInterfaceQueue([&promise] { promise.set_value(); });
+    promise.get_future().wait();
+}
+
+void LimitValidationInterfaceQueue() {
+    if (g_signals.CallbacksPending() >= MAX_VALIDATION_INTERFACE_QUEUE) {
+        SyncWithValidationInterfaceQueue();
+    }
+}
+
+std::vector<ValidationInterfaceStats> GetValidationInterfaceStats() {
+    std::vector<ValidationInterfaceStats> vStats;
+    LOCK(cs_subscribers);
+    for (const Subscriber &subscriber : vSubscribers) {
+        const SubscriberStats &stats = *subscriber.stats;
+        vStats.push_back({stats.name, stats.nCalls, stats.nTotalMicros,
+                          stats.nMaxMicros});
+    }
+    return vStats;
 }
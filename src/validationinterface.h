@@ -6,7 +6,13 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include "primitives/transaction.h" // CTransactionRef
+
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include <boost/signals2/signal.hpp>
 
@@ -16,11 +22,18 @@ struct CBlockLocator;
 class CBlockIndex;
 class CConnman;
 class CReserveScript;
-class CTransaction;
+class CScheduler;
 class CValidationInterface;
 class CValidationState;
+class SingleThreadedSchedulerClient;
 class uint256;
 
+/**
+ * Maximum number of notifications waiting to be delivered before
+ * ProcessNewBlock waits for the subscribers to catch up.
+ */
+static const size_t MAX_VALIDATION_INTERFACE_QUEUE = 20000;
+
 // These functions dispatch to one or all registered wallets
 
 /** Register a wallet to receive updates from core */
@@ -29,6 +42,32 @@ void RegisterValidationInterface(CValidationInterface *pwalletIn);
 void UnregisterValidationInterface(CValidationInterface *pwalletIn);
 /** Unregister all wallets from core */
 void UnregisterAllValidationInterfaces();
+/**
+ * Run func after the notifications queued so far were delivered, or right away
+ * if notifications are not delivered in the background.
+ */
+void CallFunctionInValidationInterfaceQueue(std::function<void()> func);
+/**
+ * Wait until the notifications queued so far were delivered. This must not be
+ * called with cs_main held, as subscribers may need it.
+ */
+void SyncWithValidationInterfaceQueue();
+/**
+ * Wait until fewer than MAX_VALIDATION_INTERFACE_QUEUE notifications are
+ * queued, so that a slow subscriber cannot make the queue grow without bound.
+ * This must not be called with cs_main held.
+ */
+void LimitValidationInterfaceQueue();
+
+/** Time spent by a subscriber handling notifications. */
+struct ValidationInterfaceStats {
+    std::string name;
+    uint64_t nCalls;
+    int64_t nTotalMicros;
+    int64_t nMaxMicros;
+};
+/** Statistics of every registered subscriber, in registration order. */
+std::vector<ValidationInterfaceStats> GetValidationInterfaceStats();
 
 class CValidationInterface {
 protected:
@@ -52,56 +91,127 @@ protected:
     friend void ::UnregisterAllValidationInterfaces();
 };
 
-struct CMainSignals {
-    /** Notifies listeners of updated block chain tip */
+/**
+ * Dispatches validation events to the registered CValidationInterfaces.
+ *
+ * Once a scheduler is registered, the notifications below marked as queued are
+ * delivered in order on the scheduler thread instead of on the caller's, which
+ * usually holds cs_main. The others are still delivered before the call
+ * returns, as their callers need the subscribers' answer or side effects.
+ */
+class CMainSignals {
+private:
     boost::signals2::signal<void(const CBlockIndex *, const CBlockIndex *,
                                  bool fInitialDownload)>
-        UpdatedBlockTip;
+        m_UpdatedBlockTip;
+    boost::signals2::signal<void(const CTransaction &,
+                                 const CBlockIndex *pindex, int posInBlock)>
+        m_SyncTransaction;
+    boost::signals2::signal<void(const uint256 &)> m_UpdatedTransaction;
+    boost::signals2::signal<void(const CBlockLocator &)> m_SetBestChain;
+    boost::signals2::signal<void(const uint256 &)> m_Inventory;
+    boost::signals2::signal<void(int64_t nBestBlockTime, CConnman *connman)>
+        m_Broadcast;
+    boost::signals2::signal<void(const CBlock &, const CValidationState &)>
+        m_BlockChecked;
+    boost::signals2::signal<void(std::shared_ptr<CReserveScript> &)>
+        m_ScriptForMining;
+    boost::signals2::signal<void(const uint256 &)> m_BlockFound;
+    boost::signals2::signal<void(const CBlockIndex *,
+                                 const std::shared_ptr<const CBlock> &)>
+        m_NewPoWValidBlock;
+
+    /** Delivers the queued notifications, if a scheduler is registered. */
+    CScheduler *m_scheduler = nullptr;
+    std::unique_ptr<SingleThreadedSchedulerClient> m_schedulerClient;
+
+    /** Time notifications spent in the queue. */
+    std::atomic<uint64_t> nQueueDelivered{0};
+    std::atomic<int64_t> nQueueWaitMicros{0};
+    std::atomic<int64_t> nQueueMaxWaitMicros{0};
+
+    void Enqueue(std::function<void()> func);
+
+    friend void ::RegisterValidationInterface(CValidationInterface *);
+    friend void ::UnregisterValidationInterface(CValidationInterface *);
+    friend void ::UnregisterAllValidationInterfaces();
+    friend void ::CallFunctionInValidationInterfaceQueue(
+        std::function<void()> func);
+
+public:
+    CMainSignals();
+    ~CMainSignals();
+
+    /** Deliver the queued notifications on scheduler's thread from now on. */
+    void RegisterBackgroundSignalScheduler(CScheduler &scheduler);
+    /** Deliver all notifications synchronously again. */
+    void UnregisterBackgroundSignalScheduler();
+    /**
+     * Deliver the remaining queued notifications on the calling thread, once
+     * the scheduler is no longer serviced. If its thread was only interrupted,
+     * as when initialization failed, they are dropped.
+     */
+    void FlushBackgroundCallbacks();
+
+    /** Number of notifications waiting to be delivered. */
+    size_t CallbacksPending();
+    /**
+     * Number of notifications delivered from the queue, and the total and
+     * longest time they waited there.
+     */
+    void GetQueueStats(uint64_t &nDelivered, int64_t &nTotalWaitMicros,
+                       int64_t &nMaxWaitMicros) const;
+
     /**
      * A posInBlock value for SyncTransaction calls for tranactions not included
      * in connected blocks such as transactions removed from mempool, accepted
      * to mempool or appearing in disconnected blocks.
      */
     static const int SYNC_TRANSACTION_NOT_IN_BLOCK = -1;
+
+    /** Notifies listeners of updated block chain tip. Queued. */
+    void UpdatedBlockTip(const CBlockIndex *pindexNew,
+                         const CBlockIndex *pindexFork, bool fInitialDownload);
     /**
      * Notifies listeners of updated transaction data (transaction, and
      * optionally the block it is found in). Called with block data when
      * transaction is included in a connected block, and without block data when
      * transaction was accepted to mempool, removed from mempool (only when
      * removal was due to conflict from connected block), or appeared in a
-     * disconnected block.
+     * disconnected block. Queued.
      */
-    boost::signals2::signal<void(const CTransaction &,
-                                 const CBlockIndex *pindex, int posInBlock)>
-        SyncTransaction;
+    void SyncTransaction(const CTransactionRef &ptx, const CBlockIndex *pindex,
+                         int posInBlock);
     /**
      * Notifies listeners of an updated transaction without new data (for now: a
-     * coinbase potentially becoming visible).
+     * coinbase potentially becoming visible). Queued.
      */
-    boost::signals2::signal<void(const uint256 &)> UpdatedTransaction;
-    /** Notifies listeners of a new active block chain. */
-    boost::signals2::signal<void(const CBlockLocator &)> SetBestChain;
-    /** Notifies listeners about an inventory item being seen on the network. */
-    boost::signals2::signal<void(const uint256 &)> Inventory;
+    void UpdatedTransaction(const uint256 &hash);
+    /** Notifies listeners of a new active block chain. Queued. */
+    void SetBestChain(const CBlockLocator &locator);
+    /**
+     * Notifies listeners about an inventory item being seen on the network.
+     * Queued.
+     */
+    void Inventory(const uint256 &hash);
     /** Tells listeners to broadcast their data. */
-    boost::signals2::signal<void(int64_t nBestBlockTime, CConnman *connman)>
-        Broadcast;
-    /** Notifies listeners of a block validation result */
-    boost::signals2::signal<void(const CBlock &, const CValidationState &)>
-        BlockChecked;
+    void Broadcast(int64_t nBestBlockTime, CConnman *connman);
+    /**
+     * Notifies listeners of a block validation result. The state is only valid
+     * during the call, and callers rely on the listeners having seen it.
+     */
+    void BlockChecked(const CBlock &block, const CValidationState &state);
     /** Notifies listeners that a key for mining is required (coinbase) */
-    boost::signals2::signal<void(std::shared_ptr<CReserveScript> &)>
-        ScriptForMining;
+    void ScriptForMining(std::shared_ptr<CReserveScript> &coinbaseScript);
     /** Notifies listeners that a block has been successfully mined */
-    boost::signals2::signal<void(const uint256 &)> BlockFound;
+    void BlockFound(const uint256 &hash);
     /**
      * Notifies listeners that a block which builds directly on our current tip
      * has been received and connected to the headers tree, though not validated
-     * yet.
+     * yet. Delivered right away, to relay the block as early as possible.
      */
-    boost::signals2::signal<void(const CBlockIndex *,
-                                 const std::shared_ptr<const CBlock> &)>
-        NewPoWValidBlock;
+    void NewPoWValidBlock(const CBlockIndex *pindex,
+                          const std::shared_ptr<const CBlock> &block);
 };
 
 CMainSignals &GetMainSignals();
@@ -18,6 +18,7 @@
 #include "util.h"
 #include "utilmoneystr.h"
 #include "validation.h"
+#include "validationinterface.h"
 #include "wallet.h"
 #include "walletdb.h"
 
@@ -37,6 +38,9 @@ std::string HelpRequiringPassphrase() {
 
 bool EnsureWalletIsAvailable(bool avoidException) {
     if (pwalletMain) {
+        // Let the wallet see the transactions and blocks validated so far, as
+        // they are notified to it in the background.
+        SyncWithValidationInterfaceQueue();
         return true;
     }
 
@@ -17,3 +17,8 @@ bool CZMQAbstractNotifier::NotifyTransaction(
     const CTransaction & /*transaction*/) {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyMempoolTransaction(
+    const CTransaction & /*transaction*/) {
+    return true;
+}
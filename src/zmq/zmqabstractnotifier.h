@@ -31,6 +31,8 @@ public:
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    //! Called for transactions outside of a block, i.e. entering the mempool.
+    virtual bool NotifyMempoolTransaction(const CTransaction &transaction);
 
 protected:
     void *psocket;
@@ -36,6 +36,8 @@ CZMQNotificationInterface *CZMQNotificationInterface::Create() {
         CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] =
         CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
+    factories["pubrawblocktemplate"] =
+        CZMQAbstractNotifier::Create<CZMQPublishRawBlockTemplateNotifier>;
     factories["pubrawtx"] =
         CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
 
@@ -139,7 +141,9 @@ void CZMQNotificationInterface::SyncTransaction(const CTransaction &tx,
     for (std::list<CZMQAbstractNotifier *>::iterator i = notifiers.begin();
          i != notifiers.end();) {
         CZMQAbstractNotifier *notifier = *i;
-        if (notifier->NotifyTransaction(tx)) {
+        if (notifier->NotifyTransaction(tx) &&
+            (posInBlock != CMainSignals::SYNC_TRANSACTION_NOT_IN_BLOCK ||
+             notifier->NotifyMempoolTransaction(tx))) {
             i++;
         } else {
             notifier->Shutdown();
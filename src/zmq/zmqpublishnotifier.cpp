@@ -3,10 +3,14 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "zmqpublishnotifier.h"
+#include "chainparams.h"
 #include "config.h"
+#include "miner.h"
 #include "rpc/server.h"
+#include "script/script.h"
 #include "streams.h"
 #include "util.h"
+#include "utilmoneystr.h"
 #include "validation.h"
 
 #include <cstdarg>
@@ -18,6 +22,7 @@ static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX = "hashtx";
 static const char *MSG_RAWBLOCK = "rawblock";
 static const char *MSG_RAWTX = "rawtx";
+static const char *MSG_RAWBLOCKTEMPLATE = "rawblocktemplate";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void *data, size_t size, ...) {
@@ -181,3 +186,69 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+CZMQPublishRawBlockTemplateNotifier::CZMQPublishRawBlockTemplateNotifier()
+    : nLastFees(0), nFeeDelta(DEFAULT_ZMQ_BLOCK_TEMPLATE_FEE_DELTA),
+      nLastCheck(0) {}
+
+bool CZMQPublishRawBlockTemplateNotifier::Initialize(void *pcontext) {
+    if (IsArgSet("-zmqrawblocktemplatefeedelta")) {
+        Amount n(0);
+        if (!ParseMoney(GetArg("-zmqrawblocktemplatefeedelta", ""), n)) {
+            LogPrintf("zmq: Invalid amount for -zmqrawblocktemplatefeedelta: "
+                      "'%s'\n",
+                      GetArg("-zmqrawblocktemplatefeedelta", ""));
+            return false;
+        }
+        nFeeDelta = n;
+    }
+    return CZMQAbstractPublishNotifier::Initialize(pcontext);
+}
+
+bool CZMQPublishRawBlockTemplateNotifier::SendTemplate(bool fForce) {
+    const Config &config = GetConfig();
+    const CChainParams &params = config.GetChainParams();
+
+    // The engine only adds the transactions which entered the mempool since
+    // its last template, so that this is cheap after the first one.
+    CScript scriptDummy = CScript() << OP_TRUE;
+    std::unique_ptr<CBlockTemplate> pblocktemplate =
+        GetBlockTemplateEngine(config).CreateNewBlock(scriptDummy);
+    if (!pblocktemplate) {
+        zmqError("Can't create block template");
+        return false;
+    }
+
+    const Amount nFees = -1 * pblocktemplate->vTxFees[0];
+    if (!fForce && nFees < nLastFees + nFeeDelta) {
+        return true;
+    }
+    nLastFees = nFees;
+
+    const CBlock &block = pblocktemplate->block;
+    LogPrint("zmq", "zmq: Publish rawblocktemplate at height %d, fees %s\n",
+             block.nHeight, FormatMoney(nFees));
+
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
+    ss << uint32_t(params.EquihashN(block.nHeight))
+       << uint32_t(params.EquihashK(block.nHeight)) << block;
+    return SendMessage(MSG_RAWBLOCKTEMPLATE, &(*ss.begin()), ss.size());
+}
+
+bool CZMQPublishRawBlockTemplateNotifier::NotifyBlock(
+    const CBlockIndex *pindex) {
+    nLastCheck = GetTimeMicros();
+    return SendTemplate(true);
+}
+
+bool CZMQPublishRawBlockTemplateNotifier::NotifyMempoolTransaction(
+    const CTransaction &transaction) {
+    // Transactions can arrive faster than templates are worth making: the
+    // fees are looked at again with a later transaction.
+    const int64_t nNow = GetTimeMicros();
+    if (nNow - nLastCheck < ZMQ_BLOCK_TEMPLATE_CHECK_INTERVAL) {
+        return true;
+    }
+    nLastCheck = nNow;
+    return SendTemplate(false);
+}
@@ -7,8 +7,15 @@
 
 #include "zmqabstractnotifier.h"
 
+#include "amount.h"
+
 class CBlockIndex;
 
+//! Default for -zmqrawblocktemplatefeedelta
+static const Amount DEFAULT_ZMQ_BLOCK_TEMPLATE_FEE_DELTA(100000);
+//! Minimum time between two checks of the template fees, in microseconds.
+static const int64_t ZMQ_BLOCK_TEMPLATE_CHECK_INTERVAL = 1000000;
+
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier {
 private:
     //!< upcounting per message sequence number
@@ -42,6 +49,32 @@ public:
     bool NotifyBlock(const CBlockIndex *pindex) override;
 };
 
+/**
+ * Publishes a block template whenever the tip changes, and when the fees of
+ * the template rose by -zmqrawblocktemplatefeedelta since the last one sent.
+ * The body is the Equihash N and K for the height of the template (LE 4byte
+ * each), followed by the block. As with getblocktemplate, the coinbase pays
+ * to OP_TRUE and is meant to be replaced by the miner.
+ */
+class CZMQPublishRawBlockTemplateNotifier : public CZMQAbstractPublishNotifier {
+private:
+    //! Fees of the last template sent.
+    Amount nLastFees;
+    //! The fee increase which makes a new template worth sending.
+    Amount nFeeDelta;
+    //! When the fees of the template were last checked.
+    int64_t nLastCheck;
+
+    bool SendTemplate(bool fForce);
+
+public:
+    CZMQPublishRawBlockTemplateNotifier();
+
+    bool Initialize(void *pcontext) override;
+    bool NotifyBlock(const CBlockIndex *pindex) override;
+    bool NotifyMempoolTransaction(const CTransaction &transaction) override;
+};
+
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier {
 public:
     bool NotifyTransaction(const CTransaction &transaction) override;
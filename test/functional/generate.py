@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin Candy developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the Equihash solver of the generate RPCs.
+
+Tests the -genproclimit and -generatetimeout options and the statistics
+returned with verbose set.
+"""
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 assert_greater_than,
+                                 assert_greater_than_or_equal,
+                                 start_node,
+                                 )
+
+# Height from which regtest blocks need an Equihash solution.
+CDY_HEIGHT = 2260
+# Mine to an address so that the test runs without a wallet as well.
+ADDRESS = 'mneYUmWYsuk7kySiURxCi3AGxrAqZxLgPZ'
+
+
+class GenerateTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.setup_clean_chain = True
+        self.num_nodes = 1
+        self.extra_args = [['-genproclimit=2']]
+
+    def restart_node(self, extra_args):
+        self.stop_node(0)
+        self.nodes[0] = start_node(0, self.options.tmpdir, extra_args)
+
+    def check_result(self, result, nblocks, nthreads):
+        assert_equal(len(result['blocks']), nblocks)
+        assert_equal(result['threads'], nthreads)
+        assert_greater_than_or_equal(result['nonces'], nblocks)
+        assert_greater_than_or_equal(result['solutions'], nblocks)
+        assert_greater_than(result['elapsed'], 0)
+        assert_greater_than(result['solutionspersecond'], 0)
+
+    def run_test(self):
+        node = self.nodes[0]
+        self.log.info("Mine the blocks solved with sha256d")
+        node.generatetoaddress(CDY_HEIGHT - 2, ADDRESS)
+        result = node.generatetoaddress(1, ADDRESS, 1000000, True)
+        assert_equal(len(result['blocks']), 1)
+        assert_equal(result['nonces'], 0)
+        assert_equal(node.getblockcount(), CDY_HEIGHT - 1)
+
+        self.log.info("Solve Equihash with -genproclimit=2")
+        result = node.generatetoaddress(3, ADDRESS, 1000000, True)
+        self.check_result(result, 3, 2)
+        assert_equal(node.getbestblockhash(), result['blocks'][-1])
+
+        self.log.info("Solve Equihash on one thread")
+        self.restart_node(['-genproclimit=1'])
+        result = self.nodes[0].generatetoaddress(2, ADDRESS, 1000000, True)
+        self.check_result(result, 2, 1)
+
+        self.log.info("Solve Equihash on all cores with -genproclimit=-1")
+        self.restart_node(['-genproclimit=-1'])
+        result = self.nodes[0].generatetoaddress(2, ADDRESS, 1000000, True)
+        assert_greater_than_or_equal(result['threads'], 1)
+        self.check_result(result, 2, result['threads'])
+
+        self.log.info("Test -generatetimeout")
+        # The timeout applies to each block, so that every one of them is
+        # found however long the whole call takes.
+        self.restart_node(['-genproclimit=1', '-generatetimeout=60'])
+        result = self.nodes[0].generatetoaddress(5, ADDRESS, 1000000, True)
+        self.check_result(result, 5, 1)
+
+        # Running out of tries ends the call without an error.
+        height = self.nodes[0].getblockcount()
+        result = self.nodes[0].generatetoaddress(1, ADDRESS, 0, True)
+        assert_equal(result['blocks'], [])
+        assert_equal(result['nonces'], 0)
+        assert_equal(self.nodes[0].getblockcount(), height)
+
+
+if __name__ == '__main__':
+    GenerateTest().main()
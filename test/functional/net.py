@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+# Copyright (c) 2018 The Bitcoin Candy developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test RPC calls related to net.
+
+Tests correspond to code in rpc/net.cpp.
+"""
+
+from decimal import Decimal
+import os
+import sys
+
+from test_framework.mininode import wait_until
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (assert_equal,
+                                 assert_greater_than,
+                                 assert_greater_than_or_equal,
+                                 connect_nodes_bi,
+                                 disconnect_nodes,
+                                 sync_blocks,
+                                 )
+
+# Mine to an address so that the test runs without a wallet as well.
+ADDRESS = 'mneYUmWYsuk7kySiURxCi3AGxrAqZxLgPZ'
+
+
+class NetTest(BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.setup_clean_chain = True
+        self.num_nodes = 2
+        # A receive buffer of 1000 bytes pauses receiving from node0 again
+        # and again while syncing.
+        self.extra_args = [[], ['-maxreceivebuffer=1']]
+
+    def run_test(self):
+        self._test_getnetmsgstats()
+        self._test_socket_events()
+
+    def _check_histogram(self, histogram):
+        assert_equal(sorted(histogram.keys()),
+                     ['count', 'histogram', 'max', 'median', 'p99', 'total'])
+        assert_greater_than(histogram['count'], 0)
+        assert_greater_than_or_equal(histogram['max'], 0)
+        assert_greater_than_or_equal(histogram['p99'], histogram['median'])
+        # Only the non-empty buckets are listed, the last one without upto.
+        assert_equal(sum(b['count'] for b in histogram['histogram']),
+                     histogram['count'])
+        for bucket in histogram['histogram'][:-1]:
+            assert 'upto' in bucket
+            assert_greater_than(bucket['count'], 0)
+
+    def _test_getnetmsgstats(self):
+        self.log.info("Test getnetmsgstats")
+        # Have both nodes exchange ping and pong messages.
+        self.nodes[0].ping()
+        wait_until(lambda: 'pong' in self.nodes[0].getnetmsgstats()[
+                   'messages'], timeout=30)
+        wait_until(lambda: 'ping' in self.nodes[1].getnetmsgstats()[
+                   'messages'], timeout=30)
+
+        stats = self.nodes[0].getnetmsgstats()
+        assert_equal(sorted(stats.keys()), ['messages', 'peers', 'sendbuffer'])
+        # The handshake happened before the pong.
+        for command in ['version', 'verack', 'pong']:
+            assert command in stats['messages']
+        for command, cmd_stats in stats['messages'].items():
+            assert_equal(sorted(cmd_stats.keys()), ['processing', 'queued'])
+            self._check_histogram(cmd_stats['processing'])
+            self._check_histogram(cmd_stats['queued'])
+        self._check_histogram(stats['sendbuffer'])
+
+        peers = self.nodes[0].getpeerinfo()
+        assert_equal(len(stats['peers']), len(peers))
+        assert_equal(sorted(p['id'] for p in stats['peers']),
+                     sorted(p['id'] for p in peers))
+        for peer in stats['peers']:
+            assert_equal(sorted(peer.keys()),
+                         ['addr', 'id', 'processing', 'processing_per_msg'])
+            assert 'version' in peer['processing_per_msg']
+            assert_greater_than_or_equal(peer['processing'], sum(
+                peer['processing_per_msg'].values()) - Decimal('0.000001'))
+
+    def _test_socket_events(self):
+        self.log.info("Test waiting on the sockets")
+        if sys.platform.startswith('linux'):
+            debug_log = os.path.join(self.options.tmpdir, 'node0', 'regtest',
+                                     'debug.log')
+            with open(debug_log, encoding='utf-8') as f:
+                assert 'Using epoll to wait on network sockets' in f.read()
+
+        # node1 stops watching its socket for data while its receive buffer
+        # is full, and has to watch it again once the messages are processed.
+        self.nodes[0].generatetoaddress(150, ADDRESS)
+        sync_blocks(self.nodes)
+
+        # Reconnecting reuses the descriptors of the closed sockets, which
+        # have to be registered again.
+        for _ in range(3):
+            disconnect_nodes(self.nodes[0], 1)
+            wait_until(lambda: not self.nodes[0].getpeerinfo() and
+                       not self.nodes[1].getpeerinfo(), timeout=30)
+            connect_nodes_bi(self.nodes, 0, 1)
+            self.nodes[1].generatetoaddress(10, ADDRESS)
+            sync_blocks(self.nodes)
+
+
+if __name__ == '__main__':
+    NetTest().main()
@@ -72,6 +72,8 @@ BASE_SCRIPTS = [
     'proxy_test.py',
     'signrawtransactions.py',
     'disconnect_ban.py',
+    'net.py',
+    'generate.py',
     'decodescript.py',
     'blockchain.py',
     'disablewallet.py',
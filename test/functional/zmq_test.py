@@ -28,8 +28,14 @@ class ZMQTest (BitcoinTestFramework):
         self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, b"hashtx")
         ip_address = "tcp://127.0.0.1:28332"
         self.zmqSubSocket.connect(ip_address)
+        self.zmqTemplateSocket = self.zmqContext.socket(zmq.SUB)
+        self.zmqTemplateSocket.set(zmq.RCVTIMEO, 60000)
+        self.zmqTemplateSocket.setsockopt(zmq.SUBSCRIBE, b"rawblocktemplate")
+        template_address = "tcp://127.0.0.1:28333"
+        self.zmqTemplateSocket.connect(template_address)
         extra_args = [
-            ['-zmqpubhashtx=%s' % ip_address, '-zmqpubhashblock=%s' % ip_address], []]
+            ['-zmqpubhashtx=%s' % ip_address, '-zmqpubhashblock=%s' % ip_address,
+             '-zmqpubrawblocktemplate=%s' % template_address], []]
         self.nodes = start_nodes(
             self.num_nodes, self.options.tmpdir, extra_args)
 
@@ -102,5 +108,21 @@ class ZMQTest (BitcoinTestFramework):
         # txid from sendtoaddress must be equal to the hash received over zmq
         assert_equal(hashRPC, hashZMQ)
 
+        # A template on top of the new tip is pushed after each block
+        tip = self.nodes[0].generate(1)[0]
+        gbt = self.nodes[0].getblocktemplate()
+        while True:
+            msg = self.zmqTemplateSocket.recv_multipart()
+            assert_equal(msg[0], b"rawblocktemplate")
+            body = msg[1]
+            n, k = struct.unpack('<II', body[:8])
+            prevhash = bytes_to_hex_str(body[8 + 4:8 + 36][::-1])
+            if prevhash == tip:
+                break
+        height = struct.unpack('<I', body[8 + 68:8 + 72])[0]
+        assert_equal(height, gbt['height'])
+        assert_equal(n, gbt['equihashn'])
+        assert_equal(k, gbt['equihashk'])
+
 if __name__ == '__main__':
     ZMQTest().main()